@@ -1,36 +1,393 @@
 #include "Application.h"
 
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
 #include <stdexcept>
 
 namespace cvl
 {
 	Application::Application()
-		: 
-		_cvl_window(std::make_unique<CvlWindow>(WIDTH, HEIGHT, "Vulkan")),
-		_cvl_device(std::make_unique<CvlDevice>(*_cvl_window))
+		: _dynamic_resolution(DynamicResolutionConfig{ TARGET_FRAME_MS })
 	{
-		LoadModels();
-		CreatePipelineLayout();
-		RecreateSwapchain();
-		CreateCommandBuffers();
+		_thread_pool = std::make_unique<CvlThreadPool>();
+		_startup_graph = std::make_unique<CvlStartupGraph>(*_thread_pool);
+		if (CAPTURE_FRAME_COUNT > 0)
+		{
+			_frame_capture = std::make_unique<CvlFrameCapture>(CAPTURE_PATH, CAPTURE_FRAME_COUNT);
+		}
+		AddStartupSteps();
+		_startup_graph->Run();
+		_cvl_device->ReportMemoryUsage();
 	}
 
 	Application::~Application()
 	{
-		vkDestroyPipelineLayout(_cvl_device->device(), _pipeline_layout, nullptr);
+		vkDestroyPipelineLayout(_cvl_device->device(), _pipeline_layout, _cvl_device->GetAllocator());
+		if (_scene_pipeline_layout != VK_NULL_HANDLE)
+		{
+			vkDestroyPipelineLayout(_cvl_device->device(), _scene_pipeline_layout, _cvl_device->GetAllocator());
+		}
 	}
 
 	void Application::Run()
 	{
-		while (!_cvl_window->ShouldClose())
+		for (uint32_t i = 0; i < RENDER_QUEUE_DEPTH + 2; ++i)
+		{
+			_frame_packets.push_back(std::make_unique<FramePacket>());
+		}
+		if (OFFLINE_FRAME_COUNT > 0)
+		{
+			_startup_graph->WriteReport(STARTUP_REPORT_PATH, STARTUP_TARGET_MS);
+			_startup_graph.reset();
+			RunOffline();
+			vkDeviceWaitIdle(_cvl_device->device());
+			return;
+		}
+
+		// The render queue has a slot left for the stop request
+		_render_queue = std::make_unique<CvlSpscQueue<FramePacket*>>(_frame_packets.size() + 1);
+		_free_packets = std::make_unique<CvlSpscQueue<FramePacket*>>(_frame_packets.size());
+		for (const auto& packet : _frame_packets)
+		{
+			_free_packets->Push(packet.get());
+		}
+		std::thread render_thread;
+		if (USE_RENDER_THREAD)
 		{
-			_cvl_window->PollEvents();
-			DrawFrame();
+			render_thread = std::thread(&Application::RenderLoop, this);
 		}
 
+		try
+		{
+			std::optional<std::chrono::high_resolution_clock::time_point> last_packet_time;
+			while (!_cvl_window->ShouldClose())
+			{
+				auto frame_start = std::chrono::high_resolution_clock::now();
+				_cvl_window->PollEvents();
+				VkExtent2D extent = _cvl_window->GetExtent();
+				if (extent.width == 0 || extent.height == 0)
+				{
+					// Minimized, nothing is simulated or rendered until the window is restored
+					_cvl_window->WaitEvents();
+					continue;
+				}
+
+				// Blocks once the render thread is RENDER_QUEUE_DEPTH packets behind
+				auto wait_start = std::chrono::high_resolution_clock::now();
+				FramePacket* packet = _free_packets->Pop();
+				if (_render_failed.load(std::memory_order_acquire))
+				{
+					std::rethrow_exception(_render_error);
+				}
+				auto simulate_start = std::chrono::high_resolution_clock::now();
+				float dt = 0.0f;
+				if (_last_frame_time.has_value())
+				{
+					// Clamped so a stall (e.g. dragging the window) doesn't make particles jump
+					dt = std::min(std::chrono::duration<float>(simulate_start - *_last_frame_time).count(), 0.05f);
+				}
+				_last_frame_time = simulate_start;
+
+				// The window's flag is only touched here, the render thread recreates the swap chain from the packet
+				packet->resize_time.reset();
+				if (_cvl_window->WasWindowResized())
+				{
+					_cvl_window->ResetWindowResizedFlag();
+					packet->resize_time = simulate_start;
+				}
+				SimulateFrame(*packet, dt, extent);
+				auto simulate_end = std::chrono::high_resolution_clock::now();
+				double main_ms = std::chrono::duration<double, std::milli>((wait_start - frame_start) + (simulate_end - simulate_start)).count();
+				double main_wait_ms = std::chrono::duration<double, std::milli>(simulate_start - wait_start).count();
+				double frame_ms = last_packet_time.has_value() ? std::chrono::duration<double, std::milli>(simulate_end - *last_packet_time).count() : 0.0;
+				last_packet_time = simulate_end;
+				MeasureRenderThread(*packet, main_ms, main_wait_ms, frame_ms);
+
+				if (USE_RENDER_THREAD)
+				{
+					_render_queue->Push(packet);
+				}
+				else
+				{
+					RenderPacket(*packet);
+					_free_packets->Push(packet);
+				}
+			}
+		}
+		catch (...)
+		{
+			StopRenderThread(render_thread);
+			throw;
+		}
+		StopRenderThread(render_thread);
+
 		vkDeviceWaitIdle(_cvl_device->device());
 	}
 
+	void Application::RunOffline()
+	{
+		if (!_use_dynamic_rendering)
+		{
+			throw std::runtime_error("[Application] Offline rendering needs dynamic rendering!");
+		}
+		// Offscreen targets are drawn at full resolution without the render graph, so there is no depth pyramid either
+		_dynamic_resolution_active = false;
+		_render_extent = _cvl_swap_chain->GetSwapChainExtent();
+		if (_cluster_mesh != nullptr)
+		{
+			_cluster_mesh->SetOcclusionPyramid(nullptr);
+		}
+
+		// Same formats as the swap chain, so the scene's pipelines render into the offscreen targets unchanged.
+		// Per-frame resources are sized for MAX_FRAMES_IN_FLIGHT, which bounds the offline frames in flight as well
+		OfflineRenderConfig config;
+		config.extent = _render_extent;
+		config.color_format = _cvl_swap_chain->GetSwapChainImageFormat();
+		config.depth_format = _cvl_swap_chain->GetDepthFormat();
+		config.frames_in_flight = CvlSwapchain::MAX_FRAMES_IN_FLIGHT;
+		config.readback_buffers = OFFLINE_READBACK_BUFFERS;
+		config.image_format = OFFLINE_IMAGE_FORMAT;
+		config.output_directory = OFFLINE_OUTPUT_DIRECTORY;
+		CvlOfflineRenderer offline_renderer(*_cvl_device, *_thread_pool, config);
+		offline_renderer.Render(OFFLINE_FRAME_COUNT, [this](const OfflineFrame& frame, QueueSubmission& submission)
+		{
+			RecordOfflineFrame(frame, submission);
+		});
+	}
+
+	void Application::RecordOfflineFrame(const OfflineFrame& frame, QueueSubmission& submission)
+	{
+		// RenderFrame's CPU work with a fixed time step, the offline renderer has waited on this slot's previous frame.
+		// Simulated and rendered on this thread, so one packet is enough
+		_frame = frame.slot;
+		FramePacket& packet = *_frame_packets.front();
+		SimulateFrame(packet, OFFLINE_FRAME_DT, frame.extent);
+		SetFramePacket(packet);
+		_cvl_device->GetDeletionQueue().BeginFrame();
+		_pipeline_cache->BeginFrame();
+		if (_debug_draw != nullptr)
+		{
+			_debug_draw->BeginFrame(_frame);
+		}
+		if (_particle_system != nullptr && _particle_system->IsAsyncCompute())
+		{
+			_particle_system->SubmitAsyncSimulation(_frame, _frame_dt);
+		}
+		if (_cluster_mesh != nullptr)
+		{
+			UpdateClusterLod();
+		}
+		if (_draw_list != nullptr)
+		{
+			BuildDrawList();
+		}
+		if (_debug_draw != nullptr)
+		{
+			DrawDebugOverlay();
+		}
+		if (_sprite_batch != nullptr)
+		{
+			UpdateSprites();
+		}
+
+		VkCommandBuffer command_buffer = frame.command_buffer;
+		if (_particle_system != nullptr && !_particle_system->IsAsyncCompute())
+		{
+			_particle_system->RecordPreSimulationBarrier(command_buffer);
+			_particle_system->Simulate(command_buffer, _frame, _frame_dt);
+			_particle_system->RecordPostSimulationBarrier(command_buffer);
+		}
+		if (_cluster_mesh != nullptr)
+		{
+			_cluster_mesh->RecordPreCullBarrier(command_buffer);
+			_cluster_mesh->Cull(command_buffer, _frame, _view_proj, _camera_eye);
+			_cluster_mesh->RecordPostCullBarrier(command_buffer);
+		}
+
+		VkRenderingAttachmentInfo color_attachment = {};
+		color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		color_attachment.imageView = frame.color_view;
+		color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		color_attachment.clearValue.color = { 0.1f, 0.1f, 0.1f, 1.0f };
+
+		VkRenderingAttachmentInfo depth_attachment = {};
+		depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		depth_attachment.imageView = frame.depth_view;
+		depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth_attachment.clearValue.depthStencil = { 1.0f, 0 };
+
+		VkRect2D render_area = { { 0, 0 }, frame.extent };
+		VkRenderingInfo rendering_info = {};
+		rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		rendering_info.renderArea = render_area;
+		rendering_info.layerCount = 1;
+		rendering_info.colorAttachmentCount = 1;
+		rendering_info.pColorAttachments = &color_attachment;
+		rendering_info.pDepthAttachment = &depth_attachment;
+
+		_cvl_device->CmdBeginRendering(command_buffer, rendering_info);
+		RenderScene(command_buffer, render_area);
+		RenderSceneLate(command_buffer, render_area);
+		_cvl_device->CmdEndRendering(command_buffer);
+
+		if (_particle_system != nullptr)
+		{
+			_particle_system->AddGraphicsDependencies(submission);
+		}
+	}
+
+	void Application::AddStartupSteps()
+	{
+		// GLFW and the device's command pool, i.e. every upload, stay on the main thread. Shader compilation,
+		// the cluster mesh's LOD chain and meshlets and pipeline creation run on the workers meanwhile
+		CvlStartupGraph& graph = *_startup_graph;
+		graph.AddStep("Window", {}, StartupThread::Main, [this]()
+		{
+			_cvl_window = std::make_unique<CvlWindow>(WIDTH, HEIGHT, "Vulkan");
+		});
+		graph.AddStep("Shaders", {}, StartupThread::Worker, [this]()
+		{
+			PrecompileShaders();
+		});
+		if (USE_CLUSTER_MESH)
+		{
+			graph.AddStep("ClusterGeometry", {}, StartupThread::Worker, [this]()
+			{
+				BuildClusterGeometry();
+			});
+		}
+		graph.AddStep("Device", { "Window" }, StartupThread::Main, [this]()
+		{
+			_cvl_device = std::make_unique<CvlDevice>(*_cvl_window);
+			// Offline rendering keeps as many frames in flight as the swap chain
+			_cvl_device->GetDeletionQueue().SetFramesInFlight(CvlSwapchain::MAX_FRAMES_IN_FLIGHT);
+			// Two timestamps per frame: start and end of the command buffer
+			_gpu_timer = std::make_unique<CvlGpuTimer>(*_cvl_device, CvlSwapchain::MAX_FRAMES_IN_FLIGHT, 2);
+			_use_dynamic_rendering = USE_DYNAMIC_RENDERING && _cvl_device->IsDynamicRenderingSupported();
+			_cvl_device->SetMemoryBudgetCallback([](uint32_t heap, const MemoryHeapBudget& budget)
+			{
+				std::cout << "[Application] Memory heap " << heap << " under pressure: " << budget.usage / (1024.0 * 1024.0) << " of "
+					<< budget.budget / (1024.0 * 1024.0) << " MB budget used\n";
+			}, MEMORY_PRESSURE);
+		});
+		graph.AddStep("PipelineCache", { "Device" }, StartupThread::Worker, [this]()
+		{
+			_pipeline_cache = std::make_unique<CvlPipelineCache>(*_cvl_device);
+			if (USE_SHADER_HOT_RELOAD)
+			{
+				_pipeline_cache->EnableHotReload("src\\shaders");
+			}
+		});
+		// Added before the uploads, so the main thread creates it first and the pipeline builds can start early
+		graph.AddStep("Swapchain", { "Device" }, StartupThread::Main, [this]()
+		{
+			_cvl_swap_chain = std::make_unique<CvlSwapchain>(*_cvl_device, _cvl_window->GetExtent(), _use_dynamic_rendering);
+		});
+		graph.AddStep("Models", { "Device" }, StartupThread::Main, [this]()
+		{
+			LoadModels();
+		});
+		graph.AddStep("PipelineLayouts", { "Models" }, StartupThread::Worker, [this]()
+		{
+			CreatePipelineLayout();
+		});
+		graph.AddStep("CommandBuffers", { "Device" }, StartupThread::Main, [this]()
+		{
+			CreateCommandBuffers();
+		});
+		// Subsystems create compute pipelines and upload their buffers, shaders are only compiled by the Shaders step
+		if (USE_CLUSTER_MESH)
+		{
+			graph.AddStep("ClusterMesh", { "PipelineCache", "Shaders", "ClusterGeometry" }, StartupThread::Main, [this]()
+			{
+				LoadClusterMesh();
+			});
+		}
+		if (USE_PARTICLES)
+		{
+			graph.AddStep("Particles", { "PipelineCache", "Shaders" }, StartupThread::Main, [this]()
+			{
+				_particle_system = std::make_unique<CvlParticleSystem>(*_cvl_device, *_pipeline_cache, PARTICLE_COUNT, CvlSwapchain::MAX_FRAMES_IN_FLIGHT, USE_ASYNC_COMPUTE);
+			});
+		}
+		if (USE_DEBUG_DRAW)
+		{
+			graph.AddStep("DebugDraw", { "PipelineCache", "Shaders" }, StartupThread::Main, [this]()
+			{
+				_debug_draw = std::make_unique<CvlDebugDraw>(*_cvl_device, *_pipeline_cache, DEBUG_DRAW_MAX_VERTICES, CvlSwapchain::MAX_FRAMES_IN_FLIGHT);
+			});
+		}
+		if (USE_SPRITES)
+		{
+			graph.AddStep("Sprites", { "PipelineCache", "Shaders" }, StartupThread::Main, [this]()
+			{
+				LoadSprites();
+			});
+		}
+
+		// Each subsystem's render pipelines are built on a worker as soon as it exists, overlapping the remaining uploads
+		std::vector<std::string> frame_dependencies = { "CommandBuffers" };
+		for (PipelineBuild& build : GetPipelineBuilds())
+		{
+			std::string step = build.step + "Pipelines";
+			graph.AddStep(step, { build.step, "Swapchain", "PipelineLayouts", "PipelineCache", "Shaders" }, StartupThread::Worker, std::move(build.build));
+			frame_dependencies.push_back(step);
+		}
+		graph.AddStep("RenderGraph", frame_dependencies, StartupThread::Main, [this]()
+		{
+			if (_cluster_mesh != nullptr)
+			{
+				UpdateOcclusionPyramid();
+			}
+			if (_use_dynamic_rendering)
+			{
+				BuildRenderGraph();
+			}
+		});
+	}
+
+	void Application::PrecompileShaders()
+	{
+		// Every pipeline loads its SPIR-V from here on, with all .spv files up to date nothing is compiled
+		std::vector<std::string> shader_fps;
+		for (const auto& entry : std::filesystem::directory_iterator("src\\shaders"))
+		{
+			std::string extension = entry.path().extension().string();
+			// Only shader sources, the directory also holds their .spv, .spv.hash and .log outputs
+			if (entry.is_regular_file() && (extension == ".vert" || extension == ".frag" || extension == ".comp"))
+			{
+				shader_fps.push_back(entry.path().string());
+			}
+		}
+
+		std::atomic<uint32_t> compiled_count = 0;
+		_thread_pool->ParallelFor(shader_fps.size(), 1, [&shader_fps, &compiled_count](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (CvlPipeline::PrecompileShader(shader_fps[i]))
+				{
+					++compiled_count;
+				}
+			}
+		});
+		std::cout << "[Application] " << compiled_count.load() << " of " << shader_fps.size() << " shaders compiled, the rest were up to date\n";
+	}
+
 	void Application::LoadModels()
 	{
 		std::vector<CvlModel::Vertex> vertices =
@@ -41,70 +398,1081 @@ namespace cvl
 		};
 
 		_cvl_model = std::make_unique<CvlModel>(*_cvl_device, vertices);
+
+		if (USE_SCENE)
+		{
+			LoadScene();
+		}
+	}
+
+	void Application::BuildClusterGeometry()
+	{
+		constexpr float ring_radius = 1.0f;
+		constexpr float tube_radius = 0.4f;
+		constexpr float two_pi = 6.28318530718f;
+
+		std::vector<CvlClusterMesh::Vertex> vertices;
+		vertices.reserve(TORUS_SEGMENTS * TORUS_SIDES);
+		for (uint32_t i = 0; i < TORUS_SEGMENTS; ++i)
+		{
+			float u = two_pi * i / TORUS_SEGMENTS;
+			for (uint32_t j = 0; j < TORUS_SIDES; ++j)
+			{
+				float v = two_pi * j / TORUS_SIDES;
+				glm::vec3 normal(std::cos(v) * std::cos(u), std::sin(v), std::cos(v) * std::sin(u));
+				glm::vec3 center(ring_radius * std::cos(u), 0.0f, ring_radius * std::sin(u));
+				vertices.push_back({ center + normal * tube_radius, normal });
+			}
+		}
+
+		// Wound so that cross(b - a, c - a) points outwards, which the meshlet normal cones rely on
+		std::vector<uint32_t> indices;
+		indices.reserve(TORUS_SEGMENTS * TORUS_SIDES * 6);
+		for (uint32_t i = 0; i < TORUS_SEGMENTS; ++i)
+		{
+			uint32_t next_i = (i + 1) % TORUS_SEGMENTS;
+			for (uint32_t j = 0; j < TORUS_SIDES; ++j)
+			{
+				uint32_t next_j = (j + 1) % TORUS_SIDES;
+				uint32_t a = i * TORUS_SIDES + j;
+				uint32_t b = next_i * TORUS_SIDES + j;
+				uint32_t c = next_i * TORUS_SIDES + next_j;
+				uint32_t d = i * TORUS_SIDES + next_j;
+				indices.insert(indices.end(), { a, d, c, a, c, b });
+			}
+		}
+
+		_cluster_geometry = std::make_unique<CvlClusterMesh::Geometry>(CvlClusterMesh::LoadOrBuildGeometry(CLUSTER_GEOMETRY_PATH, vertices, indices));
+	}
+
+	void Application::LoadClusterMesh()
+	{
+		_cluster_mesh = std::make_unique<CvlClusterMesh>
+		(
+			*_cvl_device,
+			*_pipeline_cache,
+			*_cluster_geometry,
+			CvlSwapchain::MAX_FRAMES_IN_FLIGHT
+		);
+		_cluster_geometry.reset();
+		_cluster_mesh->SetLodComparison(COMPARE_LOD);
+		_cluster_mesh->SetOcclusionComparison(COMPARE_OCCLUSION);
+	}
+
+	void Application::LoadScene()
+	{
+		// Triangle, quad and hexagon in the xy plane
+		std::vector<std::vector<CvlModel::Vertex>> mesh_vertices(3);
+		mesh_vertices[0] =
+		{
+			{{ 0.0f, -0.5f}, { 1.0f, 0.3f, 0.3f }},
+			{{ 0.5f,  0.5f}, { 0.3f, 1.0f, 0.3f }},
+			{{-0.5f,  0.5f}, { 0.3f, 0.3f, 1.0f }}
+		};
+		mesh_vertices[1] =
+		{
+			{{-0.5f, -0.5f}, { 1.0f, 1.0f, 1.0f }},
+			{{ 0.5f, -0.5f}, { 0.6f, 0.6f, 0.6f }},
+			{{ 0.5f,  0.5f}, { 1.0f, 1.0f, 1.0f }},
+			{{-0.5f, -0.5f}, { 1.0f, 1.0f, 1.0f }},
+			{{ 0.5f,  0.5f}, { 1.0f, 1.0f, 1.0f }},
+			{{-0.5f,  0.5f}, { 0.6f, 0.6f, 0.6f }}
+		};
+		constexpr float two_pi = 6.28318530718f;
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			float a0 = two_pi * i / 6.0f;
+			float a1 = two_pi * (i + 1) / 6.0f;
+			mesh_vertices[2].push_back({ { 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f } });
+			mesh_vertices[2].push_back({ { 0.5f * std::cos(a0), 0.5f * std::sin(a0) }, { 0.5f, 0.5f, 0.5f } });
+			mesh_vertices[2].push_back({ { 0.5f * std::cos(a1), 0.5f * std::sin(a1) }, { 0.5f, 0.5f, 0.5f } });
+		}
+		for (const std::vector<CvlModel::Vertex>& vertices : mesh_vertices)
+		{
+			_scene_meshes.push_back(std::make_unique<CvlModel>(*_cvl_device, vertices));
+			if (_frame_capture != nullptr)
+			{
+				_frame_capture->AddModel(_scene_meshes.back().get(), vertices);
+			}
+		}
+		_scene_materials =
+		{
+			glm::vec4(1.0f, 0.9f, 0.8f, 1.0f),
+			glm::vec4(0.6f, 0.8f, 1.0f, 1.0f),
+			glm::vec4(0.9f, 0.5f, 0.3f, 1.0f),
+			glm::vec4(0.4f, 0.8f, 0.4f, 1.0f)
+		};
+		// Variant 0 multiplies the vertex color by the tint, variant 1 draws the flat tint
+		_scene_material_pipelines = { 0, 0, 1, 1 };
+		if (_frame_capture != nullptr)
+		{
+			_frame_capture->SetMaterials(_scene_materials);
+		}
+		_draw_list = std::make_unique<CvlDrawList>();
+
+		_scene = std::make_unique<CvlScene>();
+		_scene->Reserve(SCENE_ROOTS * (1 + SCENE_CHILDREN * (1 + SCENE_GRANDCHILDREN)));
+		_scene_roots.reserve(SCENE_ROOTS);
+
+		// Roots on a grid below the torus, children on a ring around their root, grandchildren on a smaller ring around their parent
+		uint32_t grid_size = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(SCENE_ROOTS))));
+		float grid_offset = -2.0f * static_cast<float>(grid_size);
+		auto setup = [this](Entity entity, const glm::vec3& position, float scale, uint32_t mesh, uint32_t material)
+		{
+			_scene->SetPosition(entity, position);
+			_scene->SetScale(entity, glm::vec3(scale));
+			// Circumscribes the meshes, which fit in a unit square
+			_scene->SetLocalBounds(entity, glm::vec4(0.0f, 0.0f, 0.0f, 0.71f));
+			_scene->SetMesh(entity, mesh);
+			_scene->SetMaterial(entity, material);
+		};
+		uint32_t mesh_count = static_cast<uint32_t>(_scene_meshes.size());
+		uint32_t material_count = static_cast<uint32_t>(_scene_materials.size());
+		for (uint32_t r = 0; r < SCENE_ROOTS; ++r)
+		{
+			Entity root = _scene->CreateEntity();
+			glm::vec3 root_position(static_cast<float>(r % grid_size) * 4.0f + grid_offset, -2.0f, static_cast<float>(r / grid_size) * 4.0f + grid_offset);
+			setup(root, root_position, 1.0f, r % mesh_count, r % material_count);
+			_scene_roots.push_back(root);
+			for (uint32_t c = 0; c < SCENE_CHILDREN; ++c)
+			{
+				float child_angle = two_pi * c / SCENE_CHILDREN;
+				Entity child = _scene->CreateEntity(root);
+				setup(child, glm::vec3(std::cos(child_angle), 0.0f, std::sin(child_angle)) * 1.5f, 0.25f, c % mesh_count, (r + c) % material_count);
+				for (uint32_t g = 0; g < SCENE_GRANDCHILDREN; ++g)
+				{
+					float grandchild_angle = two_pi * g / SCENE_GRANDCHILDREN;
+					Entity grandchild = _scene->CreateEntity(child);
+					setup(grandchild, glm::vec3(std::cos(grandchild_angle), std::sin(grandchild_angle), 0.0f) * 2.0f, 0.2f, CvlScene::INVALID_ID, CvlScene::INVALID_ID);
+				}
+			}
+		}
+	}
+
+	void Application::SimulateFrame(FramePacket& packet, float dt, VkExtent2D extent)
+	{
+		packet.dt = dt;
+		packet.window_extent = extent;
+		if (_scene != nullptr)
+		{
+			UpdateScene(dt);
+			GatherDrawables(packet);
+		}
+		UpdateCamera(packet);
+	}
+
+	void Application::UpdateScene(float dt)
+	{
+		// Spinning the roots moves every transform below them
+		_scene_time += dt;
+		glm::quat spin = glm::angleAxis(0.5f * _scene_time, glm::vec3(0.0f, 1.0f, 0.0f));
+		for (Entity root : _scene_roots)
+		{
+			_scene->SetRotation(root, spin);
+		}
+		_scene->UpdateTransforms(*_thread_pool);
+
+		const SceneStats& stats = _scene->GetStats();
+		_scene_update_ms_sum += stats.update_ms;
+		if (++_scene_update_frames < SCENE_REPORT_INTERVAL_FRAMES)
+		{
+			return;
+		}
+		std::cout << "[Application] Scene: " << stats.entities << " transforms in " << stats.levels << " levels on "
+			<< stats.threads << " threads, " << _scene_update_ms_sum / _scene_update_frames << " ms per update (last rebuild "
+			<< stats.rebuild_ms << " ms)\n";
+		_scene_update_ms_sum = 0.0;
+		_scene_update_frames = 0;
+	}
+
+	void Application::GatherDrawables(FramePacket& packet)
+	{
+		// Copied out, the next frame's simulation rewrites the scene while the render thread still culls this one
+		packet.drawables.clear();
+		const glm::mat4* world_matrices = _scene->GetWorldMatrices();
+		const glm::vec4* world_bounds = _scene->GetWorldBounds();
+		const uint32_t* mesh_ids = _scene->GetMeshIds();
+		const uint32_t* material_ids = _scene->GetMaterialIds();
+		std::mutex mutex;
+		_thread_pool->ParallelFor(_scene->GetCount(), 65536, [&](size_t begin, size_t end)
+		{
+			std::vector<SceneDrawable> drawables;
+			for (size_t i = begin; i < end; ++i)
+			{
+				if (mesh_ids[i] != CvlScene::INVALID_ID)
+				{
+					drawables.push_back({ world_matrices[i], world_bounds[i], mesh_ids[i], material_ids[i] });
+				}
+			}
+			std::lock_guard<std::mutex> lock(mutex);
+			packet.drawables.insert(packet.drawables.end(), drawables.begin(), drawables.end());
+		});
+	}
+
+	void Application::BuildDrawList()
+	{
+		_draw_list->Clear();
+		if (_scene_pipelines.empty())
+		{
+			return;
+		}
+
+		// Frustum planes from the rows of the view projection (Gribb/Hartmann), depth in [0, 1]
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			rows[i] = glm::vec4(_view_proj[0][i], _view_proj[1][i], _view_proj[2][i], _view_proj[3][i]);
+		}
+		glm::vec4 frustum[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[2], rows[3] - rows[2] };
+		for (glm::vec4& plane : frustum)
+		{
+			plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+		}
+
+		const std::vector<SceneDrawable>& drawables = _render_packet->drawables;
+		_thread_pool->ParallelFor(drawables.size(), 4096, [&](size_t begin, size_t end)
+		{
+			std::vector<uint64_t> keys;
+			std::vector<DrawCommand> commands;
+			for (size_t i = begin; i < end; ++i)
+			{
+				const SceneDrawable& drawable = drawables[i];
+				glm::vec4 center(drawable.bounds.x, drawable.bounds.y, drawable.bounds.z, 1.0f);
+				bool visible = true;
+				for (const glm::vec4& plane : frustum)
+				{
+					visible = visible && glm::dot(plane, center) > -drawable.bounds.w;
+				}
+				if (!visible)
+				{
+					continue;
+				}
+				// Clip space w is the view space distance along the view direction
+				float depth = glm::dot(rows[3], center) / CAMERA_FAR;
+				uint32_t pipeline = _scene_material_pipelines[drawable.material];
+				keys.push_back(CvlDrawList::MakeKey(DrawPass::Opaque, pipeline, drawable.material, drawable.mesh, depth));
+				commands.push_back({ _scene_pipelines[pipeline].get(), _scene_meshes[drawable.mesh].get(), drawable.material, _view_proj * drawable.world });
+			}
+			_draw_list->Append(keys, commands);
+		});
+		_draw_list->Sort(*_thread_pool);
+	}
+
+	void Application::DrawDebugOverlay()
+	{
+		_debug_draw->DrawAxes(glm::mat4(1.0f), 2.0f);
+
+		uint32_t boxes = 0;
+		if (DEBUG_DRAW_SCENE_BOUNDS)
+		{
+			for (const SceneDrawable& drawable : _render_packet->drawables)
+			{
+				glm::vec3 center(drawable.bounds.x, drawable.bounds.y, drawable.bounds.z);
+				glm::vec3 extent(drawable.bounds.w);
+				_debug_draw->DrawBox(center - extent, center + extent, glm::vec4(0.2f, 1.0f, 0.4f, 0.5f));
+				++boxes;
+			}
+		}
+
+		std::ostringstream text;
+		text << std::fixed << std::setprecision(2) << "FRAME " << _frame_dt * 1000.0f << " MS";
+		std::optional<double> gpu_ms = _gpu_timer->GetElapsedMs(0, 1);
+		if (gpu_ms.has_value())
+		{
+			text << "  GPU " << gpu_ms.value() << " MS";
+		}
+		if (_draw_list != nullptr)
+		{
+			text << "\nDRAWS " << _draw_list->GetCount();
+		}
+		text << "\nDEBUG BOXES " << boxes;
+		if (_sprite_batch != nullptr)
+		{
+			text << "\nSPRITES " << _sprites.size();
+		}
+		constexpr float text_height = 14.0f;
+		std::string overlay = text.str();
+		float width = CvlDebugDraw::GetTextWidth(overlay, text_height);
+		// Lines are 1.5 glyph heights apart
+		float lines = static_cast<float>(std::count(overlay.begin(), overlay.end(), '\n') + 1);
+		_debug_draw->DrawScreenRect(glm::vec2(4.0f), glm::vec2(16.0f + width, 16.0f + text_height * (1.5f * lines - 0.5f)), glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+		_debug_draw->DrawText(glm::vec2(10.0f), overlay, text_height, glm::vec4(1.0f, 1.0f, 0.4f, 1.0f));
+	}
+
+	void Application::LoadSprites()
+	{
+		_sprite_batch = std::make_unique<CvlSpriteBatch>(*_cvl_device, *_pipeline_cache, SPRITE_COUNT, CvlSwapchain::MAX_FRAMES_IN_FLIGHT);
+
+		// Eight white shapes at four resolutions packed into one atlas, the sprite color tints them
+		constexpr uint32_t shape_count = 8;
+		constexpr uint32_t image_sizes[] = { 12, 20, 32, 48 };
+		constexpr float two_pi = 6.28318530718f;
+		auto shape_distance = [two_pi](uint32_t shape, float u, float v)
+		{
+			// Negative inside, in units of half the image size
+			float r = std::sqrt(u * u + v * v);
+			switch (shape)
+			{
+			case 0: return r - 0.9f;
+			case 1: return std::abs(r - 0.7f) - 0.2f;
+			case 2: return std::max(std::abs(u), std::abs(v)) - 0.75f;
+			case 3: return std::abs(u) + std::abs(v) - 0.9f;
+			case 4: return std::max(std::min(std::abs(u), std::abs(v)) - 0.25f, std::max(std::abs(u), std::abs(v)) - 0.9f);
+			case 5: return r - (0.55f + 0.35f * std::cos(5.0f * std::atan2(v, u) + two_pi * 0.25f));
+			case 6: return (static_cast<int>((u + 1.0f) * 4.0f) + static_cast<int>((v + 1.0f) * 4.0f)) % 2 == 0 ? -1.0f : 1.0f;
+			default: return r - 1.0f;
+			}
+		};
+		_sprite_atlas = std::make_unique<CvlTextureAtlas>(*_cvl_device, SPRITE_ATLAS_PAGE_SIZE, SPRITE_ATLAS_PAGES);
+		std::vector<uint8_t> pixels;
+		for (uint32_t image_size : image_sizes)
+		{
+			pixels.resize(image_size * image_size * 4);
+			for (uint32_t shape = 0; shape < shape_count; ++shape)
+			{
+				for (uint32_t y = 0; y < image_size; ++y)
+				{
+					for (uint32_t x = 0; x < image_size; ++x)
+					{
+						float u = (static_cast<float>(x) + 0.5f) / image_size * 2.0f - 1.0f;
+						float v = (static_cast<float>(y) + 0.5f) / image_size * 2.0f - 1.0f;
+						// One texel of anti-aliasing, the last shape fades out radially instead
+						float coverage = shape == shape_count - 1
+							? std::clamp(-shape_distance(shape, u, v), 0.0f, 1.0f)
+							: std::clamp(0.5f - shape_distance(shape, u, v) * image_size * 0.5f, 0.0f, 1.0f);
+						uint8_t* pixel = &pixels[(y * image_size + x) * 4];
+						pixel[0] = 255;
+						pixel[1] = 255;
+						pixel[2] = 255;
+						pixel[3] = EncodeUnorm8(coverage);
+					}
+				}
+				AtlasHandle image = _sprite_atlas->Insert(image_size, image_size, pixels.data());
+				if (image == INVALID_ATLAS_HANDLE)
+				{
+					throw std::runtime_error("[Application] Failed to fit sprite images in the atlas!");
+				}
+				_sprite_images.push_back(image);
+			}
+		}
+		_sprite_atlas->Flush();
+		_sprite_atlas->ReportStats();
+		_sprite_texture = _sprite_batch->AddTexture(_sprite_atlas->GetTexture());
+
+		std::mt19937 rng(7);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		_sprites.resize(SPRITE_COUNT);
+		_sprite_velocities.resize(SPRITE_COUNT);
+		for (uint32_t i = 0; i < SPRITE_COUNT; ++i)
+		{
+			CvlSpriteBatch::Sprite& sprite = _sprites[i];
+			sprite.position = glm::vec2(unit(rng) * WIDTH, unit(rng) * HEIGHT);
+			sprite.size = glm::vec2(2.0f + 10.0f * unit(rng));
+			sprite.rotation = two_pi * unit(rng);
+			const AtlasRegion& region = _sprite_atlas->GetRegion(_sprite_images[rng() % _sprite_images.size()]);
+			sprite.texture_layer = region.layer;
+			sprite.uv_rect = EncodeUvRect(region.uv_rect);
+			sprite.color = EncodeColor(glm::vec4(0.3f + 0.7f * unit(rng), 0.3f + 0.7f * unit(rng), 0.3f + 0.7f * unit(rng), 0.8f));
+			float angle = two_pi * unit(rng);
+			_sprite_velocities[i] = glm::vec2(std::cos(angle), std::sin(angle)) * (20.0f + 100.0f * unit(rng));
+		}
+	}
+
+	void Application::UpdateSprites()
+	{
+		// Bounced off the edges of the area the sprites are drawn to
+		VkExtent2D extent = _dynamic_resolution_active ? _render_extent : _cvl_swap_chain->GetSwapChainExtent();
+		glm::vec2 bounds(static_cast<float>(extent.width), static_cast<float>(extent.height));
+
+		_sprite_batch->Begin(_frame);
+		for (uint32_t i = 0; i < _sprites.size(); ++i)
+		{
+			CvlSpriteBatch::Sprite& sprite = _sprites[i];
+			glm::vec2& velocity = _sprite_velocities[i];
+			sprite.position += velocity * _frame_dt;
+			if (sprite.position.x < 0.0f || sprite.position.x > bounds.x)
+			{
+				velocity.x = -velocity.x;
+				sprite.position.x = std::clamp(sprite.position.x, 0.0f, bounds.x);
+			}
+			if (sprite.position.y < 0.0f || sprite.position.y > bounds.y)
+			{
+				velocity.y = -velocity.y;
+				sprite.position.y = std::clamp(sprite.position.y, 0.0f, bounds.y);
+			}
+			sprite.rotation += (i & 1) != 0 ? _frame_dt : -_frame_dt;
+			// Every image is in the atlas, so there is one batch per layer
+			_sprite_batch->Submit(i % SPRITE_LAYERS, _sprite_texture, sprite);
+		}
+		_sprite_batch->End();
 	}
 
 	void Application::CreatePipelineLayout()
 	{
+		// Dequantization of the model's positions
+		VkPushConstantRange push_constant_range = {};
+		push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_constant_range.offset = 0;
+		push_constant_range.size = sizeof(glm::vec4);
+
 		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
 		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipeline_layout_info.setLayoutCount = 0;
 		pipeline_layout_info.pSetLayouts = nullptr;
-		pipeline_layout_info.pushConstantRangeCount = 0;
-		pipeline_layout_info.pPushConstantRanges = nullptr;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
 
-		if (vkCreatePipelineLayout(_cvl_device->device(), &pipeline_layout_info, nullptr, &_pipeline_layout) != VK_SUCCESS)
+		if (vkCreatePipelineLayout(_cvl_device->device(), &pipeline_layout_info, _cvl_device->GetAllocator(), &_pipeline_layout) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[Application] Failed to create pipeline layout!");
 		}
+
+		if (_scene != nullptr)
+		{
+			// Pushed in ranges by CvlDrawList
+			push_constant_range.size = sizeof(DrawPushConstants);
+			if (vkCreatePipelineLayout(_cvl_device->device(), &pipeline_layout_info, _cvl_device->GetAllocator(), &_scene_pipeline_layout) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[Application] Failed to create scene pipeline layout!");
+			}
+		}
 	}
 
 	void Application::CreatePipeline()
 	{
 		assert(_cvl_swap_chain != nullptr && "Cannot create pipeline before swap chain");
 		assert(_pipeline_layout != nullptr && "Cannot create pipeline before pipeline layout");
+		for (const PipelineBuild& build : GetPipelineBuilds())
+		{
+			build.build();
+		}
+	}
+
+	void Application::CreateScenePipelines()
+	{
 		PipelineConfigInfo pipeline_config = {};
-		CvlPipeline::DefaultPipelineConfigInfo(pipeline_config);
-		pipeline_config.render_pass = _cvl_swap_chain->GetRenderPass();
+		DefaultSceneConfigInfo(pipeline_config);
 		pipeline_config.pipeline_layout = _pipeline_layout;
-		_cvl_pipeline = std::make_unique<CvlPipeline>(*_cvl_device, pipeline_config, "src\\shaders\\shader.vert", "src\\shaders\\shader.frag");
+		_cvl_pipeline = _pipeline_cache->GetGraphicsPipeline(pipeline_config, "src\\shaders\\shader.vert", "src\\shaders\\shader.frag");
+		++_pipeline_build_count;
+
+		if (_scene != nullptr)
+		{
+			_scene_pipelines.clear();
+			for (uint32_t variant = 0; variant < 2; ++variant)
+			{
+				PipelineConfigInfo scene_config = {};
+				DefaultSceneConfigInfo(scene_config);
+				scene_config.pipeline_layout = _scene_pipeline_layout;
+				scene_config.vertex_specialization.Set(0, variant == 0);
+				_scene_pipelines.push_back(_pipeline_cache->GetGraphicsPipeline(scene_config, "src\\shaders\\scene.vert", "src\\shaders\\shader.frag"));
+				++_pipeline_build_count;
+				if (_frame_capture != nullptr)
+				{
+					_frame_capture->AddPipeline(_scene_pipelines.back().get(), scene_config, "src\\shaders\\scene.vert", "src\\shaders\\shader.frag");
+				}
+			}
+		}
 	}
 
-	void Application::RecreateSwapchain()
+	std::vector<Application::PipelineBuild> Application::GetPipelineBuilds()
 	{
-		auto extent = _cvl_window->GetExtent();
-		while (extent.width == 0 || extent.height == 0)
+		// A build only touches its own subsystem and the pipeline cache, so the builds can run in parallel
+		std::vector<PipelineBuild> builds;
+		builds.push_back({ "Models", [this]()
+		{
+			CreateScenePipelines();
+		} });
+		if (USE_DEBUG_DRAW)
 		{
-			extent = _cvl_window->GetExtent();
-			glfwWaitEvents();
+			builds.push_back({ "DebugDraw", [this]()
+			{
+				PipelineConfigInfo debug_config = {};
+				DefaultSceneConfigInfo(debug_config);
+				_debug_draw->CreateRenderPipelines(debug_config);
+				++_pipeline_build_count;
+			} });
 		}
-		vkDeviceWaitIdle(_cvl_device->device());
+		if (USE_SPRITES)
+		{
+			builds.push_back({ "Sprites", [this]()
+			{
+				PipelineConfigInfo sprite_config = {};
+				DefaultSceneConfigInfo(sprite_config);
+				_sprite_batch->CreateRenderPipeline(sprite_config);
+				++_pipeline_build_count;
+			} });
+		}
+		if (USE_CLUSTER_MESH)
+		{
+			builds.push_back({ "ClusterMesh", [this]()
+			{
+				PipelineConfigInfo mesh_config = {};
+				DefaultSceneConfigInfo(mesh_config);
+				_cluster_mesh->CreateRenderPipeline(mesh_config);
+				++_pipeline_build_count;
+			} });
+		}
+		if (USE_PARTICLES)
+		{
+			builds.push_back({ "Particles", [this]()
+			{
+				PipelineConfigInfo particle_config = {};
+				DefaultSceneConfigInfo(particle_config);
+				_particle_system->CreateRenderPipeline(particle_config);
+				++_pipeline_build_count;
+			} });
+		}
+		return builds;
+	}
+
+	void Application::DefaultSceneConfigInfo(PipelineConfigInfo& config_info)
+	{
+		CvlPipeline::DefaultPipelineConfigInfo(config_info);
+		if (_use_dynamic_rendering)
+		{
+			config_info.color_attachment_formats = { _cvl_swap_chain->GetSwapChainImageFormat() };
+			config_info.depth_attachment_format = _cvl_swap_chain->GetDepthFormat();
+		}
+		else
+		{
+			config_info.render_pass = _cvl_swap_chain->GetRenderPass();
+		}
+	}
+
+	bool Application::RecreateSwapchain(VkExtent2D extent)
+	{
+		// The packet's extent is never zero, but packets queued before a minimize are still rendered afterwards
+		// and the surface's extent is already zero then. Waiting for a restore here would stall the render thread
+		VkExtent2D surface_extent = _cvl_device->GetSwapChainSupport().capabilities.currentExtent;
+		if (surface_extent.width == 0 || surface_extent.height == 0)
+		{
+			_swap_chain_recreate_pending = true;
+			return false;
+		}
+		_swap_chain_recreate_pending = false;
+
+		// No device wait here, the old swap chain is retired once its frames have completed
+		auto start_time = std::chrono::high_resolution_clock::now();
+
+		bool formats_changed = true;
 		if (_cvl_swap_chain == nullptr)
 		{
-			_cvl_swap_chain = std::make_unique<CvlSwapchain>(*_cvl_device, extent);
+			_cvl_swap_chain = std::make_unique<CvlSwapchain>(*_cvl_device, extent, _use_dynamic_rendering);
+		}
+		else
+		{
+			std::shared_ptr<CvlSwapchain> old_swap_chain = std::move(_cvl_swap_chain);
+			_cvl_swap_chain = std::make_unique<CvlSwapchain>(*_cvl_device, extent, old_swap_chain);
+			formats_changed = !old_swap_chain->CompareSwapFormats(*_cvl_swap_chain);
+			_resize_start_time = start_time;
+		}
+
+		// The pipeline only depends on attachment formats (and the render pass, which is reused when they match)
+		bool rebuild_pipeline = _cvl_pipeline == nullptr || formats_changed;
+		if (rebuild_pipeline)
+		{
+			// Rare: the surface format changed, the old pipeline is destroyed once the frames in flight are done with it
+			CreatePipeline();
+			_pipeline_cache->ReleaseUnusedPipelines();
+		}
+		if (_cluster_mesh != nullptr)
+		{
+			UpdateOcclusionPyramid();
+		}
+		if (_use_dynamic_rendering)
+		{
+			BuildRenderGraph();
+		}
+
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time);
+		std::cout << "[Application] Swapchain recreated in " << elapsed.count() << " ms"
+			<< " (dynamic rendering: " << (_use_dynamic_rendering ? "on" : "off")
+			<< ", pipeline rebuilt: " << (rebuild_pipeline ? "yes" : "no")
+			<< ", pipelines built so far: " << _pipeline_build_count.load() << ")\n";
+		return true;
+	}
+
+	void Application::UpdateOcclusionPyramid()
+	{
+		// Only the render graph orders the depth reads, the render pass path keeps depth transient.
+		// Support doesn't change between swap chains, so there is never a pyramid to drop here
+		if (!USE_OCCLUSION_CULLING || !_use_dynamic_rendering || !_cvl_swap_chain->IsDepthSampled() || !CvlHiZPyramid::IsSupported(*_cvl_device))
+		{
+			return;
+		}
+		VkImageView depth_view = _cvl_swap_chain->GetDepthImageView();
+		VkExtent2D extent = _cvl_swap_chain->GetSwapChainExtent();
+		if (depth_view == _hiz_depth_view && extent.width == _hiz_depth_extent.width && extent.height == _hiz_depth_extent.height)
+		{
+			return;
+		}
+
+		// The cluster mesh's single descriptor set is rewritten below, which frames in flight must not be using.
+		// Deferring the pyramid's destruction alone wouldn't avoid this wait
+		if (_hiz_pyramid != nullptr)
+		{
+			_cvl_swap_chain->WaitForFramesInFlight();
+		}
+		_hiz_pyramid = std::make_unique<CvlHiZPyramid>(*_cvl_device, *_pipeline_cache, extent, depth_view, CvlSwapchain::MAX_FRAMES_IN_FLIGHT);
+		_cluster_mesh->SetOcclusionPyramid(_hiz_pyramid.get());
+		_hiz_depth_view = depth_view;
+		_hiz_depth_extent = extent;
+	}
+
+	void Application::BuildRenderGraph()
+	{
+		if (_render_graph == nullptr)
+		{
+			_render_graph = std::make_unique<CvlRenderGraph>(*_cvl_device);
+		}
+		else
+		{
+			// Transient resources still used by frames in flight are released through the deletion queue
+			_render_graph->Reset();
+		}
+
+		VkExtent2D extent = _cvl_swap_chain->GetSwapChainExtent();
+		VkImageAspectFlags depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		VkFormat depth_format = _cvl_swap_chain->GetDepthFormat();
+		if (depth_format == VK_FORMAT_D32_SFLOAT_S8_UINT || depth_format == VK_FORMAT_D24_UNORM_S8_UINT)
+		{
+			depth_aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+
+		// Blitting needs a transfer capable swap chain and a linearly filterable format
+		VkFormat color_format = _cvl_swap_chain->GetSwapChainImageFormat();
+		bool can_blit = (_cvl_swap_chain->GetImageUsage() & VK_IMAGE_USAGE_TRANSFER_DST_BIT) &&
+			_cvl_device->IsFormatFeatureSupported
+			(
+				color_format,
+				VK_IMAGE_TILING_OPTIMAL,
+				VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+			);
+		bool was_active = _dynamic_resolution_active;
+		_dynamic_resolution_active = USE_DYNAMIC_RESOLUTION && can_blit && _gpu_timer->IsSupported();
+		if (_dynamic_resolution_active != was_active || _render_extent.width == 0)
+		{
+			std::cout << "[Application] Dynamic resolution: " << (_dynamic_resolution_active ? "on" : "off") << std::endl;
+		}
+		_render_extent = _dynamic_resolution_active ? _dynamic_resolution.GetRenderExtent(extent) : extent;
+
+		// The acquired image comes in undefined, the shared depth image was last written by the previous frame
+		_graph_swap_chain_image = _render_graph->ImportImage
+		(
+			"swap chain",
+			{ _cvl_swap_chain->GetSwapChainImageFormat(), extent, VK_IMAGE_ASPECT_COLOR_BIT },
+			{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_NONE },
+			RenderGraphUsage::Present
+		);
+		_graph_depth_image = _render_graph->ImportImage
+		(
+			"depth",
+			{ depth_format, extent, depth_aspect },
+			{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT }
+		);
+
+		if (_particle_system != nullptr)
+		{
+			// Last read as vertex buffer by the previous frame
+			_graph_particles = _render_graph->ImportBuffer
+			(
+				"particles",
+				{ _particle_system->GetBufferSize() },
+				{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_NONE }
+			);
+			// With async compute the simulation is ordered against drawing by semaphores instead
+			if (!_particle_system->IsAsyncCompute())
+			{
+				_render_graph->AddPass("simulate particles")
+					.Write(_graph_particles, RenderGraphUsage::ComputeStorageWrite)
+					.SetExecute([this](const CvlRenderGraph::PassContext& context)
+					{
+						_particle_system->Simulate(context.command_buffer, _frame, _frame_dt);
+					});
+			}
+		}
+
+		if (_cluster_mesh != nullptr)
+		{
+			// The compacted indices were last read by the previous frame, the draw slots are reset by the host
+			_graph_cluster_indices = _render_graph->ImportBuffer
+			(
+				"cluster indices",
+				{ _cluster_mesh->GetVisibleIndexBufferSize() },
+				{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_NONE }
+			);
+			_graph_cluster_draws = _render_graph->ImportBuffer
+			(
+				"cluster draws",
+				{ _cluster_mesh->GetDrawBufferSize() },
+				{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE }
+			);
+			auto cull_pass = _render_graph->AddPass("cull clusters");
+			cull_pass
+				.Write(_graph_cluster_indices, RenderGraphUsage::ComputeStorageWrite)
+				.Write(_graph_cluster_draws, RenderGraphUsage::ComputeStorageWrite)
+				.SetExecute([this](const CvlRenderGraph::PassContext& context)
+				{
+					_cluster_mesh->Cull(context.command_buffer, _frame, _view_proj, _camera_eye);
+				});
+
+			_occlusion_active = _hiz_pyramid != nullptr;
+			if (_occlusion_active)
+			{
+				// Last sampled by the previous frame's second cull phase, the pyramid never leaves GENERAL
+				_graph_hiz = _render_graph->ImportImage
+				(
+					"hiz",
+					{ CvlHiZPyramid::FORMAT, _hiz_pyramid->GetExtent(), VK_IMAGE_ASPECT_COLOR_BIT },
+					{ VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT }
+				);
+				_graph_cluster_occluded = _render_graph->ImportBuffer
+				(
+					"cluster occluded",
+					{ _cluster_mesh->GetOccludedBufferSize() },
+					{ VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE }
+				);
+				cull_pass
+					.Read(_graph_hiz, RenderGraphUsage::ComputeStorageRead)
+					.Write(_graph_cluster_occluded, RenderGraphUsage::ComputeStorageWrite);
+			}
 		}
 		else
 		{
-			_cvl_swap_chain = std::make_unique<CvlSwapchain>(*_cvl_device, extent, std::move(_cvl_swap_chain));
-			if (_cvl_swap_chain->ImageCount() != _command_buffers.size())
+			_occlusion_active = false;
+		}
+
+		// Without dynamic resolution the scene renders straight into the swap chain image.
+		// Otherwise the scene target is allocated at full size once per swap chain, lower scales render into its top left corner
+		RenderGraphResource scene_target = _graph_swap_chain_image;
+		if (_dynamic_resolution_active)
+		{
+			_graph_scene_color = _render_graph->CreateImage("scene color", { color_format, extent, VK_IMAGE_ASPECT_COLOR_BIT });
+			scene_target = _graph_scene_color;
+		}
+
+		auto scene_pass = _render_graph->AddPass("scene");
+		scene_pass
+			.Write(scene_target, RenderGraphUsage::ColorAttachment)
+			.Write(_graph_depth_image, RenderGraphUsage::DepthAttachment)
+			.ClearColor(scene_target, { { 0.1f, 0.1f, 0.1f, 1.0f } })
+			.ClearDepth(_graph_depth_image, { 1.0f, 0 })
+			.SetExecute([this](const CvlRenderGraph::PassContext& context)
 			{
-				FreeCommandBuffers();
-				CreateCommandBuffers();
+				RenderScene(context.command_buffer, context.render_area);
+				if (!_occlusion_active)
+				{
+					RenderSceneLate(context.command_buffer, context.render_area);
+				}
+			});
+		if (_cluster_mesh != nullptr)
+		{
+			scene_pass
+				.Read(_graph_cluster_indices, RenderGraphUsage::IndexBuffer)
+				.Read(_graph_cluster_draws, RenderGraphUsage::IndirectBuffer);
+		}
+
+		// The early draw's depth is reduced into the pyramid, the deferred meshlets are tested against it and
+		// the ones that show up are drawn by a second scene pass, together with everything that doesn't occlude
+		if (_occlusion_active)
+		{
+			_render_graph->AddPass("build hiz")
+				.Read(_graph_depth_image, RenderGraphUsage::ComputeSampled)
+				.Write(_graph_hiz, RenderGraphUsage::ComputeStorageWrite)
+				.SetExecute([this](const CvlRenderGraph::PassContext& context)
+				{
+					_hiz_pyramid->Build(context.command_buffer, _frame, _render_extent, _view_proj);
+				});
+			_render_graph->AddPass("cull occluded clusters")
+				.Read(_graph_hiz, RenderGraphUsage::ComputeStorageRead)
+				.Read(_graph_cluster_occluded, RenderGraphUsage::ComputeStorageRead)
+				.Write(_graph_cluster_indices, RenderGraphUsage::ComputeStorageWrite)
+				.Write(_graph_cluster_draws, RenderGraphUsage::ComputeStorageWrite)
+				.SetExecute([this](const CvlRenderGraph::PassContext& context)
+				{
+					_cluster_mesh->CullOccluded(context.command_buffer, _frame);
+				});
+		}
+		CvlRenderGraph::PassBuilder late_pass = _occlusion_active ? _render_graph->AddPass("scene late") : scene_pass;
+		if (_occlusion_active)
+		{
+			late_pass
+				.Write(scene_target, RenderGraphUsage::ColorAttachment)
+				.Write(_graph_depth_image, RenderGraphUsage::DepthAttachment)
+				.Read(_graph_cluster_indices, RenderGraphUsage::IndexBuffer)
+				.Read(_graph_cluster_draws, RenderGraphUsage::IndirectBuffer)
+				.SetExecute([this](const CvlRenderGraph::PassContext& context) { RenderSceneLate(context.command_buffer, context.render_area); });
+		}
+		if (_particle_system != nullptr)
+		{
+			late_pass.Read(_graph_particles, RenderGraphUsage::VertexBuffer);
+		}
+
+		if (_dynamic_resolution_active)
+		{
+			scene_pass.SetDynamicRenderArea([this]() { return VkRect2D{ { 0, 0 }, _render_extent }; });
+			if (_occlusion_active)
+			{
+				late_pass.SetDynamicRenderArea([this]() { return VkRect2D{ { 0, 0 }, _render_extent }; });
 			}
+			_render_graph->AddPass("upscale")
+				.Read(_graph_scene_color, RenderGraphUsage::TransferSrc)
+				.Write(_graph_swap_chain_image, RenderGraphUsage::TransferDst)
+				.SetExecute([this](const CvlRenderGraph::PassContext& context)
+				{
+					BlitToSwapchain(context.command_buffer, context.GetImage(_graph_scene_color), context.GetImage(_graph_swap_chain_image));
+				});
 		}
-		// todo: If render pass compatible do nothing else
-		CreatePipeline();
+
+		_render_graph->Compile();
 	}
 
-	void Application::RecordCommandBuffer(int image_index)
+	void Application::RecordCommandBuffer(VkCommandBuffer command_buffer, int image_index)
 	{
 		VkCommandBufferBeginInfo begin_info = {};
 		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-		if (vkBeginCommandBuffer(_command_buffers[image_index], &begin_info) != VK_SUCCESS)
+		if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[Application] Failed to begin recording command buffer!");
 		}
 
+		_gpu_timer->BeginFrame(command_buffer, _frame);
+		_gpu_timer->WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		if (_particle_system != nullptr && _particle_system->IsAsyncCompute())
+		{
+			MeasureAsyncCompute();
+		}
+		UpdateRenderScale();
+		if (_cluster_mesh != nullptr)
+		{
+			UpdateClusterLod();
+		}
+		if (_draw_list != nullptr)
+		{
+			BuildDrawList();
+		}
+		if (_debug_draw != nullptr)
+		{
+			DrawDebugOverlay();
+		}
+		if (_sprite_batch != nullptr)
+		{
+			UpdateSprites();
+		}
+
+		if (_render_graph != nullptr)
+		{
+			_render_graph->SetImportedImage(_graph_swap_chain_image, _cvl_swap_chain->GetImage(image_index), _cvl_swap_chain->GetImageView(image_index));
+			_render_graph->SetImportedImage(_graph_depth_image, _cvl_swap_chain->GetDepthImage(), _cvl_swap_chain->GetDepthImageView());
+			if (_particle_system != nullptr)
+			{
+				_render_graph->SetImportedBuffer(_graph_particles, _particle_system->GetBuffer());
+			}
+			if (_cluster_mesh != nullptr)
+			{
+				_render_graph->SetImportedBuffer(_graph_cluster_indices, _cluster_mesh->GetVisibleIndexBuffer());
+				_render_graph->SetImportedBuffer(_graph_cluster_draws, _cluster_mesh->GetDrawBuffer());
+			}
+			if (_occlusion_active)
+			{
+				_render_graph->SetImportedImage(_graph_hiz, _hiz_pyramid->GetImage(), _hiz_pyramid->GetImageView());
+				_render_graph->SetImportedBuffer(_graph_cluster_occluded, _cluster_mesh->GetOccludedBuffer());
+			}
+			_render_graph->Execute(command_buffer);
+		}
+		else
+		{
+			if (_particle_system != nullptr && !_particle_system->IsAsyncCompute())
+			{
+				_particle_system->RecordPreSimulationBarrier(command_buffer);
+				_particle_system->Simulate(command_buffer, _frame, _frame_dt);
+				_particle_system->RecordPostSimulationBarrier(command_buffer);
+			}
+			if (_cluster_mesh != nullptr)
+			{
+				_cluster_mesh->RecordPreCullBarrier(command_buffer);
+				_cluster_mesh->Cull(command_buffer, _frame, _view_proj, _camera_eye);
+				_cluster_mesh->RecordPostCullBarrier(command_buffer);
+			}
+			BeginSwapchainRendering(command_buffer, image_index);
+			RenderScene(command_buffer, { { 0, 0 }, _cvl_swap_chain->GetSwapChainExtent() });
+			RenderSceneLate(command_buffer, { { 0, 0 }, _cvl_swap_chain->GetSwapChainExtent() });
+			EndSwapchainRendering(command_buffer);
+		}
+		_gpu_timer->WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[Application] Failed to record command buffer!");
+		}
+	}
+
+	void Application::UpdateRenderScale()
+	{
+		if (!_dynamic_resolution_active)
+		{
+			return;
+		}
+		// Measured two frames ago, the most recent frame whose fence has been waited on
+		std::optional<double> gpu_ms = _gpu_timer->GetElapsedMs(0, 1);
+		if (gpu_ms.has_value())
+		{
+			_dynamic_resolution.Update(gpu_ms.value());
+		}
+		_render_extent = _dynamic_resolution.GetRenderExtent(_cvl_swap_chain->GetSwapChainExtent());
+	}
+
+	void Application::MeasureAsyncCompute()
+	{
+		// Both timers were just read back for the same frame slot, the simulation step submitted alongside that frame's graphics work
+		const CvlGpuTimer& compute_timer = _particle_system->GetGpuTimer();
+		std::optional<double> compute_start = compute_timer.GetTimestampMs(0);
+		std::optional<double> compute_end = compute_timer.GetTimestampMs(1);
+		std::optional<double> graphics_start = _gpu_timer->GetTimestampMs(0);
+		std::optional<double> graphics_end = _gpu_timer->GetTimestampMs(1);
+		if (!compute_start.has_value() || !compute_end.has_value() || !graphics_start.has_value() || !graphics_end.has_value())
+		{
+			return;
+		}
+		_async_compute_ms_sum += compute_end.value() - compute_start.value();
+		_async_graphics_ms_sum += graphics_end.value() - graphics_start.value();
+		// Timestamps of different queues are only comparable in the calibrated device time domain
+		bool calibrated = _cvl_device->IsCalibratedTimestampSupported();
+		if (calibrated)
+		{
+			double overlap = std::min(compute_end.value(), graphics_end.value()) - std::max(compute_start.value(), graphics_start.value());
+			_async_overlap_ms_sum += std::max(overlap, 0.0);
+		}
+		if (++_async_compute_samples < ASYNC_COMPUTE_REPORT_INTERVAL_FRAMES)
+		{
+			return;
+		}
+
+		double samples = static_cast<double>(_async_compute_samples);
+		std::cout << "[Application] Async compute " << _async_compute_ms_sum / samples << " ms, graphics " << _async_graphics_ms_sum / samples << " ms";
+		if (calibrated)
+		{
+			double hidden = _async_compute_ms_sum > 0.0 ? _async_overlap_ms_sum / _async_compute_ms_sum : 0.0;
+			std::cout << ", overlapped " << _async_overlap_ms_sum / samples << " ms (" << hidden * 100.0 << "% of the compute time)\n";
+		}
+		else
+		{
+			std::cout << ", overlap unknown without calibrated timestamps\n";
+		}
+		_async_compute_ms_sum = 0.0;
+		_async_graphics_ms_sum = 0.0;
+		_async_overlap_ms_sum = 0.0;
+		_async_compute_samples = 0;
+	}
+
+	void Application::UpdateCamera(FramePacket& packet)
+	{
+		// Orbits close enough to the torus that parts of it leave the frustum, then far enough for coarse LODs
+		_camera_time += packet.dt;
+		float angle = 0.3f * _camera_time;
+		float distance = 5.0f - 2.8f * std::cos(0.15f * _camera_time);
+		packet.camera_eye = glm::vec3(distance * std::cos(angle), 0.4f * distance, distance * std::sin(angle));
+
+		// The window's extent, which the render thread recreates the swap chain with when they differ
+		float aspect = static_cast<float>(packet.window_extent.width) / static_cast<float>(packet.window_extent.height);
+		glm::mat4 proj = glm::perspective(glm::radians(60.0f), aspect, CAMERA_NEAR, CAMERA_FAR);
+		// Vulkan's clip space y points down
+		proj[1][1] *= -1.0f;
+		packet.view_proj = proj * glm::lookAt(packet.camera_eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		packet.projection_scale = std::abs(proj[1][1]);
+	}
+
+	void Application::UpdateClusterLod()
+	{
+		VkExtent2D render_extent = _dynamic_resolution_active ? _render_extent : _cvl_swap_chain->GetSwapChainExtent();
+		_cluster_mesh->UpdateLod(_camera_eye, _render_packet->projection_scale * 0.5f * render_extent.height);
+	}
+
+	void Application::SetViewport(VkCommandBuffer command_buffer, VkRect2D render_area)
+	{
+		VkViewport viewport = {};
+		viewport.x = static_cast<float>(render_area.offset.x);
+		viewport.y = static_cast<float>(render_area.offset.y);
+		viewport.width = static_cast<float>(render_area.extent.width);
+		viewport.height = static_cast<float>(render_area.extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		VkRect2D scissor = render_area;
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+	}
+
+	void Application::RenderScene(VkCommandBuffer command_buffer, VkRect2D render_area)
+	{
+		SetViewport(command_buffer, render_area);
+		if (_cluster_mesh != nullptr)
+		{
+			_cluster_mesh->Draw(command_buffer, _frame, _view_proj);
+		}
+
+		_cvl_pipeline->Bind(command_buffer);
+		//vkCmdDraw(_command_buffers[i], 3, 1, 0, 0); // 3 vertices 1 instance(for multiple copies)
+		glm::vec4 dequantization = _cvl_model->GetPositionDequantization();
+		vkCmdPushConstants(command_buffer, _pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(dequantization), &dequantization);
+		_cvl_model->Bind(command_buffer);
+		_cvl_model->Draw(command_buffer);
+
+		if (_draw_list != nullptr)
+		{
+			_draw_list->Record(command_buffer, _scene_pipeline_layout, _scene_materials);
+		}
+	}
+
+	void Application::RenderSceneLate(VkCommandBuffer command_buffer, VkRect2D render_area)
+	{
+		SetViewport(command_buffer, render_area);
+		if (_cluster_mesh != nullptr)
+		{
+			_cluster_mesh->DrawOccluded(command_buffer, _frame, _view_proj);
+		}
+
+		if (_particle_system != nullptr)
+		{
+			_particle_system->Draw(command_buffer);
+		}
+
+		if (_sprite_batch != nullptr)
+		{
+			_sprite_batch->Draw(command_buffer, render_area);
+		}
+
+		// Last, screen space batches go on top of everything
+		if (_debug_draw != nullptr)
+		{
+			_debug_draw->Draw(command_buffer, _view_proj, render_area);
+		}
+	}
+
+	void Application::BlitToSwapchain(VkCommandBuffer command_buffer, VkImage src, VkImage dst)
+	{
+		VkExtent2D dst_extent = _cvl_swap_chain->GetSwapChainExtent();
+
+		VkImageBlit region = {};
+		region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.srcOffsets[1] = { static_cast<int32_t>(_render_extent.width), static_cast<int32_t>(_render_extent.height), 1 };
+		region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.dstOffsets[1] = { static_cast<int32_t>(dst_extent.width), static_cast<int32_t>(dst_extent.height), 1 };
+
+		vkCmdBlitImage
+		(
+			command_buffer,
+			src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &region,
+			VK_FILTER_LINEAR
+		);
+	}
+
+	void Application::BeginSwapchainRendering(VkCommandBuffer command_buffer, int image_index)
+	{
+		// Render pass path only, with dynamic rendering the render graph begins rendering and transitions the images
 		VkRenderPassBeginInfo render_pass_info = {};
 		render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		render_pass_info.renderPass = _cvl_swap_chain->GetRenderPass();
@@ -121,35 +1489,19 @@ namespace cvl
 		render_pass_info.clearValueCount = static_cast<uint32_t>(std::size(clear_values));
 		render_pass_info.pClearValues = clear_values;
 
-		vkCmdBeginRenderPass(_command_buffers[image_index], &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = static_cast<float>(_cvl_swap_chain->GetSwapChainExtent().width);
-		viewport.height = static_cast<float>(_cvl_swap_chain->GetSwapChainExtent().height);
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		VkRect2D scissor{ {0, 0}, _cvl_swap_chain->GetSwapChainExtent() };
-		vkCmdSetViewport(_command_buffers[image_index], 0, 1, &viewport);
-		vkCmdSetScissor(_command_buffers[image_index], 0, 1, &scissor);
-
-		_cvl_pipeline->Bind(_command_buffers[image_index]);
-		//vkCmdDraw(_command_buffers[i], 3, 1, 0, 0); // 3 vertices 1 instance(for multiple copies)
-		_cvl_model->Bind(_command_buffers[image_index]);
-		_cvl_model->Draw(_command_buffers[image_index]);
+		vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
 
-		vkCmdEndRenderPass(_command_buffers[image_index]);
+	}
 
-		if (vkEndCommandBuffer(_command_buffers[image_index]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("[Application] Failed to record command buffer!");
-		}
+	void Application::EndSwapchainRendering(VkCommandBuffer command_buffer)
+	{
+		vkCmdEndRenderPass(command_buffer);
 	}
 
 	void Application::CreateCommandBuffers()
 	{
-		_command_buffers.resize(_cvl_swap_chain->ImageCount());
+		// Recorded every frame, so one per frame in flight is enough and doesn't depend on the swap chain
+		_command_buffers.resize(CvlSwapchain::MAX_FRAMES_IN_FLIGHT);
 
 		VkCommandBufferAllocateInfo alloc_info = {};
 		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -163,20 +1515,112 @@ namespace cvl
 		}
 	}
 
-	void Application::FreeCommandBuffers()
+	void Application::RenderLoop()
 	{
-		vkFreeCommandBuffers(_cvl_device->device(), _cvl_device->GetCommandPool(), static_cast<uint32_t>(_command_buffers.size()), _command_buffers.data());
-		_command_buffers.clear();
+		while (true)
+		{
+			auto wait_start = std::chrono::high_resolution_clock::now();
+			FramePacket* packet = _render_queue->Pop();
+			if (packet == nullptr)
+			{
+				return;
+			}
+			packet->render_wait_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - wait_start).count();
+			// After a failure packets are only handed back, the main thread rethrows once it gets the next one
+			if (!_render_failed.load(std::memory_order_relaxed))
+			{
+				try
+				{
+					RenderPacket(*packet);
+				}
+				catch (...)
+				{
+					_render_error = std::current_exception();
+					_render_failed.store(true, std::memory_order_release);
+				}
+			}
+			_free_packets->Push(packet);
+		}
 	}
 
-	void Application::DrawFrame()
+	void Application::StopRenderThread(std::thread& render_thread)
 	{
+		if (render_thread.joinable())
+		{
+			_render_queue->Push(nullptr);
+			render_thread.join();
+		}
+	}
+
+	void Application::RenderPacket(FramePacket& packet)
+	{
+		auto start_time = std::chrono::high_resolution_clock::now();
+		RenderFrame(packet);
+		packet.render_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+	}
+
+	void Application::SetFramePacket(const FramePacket& packet)
+	{
+		_render_packet = &packet;
+		_frame_dt = packet.dt;
+		_camera_eye = packet.camera_eye;
+		_view_proj = packet.view_proj;
+	}
+
+	void Application::MeasureRenderThread(const FramePacket& packet, double main_ms, double main_wait_ms, double frame_ms)
+	{
+		// The packet's render times are from its previous trip through the queue
+		_main_ms_sum += main_ms;
+		_main_wait_ms_sum += main_wait_ms;
+		_render_ms_sum += packet.render_ms;
+		_render_wait_ms_sum += packet.render_wait_ms;
+		_frame_ms_sum += frame_ms;
+		if (++_render_thread_frames < RENDER_THREAD_REPORT_INTERVAL_FRAMES)
+		{
+			return;
+		}
+
+		// Run one after the other, a frame would take the main and the render thread's time added up
+		double frames = static_cast<double>(_render_thread_frames);
+		double main_avg = _main_ms_sum / frames;
+		double render_avg = _render_ms_sum / frames;
+		double frame_avg = _frame_ms_sum / frames;
+		double overlap = std::clamp(main_avg + render_avg - frame_avg, 0.0, std::min(main_avg, render_avg));
+		double hidden = main_avg > 0.0 ? overlap / main_avg : 0.0;
+		std::cout << "[Application] " << (USE_RENDER_THREAD ? "Render thread" : "Inline rendering") << ": frame " << frame_avg
+			<< " ms, main thread " << main_avg << " ms (waited " << _main_wait_ms_sum / frames << " ms for a packet), render "
+			<< render_avg << " ms (waited " << _render_wait_ms_sum / frames << " ms), overlapped " << overlap << " ms ("
+			<< hidden * 100.0 << "% of the main thread's time)\n";
+		_main_ms_sum = 0.0;
+		_main_wait_ms_sum = 0.0;
+		_render_ms_sum = 0.0;
+		_render_wait_ms_sum = 0.0;
+		_frame_ms_sum = 0.0;
+		_render_thread_frames = 0;
+	}
+
+	void Application::RenderFrame(const FramePacket& packet)
+	{
+		SetFramePacket(packet);
+		if (packet.resize_time.has_value() || _swap_chain_recreate_pending)
+		{
+			if (!RecreateSwapchain(packet.window_extent))
+			{
+				return;
+			}
+			if (packet.resize_time.has_value())
+			{
+				// Measured from the resize event on the main thread
+				_resize_start_time = packet.resize_time;
+			}
+		}
+
 		uint32_t image_index;
 		VkResult result = _cvl_swap_chain->AquireNextImage(&image_index);
 
 		if (result == VK_ERROR_OUT_OF_DATE_KHR)
 		{
-			RecreateSwapchain();
+			RecreateSwapchain(packet.window_extent);
 			return;
 		}
 		if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
@@ -184,17 +1628,68 @@ namespace cvl
 			throw std::runtime_error("[Application] Failed to acquire swap chain image!");
 		}
 
-		RecordCommandBuffer(image_index);
-		result = _cvl_swap_chain->SubmitCommandBuffers(&_command_buffers[image_index], &image_index);
-		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || _cvl_window->WasWindowResized())
+		// AquireNextImage waited on this frame's fence, so its command buffer is no longer in use
+		_frame = static_cast<uint32_t>(_cvl_swap_chain->GetCurrentFrame());
+		_cvl_device->GetDeletionQueue().BeginFrame();
+		_pipeline_cache->BeginFrame();
+		_cvl_device->UpdateMemoryBudget();
+		if (++_memory_report_frames == MEMORY_REPORT_INTERVAL_FRAMES)
 		{
-			_cvl_window->ResetWindowResizedFlag();
-			RecreateSwapchain();
+			_cvl_device->ReportMemoryUsage();
+			_memory_report_frames = 0;
+		}
+		if (_debug_draw != nullptr)
+		{
+			_debug_draw->BeginFrame(_frame);
+		}
+		if (_particle_system != nullptr && _particle_system->IsAsyncCompute())
+		{
+			// Submitted first so the compute queue is busy while the graphics work is recorded
+			_particle_system->SubmitAsyncSimulation(_frame, _frame_dt);
+		}
+		VkCommandBuffer command_buffer = _command_buffers[_frame];
+		RecordCommandBuffer(command_buffer, image_index);
+		if (_frame_capture != nullptr && _draw_list != nullptr && !_frame_capture->IsDone() && _frame_number >= CAPTURE_FIRST_FRAME)
+		{
+			// Replayed at the window size, the draws don't depend on the render scale
+			_frame_capture->SetTargets
+			(
+				_cvl_swap_chain->GetSwapChainExtent(),
+				_cvl_swap_chain->GetSwapChainImageFormat(),
+				_cvl_swap_chain->GetDepthFormat(),
+				glm::vec4(0.1f, 0.1f, 0.1f, 1.0f)
+			);
+			_frame_capture->CaptureFrame(_frame_number, _view_proj, *_draw_list);
+		}
+		++_frame_number;
+		QueueSubmission submission;
+		submission.command_buffers = { command_buffer };
+		if (_particle_system != nullptr)
+		{
+			_particle_system->AddGraphicsDependencies(submission);
+		}
+		result = _cvl_swap_chain->SubmitCommandBuffers(submission, &image_index);
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+		{
+			RecreateSwapchain(packet.window_extent);
 			return;
 		}
 		if (result != VK_SUCCESS)
 		{
 			throw std::runtime_error("[Application] Failed to present swap chain image!");
 		}
+
+		if (_resize_start_time.has_value())
+		{
+			auto latency = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - *_resize_start_time);
+			std::cout << "[Application] Resize to first frame: " << latency.count() << " ms\n";
+			_resize_start_time.reset();
+		}
+		if (_startup_graph != nullptr)
+		{
+			_startup_graph->SetFirstFrame();
+			_startup_graph->WriteReport(STARTUP_REPORT_PATH, STARTUP_TARGET_MS);
+			_startup_graph.reset();
+		}
 	}
 }
\ No newline at end of file
@@ -1,22 +1,140 @@
 #pragma once
 
 #include "cvl_pipeline.h"
+#include "cvl_pipeline_cache.h"
 #include "cvl_window.h"
 #include "cvl_device.h"
 #include "cvl_swap_chain.h"
 #include "cvl_model.h"
+#include "cvl_render_graph.h"
+#include "cvl_gpu_timer.h"
+#include "cvl_dynamic_resolution.h"
+#include "cvl_particle_system.h"
+#include "cvl_cluster_mesh.h"
+#include "cvl_hiz_pyramid.h"
+#include "cvl_scene.h"
+#include "cvl_draw_list.h"
+#include "cvl_debug_draw.h"
+#include "cvl_sprite_batch.h"
+#include "cvl_texture_atlas.h"
+#include "cvl_thread_pool.h"
+#include "cvl_startup_graph.h"
+#include "cvl_spsc_queue.h"
+#include "cvl_offline_renderer.h"
+#include "cvl_frame_capture.h"
 
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace cvl
 {
+	// Drawable scene entity as simulated for one frame
+	struct SceneDrawable
+	{
+		glm::mat4 world;
+		glm::vec4 bounds;	// xyz = center, w = radius
+		uint32_t mesh;
+		uint32_t material;
+	};
+
+	// Everything the render thread takes from the simulation for one frame, the main thread doesn't touch it while queued
+	struct FramePacket
+	{
+		float dt = 0.0f;
+		VkExtent2D window_extent = {};
+		// When the window was resized, on the first packet simulated afterwards
+		std::optional<std::chrono::high_resolution_clock::time_point> resize_time;
+		glm::vec3 camera_eye = glm::vec3(0.0f);
+		glm::mat4 view_proj = glm::mat4(1.0f);
+		// projection[1][1], LODs are picked at the render scale
+		float projection_scale = 1.0f;
+		// Roots and children only, the transform-only grandchildren stay with the scene
+		std::vector<SceneDrawable> drawables;
+		// Written by the render thread, read by the main thread once the packet is back in the free queue
+		double render_ms = 0.0;
+		double render_wait_ms = 0.0;
+	};
 
 	class Application
 	{
 	public:
 		static constexpr int WIDTH = 800;
 		static constexpr int HEIGHT = 600;
+		// Render through VK_KHR_dynamic_rendering when the device supports it
+		static constexpr bool USE_DYNAMIC_RENDERING = true;
+		// Render at a scale driven by GPU frame time and blit to the swap chain, needs dynamic rendering
+		static constexpr bool USE_DYNAMIC_RESOLUTION = true;
+		static constexpr double TARGET_FRAME_MS = 1000.0 / 60.0;
+		static constexpr bool USE_PARTICLES = true;
+		static constexpr uint32_t PARTICLE_COUNT = 1u << 21;
+		// Simulate particles on a compute-only queue one frame ahead, logs how much of it overlaps the graphics work
+		static constexpr bool USE_ASYNC_COMPUTE = true;
+		static constexpr uint32_t ASYNC_COMPUTE_REPORT_INTERVAL_FRAMES = 300;
+		// Torus split into meshlets and culled on the GPU, TORUS_SEGMENTS * TORUS_SIDES * 2 triangles
+		static constexpr bool USE_CLUSTER_MESH = true;
+		static constexpr uint32_t TORUS_SEGMENTS = 512;
+		static constexpr uint32_t TORUS_SIDES = 256;
+		// Meshlets and LOD chain built by the first run and loaded by later ones
+		static constexpr const char* CLUSTER_GEOMETRY_PATH = "cluster_mesh.cmsh";
+		// Alternates LOD selection every report interval to log triangle counts and GPU time with and without it
+		static constexpr bool COMPARE_LOD = true;
+		// Two-phase occlusion culling of the meshlets against a depth pyramid, needs the render graph and sampleable depth
+		static constexpr bool USE_OCCLUSION_CULLING = true;
+		// Alternates occlusion culling every second report interval to log the GPU time it saves
+		static constexpr bool COMPARE_OCCLUSION = true;
+		// Entity hierarchy animated every frame, SCENE_ROOTS * (1 + SCENE_CHILDREN * (1 + SCENE_GRANDCHILDREN)) transforms.
+		// Roots and children are drawn through a sorted draw list, grandchildren are transform-only
+		static constexpr bool USE_SCENE = true;
+		static constexpr uint32_t SCENE_ROOTS = 1024;
+		static constexpr uint32_t SCENE_CHILDREN = 32;
+		static constexpr uint32_t SCENE_GRANDCHILDREN = 31;
+		static constexpr uint32_t SCENE_REPORT_INTERVAL_FRAMES = 300;
+		// Immediate-mode lines and text, with wire boxes around every drawable scene entity as a stress test
+		static constexpr bool USE_DEBUG_DRAW = true;
+		static constexpr bool DEBUG_DRAW_SCENE_BOUNDS = true;
+		static constexpr uint32_t DEBUG_DRAW_MAX_VERTICES = 1u << 20;
+		// Textured sprites bouncing in screen space, every one animated and submitted each frame
+		static constexpr bool USE_SPRITES = true;
+		static constexpr uint32_t SPRITE_COUNT = 1u << 20;
+		static constexpr uint32_t SPRITE_LAYERS = 4;
+		static constexpr uint32_t SPRITE_ATLAS_PAGE_SIZE = 256;
+		static constexpr uint32_t SPRITE_ATLAS_PAGES = 2;
+		static constexpr float CAMERA_NEAR = 0.05f;
+		static constexpr float CAMERA_FAR = 50.0f;
+		// Recompile and swap pipelines when files in src/shaders change
+		static constexpr bool USE_SHADER_HOT_RELOAD = true;
+		// Per category and per heap device memory, with a warning once a heap reaches MEMORY_PRESSURE of its budget
+		static constexpr uint32_t MEMORY_REPORT_INTERVAL_FRAMES = 1800;
+		static constexpr float MEMORY_PRESSURE = 0.9f;
+		// Render this many frames offscreen at the window size and write them to OFFLINE_OUTPUT_DIRECTORY instead of
+		// running interactively, 0 runs interactively. Frames advance by a fixed OFFLINE_FRAME_DT
+		static constexpr uint32_t OFFLINE_FRAME_COUNT = 0;
+		static constexpr const char* OFFLINE_OUTPUT_DIRECTORY = "offline";
+		static constexpr OfflineImageFormat OFFLINE_IMAGE_FORMAT = OfflineImageFormat::Png;
+		// Readback buffers beyond the frames in flight let encoding fall behind before rendering has to wait
+		static constexpr uint32_t OFFLINE_READBACK_BUFFERS = 8;
+		static constexpr float OFFLINE_FRAME_DT = 1.0f / 60.0f;
+		// Write the draw list path (scene meshes, pipelines, materials and draws) of CAPTURE_FRAME_COUNT frames starting at
+		// CAPTURE_FIRST_FRAME to CAPTURE_PATH, for Replay.exe. 0 captures nothing
+		static constexpr uint32_t CAPTURE_FRAME_COUNT = 0;
+		static constexpr uint64_t CAPTURE_FIRST_FRAME = 600;
+		static constexpr const char* CAPTURE_PATH = "frame.cvlcap";
+		// Per-step timings of the parallel startup and the time to the first presented frame, written after that frame
+		static constexpr const char* STARTUP_REPORT_PATH = "startup_report.txt";
+		static constexpr double STARTUP_TARGET_MS = 200.0;
+		// Record, submit and present on a render thread fed frame packets by the main thread, which handles events and
+		// simulation. At most RENDER_QUEUE_DEPTH packets wait for the render thread. false renders the packets inline,
+		// so the overlap logged every RENDER_THREAD_REPORT_INTERVAL_FRAMES can be compared
+		static constexpr bool USE_RENDER_THREAD = true;
+		static constexpr uint32_t RENDER_QUEUE_DEPTH = 2;
+		static constexpr uint32_t RENDER_THREAD_REPORT_INTERVAL_FRAMES = 300;
 
 		Application();
 		~Application();
@@ -27,21 +145,154 @@ namespace cvl
 		void Run();
 
 	private:
+		// Render pipelines of one subsystem, step is the startup step creating the subsystem
+		struct PipelineBuild
+		{
+			std::string step;
+			std::function<void()> build;
+		};
+
+		void AddStartupSteps();
+		void PrecompileShaders();
 		void LoadModels();
+		void BuildClusterGeometry();
+		void LoadClusterMesh();
+		void LoadScene();
+		// Main thread
+		void SimulateFrame(FramePacket& packet, float dt, VkExtent2D extent);
+		void UpdateScene(float dt);
+		void GatherDrawables(FramePacket& packet);
+		void UpdateCamera(FramePacket& packet);
+		void MeasureRenderThread(const FramePacket& packet, double main_ms, double main_wait_ms, double frame_ms);
+		void StopRenderThread(std::thread& render_thread);
+		// Render thread, or the main thread when rendering inline or offline
+		void RenderLoop();
+		void RenderPacket(FramePacket& packet);
+		void SetFramePacket(const FramePacket& packet);
+		void BuildDrawList();
+		void DrawDebugOverlay();
+		void LoadSprites();
+		void UpdateSprites();
 		void CreatePipelineLayout();
 		void CreatePipeline();
+		void CreateScenePipelines();
+		std::vector<PipelineBuild> GetPipelineBuilds();
+		void DefaultSceneConfigInfo(PipelineConfigInfo& config_info);
 		void CreateCommandBuffers();
-		void FreeCommandBuffers();
-		void DrawFrame();
-		void RecreateSwapchain();
-		void RecordCommandBuffer(int image_index);
+		void RenderFrame(const FramePacket& packet);
+		void RunOffline();
+		void RecordOfflineFrame(const OfflineFrame& frame, QueueSubmission& submission);
+		// False while the surface is zero sized, the swap chain is recreated by a later frame then
+		bool RecreateSwapchain(VkExtent2D extent);
+		void UpdateOcclusionPyramid();
+		void BuildRenderGraph();
+		void RecordCommandBuffer(VkCommandBuffer command_buffer, int image_index);
+		void UpdateRenderScale();
+		void UpdateClusterLod();
+		void MeasureAsyncCompute();
+		void SetViewport(VkCommandBuffer command_buffer, VkRect2D render_area);
+		// Opaque geometry, whose depth the occlusion pyramid is built from
+		void RenderScene(VkCommandBuffer command_buffer, VkRect2D render_area);
+		// Meshlets found visible by the second cull phase, then everything that doesn't occlude
+		void RenderSceneLate(VkCommandBuffer command_buffer, VkRect2D render_area);
+		void BlitToSwapchain(VkCommandBuffer command_buffer, VkImage src, VkImage dst);
+		void BeginSwapchainRendering(VkCommandBuffer command_buffer, int image_index);
+		void EndSwapchainRendering(VkCommandBuffer command_buffer);
 
 		std::unique_ptr<CvlWindow> _cvl_window;
 		std::unique_ptr<CvlDevice> _cvl_device;
+		// Declared before everything holding pipelines so it is destroyed after them
+		std::unique_ptr<CvlPipelineCache> _pipeline_cache;
 		std::unique_ptr<CvlSwapchain> _cvl_swap_chain;
-		std::unique_ptr<CvlPipeline> _cvl_pipeline;
+		std::shared_ptr<CvlPipeline> _cvl_pipeline;
+		std::unique_ptr<CvlRenderGraph> _render_graph;
+		RenderGraphResource _graph_swap_chain_image = INVALID_RENDER_GRAPH_RESOURCE;
+		RenderGraphResource _graph_depth_image = INVALID_RENDER_GRAPH_RESOURCE;
+		RenderGraphResource _graph_scene_color = INVALID_RENDER_GRAPH_RESOURCE;
+		std::unique_ptr<CvlGpuTimer> _gpu_timer;
+		CvlDynamicResolution _dynamic_resolution;
+		bool _dynamic_resolution_active = false;
+		VkExtent2D _render_extent = {};
+
+		std::unique_ptr<CvlParticleSystem> _particle_system;
+		RenderGraphResource _graph_particles = INVALID_RENDER_GRAPH_RESOURCE;
+		double _async_compute_ms_sum = 0.0;
+		double _async_overlap_ms_sum = 0.0;
+		double _async_graphics_ms_sum = 0.0;
+		uint32_t _async_compute_samples = 0;
+		std::unique_ptr<CvlClusterMesh> _cluster_mesh;
+		// Built on a worker during startup and released once uploaded
+		std::unique_ptr<CvlClusterMesh::Geometry> _cluster_geometry;
+		RenderGraphResource _graph_cluster_indices = INVALID_RENDER_GRAPH_RESOURCE;
+		RenderGraphResource _graph_cluster_draws = INVALID_RENDER_GRAPH_RESOURCE;
+		RenderGraphResource _graph_cluster_occluded = INVALID_RENDER_GRAPH_RESOURCE;
+		// Rebuilt with the swap chain's depth image, the cluster mesh's descriptor set refers to it
+		std::unique_ptr<CvlHiZPyramid> _hiz_pyramid;
+		VkImageView _hiz_depth_view = VK_NULL_HANDLE;
+		VkExtent2D _hiz_depth_extent = {};
+		RenderGraphResource _graph_hiz = INVALID_RENDER_GRAPH_RESOURCE;
+		bool _occlusion_active = false;
+		std::unique_ptr<CvlThreadPool> _thread_pool;
+		// Kept until the first frame has been presented and the report written
+		std::unique_ptr<CvlStartupGraph> _startup_graph;
+		std::unique_ptr<CvlScene> _scene;
+		std::vector<Entity> _scene_roots;
+		float _scene_time = 0.0f;
+		std::vector<std::unique_ptr<CvlModel>> _scene_meshes;
+		// Material constants (tint) and the pipeline variant drawing each material
+		std::vector<glm::vec4> _scene_materials;
+		std::vector<uint32_t> _scene_material_pipelines;
+		std::vector<std::shared_ptr<CvlPipeline>> _scene_pipelines;
+		VkPipelineLayout _scene_pipeline_layout = VK_NULL_HANDLE;
+		std::unique_ptr<CvlDrawList> _draw_list;
+		std::unique_ptr<CvlFrameCapture> _frame_capture;
+		std::unique_ptr<CvlDebugDraw> _debug_draw;
+		// Declared before the batch, whose descriptor set references its texture
+		std::unique_ptr<CvlTextureAtlas> _sprite_atlas;
+		std::vector<AtlasHandle> _sprite_images;
+		std::unique_ptr<CvlSpriteBatch> _sprite_batch;
+		uint32_t _sprite_texture = 0;
+		std::vector<CvlSpriteBatch::Sprite> _sprites;
+		std::vector<glm::vec2> _sprite_velocities;
+		double _scene_update_ms_sum = 0.0;
+		uint32_t _scene_update_frames = 0;
+		float _camera_time = 0.0f;
+		std::optional<std::chrono::high_resolution_clock::time_point> _last_frame_time;
+
+		// One packet being simulated, RENDER_QUEUE_DEPTH queued and one being rendered
+		std::vector<std::unique_ptr<FramePacket>> _frame_packets;
+		// Main to render thread, nullptr stops the render thread
+		std::unique_ptr<CvlSpscQueue<FramePacket*>> _render_queue;
+		// Render to main thread, packets that may be simulated again
+		std::unique_ptr<CvlSpscQueue<FramePacket*>> _free_packets;
+		// Set once by the render thread, which then only returns packets until it is stopped
+		std::atomic<bool> _render_failed{ false };
+		std::exception_ptr _render_error;
+		double _main_ms_sum = 0.0;
+		double _main_wait_ms_sum = 0.0;
+		double _render_ms_sum = 0.0;
+		double _render_wait_ms_sum = 0.0;
+		double _frame_ms_sum = 0.0;
+		uint32_t _render_thread_frames = 0;
+
+		// Taken from the packet being rendered
+		const FramePacket* _render_packet = nullptr;
+		glm::vec3 _camera_eye = glm::vec3(0.0f);
+		glm::mat4 _view_proj = glm::mat4(1.0f);
+		float _frame_dt = 0.0f;
+		// Slot of the frame being recorded, per-frame resources everywhere are indexed by it
+		uint32_t _frame = 0;
+		// Frames drawn so far
+		uint64_t _frame_number = 0;
 		VkPipelineLayout _pipeline_layout;
 		std::vector<VkCommandBuffer> _command_buffers;
+		bool _use_dynamic_rendering = false;
+		// Pipelines are built from several threads during startup
+		std::atomic<uint32_t> _pipeline_build_count{ 0 };
+		std::optional<std::chrono::high_resolution_clock::time_point> _resize_start_time;
+		// Set when the swap chain has to be recreated but the window was minimized, frames are dropped until it succeeds
+		bool _swap_chain_recreate_pending = false;
+		uint32_t _memory_report_frames = 0;
 
 		std::unique_ptr<CvlModel> _cvl_model;
 	};
@@ -1,3 +1,15 @@
 C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\shader.vert -o shaders\shader.vert.spv
 C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\shader.frag -o shaders\shader.frag.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\particles.comp -o shaders\particles.comp.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\particles.vert -o shaders\particles.vert.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\particles.frag -o shaders\particles.frag.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\cluster_cull.comp -o shaders\cluster_cull.comp.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\mesh.vert -o shaders\mesh.vert.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\mesh.frag -o shaders\mesh.frag.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\scene.vert -o shaders\scene.vert.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\debug.vert -o shaders\debug.vert.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\debug.frag -o shaders\debug.frag.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\sprite.vert -o shaders\sprite.vert.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\sprite.frag -o shaders\sprite.frag.spv
+C:\VulkanSDK\1.3.239.0\Bin\glslc.exe shaders\hiz_build.comp -o shaders\hiz_build.comp.spv
 pause
\ No newline at end of file
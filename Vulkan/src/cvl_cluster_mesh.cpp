@@ -0,0 +1,814 @@
+#include "cvl_cluster_mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <iostream>
+#include <stdexcept>
+
+namespace cvl
+{
+	struct ClusterCullPushConstants
+	{
+		glm::vec4 frustum[6];
+		glm::vec4 eye;		// w = 1 when backface culling is enabled
+		uint32_t meshlet_offset;
+		uint32_t meshlet_count;
+		uint32_t slot;
+		uint32_t phase;		// 0: Cull(), 1: CullOccluded()
+	};
+
+	/* CvlClusterMesh class */
+	CvlClusterMesh::CvlClusterMesh
+	(
+		CvlDevice& device,
+		CvlPipelineCache& pipeline_cache,
+		const std::vector<Vertex>& vertices,
+		const std::vector<uint32_t>& indices,
+		uint32_t frame_count
+	) : CvlClusterMesh(device, pipeline_cache, BuildGeometry(vertices, indices), frame_count)
+	{
+	}
+
+	CvlClusterMesh::CvlClusterMesh
+	(
+		CvlDevice& device,
+		CvlPipelineCache& pipeline_cache,
+		const Geometry& geometry,
+		uint32_t frame_count
+	) : _cvl_device(device), _pipeline_cache(pipeline_cache), _frame_count(frame_count), _draw_slot_used(frame_count, false),
+		_draw_slot_lod(frame_count, 0), _draw_slot_occlusion(frame_count, false), _gpu_timer(device, frame_count, 8)
+	{
+		CreateBuffers(geometry);
+		CreateOcclusionPlaceholder();
+		CreateDescriptors();
+		CreateCullPipeline();
+	}
+
+	CvlClusterMesh::~CvlClusterMesh()
+	{
+		_cull_pipeline.reset();
+		_render_pipeline.reset();
+		_pipeline_cache.ReleasePipelines(_cull_pipeline_layout);
+		_pipeline_cache.ReleasePipelines(_render_pipeline_layout);
+		vkDestroyPipelineLayout(_cvl_device.device(), _cull_pipeline_layout, _cvl_device.GetAllocator());
+		vkDestroyPipelineLayout(_cvl_device.device(), _render_pipeline_layout, _cvl_device.GetAllocator());
+		vkDestroyDescriptorPool(_cvl_device.device(), _descriptor_pool, _cvl_device.GetAllocator());
+		vkDestroyDescriptorSetLayout(_cvl_device.device(), _descriptor_set_layout, _cvl_device.GetAllocator());
+		vkDestroySampler(_cvl_device.device(), _occlusion_sampler, _cvl_device.GetAllocator());
+		vkDestroyImageView(_cvl_device.device(), _placeholder_view, _cvl_device.GetAllocator());
+		vkDestroyImage(_cvl_device.device(), _placeholder_image, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(_placeholder_image_memory);
+
+		vkUnmapMemory(_cvl_device.device(), _draw_buffer_memory);
+		vkUnmapMemory(_cvl_device.device(), _occlusion_params_buffer_memory);
+		VkBuffer buffers[] =
+		{
+			_vertex_buffer, _meshlet_buffer, _index_buffer, _visible_index_buffer, _draw_buffer, _occluded_buffer, _occlusion_params_buffer
+		};
+		VkDeviceMemory memories[] =
+		{
+			_vertex_buffer_memory, _meshlet_buffer_memory, _index_buffer_memory, _visible_index_buffer_memory, _draw_buffer_memory,
+			_occluded_buffer_memory, _occlusion_params_buffer_memory
+		};
+		for (size_t i = 0; i < std::size(buffers); ++i)
+		{
+			vkDestroyBuffer(_cvl_device.device(), buffers[i], _cvl_device.GetAllocator());
+			_cvl_device.FreeMemory(memories[i]);
+		}
+	}
+
+	void CvlClusterMesh::CreateRenderPipeline(PipelineConfigInfo& config_info)
+	{
+		config_info.binding_descriptions = GetBindingDescriptions<Vertex>();
+		config_info.attribute_descriptions = GetAttributeDescriptions<Vertex>();
+		config_info.pipeline_layout = _render_pipeline_layout;
+		_render_pipeline = _pipeline_cache.GetGraphicsPipeline(config_info, "src\\shaders\\mesh.vert", "src\\shaders\\mesh.frag");
+	}
+
+	void CvlClusterMesh::Cull(VkCommandBuffer command_buffer, uint32_t frame, const glm::mat4& view_proj, const glm::vec3& eye)
+	{
+		_gpu_timer.BeginFrame(command_buffer, frame);
+		CollectStats(frame);
+
+		// The slots' previous frame has completed, so the host can reset them without synchronization
+		for (uint32_t slot = frame * 2; slot < frame * 2 + 2; ++slot)
+		{
+			_draw_data[slot] = {};
+			_draw_data[slot].draw.instanceCount = 1;
+		}
+		_draw_slot_used[frame] = true;
+		_draw_slot_lod[frame] = GetActiveLod();
+		_draw_slot_occlusion[frame] = _occlusion_pyramid != nullptr && _occlusion_culling;
+		const LodLevel& lod = _lods[GetActiveLod()];
+		// Tested against last frame's pyramid, seen through last frame's camera
+		WriteOcclusionParams(frame * 2, frame, _draw_slot_occlusion[frame] && _occlusion_pyramid->IsBuilt());
+
+		// Frustum planes from the rows of the view projection (Gribb/Hartmann), depth range [0, 1]
+		ClusterCullPushConstants push = {};
+		auto row = [&view_proj](int i) { return glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]); };
+		push.frustum[0] = row(3) + row(0);
+		push.frustum[1] = row(3) - row(0);
+		push.frustum[2] = row(3) + row(1);
+		push.frustum[3] = row(3) - row(1);
+		push.frustum[4] = row(2);
+		push.frustum[5] = row(3) - row(2);
+		for (glm::vec4& plane : push.frustum)
+		{
+			plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+		}
+		push.eye = glm::vec4(eye, _backface_culling ? 1.0f : 0.0f);
+		push.meshlet_offset = lod.first_meshlet;
+		push.meshlet_count = lod.meshlet_count;
+		push.slot = frame * 2;
+		push.phase = 0;
+
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		_cull_pipeline->Bind(command_buffer);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline_layout, 0, 1, &_descriptor_set, 0, nullptr);
+		vkCmdPushConstants(command_buffer, _cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+		_cull_pipeline->Dispatch(command_buffer, CvlPipeline::GroupCount(lod.meshlet_count, WORKGROUP_SIZE));
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+
+	void CvlClusterMesh::Draw(VkCommandBuffer command_buffer, uint32_t frame, const glm::mat4& view_proj)
+	{
+		if (_render_pipeline == nullptr)
+		{
+			return;
+		}
+		_render_pipeline->Bind(command_buffer);
+		vkCmdPushConstants(command_buffer, _render_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(view_proj), &view_proj);
+		VkBuffer buffers[] = { _vertex_buffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, buffers, offsets);
+		vkCmdBindIndexBuffer(command_buffer, _visible_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+		// Timestamps inside rendering only approximate the draw's cost, good enough to compare LOD on and off
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		vkCmdDrawIndexedIndirect(command_buffer, _draw_buffer, sizeof(DrawData) * frame * 2, 1, sizeof(DrawData));
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	}
+
+	void CvlClusterMesh::SetOcclusionPyramid(CvlHiZPyramid* pyramid)
+	{
+		_occlusion_pyramid = pyramid;
+		UpdateOcclusionDescriptor();
+	}
+
+	void CvlClusterMesh::CullOccluded(VkCommandBuffer command_buffer, uint32_t frame)
+	{
+		if (_occlusion_pyramid == nullptr)
+		{
+			return;
+		}
+		// The pyramid now holds this frame's early draw, the deferred meshlets that show up in it are drawn late
+		WriteOcclusionParams(frame * 2 + 1, frame, _draw_slot_occlusion[frame]);
+
+		ClusterCullPushConstants push = {};
+		push.slot = frame * 2 + 1;
+		push.phase = 1;
+
+		// Deferred meshlets come from the LOD culled in the first phase, their count is only known on the GPU
+		uint32_t meshlet_count = _lods[_draw_slot_lod[frame]].meshlet_count;
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		_cull_pipeline->Bind(command_buffer);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cull_pipeline_layout, 0, 1, &_descriptor_set, 0, nullptr);
+		vkCmdPushConstants(command_buffer, _cull_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+		_cull_pipeline->Dispatch(command_buffer, CvlPipeline::GroupCount(meshlet_count, WORKGROUP_SIZE));
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+
+	void CvlClusterMesh::DrawOccluded(VkCommandBuffer command_buffer, uint32_t frame, const glm::mat4& view_proj)
+	{
+		if (_render_pipeline == nullptr || _occlusion_pyramid == nullptr)
+		{
+			return;
+		}
+		_render_pipeline->Bind(command_buffer);
+		vkCmdPushConstants(command_buffer, _render_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(view_proj), &view_proj);
+		VkBuffer buffers[] = { _vertex_buffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, buffers, offsets);
+		vkCmdBindIndexBuffer(command_buffer, _visible_index_buffer, 0, VK_INDEX_TYPE_UINT32);
+		// The late slot's first index follows the early slot's indices, set by the second cull phase
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		vkCmdDrawIndexedIndirect(command_buffer, _draw_buffer, sizeof(DrawData) * (frame * 2 + 1), 1, sizeof(DrawData));
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	}
+
+	void CvlClusterMesh::UpdateLod(const glm::vec3& eye, float pixels_per_unit)
+	{
+		float distance = std::max(glm::length(eye - _bounds_center) - _bounds_radius, 1e-3f);
+		auto error_pixels = [&](uint32_t level) { return _lods[level].error * pixels_per_unit / distance; };
+
+		// One level per frame at most, finer when the current error shows, coarser when the next one is well hidden
+		if (_current_lod > 0 && error_pixels(_current_lod) > LOD_ERROR_PIXELS)
+		{
+			--_current_lod;
+		}
+		else if (_current_lod + 1 < _lods.size() && error_pixels(_current_lod + 1) < LOD_ERROR_PIXELS * LOD_HYSTERESIS)
+		{
+			++_current_lod;
+		}
+	}
+
+	void CvlClusterMesh::RecordPreCullBarrier(VkCommandBuffer command_buffer)
+	{
+		// The previous frame's index fetch must be done before the compacted indices are overwritten
+		vkCmdPipelineBarrier
+		(
+			command_buffer,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			0, nullptr
+		);
+	}
+
+	void CvlClusterMesh::RecordPostCullBarrier(VkCommandBuffer command_buffer)
+	{
+		VkBufferMemoryBarrier barriers[2] = {};
+		for (VkBufferMemoryBarrier& barrier : barriers)
+		{
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.offset = 0;
+			barrier.size = VK_WHOLE_SIZE;
+		}
+		barriers[0].dstAccessMask = VK_ACCESS_INDEX_READ_BIT;
+		barriers[0].buffer = _visible_index_buffer;
+		barriers[1].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		barriers[1].buffer = _draw_buffer;
+
+		vkCmdPipelineBarrier
+		(
+			command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			0,
+			0, nullptr,
+			2, barriers,
+			0, nullptr
+		);
+	}
+
+	CvlClusterMesh::Geometry CvlClusterMesh::BuildGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		auto start_time = std::chrono::high_resolution_clock::now();
+		std::vector<glm::vec3> positions(vertices.size());
+		std::vector<glm::vec3> normals(vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			positions[i] = vertices[i].pos;
+			normals[i] = vertices[i].normal;
+		}
+		std::vector<MeshLod> lod_chain = BuildLodChain(positions, normals, indices, MAX_LOD_LEVELS);
+		auto lod_time = std::chrono::high_resolution_clock::now();
+
+		// Every level is split into meshlets separately, the levels follow each other in both buffers
+		Geometry geometry;
+		geometry.vertices = vertices;
+		glm::vec3 min(std::numeric_limits<float>::max());
+		glm::vec3 max(-std::numeric_limits<float>::max());
+		for (const MeshLod& level : lod_chain)
+		{
+			MeshletData meshlets = BuildMeshlets(positions, level.indices);
+			std::vector<uint32_t> level_indices = GetMeshletIndices(meshlets);
+
+			LodLevel lod = {};
+			lod.first_meshlet = static_cast<uint32_t>(geometry.cull_data.size());
+			lod.meshlet_count = static_cast<uint32_t>(meshlets.meshlets.size());
+			lod.index_count = static_cast<uint32_t>(level_indices.size());
+			lod.error = level.error;
+			uint32_t index_base = static_cast<uint32_t>(geometry.meshlet_indices.size());
+			for (uint32_t i = 0; i < lod.meshlet_count; ++i)
+			{
+				const MeshletBounds& bounds = meshlets.bounds[i];
+				MeshletCullData data = {};
+				data.sphere = glm::vec4(bounds.center, bounds.radius);
+				data.cone = glm::vec4(bounds.cone_axis, bounds.cone_cutoff);
+				data.index_offset = index_base + meshlets.meshlets[i].triangle_offset;
+				data.index_count = meshlets.meshlets[i].triangle_count * 3;
+				geometry.cull_data.push_back(data);
+				min = glm::min(min, bounds.center - glm::vec3(bounds.radius));
+				max = glm::max(max, bounds.center + glm::vec3(bounds.radius));
+			}
+			geometry.meshlet_indices.insert(geometry.meshlet_indices.end(), level_indices.begin(), level_indices.end());
+			geometry.lods.push_back(lod);
+		}
+		geometry.bounds_center = (min + max) * 0.5f;
+		geometry.bounds_radius = glm::length(max - min) * 0.5f;
+		auto end_time = std::chrono::high_resolution_clock::now();
+
+		std::cout << "[CvlClusterMesh] " << geometry.lods.size() << " LOD levels built in "
+			<< std::chrono::duration<double, std::milli>(lod_time - start_time).count() << " ms, meshlets in "
+			<< std::chrono::duration<double, std::milli>(end_time - lod_time).count() << " ms\n";
+		for (size_t i = 0; i < geometry.lods.size(); ++i)
+		{
+			std::cout << "[CvlClusterMesh]   LOD " << i << ": " << geometry.lods[i].index_count / 3 << " triangles in "
+				<< geometry.lods[i].meshlet_count << " meshlets, error " << geometry.lods[i].error << '\n';
+		}
+		return geometry;
+	}
+
+	CvlClusterMesh::Geometry CvlClusterMesh::LoadOrBuildGeometry(const std::string& geometry_fp, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		uint64_t source_hash = GetSourceHash(vertices, indices);
+		Geometry geometry;
+		if (LoadGeometry(geometry_fp, source_hash, geometry))
+		{
+			std::cout << "[CvlClusterMesh] Loaded " << geometry.lods.size() << " LOD levels, " << geometry.cull_data.size()
+				<< " meshlets from " << geometry_fp << '\n';
+			return geometry;
+		}
+		geometry = BuildGeometry(vertices, indices);
+		SaveGeometry(geometry_fp, source_hash, geometry);
+		return geometry;
+	}
+
+	// private
+	uint64_t CvlClusterMesh::GetSourceHash(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		// FNV-1a over the mesh and the limits the build depends on
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash](const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; ++i)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		};
+		const uint32_t limits[] = { MAX_LOD_LEVELS, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES };
+		add(limits, sizeof(limits));
+		add(vertices.data(), vertices.size() * sizeof(Vertex));
+		add(indices.data(), indices.size() * sizeof(uint32_t));
+		return hash;
+	}
+
+	bool CvlClusterMesh::LoadGeometry(const std::string& geometry_fp, uint64_t source_hash, Geometry& geometry)
+	{
+		std::ifstream ifs(geometry_fp, std::ios::binary);
+		if (!ifs.is_open())
+		{
+			return false;
+		}
+		uint32_t magic = 0;
+		uint32_t version = 0;
+		uint64_t hash = 0;
+		ifs.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+		ifs.read(reinterpret_cast<char*>(&version), sizeof(version));
+		ifs.read(reinterpret_cast<char*>(&hash), sizeof(hash));
+		if (!ifs || magic != GEOMETRY_FILE_MAGIC || version != GEOMETRY_FILE_VERSION || hash != source_hash)
+		{
+			std::cout << "[CvlClusterMesh] " << geometry_fp << " was built from another mesh or version, rebuilding\n";
+			return false;
+		}
+
+		// A truncated file fails the stream, counts are bounded by what is left of it
+		ifs.seekg(0, std::ios::end);
+		uint64_t file_size = static_cast<uint64_t>(ifs.tellg());
+		ifs.seekg(sizeof(magic) + sizeof(version) + sizeof(hash));
+		auto read_array = [&ifs, file_size](auto& values)
+		{
+			uint32_t count = 0;
+			ifs.read(reinterpret_cast<char*>(&count), sizeof(count));
+			if (!ifs || count > file_size / sizeof(values[0]))
+			{
+				return false;
+			}
+			values.resize(count);
+			ifs.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(count * sizeof(values[0])));
+			return static_cast<bool>(ifs);
+		};
+		if (!read_array(geometry.vertices) || !read_array(geometry.cull_data) || !read_array(geometry.meshlet_indices) || !read_array(geometry.lods))
+		{
+			std::cout << "[CvlClusterMesh] " << geometry_fp << " is truncated, rebuilding\n";
+			return false;
+		}
+		ifs.read(reinterpret_cast<char*>(&geometry.bounds_center), sizeof(geometry.bounds_center));
+		ifs.read(reinterpret_cast<char*>(&geometry.bounds_radius), sizeof(geometry.bounds_radius));
+		return static_cast<bool>(ifs) && !geometry.lods.empty();
+	}
+
+	void CvlClusterMesh::SaveGeometry(const std::string& geometry_fp, uint64_t source_hash, const Geometry& geometry)
+	{
+		std::ofstream ofs(geometry_fp, std::ios::binary | std::ios::trunc);
+		if (!ofs.is_open())
+		{
+			std::cout << "[CvlClusterMesh] Failed to write " << geometry_fp << '\n';
+			return;
+		}
+		auto write_array = [&ofs](const auto& values)
+		{
+			uint32_t count = static_cast<uint32_t>(values.size());
+			ofs.write(reinterpret_cast<const char*>(&count), sizeof(count));
+			ofs.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(count * sizeof(values[0])));
+		};
+		ofs.write(reinterpret_cast<const char*>(&GEOMETRY_FILE_MAGIC), sizeof(GEOMETRY_FILE_MAGIC));
+		ofs.write(reinterpret_cast<const char*>(&GEOMETRY_FILE_VERSION), sizeof(GEOMETRY_FILE_VERSION));
+		ofs.write(reinterpret_cast<const char*>(&source_hash), sizeof(source_hash));
+		write_array(geometry.vertices);
+		write_array(geometry.cull_data);
+		write_array(geometry.meshlet_indices);
+		write_array(geometry.lods);
+		ofs.write(reinterpret_cast<const char*>(&geometry.bounds_center), sizeof(geometry.bounds_center));
+		ofs.write(reinterpret_cast<const char*>(&geometry.bounds_radius), sizeof(geometry.bounds_radius));
+		std::cout << "[CvlClusterMesh] Wrote " << geometry_fp << " for the next run\n";
+	}
+
+	void CvlClusterMesh::CreateBuffers(const Geometry& geometry)
+	{
+		_lods = geometry.lods;
+		for (const LodLevel& lod : _lods)
+		{
+			_max_lod_meshlets = std::max(_max_lod_meshlets, lod.meshlet_count);
+		}
+		_bounds_center = geometry.bounds_center;
+		_bounds_radius = geometry.bounds_radius;
+
+		CreateDeviceLocalBuffer
+		(
+			geometry.vertices.data(), sizeof(Vertex) * geometry.vertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, _vertex_buffer, _vertex_buffer_memory
+		);
+		CreateDeviceLocalBuffer
+		(
+			geometry.cull_data.data(), sizeof(MeshletCullData) * geometry.cull_data.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _meshlet_buffer, _meshlet_buffer_memory
+		);
+		CreateDeviceLocalBuffer
+		(
+			geometry.meshlet_indices.data(), sizeof(uint32_t) * geometry.meshlet_indices.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, _index_buffer, _index_buffer_memory
+		);
+		// Written by the cull pass every frame, sized for the case where nothing is culled
+		_cvl_device.CreateBuffer
+		(
+			GetVisibleIndexBufferSize(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Geometry,
+			_visible_index_buffer,
+			_visible_index_buffer_memory
+		);
+		// Small and reset by the host every frame, stays mapped
+		_cvl_device.CreateBuffer
+		(
+			GetDrawBufferSize(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Geometry,
+			_draw_buffer,
+			_draw_buffer_memory
+		);
+		vkMapMemory(_cvl_device.device(), _draw_buffer_memory, 0, GetDrawBufferSize(), 0, reinterpret_cast<void**>(&_draw_data));
+		memset(_draw_data, 0, static_cast<size_t>(GetDrawBufferSize()));
+
+		// Meshlets deferred by the first phase, one list per frame in flight sized for the largest LOD
+		_cvl_device.CreateBuffer
+		(
+			GetOccludedBufferSize(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Geometry,
+			_occluded_buffer,
+			_occluded_buffer_memory
+		);
+		// Written by the host while recording, one entry per draw slot
+		VkDeviceSize params_size = sizeof(OcclusionParams) * 2 * _frame_count;
+		_cvl_device.CreateBuffer
+		(
+			params_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Geometry,
+			_occlusion_params_buffer,
+			_occlusion_params_buffer_memory
+		);
+		vkMapMemory(_cvl_device.device(), _occlusion_params_buffer_memory, 0, params_size, 0, reinterpret_cast<void**>(&_occlusion_params));
+		std::fill_n(_occlusion_params, 2 * _frame_count, OcclusionParams{});
+	}
+
+	void CvlClusterMesh::CreateDeviceLocalBuffer
+	(
+		const void* data,
+		VkDeviceSize size,
+		VkBufferUsageFlags usage,
+		VkBuffer& buffer,
+		VkDeviceMemory& memory
+	)
+	{
+		VkBuffer staging_buffer;
+		VkDeviceMemory staging_buffer_memory;
+		_cvl_device.CreateBuffer
+		(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging,
+			staging_buffer,
+			staging_buffer_memory
+		);
+		void* mapped;
+		vkMapMemory(_cvl_device.device(), staging_buffer_memory, 0, size, 0, &mapped);
+		memcpy(mapped, data, static_cast<size_t>(size));
+		vkUnmapMemory(_cvl_device.device(), staging_buffer_memory);
+
+		_cvl_device.CreateBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Geometry, buffer, memory);
+		_cvl_device.CopyBuffer(staging_buffer, buffer, size);
+
+		vkDestroyBuffer(_cvl_device.device(), staging_buffer, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(staging_buffer_memory);
+	}
+
+	void CvlClusterMesh::CreateDescriptors()
+	{
+		// 0: meshlet bounds, 1: indices in meshlet order, 2: compacted indices, 3: draw slots,
+		// 4: deferred meshlets, 5: occlusion params, 6: depth pyramid
+		VkDescriptorSetLayoutBinding bindings[7] = {};
+		for (uint32_t i = 0; i < 7; ++i)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = i < 6 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layout_info = {};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = 7;
+		layout_info.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(_cvl_device.device(), &layout_info, _cvl_device.GetAllocator(), &_descriptor_set_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlClusterMesh] Failed to create descriptor set layout!");
+		}
+
+		VkDescriptorPoolSize pool_sizes[2] = {};
+		pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		pool_sizes[0].descriptorCount = 6;
+		pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_sizes[1].descriptorCount = 1;
+
+		VkDescriptorPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = 1;
+		pool_info.poolSizeCount = 2;
+		pool_info.pPoolSizes = pool_sizes;
+		if (vkCreateDescriptorPool(_cvl_device.device(), &pool_info, _cvl_device.GetAllocator(), &_descriptor_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlClusterMesh] Failed to create descriptor pool!");
+		}
+
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = _descriptor_pool;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &_descriptor_set_layout;
+		if (vkAllocateDescriptorSets(_cvl_device.device(), &alloc_info, &_descriptor_set) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlClusterMesh] Failed to allocate descriptor set!");
+		}
+
+		VkBuffer buffers[] =
+		{
+			_meshlet_buffer, _index_buffer, _visible_index_buffer, _draw_buffer, _occluded_buffer, _occlusion_params_buffer
+		};
+		VkDescriptorBufferInfo buffer_infos[6] = {};
+		VkWriteDescriptorSet writes[6] = {};
+		for (uint32_t i = 0; i < 6; ++i)
+		{
+			buffer_infos[i].buffer = buffers[i];
+			buffer_infos[i].offset = 0;
+			buffer_infos[i].range = VK_WHOLE_SIZE;
+
+			writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[i].dstSet = _descriptor_set;
+			writes[i].dstBinding = i;
+			writes[i].descriptorCount = 1;
+			writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[i].pBufferInfo = &buffer_infos[i];
+		}
+		vkUpdateDescriptorSets(_cvl_device.device(), 6, writes, 0, nullptr);
+		UpdateOcclusionDescriptor();
+	}
+
+	void CvlClusterMesh::CreateCullPipeline()
+	{
+		VkPushConstantRange cull_push_range = {};
+		cull_push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		cull_push_range.offset = 0;
+		cull_push_range.size = sizeof(ClusterCullPushConstants);
+
+		VkPipelineLayoutCreateInfo cull_layout_info = {};
+		cull_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		cull_layout_info.setLayoutCount = 1;
+		cull_layout_info.pSetLayouts = &_descriptor_set_layout;
+		cull_layout_info.pushConstantRangeCount = 1;
+		cull_layout_info.pPushConstantRanges = &cull_push_range;
+		if (vkCreatePipelineLayout(_cvl_device.device(), &cull_layout_info, _cvl_device.GetAllocator(), &_cull_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlClusterMesh] Failed to create cull pipeline layout!");
+		}
+
+		// Drawing only needs the view projection
+		VkPushConstantRange render_push_range = {};
+		render_push_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		render_push_range.offset = 0;
+		render_push_range.size = sizeof(glm::mat4);
+
+		VkPipelineLayoutCreateInfo render_layout_info = {};
+		render_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		render_layout_info.pushConstantRangeCount = 1;
+		render_layout_info.pPushConstantRanges = &render_push_range;
+		if (vkCreatePipelineLayout(_cvl_device.device(), &render_layout_info, _cvl_device.GetAllocator(), &_render_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlClusterMesh] Failed to create render pipeline layout!");
+		}
+
+		SpecializationConstants specialization;
+		specialization.Set(0, WORKGROUP_SIZE);
+		_cull_pipeline = _pipeline_cache.GetComputePipeline(_cull_pipeline_layout, "src\\shaders\\cluster_cull.comp", specialization);
+	}
+
+	void CvlClusterMesh::CreateOcclusionPlaceholder()
+	{
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = CvlHiZPyramid::FORMAT;
+		image_info.extent = { 1, 1, 1 };
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		_cvl_device.CreateImageWithInfo(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Textures, _placeholder_image, _placeholder_image_memory);
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = _placeholder_image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = CvlHiZPyramid::FORMAT;
+		view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &_placeholder_view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlClusterMesh] Failed to create placeholder image view!");
+		}
+
+		// Pyramid texels are fetched per level, never filtered
+		VkSamplerCreateInfo sampler_info = {};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = VK_FILTER_NEAREST;
+		sampler_info.minFilter = VK_FILTER_NEAREST;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(_cvl_device.device(), &sampler_info, _cvl_device.GetAllocator(), &_occlusion_sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlClusterMesh] Failed to create occlusion sampler!");
+		}
+
+		// Sampled in GENERAL like the pyramid, its contents are never read
+		VkCommandBuffer command_buffer = _cvl_device.BeginSingleTimeCommands();
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = _placeholder_image;
+		barrier.subresourceRange = view_info.subresourceRange;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		_cvl_device.EndSingleTimeCommands(command_buffer);
+	}
+
+	void CvlClusterMesh::UpdateOcclusionDescriptor()
+	{
+		VkDescriptorImageInfo image_info = {};
+		image_info.sampler = _occlusion_sampler;
+		image_info.imageView = _occlusion_pyramid != nullptr ? _occlusion_pyramid->GetImageView() : _placeholder_view;
+		image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = _descriptor_set;
+		write.dstBinding = 6;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &image_info;
+		vkUpdateDescriptorSets(_cvl_device.device(), 1, &write, 0, nullptr);
+	}
+
+	void CvlClusterMesh::WriteOcclusionParams(uint32_t slot, uint32_t frame, bool enabled)
+	{
+		// The slot's previous frame has completed, like the draw slots
+		OcclusionParams& params = _occlusion_params[slot];
+		params = {};
+		params.enabled = enabled ? 1 : 0;
+		params.occluded_offset = frame * _max_lod_meshlets;
+		if (enabled)
+		{
+			VkExtent2D render_size = _occlusion_pyramid->GetBuildExtent();
+			params.view_proj = _occlusion_pyramid->GetBuildViewProj();
+			params.render_size = glm::ivec2(render_size.width, render_size.height);
+			params.levels = static_cast<int32_t>(_occlusion_pyramid->GetMipLevels());
+		}
+	}
+
+	void CvlClusterMesh::CollectStats(uint32_t frame)
+	{
+		if (!_draw_slot_used[frame])
+		{
+			return;
+		}
+		const DrawData& early = _draw_data[frame * 2];
+		const DrawData& late = _draw_data[frame * 2 + 1];
+		const LodLevel& lod = _lods[_draw_slot_lod[frame]];
+		_stats_meshlets += lod.meshlet_count;
+		_stats_frustum_culled += early.frustum_culled;
+		_stats_backface_culled += early.backface_culled;
+		_stats_deferred += early.occlusion_culled;
+		_stats_occlusion_culled += late.occlusion_culled;
+		_stats_lod_triangles += lod.index_count / 3;
+		_stats_visible_triangles += (early.draw.indexCount + late.draw.indexCount) / 3;
+		_stats_lod_sum += _draw_slot_lod[frame];
+		_cull_ms_sum += _gpu_timer.GetElapsedMs(0, 1).value_or(0.0);
+		_draw_ms_sum += _gpu_timer.GetElapsedMs(2, 3).value_or(0.0);
+		_recull_ms_sum += _gpu_timer.GetElapsedMs(4, 5).value_or(0.0);
+		_late_draw_ms_sum += _gpu_timer.GetElapsedMs(6, 7).value_or(0.0);
+		if (_occlusion_pyramid != nullptr)
+		{
+			// From the pyramid's own timer, one build behind, close enough for an average
+			_hiz_ms_sum += _occlusion_pyramid->GetBuildMs().value_or(0.0);
+		}
+		if (++_stats_frames < REPORT_INTERVAL_FRAMES)
+		{
+			return;
+		}
+
+		double frames = static_cast<double>(_stats_frames);
+		double meshlets = static_cast<double>(_stats_meshlets);
+		double full_triangles = static_cast<double>(_lods[0].index_count / 3) * frames;
+		std::cout << "[CvlClusterMesh] LOD " << (_lod_enabled ? "on" : "off") << " (average level " << _stats_lod_sum / frames
+			<< "): " << _stats_lod_triangles / frames << " of " << _lods[0].index_count / 3 << " triangles after LOD, "
+			<< 100.0 * _stats_frustum_culled / meshlets << "% of meshlets frustum culled, "
+			<< 100.0 * _stats_backface_culled / meshlets << "% backface culled, "
+			<< _stats_visible_triangles / frames << " triangles drawn ("
+			<< 100.0 * (1.0 - _stats_visible_triangles / full_triangles) << "% rejected), cull "
+			<< _cull_ms_sum / frames << " ms, draw " << _draw_ms_sum / frames << " ms\n";
+		if (_occlusion_pyramid != nullptr)
+		{
+			// The pyramid is built either way, only count it when something is tested against it
+			bool occlusion = _occlusion_culling;
+			double gpu_ms = (_cull_ms_sum + _draw_ms_sum + _recull_ms_sum + _late_draw_ms_sum + (occlusion ? _hiz_ms_sum : 0.0)) / frames;
+			double& same_state = _report_gpu_ms[_lod_enabled ? 1 : 0][occlusion ? 1 : 0];
+			double other_state = _report_gpu_ms[_lod_enabled ? 1 : 0][occlusion ? 0 : 1];
+			same_state = gpu_ms;
+			std::cout << "[CvlClusterMesh] Occlusion " << (occlusion ? "on" : "off") << ": "
+				<< 100.0 * _stats_deferred / meshlets << "% of meshlets deferred by the first phase, "
+				<< (_stats_deferred > 0 ? 100.0 * (_stats_deferred - _stats_occlusion_culled) / _stats_deferred : 0.0)
+				<< "% of those drawn late, " << 100.0 * _stats_occlusion_culled / meshlets << "% occluded, recull "
+				<< _recull_ms_sum / frames << " ms, late draw " << _late_draw_ms_sum / frames << " ms, pyramid "
+				<< _hiz_ms_sum / frames << " ms, " << gpu_ms << " ms GPU in total";
+			if (other_state > 0.0)
+			{
+				double saved = occlusion ? other_state - gpu_ms : gpu_ms - other_state;
+				std::cout << ", occlusion culling saves " << saved << " ms at this LOD setting";
+			}
+			std::cout << '\n';
+		}
+		_stats_meshlets = 0;
+		_stats_frustum_culled = 0;
+		_stats_backface_culled = 0;
+		_stats_deferred = 0;
+		_stats_occlusion_culled = 0;
+		_stats_lod_triangles = 0;
+		_stats_visible_triangles = 0;
+		_stats_lod_sum = 0;
+		_cull_ms_sum = 0.0;
+		_draw_ms_sum = 0.0;
+		_recull_ms_sum = 0.0;
+		_late_draw_ms_sum = 0.0;
+		_hiz_ms_sum = 0.0;
+		_stats_frames = 0;
+		if (_lod_comparison)
+		{
+			_lod_enabled = !_lod_enabled;
+		}
+		if (_occlusion_comparison && ++_stats_reports % 2 == 0)
+		{
+			_occlusion_culling = !_occlusion_culling;
+		}
+	}
+	/* ~CvlClusterMesh class */
+}
\ No newline at end of file
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_pipeline.h"
+#include "cvl_pipeline_cache.h"
+#include "cvl_gpu_timer.h"
+#include "cvl_hiz_pyramid.h"
+#include "cvl_meshlet.h"
+#include "cvl_mesh_simplifier.h"
+#include "cvl_vertex_layout.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Indexed mesh split into meshlets. Every frame a compute pass tests each meshlet's bounding sphere
+		against the frustum and its normal cone against the eye, then appends the indices of the surviving
+		meshlets to a compacted index buffer drawn with a single indexed indirect draw.
+		A QEM simplified LOD chain shares the vertex buffer, the levels' meshlets follow each other in one
+		meshlet and index buffer and UpdateLod() picks the level whose error stays below a pixel on screen.
+		This is the only mesh with a LOD chain: CvlModel is an unindexed 2D triangle list of a few vertices,
+		so there is nothing for the simplifier to collapse.
+		With an occlusion pyramid set, culling runs in two phases. Cull() also tests the meshlets against the pyramid
+		built last frame and defers the occluded ones to a list instead of drawing them. Once the early draw has been
+		rendered and the pyramid rebuilt from its depth, CullOccluded() tests the deferred meshlets again and
+		DrawOccluded() draws the ones that turned out visible, so nothing disoccluded since last frame pops in late.
+		Cull() and Draw() don't record barriers, the render graph derives them from the declared usage.
+	*/
+	class CvlClusterMesh
+	{
+	public:
+		struct Vertex
+		{
+			glm::vec3 pos;
+			glm::vec3 normal;
+		};
+
+		// std430 layout, matches shaders/cluster_cull.comp
+		struct DrawData
+		{
+			VkDrawIndexedIndirectCommand draw;
+			uint32_t visible_meshlets;
+			uint32_t frustum_culled;
+			uint32_t backface_culled;
+			uint32_t occlusion_culled;
+		};
+
+		// std430 layout, matches shaders/cluster_cull.comp
+		struct MeshletCullData
+		{
+			glm::vec4 sphere;	// xyz = center, w = radius
+			glm::vec4 cone;		// xyz = axis, w = cutoff
+			uint32_t index_offset;
+			uint32_t index_count;
+			uint32_t padding[2];
+		};
+
+		struct LodLevel
+		{
+			uint32_t first_meshlet;
+			uint32_t meshlet_count;
+			uint32_t index_count;
+			float error;
+		};
+
+		// CPU side of the mesh, the LOD chain split into meshlets. Needs no device, so it can be built on another thread
+		struct Geometry
+		{
+			std::vector<Vertex> vertices;
+			std::vector<MeshletCullData> cull_data;
+			std::vector<uint32_t> meshlet_indices;
+			std::vector<LodLevel> lods;
+			glm::vec3 bounds_center = glm::vec3(0.0f);
+			float bounds_radius = 0.0f;
+		};
+
+		// Passed to shaders/cluster_cull.comp as specialization constant 0 (local_size_x_id)
+		static constexpr uint32_t WORKGROUP_SIZE = 64;
+		static constexpr uint32_t REPORT_INTERVAL_FRAMES = 300;
+		static constexpr uint32_t MAX_LOD_LEVELS = 6;
+		static constexpr float LOD_ERROR_PIXELS = 1.0f;
+		// A coarser level is only taken once its error drops below this fraction of LOD_ERROR_PIXELS
+		static constexpr float LOD_HYSTERESIS = 0.75f;
+		static constexpr uint32_t GEOMETRY_FILE_MAGIC = 0x48534D43;	// "CMSH"
+		// Bump when BuildGeometry changes its output, files of other versions are rebuilt
+		static constexpr uint32_t GEOMETRY_FILE_VERSION = 1;
+
+		CvlClusterMesh
+		(
+			CvlDevice& device,
+			CvlPipelineCache& pipeline_cache,
+			const std::vector<Vertex>& vertices,
+			const std::vector<uint32_t>& indices,
+			uint32_t frame_count
+		);
+		CvlClusterMesh
+		(
+			CvlDevice& device,
+			CvlPipelineCache& pipeline_cache,
+			const Geometry& geometry,
+			uint32_t frame_count
+		);
+		~CvlClusterMesh();
+
+		CvlClusterMesh(const CvlClusterMesh&) = delete;
+		CvlClusterMesh& operator=(const CvlClusterMesh&) = delete;
+
+		static Geometry BuildGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+		// Offline build: loads geometry_fp if it was built from the same mesh, otherwise builds and writes it for the next run
+		static Geometry LoadOrBuildGeometry(const std::string& geometry_fp, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+		// config_info must have its attachments set, vertex input and layout are overridden
+		void CreateRenderPipeline(PipelineConfigInfo& config_info);
+
+		// Must be recorded outside of rendering, the mesh is in world space
+		void Cull(VkCommandBuffer command_buffer, uint32_t frame, const glm::mat4& view_proj, const glm::vec3& eye);
+		void Draw(VkCommandBuffer command_buffer, uint32_t frame, const glm::mat4& view_proj);
+		void SetBackfaceCulling(bool enabled) { _backface_culling = enabled; }
+		// pixels_per_unit: screen height / (2 * tan(fov_y / 2)), i.e. projection[1][1] * height / 2
+		void UpdateLod(const glm::vec3& eye, float pixels_per_unit);
+		void SetLodEnabled(bool enabled) { _lod_enabled = enabled; }
+		// Toggles LOD selection after every report, so the log compares both
+		void SetLodComparison(bool enabled) { _lod_comparison = enabled; }
+
+		// The pyramid must be built from the same depth the early draw renders into, nullptr disables occlusion culling.
+		// Updates the descriptor set, frames in flight must have completed
+		void SetOcclusionPyramid(CvlHiZPyramid* pyramid);
+		// Second phase, must be recorded outside of rendering after the pyramid has been rebuilt this frame
+		void CullOccluded(VkCommandBuffer command_buffer, uint32_t frame);
+		void DrawOccluded(VkCommandBuffer command_buffer, uint32_t frame, const glm::mat4& view_proj);
+		void SetOcclusionCulling(bool enabled) { _occlusion_culling = enabled; }
+		// Toggles occlusion culling after every second report, so the log compares both at either LOD setting
+		void SetOcclusionComparison(bool enabled) { _occlusion_comparison = enabled; }
+
+		// For command buffers that aren't recorded through the render graph
+		void RecordPreCullBarrier(VkCommandBuffer command_buffer);
+		void RecordPostCullBarrier(VkCommandBuffer command_buffer);
+
+		VkBuffer GetVisibleIndexBuffer() { return _visible_index_buffer; }
+		// Sized for the finest level with nothing culled
+		VkDeviceSize GetVisibleIndexBufferSize() { return sizeof(uint32_t) * _lods[0].index_count; }
+		VkBuffer GetDrawBuffer() { return _draw_buffer; }
+		// Early and late draw slot per frame
+		VkDeviceSize GetDrawBufferSize() { return sizeof(DrawData) * 2 * _frame_count; }
+		// Meshlets deferred by Cull() to CullOccluded()
+		VkBuffer GetOccludedBuffer() { return _occluded_buffer; }
+		VkDeviceSize GetOccludedBufferSize() { return sizeof(uint32_t) * _max_lod_meshlets * _frame_count; }
+
+	private:
+		static uint64_t GetSourceHash(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+		static bool LoadGeometry(const std::string& geometry_fp, uint64_t source_hash, Geometry& geometry);
+		static void SaveGeometry(const std::string& geometry_fp, uint64_t source_hash, const Geometry& geometry);
+
+		// std430 layout, matches shaders/cluster_cull.comp, one per draw slot
+		struct OcclusionParams
+		{
+			glm::mat4 view_proj;	// the camera the pyramid was built with
+			glm::ivec2 render_size;	// rendered area of the depth buffer
+			int32_t levels;
+			uint32_t enabled;
+			uint32_t occluded_offset;	// first entry of the frame's deferred meshlet list
+			uint32_t padding[3];
+		};
+
+		void CreateBuffers(const Geometry& geometry);
+		void CreateDeviceLocalBuffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory);
+		void CreateDescriptors();
+		void CreateCullPipeline();
+		void CreateOcclusionPlaceholder();
+		void UpdateOcclusionDescriptor();
+		void WriteOcclusionParams(uint32_t slot, uint32_t frame, bool enabled);
+		void CollectStats(uint32_t frame);
+		uint32_t GetActiveLod() { return _lod_enabled ? _current_lod : 0; }
+
+		CvlDevice& _cvl_device;
+		CvlPipelineCache& _pipeline_cache;
+		uint32_t _frame_count;
+		bool _backface_culling = true;
+		std::vector<LodLevel> _lods;
+		glm::vec3 _bounds_center = glm::vec3(0.0f);
+		float _bounds_radius = 0.0f;
+		uint32_t _current_lod = 0;
+		bool _lod_enabled = true;
+		bool _lod_comparison = false;
+		uint32_t _max_lod_meshlets = 0;
+		CvlHiZPyramid* _occlusion_pyramid = nullptr;
+		bool _occlusion_culling = true;
+		bool _occlusion_comparison = false;
+
+		VkBuffer _vertex_buffer;
+		VkDeviceMemory _vertex_buffer_memory;
+		VkBuffer _meshlet_buffer;
+		VkDeviceMemory _meshlet_buffer_memory;
+		VkBuffer _index_buffer;
+		VkDeviceMemory _index_buffer_memory;
+		VkBuffer _visible_index_buffer;
+		VkDeviceMemory _visible_index_buffer_memory;
+		// Two slots per frame in flight (early and late), reset by the host once the slot's fence has been waited on
+		VkBuffer _draw_buffer;
+		VkDeviceMemory _draw_buffer_memory;
+		DrawData* _draw_data = nullptr;
+		std::vector<bool> _draw_slot_used;
+		std::vector<uint32_t> _draw_slot_lod;
+		std::vector<bool> _draw_slot_occlusion;
+		VkBuffer _occluded_buffer;
+		VkDeviceMemory _occluded_buffer_memory;
+		VkBuffer _occlusion_params_buffer;
+		VkDeviceMemory _occlusion_params_buffer_memory;
+		OcclusionParams* _occlusion_params = nullptr;
+		// Bound while no pyramid is set, the descriptor has to be valid even though nothing samples it
+		VkImage _placeholder_image;
+		VkDeviceMemory _placeholder_image_memory;
+		VkImageView _placeholder_view;
+		VkSampler _occlusion_sampler;
+
+		VkDescriptorSetLayout _descriptor_set_layout;
+		VkDescriptorPool _descriptor_pool;
+		VkDescriptorSet _descriptor_set;
+		VkPipelineLayout _cull_pipeline_layout;
+		VkPipelineLayout _render_pipeline_layout;
+		std::shared_ptr<CvlPipeline> _cull_pipeline;
+		std::shared_ptr<CvlPipeline> _render_pipeline;
+
+		CvlGpuTimer _gpu_timer;
+		uint64_t _stats_meshlets = 0;
+		uint64_t _stats_frustum_culled = 0;
+		uint64_t _stats_backface_culled = 0;
+		uint64_t _stats_deferred = 0;
+		uint64_t _stats_occlusion_culled = 0;
+		uint64_t _stats_lod_triangles = 0;
+		uint64_t _stats_visible_triangles = 0;
+		uint64_t _stats_lod_sum = 0;
+		double _cull_ms_sum = 0.0;
+		double _draw_ms_sum = 0.0;
+		double _recull_ms_sum = 0.0;
+		double _late_draw_ms_sum = 0.0;
+		double _hiz_ms_sum = 0.0;
+		uint32_t _stats_frames = 0;
+		uint32_t _stats_reports = 0;
+		// Average GPU ms of the last report per [LOD on][occlusion on], to tell what occlusion culling saves
+		double _report_gpu_ms[2][2] = {};
+	};
+
+	template<> struct VertexLayout<CvlClusterMesh::Vertex>
+	{
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings = { VertexBinding<CvlClusterMesh::Vertex>() };
+		static constexpr std::array<VkVertexInputAttributeDescription, 2> attributes =
+		{
+			VertexAttribute<glm::vec3>(0, offsetof(CvlClusterMesh::Vertex, pos)),
+			VertexAttribute<glm::vec3>(1, offsetof(CvlClusterMesh::Vertex, normal))
+		};
+	};
+}
\ No newline at end of file
@@ -0,0 +1,387 @@
+#include "cvl_debug_draw.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <iostream>
+#include <stdexcept>
+
+namespace cvl
+{
+	/* Stroke font */
+	// 16-segment glyphs on a cell 1 wide and 2 tall (y down), segment i is bit i of the glyph mask
+	static constexpr float SEGMENTS[16][4] =
+	{
+		{ 0.0f, 0.0f, 0.5f, 0.0f }, { 0.5f, 0.0f, 1.0f, 0.0f },	// top
+		{ 1.0f, 0.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 2.0f },	// right
+		{ 1.0f, 2.0f, 0.5f, 2.0f }, { 0.5f, 2.0f, 0.0f, 2.0f },	// bottom
+		{ 0.0f, 2.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f, 0.0f },	// left
+		{ 0.0f, 1.0f, 0.5f, 1.0f }, { 0.5f, 1.0f, 1.0f, 1.0f },	// middle
+		{ 0.0f, 0.0f, 0.5f, 1.0f }, { 0.5f, 0.0f, 0.5f, 1.0f }, { 1.0f, 0.0f, 0.5f, 1.0f },	// upper diagonals and center
+		{ 0.5f, 1.0f, 0.0f, 2.0f }, { 0.5f, 1.0f, 0.5f, 2.0f }, { 0.5f, 1.0f, 1.0f, 2.0f }	// lower diagonals and center
+	};
+
+	enum Segment : uint16_t
+	{
+		A1 = 1 << 0, A2 = 1 << 1, B = 1 << 2, C = 1 << 3, D1 = 1 << 4, D2 = 1 << 5, E = 1 << 6, F = 1 << 7,
+		G1 = 1 << 8, G2 = 1 << 9, H = 1 << 10, I = 1 << 11, J = 1 << 12, K = 1 << 13, L = 1 << 14, M = 1 << 15,
+		TOP = A1 | A2, BOTTOM = D1 | D2, MIDDLE = G1 | G2
+	};
+
+	// ASCII 32 to 95
+	static constexpr uint16_t GLYPHS[64] =
+	{
+		0, I, F | I, 0, TOP | F | MIDDLE | C | BOTTOM | I | L, J | K, 0, I,					// space ! " # $ % & '
+		J | M, H | K, H | I | J | K | L | M | MIDDLE, I | L | MIDDLE, K, MIDDLE, D2, J | K,		// ( ) * + , - . /
+		TOP | B | C | BOTTOM | E | F | J | K, B | C, TOP | B | MIDDLE | E | BOTTOM,				// 0 1 2
+		TOP | B | C | BOTTOM | MIDDLE, F | MIDDLE | B | C, TOP | F | MIDDLE | C | BOTTOM,			// 3 4 5
+		TOP | F | E | BOTTOM | C | MIDDLE, TOP | B | C, TOP | B | C | BOTTOM | E | F | MIDDLE,	// 6 7 8
+		TOP | B | C | BOTTOM | F | MIDDLE,														// 9
+		I | L, I | K, J | M, MIDDLE | BOTTOM, H | K, TOP | B | G2 | L, TOP | B | C | BOTTOM | F | G2 | I,	// : ; < = > ? @
+		TOP | B | C | E | F | MIDDLE, TOP | B | C | BOTTOM | I | L | G2, TOP | F | E | BOTTOM,		// A B C
+		TOP | B | C | BOTTOM | I | L, TOP | F | E | BOTTOM | G1, TOP | F | E | G1,				// D E F
+		TOP | F | E | BOTTOM | C | G2, F | E | B | C | MIDDLE, TOP | I | L | BOTTOM,				// G H I
+		B | C | BOTTOM | E, F | E | G1 | J | M, F | E | BOTTOM,								// J K L
+		F | E | B | C | H | J, F | E | B | C | H | M, TOP | B | C | BOTTOM | E | F,				// M N O
+		TOP | B | F | E | MIDDLE, TOP | B | C | BOTTOM | E | F | M, TOP | B | F | E | MIDDLE | M,	// P Q R
+		TOP | F | MIDDLE | C | BOTTOM, TOP | I | L, F | E | BOTTOM | B | C,						// S T U
+		F | E | K | J, F | E | B | C | K | M, H | J | K | M, H | J | L, TOP | J | K | BOTTOM,	// V W X Y Z
+		A1 | I | L | D2, H | M, A2 | I | L | D1, K | M, BOTTOM									// [ \ ] ^ _
+	};
+
+	static constexpr float GLYPH_ADVANCE = 0.75f;
+	/* ~Stroke font */
+
+	/* CvlDebugDraw class */
+	CvlDebugDraw::CvlDebugDraw(CvlDevice& device, CvlPipelineCache& pipeline_cache, uint32_t max_vertices, uint32_t frame_count)
+		: _cvl_device(device), _pipeline_cache(pipeline_cache), _frame_count(frame_count)
+	{
+		_frame_vertices = std::max(1u, (max_vertices + BLOCK_VERTICES - 1) / BLOCK_VERTICES) * BLOCK_VERTICES;
+		VkDeviceSize buffer_size = sizeof(Vertex) * static_cast<VkDeviceSize>(_frame_vertices) * _frame_count;
+		_cvl_device.CreateBuffer
+		(
+			buffer_size,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging,
+			_vertex_buffer,
+			_vertex_buffer_memory
+		);
+		// Stays mapped for the lifetime of the buffer, coherent so writes need no flush
+		if (vkMapMemory(_cvl_device.device(), _vertex_buffer_memory, 0, buffer_size, 0, reinterpret_cast<void**>(&_mapped)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlDebugDraw] Failed to map vertex buffer!");
+		}
+
+		VkPushConstantRange push_constant_range = {};
+		push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_constant_range.offset = 0;
+		push_constant_range.size = sizeof(glm::mat4);
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+		if (vkCreatePipelineLayout(_cvl_device.device(), &pipeline_layout_info, _cvl_device.GetAllocator(), &_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlDebugDraw] Failed to create pipeline layout!");
+		}
+	}
+
+	CvlDebugDraw::~CvlDebugDraw()
+	{
+		for (std::shared_ptr<CvlPipeline>& pipeline : _pipelines)
+		{
+			pipeline.reset();
+		}
+		_pipeline_cache.ReleasePipelines(_pipeline_layout);
+		vkDestroyPipelineLayout(_cvl_device.device(), _pipeline_layout, _cvl_device.GetAllocator());
+		vkUnmapMemory(_cvl_device.device(), _vertex_buffer_memory);
+		vkDestroyBuffer(_cvl_device.device(), _vertex_buffer, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(_vertex_buffer_memory);
+	}
+
+	void CvlDebugDraw::CreateRenderPipelines(const PipelineConfigInfo& config_info)
+	{
+		for (uint32_t batch = 0; batch < BATCH_COUNT; ++batch)
+		{
+			bool lines = batch == WORLD_LINES || batch == SCREEN_LINES;
+			bool world = batch == WORLD_TRIANGLES || batch == WORLD_LINES;
+
+			PipelineConfigInfo batch_config = {};
+			CvlPipeline::CopyPipelineConfigInfo(config_info, batch_config);
+			batch_config.input_assembly_info.topology = lines ? VK_PRIMITIVE_TOPOLOGY_LINE_LIST : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			batch_config.rasterization_info.cullMode = VK_CULL_MODE_NONE;
+			batch_config.binding_descriptions = GetBindingDescriptions<Vertex>();
+			batch_config.attribute_descriptions = GetAttributeDescriptions<Vertex>();
+			// World geometry is hidden by the scene but doesn't occlude it, screen geometry is always on top
+			batch_config.depth_stencil_info.depthTestEnable = world ? VK_TRUE : VK_FALSE;
+			batch_config.depth_stencil_info.depthWriteEnable = VK_FALSE;
+			batch_config.depth_stencil_info.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+			batch_config.color_blend_attachment.blendEnable = VK_TRUE;
+			batch_config.color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+			batch_config.color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			batch_config.color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+			batch_config.color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+			batch_config.color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			batch_config.color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+			batch_config.pipeline_layout = _pipeline_layout;
+			_pipelines[batch] = _pipeline_cache.GetGraphicsPipeline(batch_config, "src\\shaders\\debug.vert", "src\\shaders\\debug.frag");
+		}
+	}
+
+	void CvlDebugDraw::BeginFrame(uint32_t frame)
+	{
+		_frame = frame;
+		_frame_cursor = 0;
+		for (BatchState& batch : _batches)
+		{
+			batch.runs.clear();
+			batch.block_remaining = 0;
+		}
+	}
+
+	void CvlDebugDraw::Draw(VkCommandBuffer command_buffer, const glm::mat4& view_proj, VkRect2D render_area)
+	{
+		// Pixels from the top left of the render area to clip space, Vulkan's y already points down
+		glm::mat4 screen_to_clip(1.0f);
+		screen_to_clip[0][0] = 2.0f / static_cast<float>(render_area.extent.width);
+		screen_to_clip[1][1] = 2.0f / static_cast<float>(render_area.extent.height);
+		screen_to_clip[3][0] = -1.0f;
+		screen_to_clip[3][1] = -1.0f;
+
+		bool buffer_bound = false;
+		uint32_t draws = 0;
+		uint32_t vertices = 0;
+		for (uint32_t batch = 0; batch < BATCH_COUNT; ++batch)
+		{
+			const BatchState& state = _batches[batch];
+			if (state.runs.empty() || _pipelines[batch] == nullptr)
+			{
+				continue;
+			}
+			if (!buffer_bound)
+			{
+				VkBuffer buffers[] = { _vertex_buffer };
+				VkDeviceSize offsets[] = { 0 };
+				vkCmdBindVertexBuffers(command_buffer, 0, 1, buffers, offsets);
+				buffer_bound = true;
+			}
+			_pipelines[batch]->Bind(command_buffer);
+			const glm::mat4& transform = batch == WORLD_TRIANGLES || batch == WORLD_LINES ? view_proj : screen_to_clip;
+			vkCmdPushConstants(command_buffer, _pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(transform), &transform);
+			for (const Run& run : state.runs)
+			{
+				vkCmdDraw(command_buffer, run.vertex_count, 1, run.first_vertex, 0);
+				vertices += run.vertex_count;
+				++draws;
+			}
+		}
+		_stats_vertices += vertices;
+		_stats_draws += draws;
+		ReportStats();
+	}
+
+	void CvlDebugDraw::DrawLine(const glm::vec3& a, const glm::vec3& b, const glm::vec4& color)
+	{
+		Vertex* vertices = Allocate(WORLD_LINES, 2);
+		if (vertices == nullptr)
+		{
+			return;
+		}
+		Unorm8x4 packed = EncodeColor(color);
+		vertices[0] = { a, packed };
+		vertices[1] = { b, packed };
+	}
+
+	void CvlDebugDraw::DrawBox(const glm::vec3& min, const glm::vec3& max, const glm::vec4& color)
+	{
+		glm::mat4 transform(1.0f);
+		glm::vec3 half_extent = (max - min) * 0.5f;
+		glm::vec3 center = (max + min) * 0.5f;
+		transform[0][0] = half_extent.x;
+		transform[1][1] = half_extent.y;
+		transform[2][2] = half_extent.z;
+		transform[3] = glm::vec4(center.x, center.y, center.z, 1.0f);
+		DrawBox(transform, color);
+	}
+
+	void CvlDebugDraw::DrawBox(const glm::mat4& transform, const glm::vec4& color)
+	{
+		Vertex* vertices = Allocate(WORLD_LINES, 24);
+		if (vertices == nullptr)
+		{
+			return;
+		}
+		// Corner i has x, y, z = bits 0, 1, 2 of i
+		glm::vec3 corners[8];
+		for (int i = 0; i < 8; ++i)
+		{
+			glm::vec4 corner = transform * glm::vec4((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f, 1.0f);
+			corners[i] = glm::vec3(corner.x, corner.y, corner.z);
+		}
+		static constexpr int edges[12][2] =
+		{
+			{ 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+			{ 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+			{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+		};
+		Unorm8x4 packed = EncodeColor(color);
+		for (int i = 0; i < 12; ++i)
+		{
+			vertices[i * 2] = { corners[edges[i][0]], packed };
+			vertices[i * 2 + 1] = { corners[edges[i][1]], packed };
+		}
+	}
+
+	void CvlDebugDraw::DrawAxes(const glm::mat4& transform, float size)
+	{
+		glm::vec3 origin(transform[3].x, transform[3].y, transform[3].z);
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			glm::vec3 direction(transform[axis].x, transform[axis].y, transform[axis].z);
+			glm::vec4 color(axis == 0 ? 1.0f : 0.0f, axis == 1 ? 1.0f : 0.0f, axis == 2 ? 1.0f : 0.0f, 1.0f);
+			DrawLine(origin, origin + direction * size, color);
+		}
+	}
+
+	void CvlDebugDraw::DrawTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec4& color)
+	{
+		Vertex* vertices = Allocate(WORLD_TRIANGLES, 3);
+		if (vertices == nullptr)
+		{
+			return;
+		}
+		Unorm8x4 packed = EncodeColor(color);
+		vertices[0] = { a, packed };
+		vertices[1] = { b, packed };
+		vertices[2] = { c, packed };
+	}
+
+	void CvlDebugDraw::DrawScreenLine(const glm::vec2& a, const glm::vec2& b, const glm::vec4& color)
+	{
+		Vertex* vertices = Allocate(SCREEN_LINES, 2);
+		if (vertices == nullptr)
+		{
+			return;
+		}
+		Unorm8x4 packed = EncodeColor(color);
+		vertices[0] = { glm::vec3(a, 0.0f), packed };
+		vertices[1] = { glm::vec3(b, 0.0f), packed };
+	}
+
+	void CvlDebugDraw::DrawScreenRect(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color)
+	{
+		Vertex* vertices = Allocate(SCREEN_TRIANGLES, 6);
+		if (vertices == nullptr)
+		{
+			return;
+		}
+		Unorm8x4 packed = EncodeColor(color);
+		vertices[0] = { glm::vec3(min.x, min.y, 0.0f), packed };
+		vertices[1] = { glm::vec3(max.x, min.y, 0.0f), packed };
+		vertices[2] = { glm::vec3(max.x, max.y, 0.0f), packed };
+		vertices[3] = { glm::vec3(min.x, min.y, 0.0f), packed };
+		vertices[4] = { glm::vec3(max.x, max.y, 0.0f), packed };
+		vertices[5] = { glm::vec3(min.x, max.y, 0.0f), packed };
+	}
+
+	void CvlDebugDraw::DrawText(const glm::vec2& position, const std::string& text, float height, const glm::vec4& color)
+	{
+		Unorm8x4 packed = EncodeColor(color);
+		float scale = height * 0.5f;
+		glm::vec2 origin = position;
+		for (char character : text)
+		{
+			if (character == '\n')
+			{
+				origin = glm::vec2(position.x, origin.y + height * 1.5f);
+				continue;
+			}
+			int code = std::toupper(static_cast<unsigned char>(character)) - 32;
+			uint16_t glyph = code >= 0 && code < 64 ? GLYPHS[code] : 0;
+			if (glyph != 0)
+			{
+				Vertex* vertices = Allocate(SCREEN_LINES, 2 * static_cast<uint32_t>(std::bitset<16>(glyph).count()));
+				if (vertices == nullptr)
+				{
+					return;
+				}
+				for (int segment = 0; segment < 16; ++segment)
+				{
+					if ((glyph & (1 << segment)) == 0)
+					{
+						continue;
+					}
+					const float* s = SEGMENTS[segment];
+					*vertices++ = { glm::vec3(origin.x + s[0] * scale, origin.y + s[1] * scale, 0.0f), packed };
+					*vertices++ = { glm::vec3(origin.x + s[2] * scale, origin.y + s[3] * scale, 0.0f), packed };
+				}
+			}
+			origin.x += height * GLYPH_ADVANCE;
+		}
+	}
+
+	float CvlDebugDraw::GetTextWidth(const std::string& text, float height)
+	{
+		size_t longest_line = 0;
+		size_t line = 0;
+		for (char character : text)
+		{
+			line = character == '\n' ? 0 : line + 1;
+			longest_line = std::max(longest_line, line);
+		}
+		return longest_line * height * GLYPH_ADVANCE;
+	}
+
+	// private
+	CvlDebugDraw::Vertex* CvlDebugDraw::Allocate(Batch batch, uint32_t vertex_count)
+	{
+		BatchState& state = _batches[batch];
+		if (state.block_remaining < vertex_count)
+		{
+			if (_frame_cursor + BLOCK_VERTICES > _frame_vertices || vertex_count > BLOCK_VERTICES)
+			{
+				++_stats_dropped;
+				return nullptr;
+			}
+			if (!state.runs.empty() && state.block_remaining != 0)
+			{
+				// Whole invisible primitives, allocations and blocks are multiples of the primitive size
+				Run& run = state.runs.back();
+				std::fill_n(_mapped + run.first_vertex + run.vertex_count, state.block_remaining, Vertex{ glm::vec3(0.0f), Unorm8x4{ 0, 0, 0, 0 } });
+				run.vertex_count += state.block_remaining;
+			}
+			uint32_t block_start = _frame * _frame_vertices + _frame_cursor;
+			_frame_cursor += BLOCK_VERTICES;
+			// Blocks of a batch that follow each other are drawn as one run
+			if (state.runs.empty() || state.runs.back().first_vertex + state.runs.back().vertex_count != block_start)
+			{
+				state.runs.push_back({ block_start, 0 });
+			}
+			state.block_remaining = BLOCK_VERTICES;
+		}
+		Run& run = state.runs.back();
+		Vertex* vertices = _mapped + run.first_vertex + run.vertex_count;
+		run.vertex_count += vertex_count;
+		state.block_remaining -= vertex_count;
+		return vertices;
+	}
+
+	void CvlDebugDraw::ReportStats()
+	{
+		if (++_stats_frames < REPORT_INTERVAL_FRAMES)
+		{
+			return;
+		}
+		double frames = static_cast<double>(_stats_frames);
+		std::cout << "[CvlDebugDraw] " << _stats_vertices / frames << " vertices in " << _stats_draws / frames << " draws per frame, "
+			<< _stats_dropped << " primitives dropped (" << _frame_vertices << " vertices per frame)\n";
+		_stats_vertices = 0;
+		_stats_draws = 0;
+		_stats_dropped = 0;
+		_stats_frames = 0;
+	}
+	/* ~CvlDebugDraw class */
+}
\ No newline at end of file
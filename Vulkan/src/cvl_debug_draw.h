@@ -0,0 +1,129 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_pipeline.h"
+#include "cvl_pipeline_cache.h"
+#include "cvl_vertex_layout.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Immediate-mode debug geometry: shapes submitted between BeginFrame() and Draw() are written straight
+		into a persistently mapped host-visible ring buffer with one region per frame in flight.
+		Each batch (world or screen space, lines or triangles) takes fixed-size blocks from the frame's region,
+		adjacent blocks of a batch merge, so a frame is a handful of draws regardless of the primitive count.
+		Primitives that don't fit in the frame's region are dropped and reported.
+		Coordinates are converted per primitive on the CPU, there is no per-shape allocation or upload.
+	*/
+	class CvlDebugDraw
+	{
+	public:
+		struct Vertex
+		{
+			glm::vec3 pos;
+			Unorm8x4 color;
+		};
+
+		// Multiple of both the line and the triangle vertex count, so a block's tail can be padded with whole primitives
+		static constexpr uint32_t BLOCK_VERTICES = 12288;
+		static constexpr uint32_t REPORT_INTERVAL_FRAMES = 300;
+
+		// max_vertices per frame, rounded up to whole blocks
+		CvlDebugDraw(CvlDevice& device, CvlPipelineCache& pipeline_cache, uint32_t max_vertices, uint32_t frame_count);
+		~CvlDebugDraw();
+
+		CvlDebugDraw(const CvlDebugDraw&) = delete;
+		CvlDebugDraw& operator=(const CvlDebugDraw&) = delete;
+
+		// config_info must have its attachments set, everything else is overridden per batch
+		void CreateRenderPipelines(const PipelineConfigInfo& config_info);
+
+		// The frame's previous contents must no longer be in use by the GPU
+		void BeginFrame(uint32_t frame);
+		// Must be recorded inside rendering, render_area defines the pixel space of the screen batches
+		void Draw(VkCommandBuffer command_buffer, const glm::mat4& view_proj, VkRect2D render_area);
+
+		// World space, depth tested
+		void DrawLine(const glm::vec3& a, const glm::vec3& b, const glm::vec4& color);
+		void DrawBox(const glm::vec3& min, const glm::vec3& max, const glm::vec4& color);
+		// The [-1, 1] cube transformed by transform
+		void DrawBox(const glm::mat4& transform, const glm::vec4& color);
+		void DrawAxes(const glm::mat4& transform, float size);
+		void DrawTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec4& color);
+
+		// Screen space in pixels from the top left of the render area, drawn on top
+		void DrawScreenLine(const glm::vec2& a, const glm::vec2& b, const glm::vec4& color);
+		void DrawScreenRect(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color);
+		// Stroke font of digits, letters (drawn upper case) and a few symbols, height is the glyph height in pixels
+		void DrawText(const glm::vec2& position, const std::string& text, float height, const glm::vec4& color);
+		static float GetTextWidth(const std::string& text, float height);
+
+	private:
+		enum Batch
+		{
+			WORLD_TRIANGLES,
+			WORLD_LINES,
+			SCREEN_TRIANGLES,
+			SCREEN_LINES,
+			BATCH_COUNT
+		};
+
+		struct Run
+		{
+			uint32_t first_vertex;
+			uint32_t vertex_count;
+		};
+
+		struct BatchState
+		{
+			std::vector<Run> runs;
+			// Vertices left in the block the last run writes to
+			uint32_t block_remaining = 0;
+		};
+
+		// Null when the frame's region is full
+		Vertex* Allocate(Batch batch, uint32_t vertex_count);
+		void ReportStats();
+
+		CvlDevice& _cvl_device;
+		CvlPipelineCache& _pipeline_cache;
+		uint32_t _frame_vertices;
+		uint32_t _frame_count;
+
+		VkBuffer _vertex_buffer;
+		VkDeviceMemory _vertex_buffer_memory;
+		Vertex* _mapped = nullptr;
+
+		VkPipelineLayout _pipeline_layout;
+		std::array<std::shared_ptr<CvlPipeline>, BATCH_COUNT> _pipelines;
+
+		uint32_t _frame = 0;
+		uint32_t _frame_cursor = 0;
+		std::array<BatchState, BATCH_COUNT> _batches;
+
+		uint64_t _stats_vertices = 0;
+		uint64_t _stats_draws = 0;
+		uint64_t _stats_dropped = 0;
+		uint32_t _stats_frames = 0;
+	};
+
+	template<> struct VertexLayout<CvlDebugDraw::Vertex>
+	{
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings = { VertexBinding<CvlDebugDraw::Vertex>() };
+		static constexpr std::array<VkVertexInputAttributeDescription, 2> attributes =
+		{
+			VertexAttribute<glm::vec3>(0, offsetof(CvlDebugDraw::Vertex, pos)),
+			VertexAttribute<Unorm8x4>(1, offsetof(CvlDebugDraw::Vertex, color))
+		};
+	};
+}
\ No newline at end of file
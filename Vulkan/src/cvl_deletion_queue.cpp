@@ -0,0 +1,114 @@
+#include "cvl_deletion_queue.h"
+#include "cvl_device.h"
+
+namespace cvl
+{
+	/* CvlDeletionQueue class */
+	CvlDeletionQueue::CvlDeletionQueue(CvlDevice& device)
+		: _cvl_device(device)
+	{
+	}
+
+	void CvlDeletionQueue::SetFramesInFlight(uint32_t frames_in_flight)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_frames_in_flight = frames_in_flight;
+	}
+
+	void CvlDeletionQueue::BeginFrame()
+	{
+		std::vector<Entry> retired;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			++_frame;
+			if (_frames_in_flight == 0)
+			{
+				return;
+			}
+			// This frame's fence wait retired frame _frame - frames_in_flight and everything before it
+			while (!_entries.empty() && _entries.front().frame + _frames_in_flight <= _frame)
+			{
+				retired.push_back(_entries.front());
+				_entries.pop_front();
+			}
+		}
+		// Outside the lock, FreeMemory takes the device's memory lock and other threads may keep handing over objects
+		Destroy(retired);
+	}
+
+	void CvlDeletionQueue::Flush()
+	{
+		std::vector<Entry> retired;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			retired.assign(_entries.begin(), _entries.end());
+			_entries.clear();
+		}
+		Destroy(retired);
+	}
+
+	size_t CvlDeletionQueue::GetPendingCount()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _entries.size();
+	}
+
+	// private
+	void CvlDeletionQueue::Push(VkObjectType type, uint64_t handle)
+	{
+		if (handle == 0)
+		{
+			return;
+		}
+		std::lock_guard<std::mutex> lock(_mutex);
+		_entries.push_back({ _frame, type, handle });
+	}
+
+	void CvlDeletionQueue::Destroy(const std::vector<Entry>& entries)
+	{
+		VkDevice device = _cvl_device.device();
+		const VkAllocationCallbacks* allocator = _cvl_device.GetAllocator();
+		for (const Entry& entry : entries)
+		{
+			switch (entry.type)
+			{
+			case VK_OBJECT_TYPE_BUFFER:
+				vkDestroyBuffer(device, reinterpret_cast<VkBuffer>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_IMAGE:
+				vkDestroyImage(device, reinterpret_cast<VkImage>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_IMAGE_VIEW:
+				vkDestroyImageView(device, reinterpret_cast<VkImageView>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_PIPELINE:
+				vkDestroyPipeline(device, reinterpret_cast<VkPipeline>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_SHADER_MODULE:
+				vkDestroyShaderModule(device, reinterpret_cast<VkShaderModule>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_FRAMEBUFFER:
+				vkDestroyFramebuffer(device, reinterpret_cast<VkFramebuffer>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_RENDER_PASS:
+				vkDestroyRenderPass(device, reinterpret_cast<VkRenderPass>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_SWAPCHAIN_KHR:
+				vkDestroySwapchainKHR(device, reinterpret_cast<VkSwapchainKHR>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_SEMAPHORE:
+				vkDestroySemaphore(device, reinterpret_cast<VkSemaphore>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_FENCE:
+				vkDestroyFence(device, reinterpret_cast<VkFence>(entry.handle), allocator);
+				break;
+			case VK_OBJECT_TYPE_DEVICE_MEMORY:
+				_cvl_device.FreeMemory(reinterpret_cast<VkDeviceMemory>(entry.handle));
+				break;
+			default:
+				throw std::runtime_error("[CvlDeletionQueue] Unsupported object type!");
+			}
+		}
+	}
+	/* ~CvlDeletionQueue class */
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace cvl
+{
+	class CvlDevice;
+
+	/*
+		Destroys GPU objects once every frame that could have used them has completed, so buffers, images,
+		pipelines and the like can be replaced while frames are in flight without waiting on the device.
+		Objects handed over during frame n are destroyed by the BeginFrame() of frame n + frames in flight,
+		which must be called after waiting on that frame's fence. Handles may be handed over from any thread,
+		null handles are ignored.
+	*/
+	class CvlDeletionQueue
+	{
+	public:
+		CvlDeletionQueue(CvlDevice& device);
+
+		CvlDeletionQueue(const CvlDeletionQueue&) = delete;
+		CvlDeletionQueue& operator=(const CvlDeletionQueue&) = delete;
+
+		void DestroyBuffer(VkBuffer buffer) { Push(VK_OBJECT_TYPE_BUFFER, reinterpret_cast<uint64_t>(buffer)); }
+		void DestroyImage(VkImage image) { Push(VK_OBJECT_TYPE_IMAGE, reinterpret_cast<uint64_t>(image)); }
+		void DestroyImageView(VkImageView view) { Push(VK_OBJECT_TYPE_IMAGE_VIEW, reinterpret_cast<uint64_t>(view)); }
+		void DestroyPipeline(VkPipeline pipeline) { Push(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<uint64_t>(pipeline)); }
+		void DestroyShaderModule(VkShaderModule module) { Push(VK_OBJECT_TYPE_SHADER_MODULE, reinterpret_cast<uint64_t>(module)); }
+		void DestroyFramebuffer(VkFramebuffer framebuffer) { Push(VK_OBJECT_TYPE_FRAMEBUFFER, reinterpret_cast<uint64_t>(framebuffer)); }
+		void DestroyRenderPass(VkRenderPass render_pass) { Push(VK_OBJECT_TYPE_RENDER_PASS, reinterpret_cast<uint64_t>(render_pass)); }
+		void DestroySwapchain(VkSwapchainKHR swap_chain) { Push(VK_OBJECT_TYPE_SWAPCHAIN_KHR, reinterpret_cast<uint64_t>(swap_chain)); }
+		void DestroySemaphore(VkSemaphore semaphore) { Push(VK_OBJECT_TYPE_SEMAPHORE, reinterpret_cast<uint64_t>(semaphore)); }
+		void DestroyFence(VkFence fence) { Push(VK_OBJECT_TYPE_FENCE, reinterpret_cast<uint64_t>(fence)); }
+		// Goes through CvlDevice::FreeMemory, so the allocation stays tracked until it is really freed
+		void FreeMemory(VkDeviceMemory memory) { Push(VK_OBJECT_TYPE_DEVICE_MEMORY, reinterpret_cast<uint64_t>(memory)); }
+
+		// Until it is set nothing is destroyed before Flush()
+		void SetFramesInFlight(uint32_t frames_in_flight);
+		// Call once per frame after waiting on its fence, destroys what the frames in flight can no longer use
+		void BeginFrame();
+		// Destroys everything, the device must be idle
+		void Flush();
+
+		size_t GetPendingCount();
+
+	private:
+		struct Entry
+		{
+			uint64_t frame;
+			VkObjectType type;
+			uint64_t handle;
+		};
+
+		void Push(VkObjectType type, uint64_t handle);
+		void Destroy(const std::vector<Entry>& entries);
+
+		CvlDevice& _cvl_device;
+		std::mutex _mutex;
+		// In the order they were handed over, so their frames never decrease
+		std::deque<Entry> _entries;
+		uint64_t _frame = 0;
+		uint32_t _frames_in_flight = 0;
+	};
+}
\ No newline at end of file
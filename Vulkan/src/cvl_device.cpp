@@ -4,7 +4,9 @@
 #include <set>
 #include <unordered_set>
 
+#include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <limits>
 #include <algorithm>
 
@@ -49,26 +51,48 @@ namespace cvl
 
 	/* CvlDevice class */
 
-	CvlDevice::CvlDevice(CvlWindow& window) : _window(window)
+	CvlDevice::CvlDevice(CvlWindow& window) : _window(&window)
 	{
-		CreateInstance();
-		SetupDebugMessenger();
-		CreateSurface();
-		PickPhysicalDevice();
-		CreateLogicalDevice();
-		CreateCommandPool();
+		Initialize();
+	}
+
+	CvlDevice::CvlDevice() : _window(nullptr)
+	{
+		// Nothing is presented, so the swap chain extension isn't required either
+		_device_extensions.clear();
+		Initialize();
 	}
 
 	CvlDevice::~CvlDevice()
 	{
-		vkDestroyCommandPool(_device, _command_pool, nullptr);
-		vkDestroyDevice(_device, nullptr);
+		// Objects destroyed since the last frames were retired are still queued
+		vkDeviceWaitIdle(_device);
+		_deletion_queue.Flush();
+		if (!_allocations.empty())
+		{
+			std::cout << "[CvlDevice] " << _allocations.size() << " tracked allocations were not freed\n";
+		}
+		vkDestroyCommandPool(_device, _command_pool, GetAllocator());
+		vkDestroyDevice(_device, GetAllocator());
 		if (_enable_validation_layers)
 		{
-			DestroyDebugUtilsMessengerEXT(_instance, _debug_messenger, nullptr);
+			DestroyDebugUtilsMessengerEXT(_instance, _debug_messenger, GetAllocator());
 		}
-		vkDestroySurfaceKHR(_instance, _surface, nullptr);
-		vkDestroyInstance(_instance, nullptr);
+		if (_surface != VK_NULL_HANDLE)
+		{
+			vkDestroySurfaceKHR(_instance, _surface, GetAllocator());
+		}
+		vkDestroyInstance(_instance, GetAllocator());
+	}
+
+	void CvlDevice::Initialize()
+	{
+		CreateInstance();
+		SetupDebugMessenger();
+		CreateSurface();
+		PickPhysicalDevice();
+		CreateLogicalDevice();
+		CreateCommandPool();
 	}
 
 	/* Validation layers  */
@@ -90,7 +114,7 @@ namespace cvl
 		VkDebugUtilsMessengerCreateInfoEXT create_info;
 		PopulateDebugMessengerCreateInfo(create_info);
 
-		if (CreateDebugUtilsMessengerEXT(_instance, &create_info, nullptr, &_debug_messenger) != VK_SUCCESS)
+		if (CreateDebugUtilsMessengerEXT(_instance, &create_info, GetAllocator(), &_debug_messenger) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to set up debug messenger!");
 		}
@@ -137,21 +161,40 @@ namespace cvl
 		uint32_t i = 0;
 		for (const auto& queue_family : queue_families)
 		{
-			if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+			if (!indices.IsComplete())
 			{
-				indices.graphics_family = i;
+				if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+				{
+					indices.graphics_family = i;
+				}
+
+				// Headless devices never present, the graphics family stands in for the present family
+				VkBool32 is_present_supported = VK_FALSE;
+				if (_surface != VK_NULL_HANDLE)
+				{
+					vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &is_present_supported);
+				}
+				else
+				{
+					is_present_supported = indices.graphics_family.has_value();
+				}
+				if (is_present_supported)
+				{
+					indices.present_family = i;
+				}
 			}
 
-			VkBool32 is_present_supported;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, _surface, &is_present_supported);
-			if (is_present_supported)
+			// Families without graphics run asynchronously to it, the transfer family is the one of DMA engines
+			bool graphics = (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+			bool compute = (queue_family.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+			bool transfer = (queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0;
+			if (compute && !graphics && !indices.compute_family.has_value())
 			{
-				indices.present_family = i;
+				indices.compute_family = i;
 			}
-
-			if (indices.IsComplete())
+			if (transfer && !graphics && !compute && !indices.transfer_family.has_value())
 			{
-				break;
+				indices.transfer_family = i;
 			}
 			++i;
 		}
@@ -199,6 +242,38 @@ namespace cvl
 		return required_extensions.empty();
 	}
 
+	bool CvlDevice::IsDeviceExtensionAvailable(VkPhysicalDevice device, const char* extension_name)
+	{
+		uint32_t extension_count;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
+		std::vector<VkExtensionProperties> available_extensions(extension_count);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
+
+		for (const auto& extension : available_extensions)
+		{
+			if (strcmp(extension.extensionName, extension_name) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool CvlDevice::IsDeviceTimeDomainCalibrateable(VkPhysicalDevice device)
+	{
+		// Instance level entry point of VK_EXT_calibrated_timestamps
+		auto func = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT) vkGetInstanceProcAddr(_instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+		if (func == nullptr)
+		{
+			return false;
+		}
+		uint32_t domain_count = 0;
+		func(device, &domain_count, nullptr);
+		std::vector<VkTimeDomainEXT> domains(domain_count);
+		func(device, &domain_count, domains.data());
+		return std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+	}
+
 	bool CvlDevice::IsDeviceSuitable(VkPhysicalDevice device)
 	{
 		QueueFamilyIndices indices = FindQueueFamilies(device);
@@ -207,8 +282,8 @@ namespace cvl
 		VkPhysicalDeviceFeatures device_features;
 		vkGetPhysicalDeviceFeatures(device, &device_features);
 
-		bool swap_chain_adequate = false;
-		if (extensions_supported)
+		bool swap_chain_adequate = IsHeadless();
+		if (extensions_supported && !IsHeadless())
 		{
 			SwapChainSupportDetails swap_chain_support = QuerySwapChainSupport(device);
 			swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
@@ -250,6 +325,11 @@ namespace cvl
 
 		std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
 		std::set<uint32_t> unique_queue_families = { indices.graphics_family.value(), indices.present_family.value() };
+		// Compute falls back to graphics, transfer to the compute-only family and then to graphics
+		_queue_families[static_cast<size_t>(QueueType::Graphics)] = indices.graphics_family.value();
+		_queue_families[static_cast<size_t>(QueueType::Compute)] = indices.compute_family.value_or(indices.graphics_family.value());
+		_queue_families[static_cast<size_t>(QueueType::Transfer)] = indices.transfer_family.value_or(_queue_families[static_cast<size_t>(QueueType::Compute)]);
+		unique_queue_families.insert(_queue_families.begin(), _queue_families.end());
 
 		float queue_priority = 1.0f;
 		for (uint32_t queue_family : unique_queue_families)
@@ -262,17 +342,88 @@ namespace cvl
 			queue_create_infos.emplace_back(queue_create_info);
 		}
 
-		//
-		VkPhysicalDeviceFeatures device_features = {};
-		device_features.samplerAnisotropy = VK_TRUE;
+		std::vector<const char*> enabled_extensions = _device_extensions;
+
+		// Optional features are core in 1.3, otherwise they come from their KHR extensions
+		bool core_1_3 = _physical_device_properties.apiVersion >= VK_API_VERSION_1_3;
+		bool has_features2 = _physical_device_properties.apiVersion >= VK_API_VERSION_1_1;
+		bool dynamic_rendering_available = has_features2 &&
+			(core_1_3 || IsDeviceExtensionAvailable(_physical_device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME));
+		bool synchronization2_available = has_features2 &&
+			(core_1_3 || IsDeviceExtensionAvailable(_physical_device, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME));
+		// Queried through vkGetPhysicalDeviceMemoryProperties2, so it needs 1.1 as well
+		_memory_budget_supported = has_features2 && IsDeviceExtensionAvailable(_physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		_calibrated_timestamps_supported = IsDeviceExtensionAvailable(_physical_device, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)
+			&& IsDeviceTimeDomainCalibrateable(_physical_device);
+
+		VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering_features = {};
+		dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
+		VkPhysicalDeviceSynchronization2Features synchronization2_features = {};
+		synchronization2_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+
+		VkPhysicalDeviceFeatures2 device_features = {};
+		device_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+
+		// Only structures of available extensions may be chained
+		void** chain_tail = &device_features.pNext;
+		auto chain = [&chain_tail](auto& features)
+		{
+			*chain_tail = &features;
+			chain_tail = &features.pNext;
+		};
+		if (dynamic_rendering_available)
+		{
+			chain(dynamic_rendering_features);
+		}
+		if (synchronization2_available)
+		{
+			chain(synchronization2_features);
+		}
+
+		// The same chain is queried for support and then passed to vkCreateDevice
+		if (has_features2)
+		{
+			vkGetPhysicalDeviceFeatures2(_physical_device, &device_features);
+		}
+		// Core features are enabled individually, only the ones the device has
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(_physical_device, &supported_features);
+		_storage_image_extended_formats_supported = supported_features.shaderStorageImageExtendedFormats;
+		device_features.features = {};
+		device_features.features.samplerAnisotropy = VK_TRUE;
+		device_features.features.shaderStorageImageExtendedFormats = supported_features.shaderStorageImageExtendedFormats;
+
+		_dynamic_rendering_supported = dynamic_rendering_available && dynamic_rendering_features.dynamicRendering;
+		_synchronization2_supported = synchronization2_available && synchronization2_features.synchronization2;
+		if (dynamic_rendering_available && !core_1_3)
+		{
+			enabled_extensions.emplace_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+		}
+		if (synchronization2_available && !core_1_3)
+		{
+			enabled_extensions.emplace_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+		}
+		if (_memory_budget_supported)
+		{
+			enabled_extensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+		if (_calibrated_timestamps_supported)
+		{
+			enabled_extensions.emplace_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+		}
+		std::cout << "[CvlDevice] Dynamic rendering: " << (_dynamic_rendering_supported ? "supported" : "not supported")
+			<< ", synchronization2: " << (_synchronization2_supported ? "supported" : "not supported")
+			<< ", memory budget: " << (_memory_budget_supported ? "supported" : "not supported")
+			<< ", calibrated timestamps: " << (_calibrated_timestamps_supported ? "supported" : "not supported") << std::endl;
 
 		VkDeviceCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		create_info.pNext = &device_features;
 		create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
 		create_info.pQueueCreateInfos = queue_create_infos.data();
-		create_info.pEnabledFeatures = &device_features;
-		create_info.enabledExtensionCount = static_cast<uint32_t>(_device_extensions.size());
-		create_info.ppEnabledExtensionNames = _device_extensions.data();
+		create_info.pEnabledFeatures = nullptr; // passed through VkPhysicalDeviceFeatures2 in pNext
+		create_info.enabledExtensionCount = static_cast<uint32_t>(enabled_extensions.size());
+		create_info.ppEnabledExtensionNames = enabled_extensions.data();
 		// By now there is no distinction between instance and device specific validation layers, so
 		// This is optional
 		if (_enable_validation_layers)
@@ -285,20 +436,82 @@ namespace cvl
 			create_info.enabledLayerCount = 0;
 		}
 
-		if (vkCreateDevice(_physical_device, &create_info, nullptr, &_device) != VK_SUCCESS)
+		if (vkCreateDevice(_physical_device, &create_info, GetAllocator(), &_device) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to create logical device!");
 		}
 
-		vkGetDeviceQueue(_device, indices.graphics_family.value(), 0, &_graphics_queue);
 		vkGetDeviceQueue(_device, indices.present_family.value(), 0, &_present_queue);
+
+		uint32_t queue_family_count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(_physical_device, &queue_family_count, nullptr);
+		std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+		vkGetPhysicalDeviceQueueFamilyProperties(_physical_device, &queue_family_count, queue_families.data());
+		for (size_t type = 0; type < _queues.size(); ++type)
+		{
+			vkGetDeviceQueue(_device, _queue_families[type], 0, &_queues[type]);
+			_timestamp_valid_bits[type] = queue_families[_queue_families[type]].timestampValidBits;
+			_timestamps_supported[type] = _timestamp_valid_bits[type] > 0 && _physical_device_properties.limits.timestampPeriod > 0.0f;
+			_queue_locks[type] = type;
+			for (size_t other = 0; other < type; ++other)
+			{
+				if (_queues[other] == _queues[type])
+				{
+					_queue_locks[type] = _queue_locks[other];
+					break;
+				}
+			}
+		}
+		std::cout << "[CvlDevice] Queue families: graphics " << _queue_families[static_cast<size_t>(QueueType::Graphics)]
+			<< ", compute " << _queue_families[static_cast<size_t>(QueueType::Compute)]
+			<< (HasDedicatedQueue(QueueType::Compute) ? " (dedicated)" : " (shared)")
+			<< ", transfer " << _queue_families[static_cast<size_t>(QueueType::Transfer)]
+			<< (indices.transfer_family.has_value() ? " (dedicated)" : " (shared)") << std::endl;
+
+		if (_dynamic_rendering_supported)
+		{
+			const char* begin_name = core_1_3 ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR";
+			const char* end_name = core_1_3 ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR";
+			_vk_cmd_begin_rendering = (PFN_vkCmdBeginRendering) vkGetDeviceProcAddr(_device, begin_name);
+			_vk_cmd_end_rendering = (PFN_vkCmdEndRendering) vkGetDeviceProcAddr(_device, end_name);
+			if (_vk_cmd_begin_rendering == nullptr || _vk_cmd_end_rendering == nullptr)
+			{
+				throw std::runtime_error("[CvlDevice] Failed to load dynamic rendering functions!");
+			}
+		}
+
+		if (_synchronization2_supported)
+		{
+			const char* barrier_name = core_1_3 ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR";
+			_vk_cmd_pipeline_barrier2 = (PFN_vkCmdPipelineBarrier2) vkGetDeviceProcAddr(_device, barrier_name);
+			if (_vk_cmd_pipeline_barrier2 == nullptr)
+			{
+				throw std::runtime_error("[CvlDevice] Failed to load synchronization2 functions!");
+			}
+		}
+
+		vkGetPhysicalDeviceMemoryProperties(_physical_device, &_memory_properties);
+		_heap_budgets.resize(_memory_properties.memoryHeapCount);
+		_queried_heap_usage.resize(_memory_properties.memoryHeapCount, 0);
+		_queried_heap_tracked.resize(_memory_properties.memoryHeapCount, 0);
+		_heap_under_pressure.resize(_memory_properties.memoryHeapCount, false);
+		for (uint32_t heap = 0; heap < _memory_properties.memoryHeapCount; ++heap)
+		{
+			_heap_budgets[heap].size = _memory_properties.memoryHeaps[heap].size;
+			_heap_budgets[heap].device_local = (_memory_properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		}
+		std::lock_guard<std::mutex> lock(_memory_mutex);
+		QueryMemoryBudget();
 	}
 	/* ~Devices */
 
 	/* Surface */
 	void CvlDevice::CreateSurface()
 	{
-		_window.CreateWindowSurface(_instance, nullptr, &_surface);	
+		if (_window != nullptr)
+		{
+			_window->CreateWindowSurface(_instance, GetAllocator(), &_surface);
+		}
 	}
 
 	VkSurfaceFormatKHR CvlDevice::ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& available_formats)
@@ -335,7 +548,7 @@ namespace cvl
 		else
 		{
 			int width, height;
-			_window.GetFramebufferSize(&width, &height);
+			_window->GetFramebufferSize(&width, &height);
 
 			VkExtent2D actual_extent =
 			{
@@ -364,7 +577,7 @@ namespace cvl
 		app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		app_info.pEngineName = "No Engine";
 		app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		app_info.apiVersion = VK_API_VERSION_1_0;
+		app_info.apiVersion = VK_API_VERSION_1_3;
 
 		VkInstanceCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -394,7 +607,7 @@ namespace cvl
 			create_info.enabledLayerCount = 0;
 			create_info.pNext = nullptr;
 		}
-		if (vkCreateInstance(&create_info, nullptr, &_instance) != VK_SUCCESS)
+		if (vkCreateInstance(&create_info, GetAllocator(), &_instance) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to create instance!");
 		}
@@ -407,10 +620,14 @@ namespace cvl
 
 	std::vector<const char*> CvlDevice::GetRequiredExtensions()
 	{
-		uint32_t glfw_extension_count = 0;
-		const char** glfw_extensions;
-		glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
-		std::vector<const char*> extensions(glfw_extensions, glfw_extensions + glfw_extension_count);
+		// Surface extensions are only needed with a window, headless devices don't initialize GLFW at all
+		std::vector<const char*> extensions;
+		if (_window != nullptr)
+		{
+			uint32_t glfw_extension_count = 0;
+			const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+			extensions.assign(glfw_extensions, glfw_extensions + glfw_extension_count);
+		}
 		if (_enable_validation_layers)
 		{
 			extensions.emplace_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -445,6 +662,16 @@ namespace cvl
 	}
 
 	uint32_t CvlDevice::FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties)
+	{
+		std::optional<uint32_t> memory_type = TryFindMemoryType(type_filter, properties);
+		if (!memory_type.has_value())
+		{
+			throw std::runtime_error("[CvlDevice] Failed to find suitable memory type!");
+		}
+		return memory_type.value();
+	}
+
+	std::optional<uint32_t> CvlDevice::TryFindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties)
 	{
 		VkPhysicalDeviceMemoryProperties mem_properties;
 		vkGetPhysicalDeviceMemoryProperties(_physical_device, &mem_properties);
@@ -456,7 +683,7 @@ namespace cvl
 				return i;
 			}
 		}
-		throw std::runtime_error("[CvlDevice] Failed to find suitable memory type!");
+		return std::nullopt;
 	}
 
 	VkFormat CvlDevice::FindSupportedFormat
@@ -483,23 +710,63 @@ namespace cvl
 		throw std::runtime_error("[CvlDevice] Failed to find supported format!");
 	}
 
+	bool CvlDevice::IsFormatFeatureSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features)
+	{
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(_physical_device, format, &properties);
+		VkFormatFeatureFlags supported = tiling == VK_IMAGE_TILING_LINEAR ? properties.linearTilingFeatures : properties.optimalTilingFeatures;
+		return (supported & features) == features;
+	}
+
+	/* Queues */
+	VkResult CvlDevice::Submit(QueueType queue, const QueueSubmission& submission, VkFence fence)
+	{
+		assert(submission.wait_semaphores.size() == submission.wait_stages.size());
+		VkSubmitInfo submit_info = {};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.waitSemaphoreCount = static_cast<uint32_t>(submission.wait_semaphores.size());
+		submit_info.pWaitSemaphores = submission.wait_semaphores.data();
+		submit_info.pWaitDstStageMask = submission.wait_stages.data();
+		submit_info.commandBufferCount = static_cast<uint32_t>(submission.command_buffers.size());
+		submit_info.pCommandBuffers = submission.command_buffers.data();
+		submit_info.signalSemaphoreCount = static_cast<uint32_t>(submission.signal_semaphores.size());
+		submit_info.pSignalSemaphores = submission.signal_semaphores.data();
+
+		size_t type = static_cast<size_t>(queue);
+		std::lock_guard<std::mutex> lock(_queue_mutexes[_queue_locks[type]]);
+		return vkQueueSubmit(_queues[type], 1, &submit_info, fence);
+	}
+	/* ~Queues */
+
 	/* Buffers */
 	void CvlDevice::CreateBuffer
 	(
 		VkDeviceSize size,
 		VkBufferUsageFlags usage,
 		VkMemoryPropertyFlags properties,
+		MemoryCategory category,
 		VkBuffer& buffer,
-		VkDeviceMemory& buffer_memory
+		VkDeviceMemory& buffer_memory,
+		const std::vector<uint32_t>& queue_families
 	)
 	{
+		std::vector<uint32_t> unique_families = queue_families;
+		std::sort(unique_families.begin(), unique_families.end());
+		unique_families.erase(std::unique(unique_families.begin(), unique_families.end()), unique_families.end());
+
 		VkBufferCreateInfo buff_create_info = {};
 		buff_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 		buff_create_info.size = size;
 		buff_create_info.usage = usage;
 		buff_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (unique_families.size() > 1)
+		{
+			buff_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			buff_create_info.queueFamilyIndexCount = static_cast<uint32_t>(unique_families.size());
+			buff_create_info.pQueueFamilyIndices = unique_families.data();
+		}
 
-		if (vkCreateBuffer(_device, &buff_create_info, nullptr, &buffer) != VK_SUCCESS)
+		if (vkCreateBuffer(_device, &buff_create_info, GetAllocator(), &buffer) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to create vertex buffer!");
 		}
@@ -512,7 +779,7 @@ namespace cvl
 		alloc_info.allocationSize = mem_requirements.size;
 		alloc_info.memoryTypeIndex = FindMemoryType(mem_requirements.memoryTypeBits, properties);
 
-		if (vkAllocateMemory(_device, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS)
+		if (AllocateMemory(alloc_info, category, buffer_memory) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to allocate vertex buffer memory!");
 		}
@@ -543,13 +810,13 @@ namespace cvl
 	{
 		vkEndCommandBuffer(command_buffer);
 
-		VkSubmitInfo submit_info = {};
-		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers = &command_buffer;
-
-		vkQueueSubmit(_graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-		vkQueueWaitIdle(_graphics_queue);
+		QueueSubmission submission;
+		submission.command_buffers = { command_buffer };
+		Submit(QueueType::Graphics, submission);
+		{
+			std::lock_guard<std::mutex> lock(_queue_mutexes[_queue_locks[static_cast<size_t>(QueueType::Graphics)]]);
+			vkQueueWaitIdle(GraphicsQueue());
+		}
 
 		vkFreeCommandBuffers(_device, _command_pool, 1, &command_buffer);
 	}
@@ -569,8 +836,6 @@ namespace cvl
 
 	void CvlDevice::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layer_count)
 	{
-		VkCommandBuffer command_buffer = BeginSingleTimeCommands();
-
 		VkBufferImageCopy region = {};
 		region.bufferOffset = 0;
 		region.bufferRowLength = 0;
@@ -584,13 +849,31 @@ namespace cvl
 		region.imageOffset = { 0, 0, 0 };
 		region.imageExtent = { width, height, 1 };
 
-		vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		CopyBufferToImage(buffer, image, std::vector<VkBufferImageCopy>{ region });
+	}
+
+	void CvlDevice::CopyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy>& regions)
+	{
+		if (regions.empty())
+		{
+			return;
+		}
+		VkCommandBuffer command_buffer = BeginSingleTimeCommands();
+		vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
 		EndSingleTimeCommands(command_buffer);
 	}
 
-	void CvlDevice::CreateImageWithInfo(const VkImageCreateInfo& image_info, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& image_memory)
+	VkMemoryPropertyFlags CvlDevice::CreateImageWithInfo
+	(
+		const VkImageCreateInfo& image_info,
+		VkMemoryPropertyFlags properties,
+		MemoryCategory category,
+		VkImage& image,
+		VkDeviceMemory& image_memory,
+		VkMemoryPropertyFlags optional_properties
+	)
 	{
-		if (vkCreateImage(_device, &image_info, nullptr, &image) != VK_SUCCESS)
+		if (vkCreateImage(_device, &image_info, GetAllocator(), &image) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to create image!");
 		}
@@ -601,9 +884,14 @@ namespace cvl
 		VkMemoryAllocateInfo alloc_info = {};
 		alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
 		alloc_info.allocationSize = mem_requirements.size;
-		alloc_info.memoryTypeIndex = FindMemoryType(mem_requirements.memoryTypeBits, properties);
+		std::optional<uint32_t> preferred_type = std::nullopt;
+		if (optional_properties != 0)
+		{
+			preferred_type = TryFindMemoryType(mem_requirements.memoryTypeBits, properties | optional_properties);
+		}
+		alloc_info.memoryTypeIndex = preferred_type.has_value() ? preferred_type.value() : FindMemoryType(mem_requirements.memoryTypeBits, properties);
 
-		if (vkAllocateMemory(_device, &alloc_info, nullptr, &image_memory) != VK_SUCCESS)
+		if (AllocateMemory(alloc_info, category, image_memory) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to allocate image memory!");
 		}
@@ -612,9 +900,225 @@ namespace cvl
 		{
 			throw std::runtime_error("[CvlDevice] Failed to bind image memory!");
 		}
+
+		return _memory_properties.memoryTypes[alloc_info.memoryTypeIndex].propertyFlags;
 	}
 	/* ~Buffers */
 
+	/* Memory */
+	VkResult CvlDevice::AllocateMemory(const VkMemoryAllocateInfo& alloc_info, MemoryCategory category, VkDeviceMemory& memory)
+	{
+		VkResult result = vkAllocateMemory(_device, &alloc_info, GetAllocator(), &memory);
+		if (result != VK_SUCCESS)
+		{
+			return result;
+		}
+
+		std::vector<std::pair<uint32_t, MemoryHeapBudget>> pressure;
+		MemoryBudgetCallback callback;
+		{
+			std::lock_guard<std::mutex> lock(_memory_mutex);
+			uint32_t heap = _memory_properties.memoryTypes[alloc_info.memoryTypeIndex].heapIndex;
+			_allocations[memory] = { alloc_info.allocationSize, heap, category };
+			MemoryCategoryUsage& usage = _category_usage[static_cast<size_t>(category)];
+			usage.bytes += alloc_info.allocationSize;
+			usage.peak = std::max(usage.peak, usage.bytes);
+			++usage.allocations;
+			_heap_budgets[heap].tracked += alloc_info.allocationSize;
+			RefreshHeapUsage(heap);
+			pressure = CollectMemoryPressure();
+			callback = _memory_budget_callback;
+		}
+		// Outside the lock, the callback may free memory
+		for (const auto& [heap, budget] : pressure)
+		{
+			callback(heap, budget);
+		}
+		return VK_SUCCESS;
+	}
+
+	void CvlDevice::FreeMemory(VkDeviceMemory memory)
+	{
+		if (memory == VK_NULL_HANDLE)
+		{
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(_memory_mutex);
+			auto it = _allocations.find(memory);
+			if (it != _allocations.end())
+			{
+				const MemoryAllocation& allocation = it->second;
+				MemoryCategoryUsage& usage = _category_usage[static_cast<size_t>(allocation.category)];
+				usage.bytes -= allocation.size;
+				--usage.allocations;
+				_heap_budgets[allocation.heap].tracked -= allocation.size;
+				RefreshHeapUsage(allocation.heap);
+				_allocations.erase(it);
+				// Only re-arms heaps that dropped below the pressure threshold
+				CollectMemoryPressure();
+			}
+		}
+		vkFreeMemory(_device, memory, GetAllocator());
+	}
+
+	void CvlDevice::UpdateMemoryBudget()
+	{
+		std::vector<std::pair<uint32_t, MemoryHeapBudget>> pressure;
+		MemoryBudgetCallback callback;
+		{
+			std::lock_guard<std::mutex> lock(_memory_mutex);
+			QueryMemoryBudget();
+			pressure = CollectMemoryPressure();
+			callback = _memory_budget_callback;
+		}
+		for (const auto& [heap, budget] : pressure)
+		{
+			callback(heap, budget);
+		}
+	}
+
+	std::vector<MemoryHeapBudget> CvlDevice::GetMemoryHeapBudgets()
+	{
+		std::lock_guard<std::mutex> lock(_memory_mutex);
+		return _heap_budgets;
+	}
+
+	MemoryCategoryUsage CvlDevice::GetMemoryCategoryUsage(MemoryCategory category)
+	{
+		std::lock_guard<std::mutex> lock(_memory_mutex);
+		return _category_usage[static_cast<size_t>(category)];
+	}
+
+	void CvlDevice::SetMemoryBudgetCallback(MemoryBudgetCallback callback, float pressure)
+	{
+		std::lock_guard<std::mutex> lock(_memory_mutex);
+		_memory_budget_callback = std::move(callback);
+		_memory_pressure = pressure;
+		std::fill(_heap_under_pressure.begin(), _heap_under_pressure.end(), false);
+	}
+
+	void CvlDevice::ReportMemoryUsage()
+	{
+		constexpr double mb = 1024.0 * 1024.0;
+		std::lock_guard<std::mutex> lock(_memory_mutex);
+		std::cout << "[CvlDevice] Memory (" << (_memory_budget_supported ? "VK_EXT_memory_budget" : "estimated budget") << "):\n";
+		for (size_t category = 0; category < _category_usage.size(); ++category)
+		{
+			const MemoryCategoryUsage& usage = _category_usage[category];
+			std::cout << '\t' << GetMemoryCategoryName(static_cast<MemoryCategory>(category)) << ": " << usage.bytes / mb << " MB in "
+				<< usage.allocations << " allocations, peak " << usage.peak / mb << " MB\n";
+		}
+		for (uint32_t heap = 0; heap < _heap_budgets.size(); ++heap)
+		{
+			const MemoryHeapBudget& budget = _heap_budgets[heap];
+			std::cout << "\tHeap " << heap << (budget.device_local ? " (device local): " : ": ") << budget.usage / mb << " / " << budget.budget / mb
+				<< " MB, peak " << budget.peak / mb << " MB, tracked " << budget.tracked / mb << " MB of " << budget.size / mb << " MB\n";
+		}
+		// Still counted above, their memory is freed once the frames in flight are done with them
+		std::cout << "\tDeferred destruction: " << _deletion_queue.GetPendingCount() << " objects pending\n";
+		_host_allocator.Report();
+	}
+
+	const char* CvlDevice::GetMemoryCategoryName(MemoryCategory category)
+	{
+		switch (category)
+		{
+		case MemoryCategory::Geometry: return "Geometry";
+		case MemoryCategory::Textures: return "Textures";
+		case MemoryCategory::Attachments: return "Attachments";
+		case MemoryCategory::Staging: return "Staging";
+		default: return "Unknown";
+		}
+	}
+
+	// private
+	void CvlDevice::QueryMemoryBudget()
+	{
+		if (_memory_budget_supported)
+		{
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+			budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			VkPhysicalDeviceMemoryProperties2 memory_properties = {};
+			memory_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			memory_properties.pNext = &budget_properties;
+			vkGetPhysicalDeviceMemoryProperties2(_physical_device, &memory_properties);
+			for (uint32_t heap = 0; heap < _heap_budgets.size(); ++heap)
+			{
+				_heap_budgets[heap].budget = budget_properties.heapBudget[heap];
+				_queried_heap_usage[heap] = budget_properties.heapUsage[heap];
+				_queried_heap_tracked[heap] = _heap_budgets[heap].tracked;
+			}
+		}
+		else
+		{
+			// Leaves room for other processes and driver internal allocations
+			for (MemoryHeapBudget& budget : _heap_budgets)
+			{
+				budget.budget = budget.size / 10 * 8;
+			}
+		}
+		for (uint32_t heap = 0; heap < _heap_budgets.size(); ++heap)
+		{
+			RefreshHeapUsage(heap);
+		}
+	}
+
+	void CvlDevice::RefreshHeapUsage(uint32_t heap)
+	{
+		MemoryHeapBudget& budget = _heap_budgets[heap];
+		if (_memory_budget_supported)
+		{
+			// The driver's figure is only updated by queries, allocations since the last one are added on top
+			int64_t delta = static_cast<int64_t>(budget.tracked) - static_cast<int64_t>(_queried_heap_tracked[heap]);
+			budget.usage = static_cast<VkDeviceSize>(std::max<int64_t>(static_cast<int64_t>(_queried_heap_usage[heap]) + delta, 0));
+		}
+		else
+		{
+			budget.usage = budget.tracked;
+		}
+		budget.peak = std::max(budget.peak, budget.usage);
+	}
+
+	std::vector<std::pair<uint32_t, MemoryHeapBudget>> CvlDevice::CollectMemoryPressure()
+	{
+		std::vector<std::pair<uint32_t, MemoryHeapBudget>> pressure;
+		for (uint32_t heap = 0; heap < _heap_budgets.size(); ++heap)
+		{
+			const MemoryHeapBudget& budget = _heap_budgets[heap];
+			bool under_pressure = budget.budget > 0 && static_cast<double>(budget.usage) >= static_cast<double>(budget.budget) * _memory_pressure;
+			if (under_pressure && !_heap_under_pressure[heap] && _memory_budget_callback)
+			{
+				pressure.emplace_back(heap, budget);
+			}
+			_heap_under_pressure[heap] = under_pressure;
+		}
+		return pressure;
+	}
+	/* ~Memory */
+
+	/* Dynamic rendering */
+	void CvlDevice::CmdBeginRendering(VkCommandBuffer command_buffer, const VkRenderingInfo& rendering_info)
+	{
+		assert(_dynamic_rendering_supported && "Dynamic rendering is not enabled on this device");
+		_vk_cmd_begin_rendering(command_buffer, &rendering_info);
+	}
+
+	void CvlDevice::CmdEndRendering(VkCommandBuffer command_buffer)
+	{
+		assert(_dynamic_rendering_supported && "Dynamic rendering is not enabled on this device");
+		_vk_cmd_end_rendering(command_buffer);
+	}
+	/* ~Dynamic rendering */
+
+	/* Synchronization2 */
+	void CvlDevice::CmdPipelineBarrier2(VkCommandBuffer command_buffer, const VkDependencyInfo& dependency_info)
+	{
+		assert(_synchronization2_supported && "Synchronization2 is not enabled on this device");
+		_vk_cmd_pipeline_barrier2(command_buffer, &dependency_info);
+	}
+	/* ~Synchronization2 */
+
 	/* Command Pool */
 	void CvlDevice::CreateCommandPool()
 	{
@@ -625,7 +1129,7 @@ namespace cvl
 		pool_create_info.flags = 
 			VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-		if (vkCreateCommandPool(_device, &pool_create_info, nullptr, &_command_pool) != VK_SUCCESS)
+		if (vkCreateCommandPool(_device, &pool_create_info, GetAllocator(), &_command_pool) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlDevice] Failed to create command pool!");
 		}
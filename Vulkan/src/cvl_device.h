@@ -4,11 +4,17 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <array>
+#include <functional>
 #include <stdexcept>
 #include <vector>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <unordered_map>
 
+#include "cvl_deletion_queue.h"
+#include "cvl_host_allocator.h"
 #include "cvl_window.h"
 
 namespace cvl
@@ -24,6 +30,9 @@ namespace cvl
 	{
 		std::optional<uint32_t> graphics_family;
 		std::optional<uint32_t> present_family;
+		// Only set for families without graphics, the queues fall back to a more general family otherwise
+		std::optional<uint32_t> compute_family;
+		std::optional<uint32_t> transfer_family;
 
 		bool IsComplete()
 		{
@@ -31,6 +40,56 @@ namespace cvl
 		}
 	};
 
+	enum class QueueType
+	{
+		Graphics,
+		Compute,	// compute-only family when the device has one
+		Transfer,	// transfer-only family when the device has one
+		Count
+	};
+
+	// Wait semaphores are paired with wait_stages by index
+	struct QueueSubmission
+	{
+		std::vector<VkCommandBuffer> command_buffers;
+		std::vector<VkSemaphore> wait_semaphores;
+		std::vector<VkPipelineStageFlags> wait_stages;
+		std::vector<VkSemaphore> signal_semaphores;
+	};
+
+	// What device memory is used for, allocations are tracked per category
+	enum class MemoryCategory
+	{
+		Geometry,		// vertex, index, storage and indirect buffers
+		Textures,
+		Attachments,	// render targets, depth and render graph transients
+		Staging,		// host-visible upload and streaming buffers
+		Count
+	};
+
+	struct MemoryCategoryUsage
+	{
+		VkDeviceSize bytes = 0;
+		VkDeviceSize peak = 0;
+		uint32_t allocations = 0;
+	};
+
+	struct MemoryHeapBudget
+	{
+		VkDeviceSize size = 0;
+		bool device_local = false;
+		// Whole process usage and budget from VK_EXT_memory_budget, advanced by tracked allocations between queries.
+		// Without the extension usage is the tracked usage and the budget 80% of the heap size
+		VkDeviceSize usage = 0;
+		VkDeviceSize budget = 0;
+		VkDeviceSize peak = 0;
+		// Allocations made through CvlDevice
+		VkDeviceSize tracked = 0;
+	};
+
+	// Called with the heap index when its usage crosses the pressure fraction of its budget
+	using MemoryBudgetCallback = std::function<void(uint32_t heap, const MemoryHeapBudget& budget)>;
+
 	class CvlDevice
 	{
 	public:
@@ -40,6 +99,8 @@ namespace cvl
 		static constexpr bool _enable_validation_layers = true;
 #endif
 		CvlDevice(CvlWindow& window);
+		// Headless, without a surface or swap chain support, for tools that only render offscreen
+		CvlDevice();
 		~CvlDevice();
 
 		CvlDevice(const CvlDevice&) = delete;
@@ -49,47 +110,107 @@ namespace cvl
 
 		VkDevice device() { return _device; }
 		VkSurfaceKHR surface() { return _surface; }
-		VkQueue GraphicsQueue() { return _graphics_queue; }
+		bool IsHeadless() { return _window == nullptr; }
+		VkQueue GraphicsQueue() { return _queues[static_cast<size_t>(QueueType::Graphics)]; }
 		VkQueue PresentQueue() { return _present_queue; }
+		VkQueue GetQueue(QueueType queue) { return _queues[static_cast<size_t>(queue)]; }
+		uint32_t GetQueueFamily(QueueType queue) { return _queue_families[static_cast<size_t>(queue)]; }
+		// False when the queue type shares the graphics queue
+		bool HasDedicatedQueue(QueueType queue) { return queue != QueueType::Graphics && GetQueue(queue) != GraphicsQueue(); }
 		VkCommandPool GetCommandPool() { return _command_pool;  }
+		// Host allocation callbacks for every vkCreate*, vkDestroy*, vkAllocateMemory and vkFreeMemory call
+		const VkAllocationCallbacks* GetAllocator() { return _host_allocator.GetCallbacks(); }
+		bool IsDynamicRenderingSupported() { return _dynamic_rendering_supported; }
+		bool IsSynchronization2Supported() { return _synchronization2_supported; }
+		bool IsTimestampSupported(QueueType queue = QueueType::Graphics) { return _timestamps_supported[static_cast<size_t>(queue)]; }
+		// Bits of a timestamp the queue's family actually writes, the rest are undefined
+		uint32_t GetTimestampValidBits(QueueType queue = QueueType::Graphics) { return _timestamp_valid_bits[static_cast<size_t>(queue)]; }
+		bool IsMemoryBudgetSupported() { return _memory_budget_supported; }
+		// VK_EXT_calibrated_timestamps with the device time domain, which every queue's timestamps belong to.
+		// Without it timestamps are only comparable within one queue
+		bool IsCalibratedTimestampSupported() { return _calibrated_timestamps_supported; }
+		// Storage images in formats such as rg32f, enabled when the device has it
+		bool IsStorageImageExtendedFormatsSupported() { return _storage_image_extended_formats_supported; }
+		// Nanoseconds per timestamp tick
+		float GetTimestampPeriod() { return _physical_device_properties.limits.timestampPeriod; }
+		const VkPhysicalDeviceProperties& GetPhysicalDeviceProperties() { return _physical_device_properties; }
 
 		SwapChainSupportDetails GetSwapChainSupport() { return QuerySwapChainSupport(_physical_device); }
 		QueueFamilyIndices FindPhysicalQueueFamilies() { return FindQueueFamilies(_physical_device); }
 
 		uint32_t FindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties);
+		std::optional<uint32_t> TryFindMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties);
 		VkFormat FindSupportedFormat
 		(
 			const std::vector<VkFormat>& candidates,
 			VkImageTiling tiling,
 			VkFormatFeatureFlags features
 		);
+		bool IsFormatFeatureSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features);
+
+		/* Queues */
+		// Queue types sharing a VkQueue also share its lock, so submissions are safe from any thread
+		VkResult Submit(QueueType queue, const QueueSubmission& submission, VkFence fence = VK_NULL_HANDLE);
+
+		/* Memory */
+		// vkAllocateMemory with the allocation tracked under category, must be freed with FreeMemory
+		VkResult AllocateMemory(const VkMemoryAllocateInfo& alloc_info, MemoryCategory category, VkDeviceMemory& memory);
+		void FreeMemory(VkDeviceMemory memory);
+		// Re-queries VK_EXT_memory_budget and runs the pressure callback, once per frame is enough
+		void UpdateMemoryBudget();
+		std::vector<MemoryHeapBudget> GetMemoryHeapBudgets();
+		MemoryCategoryUsage GetMemoryCategoryUsage(MemoryCategory category);
+		// The callback runs again for a heap once its usage has dropped below pressure and crossed it again
+		void SetMemoryBudgetCallback(MemoryBudgetCallback callback, float pressure = 0.9f);
+		void ReportMemoryUsage();
+		static const char* GetMemoryCategoryName(MemoryCategory category);
+		// Objects still used by frames in flight are handed over here instead of being destroyed
+		CvlDeletionQueue& GetDeletionQueue() { return _deletion_queue; }
 
 		/* Buffers */
+		// Buffers accessed from more than one of queue_families are created with concurrent sharing, so no ownership transfers are needed
 		void CreateBuffer
 		(
 			VkDeviceSize size,
 			VkBufferUsageFlags usage,
 			VkMemoryPropertyFlags properties,
+			MemoryCategory category,
 			VkBuffer& buffer,
-			VkDeviceMemory& buffer_memory
+			VkDeviceMemory& buffer_memory,
+			const std::vector<uint32_t>& queue_families = {}
 		);
 		VkCommandBuffer BeginSingleTimeCommands();
 		void EndSingleTimeCommands(VkCommandBuffer command_buffer);
 		void CopyBuffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size);
 		void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layer_count);
+		// Sub-region copies in one submission, the image must be in TRANSFER_DST_OPTIMAL
+		void CopyBufferToImage(VkBuffer buffer, VkImage image, const std::vector<VkBufferImageCopy>& regions);
 
-		void CreateImageWithInfo
+		// optional_properties are used when a matching memory type exists, returns the flags of the chosen type
+		VkMemoryPropertyFlags CreateImageWithInfo
 		(
 			const VkImageCreateInfo& image_info,
 			VkMemoryPropertyFlags properties,
+			MemoryCategory category,
 			VkImage& image,
-			VkDeviceMemory& image_memory
+			VkDeviceMemory& image_memory,
+			VkMemoryPropertyFlags optional_properties = 0
 		);
 
+		/* Dynamic rendering */
+		void CmdBeginRendering(VkCommandBuffer command_buffer, const VkRenderingInfo& rendering_info);
+		void CmdEndRendering(VkCommandBuffer command_buffer);
+
+		/* Synchronization2 */
+		void CmdPipelineBarrier2(VkCommandBuffer command_buffer, const VkDependencyInfo& dependency_info);
+
 	private:
+		// Outlives every object created with it
+		CvlHostAllocator _host_allocator;
 		VkInstance _instance;
-		CvlWindow& _window;
+		CvlWindow* _window;
 
+		void Initialize();
 		void CreateInstance();
 		void SetupDebugMessenger();
 		void CreateSurface();
@@ -101,6 +222,8 @@ namespace cvl
 		QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device);
 		SwapChainSupportDetails QuerySwapChainSupport(VkPhysicalDevice device);
 		bool CheckDeviceExtensionSupport(VkPhysicalDevice device);
+		bool IsDeviceExtensionAvailable(VkPhysicalDevice device, const char* extension_name);
+		bool IsDeviceTimeDomainCalibrateable(VkPhysicalDevice device);
 		bool IsDeviceSuitable(VkPhysicalDevice device);
 
 		/* Surface */
@@ -125,8 +248,12 @@ namespace cvl
 		/* Devices */
 		VkPhysicalDevice _physical_device = VK_NULL_HANDLE;
 		VkPhysicalDeviceProperties _physical_device_properties;
-		VkQueue _graphics_queue;
 		VkQueue _present_queue;
+		std::array<VkQueue, static_cast<size_t>(QueueType::Count)> _queues = {};
+		std::array<uint32_t, static_cast<size_t>(QueueType::Count)> _queue_families = {};
+		// Index of the lock guarding each queue type, types sharing a VkQueue map to the same lock
+		std::array<size_t, static_cast<size_t>(QueueType::Count)> _queue_locks = {};
+		std::array<std::mutex, static_cast<size_t>(QueueType::Count)> _queue_mutexes;
 		std::vector<const char*> _device_extensions =
 		{
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -135,8 +262,46 @@ namespace cvl
 		// Logical Device
 		VkDevice _device;
 
+		/* Optional features */
+		bool _dynamic_rendering_supported = false;
+		PFN_vkCmdBeginRendering _vk_cmd_begin_rendering = nullptr;
+		PFN_vkCmdEndRendering _vk_cmd_end_rendering = nullptr;
+		bool _synchronization2_supported = false;
+		PFN_vkCmdPipelineBarrier2 _vk_cmd_pipeline_barrier2 = nullptr;
+		std::array<bool, static_cast<size_t>(QueueType::Count)> _timestamps_supported = {};
+		std::array<uint32_t, static_cast<size_t>(QueueType::Count)> _timestamp_valid_bits = {};
+		bool _memory_budget_supported = false;
+		bool _calibrated_timestamps_supported = false;
+		bool _storage_image_extended_formats_supported = false;
+
+		/* Memory */
+		struct MemoryAllocation
+		{
+			VkDeviceSize size;
+			uint32_t heap;
+			MemoryCategory category;
+		};
+
+		// Expects _memory_mutex to be held
+		void QueryMemoryBudget();
+		void RefreshHeapUsage(uint32_t heap);
+		std::vector<std::pair<uint32_t, MemoryHeapBudget>> CollectMemoryPressure();
+
+		VkPhysicalDeviceMemoryProperties _memory_properties;
+		std::mutex _memory_mutex;
+		std::unordered_map<VkDeviceMemory, MemoryAllocation> _allocations;
+		std::array<MemoryCategoryUsage, static_cast<size_t>(MemoryCategory::Count)> _category_usage = {};
+		std::vector<MemoryHeapBudget> _heap_budgets;
+		// Driver reported usage and the tracked usage at the time of the last query
+		std::vector<VkDeviceSize> _queried_heap_usage;
+		std::vector<VkDeviceSize> _queried_heap_tracked;
+		std::vector<bool> _heap_under_pressure;
+		MemoryBudgetCallback _memory_budget_callback;
+		float _memory_pressure = 0.9f;
+		CvlDeletionQueue _deletion_queue{ *this };
+
 		/* Surface */
-		VkSurfaceKHR _surface;
+		VkSurfaceKHR _surface = VK_NULL_HANDLE;
 
 		/* Command Pool */
 		VkCommandPool _command_pool;
@@ -0,0 +1,245 @@
+#include "cvl_draw_list.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+
+namespace cvl
+{
+	uint64_t CvlDrawList::MakeKey(DrawPass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+	{
+		constexpr uint64_t depth_max = (1ull << DEPTH_BITS) - 1;
+		uint64_t quantized_depth = static_cast<uint64_t>(std::clamp(depth, 0.0f, 1.0f) * static_cast<float>(depth_max));
+		uint64_t state = (static_cast<uint64_t>(pipeline & ((1u << PIPELINE_BITS) - 1)) << (MATERIAL_BITS + MESH_BITS))
+			| (static_cast<uint64_t>(material & ((1u << MATERIAL_BITS) - 1)) << MESH_BITS)
+			| static_cast<uint64_t>(mesh & ((1u << MESH_BITS) - 1));
+		uint64_t key = static_cast<uint64_t>(pass) << (PIPELINE_BITS + MATERIAL_BITS + MESH_BITS + DEPTH_BITS);
+		if (pass == DrawPass::Transparent)
+		{
+			// Blending needs back to front, so depth outranks state
+			return key | ((depth_max - quantized_depth) << (PIPELINE_BITS + MATERIAL_BITS + MESH_BITS)) | state;
+		}
+		return key | (state << DEPTH_BITS) | quantized_depth;
+	}
+
+	void CvlDrawList::Clear()
+	{
+		_keys.clear();
+		_commands.clear();
+		_order.clear();
+	}
+
+	void CvlDrawList::Append(const std::vector<uint64_t>& keys, const std::vector<DrawCommand>& commands)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_keys.insert(_keys.end(), keys.begin(), keys.end());
+		_commands.insert(_commands.end(), commands.begin(), commands.end());
+	}
+
+	void CvlDrawList::Sort(CvlThreadPool& thread_pool)
+	{
+		auto start_time = std::chrono::high_resolution_clock::now();
+		_order.resize(_keys.size());
+		for (uint32_t i = 0; i < _order.size(); ++i)
+		{
+			_order[i] = i;
+		}
+		RadixSort(_keys, _order, _key_scratch, _order_scratch, thread_pool);
+		_stats.sort_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+		// Another pass over every command, only worth it for the frame that gets reported
+		if (_stats_frames + 1 == REPORT_INTERVAL_FRAMES)
+		{
+			CountUnsortedStateChanges();
+		}
+	}
+
+	void CvlDrawList::Record(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, const std::vector<glm::vec4>& materials)
+	{
+		_stats.draws = static_cast<uint32_t>(_order.size());
+		_stats.pipeline_binds = 0;
+		_stats.model_binds = 0;
+		_stats.material_pushes = 0;
+
+		// Push constants stay valid across binds of pipelines with compatible layouts
+		CvlPipeline* bound_pipeline = nullptr;
+		CvlModel* bound_model = nullptr;
+		uint32_t pushed_material = std::numeric_limits<uint32_t>::max();
+		for (uint32_t index : _order)
+		{
+			const DrawCommand& command = _commands[index];
+			if (command.pipeline != bound_pipeline)
+			{
+				command.pipeline->Bind(command_buffer);
+				bound_pipeline = command.pipeline;
+				++_stats.pipeline_binds;
+			}
+			if (command.model != bound_model)
+			{
+				command.model->Bind(command_buffer);
+				glm::vec4 dequantization = command.model->GetPositionDequantization();
+				vkCmdPushConstants
+				(
+					command_buffer,
+					pipeline_layout,
+					VK_SHADER_STAGE_VERTEX_BIT,
+					offsetof(DrawPushConstants, position_dequantization),
+					sizeof(dequantization),
+					&dequantization
+				);
+				bound_model = command.model;
+				++_stats.model_binds;
+			}
+			if (command.material != pushed_material)
+			{
+				vkCmdPushConstants
+				(
+					command_buffer,
+					pipeline_layout,
+					VK_SHADER_STAGE_VERTEX_BIT,
+					offsetof(DrawPushConstants, material),
+					sizeof(glm::vec4),
+					&materials[command.material]
+				);
+				pushed_material = command.material;
+				++_stats.material_pushes;
+			}
+			vkCmdPushConstants
+			(
+				command_buffer,
+				pipeline_layout,
+				VK_SHADER_STAGE_VERTEX_BIT,
+				offsetof(DrawPushConstants, transform),
+				sizeof(command.transform),
+				&command.transform
+			);
+			command.model->Draw(command_buffer);
+		}
+		if (++_stats_frames == REPORT_INTERVAL_FRAMES)
+		{
+			ReportStats();
+			_stats_frames = 0;
+		}
+	}
+
+	void CvlDrawList::RadixSort
+	(
+		std::vector<uint64_t>& keys,
+		std::vector<uint32_t>& values,
+		std::vector<uint64_t>& key_scratch,
+		std::vector<uint32_t>& value_scratch,
+		CvlThreadPool& thread_pool
+	)
+	{
+		size_t count = keys.size();
+		key_scratch.resize(count);
+		value_scratch.resize(count);
+		if (count < 2)
+		{
+			return;
+		}
+
+		// Each chunk is histogrammed and scattered by one task, chunks keep their relative order so every pass is stable
+		size_t chunk_count = std::clamp<size_t>(count / MIN_SORT_CHUNK, 1, thread_pool.GetThreadCount());
+		size_t chunk_size = (count + chunk_count - 1) / chunk_count;
+		std::vector<std::array<uint32_t, 256>> histograms(chunk_count);
+		std::vector<uint64_t> chunk_differences(chunk_count, 0);
+
+		// Bytes that are the same in every key (e.g. a single pass or pipeline) don't need a pass
+		thread_pool.ParallelFor(chunk_count, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t chunk = begin; chunk < end; ++chunk)
+			{
+				uint64_t difference = 0;
+				for (size_t i = chunk * chunk_size; i < std::min(count, (chunk + 1) * chunk_size); ++i)
+				{
+					difference |= keys[i] ^ keys[0];
+				}
+				chunk_differences[chunk] = difference;
+			}
+		});
+		uint64_t difference = 0;
+		for (uint64_t chunk_difference : chunk_differences)
+		{
+			difference |= chunk_difference;
+		}
+
+		for (uint32_t shift = 0; shift < 64; shift += 8)
+		{
+			if (((difference >> shift) & 0xFF) == 0)
+			{
+				continue;
+			}
+
+			thread_pool.ParallelFor(chunk_count, 1, [&](size_t begin, size_t end)
+			{
+				for (size_t chunk = begin; chunk < end; ++chunk)
+				{
+					std::array<uint32_t, 256>& histogram = histograms[chunk];
+					histogram.fill(0);
+					for (size_t i = chunk * chunk_size; i < std::min(count, (chunk + 1) * chunk_size); ++i)
+					{
+						++histogram[(keys[i] >> shift) & 0xFF];
+					}
+				}
+			});
+
+			// Exclusive prefix sum, digit major so each chunk writes its own contiguous part of every digit's range
+			uint32_t offset = 0;
+			for (uint32_t digit = 0; digit < 256; ++digit)
+			{
+				for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+				{
+					uint32_t digit_count = histograms[chunk][digit];
+					histograms[chunk][digit] = offset;
+					offset += digit_count;
+				}
+			}
+
+			thread_pool.ParallelFor(chunk_count, 1, [&](size_t begin, size_t end)
+			{
+				for (size_t chunk = begin; chunk < end; ++chunk)
+				{
+					std::array<uint32_t, 256>& offsets = histograms[chunk];
+					for (size_t i = chunk * chunk_size; i < std::min(count, (chunk + 1) * chunk_size); ++i)
+					{
+						uint32_t destination = offsets[(keys[i] >> shift) & 0xFF]++;
+						key_scratch[destination] = keys[i];
+						value_scratch[destination] = values[i];
+					}
+				}
+			});
+			keys.swap(key_scratch);
+			values.swap(value_scratch);
+		}
+	}
+
+	// private
+	void CvlDrawList::CountUnsortedStateChanges()
+	{
+		_stats.unsorted_pipeline_binds = 0;
+		_stats.unsorted_model_binds = 0;
+		_stats.unsorted_material_pushes = 0;
+		const DrawCommand* previous = nullptr;
+		for (const DrawCommand& command : _commands)
+		{
+			_stats.unsorted_pipeline_binds += previous == nullptr || command.pipeline != previous->pipeline;
+			_stats.unsorted_model_binds += previous == nullptr || command.model != previous->model;
+			_stats.unsorted_material_pushes += previous == nullptr || command.material != previous->material;
+			previous = &command;
+		}
+	}
+
+	void CvlDrawList::ReportStats()
+	{
+		uint32_t changes = _stats.pipeline_binds + _stats.model_binds + _stats.material_pushes;
+		uint32_t unsorted_changes = _stats.unsorted_pipeline_binds + _stats.unsorted_model_binds + _stats.unsorted_material_pushes;
+		std::cout << "[CvlDrawList] " << _stats.draws << " draws sorted in " << _stats.sort_ms << " ms, "
+			<< "pipeline binds " << _stats.pipeline_binds << " (" << _stats.unsorted_pipeline_binds << " unsorted), "
+			<< "model binds " << _stats.model_binds << " (" << _stats.unsorted_model_binds << " unsorted), "
+			<< "material pushes " << _stats.material_pushes << " (" << _stats.unsorted_material_pushes << " unsorted), "
+			<< 3 * _stats.draws - changes << " state changes avoided this frame ("
+			<< static_cast<int64_t>(unsorted_changes) - changes << " by sorting)\n";
+	}
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "cvl_model.h"
+#include "cvl_pipeline.h"
+#include "cvl_thread_pool.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cvl
+{
+	enum class DrawPass : uint32_t
+	{
+		Opaque = 0,
+		Transparent = 1
+	};
+
+	// Push constant block of every pipeline drawn from a CvlDrawList, ranges are only pushed when they change
+	struct DrawPushConstants
+	{
+		glm::mat4 transform;			// per draw
+		glm::vec4 position_dequantization;	// per mesh, see CvlModel::GetPositionDequantization
+		glm::vec4 material;				// per material
+	};
+
+	struct DrawCommand
+	{
+		CvlPipeline* pipeline;
+		CvlModel* model;
+		uint32_t material;
+		glm::mat4 transform;
+	};
+
+	struct DrawListStats
+	{
+		uint32_t draws = 0;
+		uint32_t pipeline_binds = 0;
+		uint32_t model_binds = 0;
+		uint32_t material_pushes = 0;
+		// Binds the same draws would have needed in submission order, only counted on frames that are reported
+		uint32_t unsorted_pipeline_binds = 0;
+		uint32_t unsorted_model_binds = 0;
+		uint32_t unsorted_material_pushes = 0;
+		double sort_ms = 0.0;
+	};
+
+	/*
+		Per-frame list of draws ordered by a 64-bit key, sorted with a parallel LSD radix sort.
+		Opaque keys:      pass | pipeline | material | mesh | depth (front to back, for early-Z)
+		Transparent keys: pass | inverted depth (back to front) | pipeline | material | mesh
+		Record binds pipelines and models and pushes material constants only when they change.
+	*/
+	class CvlDrawList
+	{
+	public:
+		static constexpr uint32_t PIPELINE_BITS = 10;
+		static constexpr uint32_t MATERIAL_BITS = 14;
+		static constexpr uint32_t MESH_BITS = 12;
+		static constexpr uint32_t DEPTH_BITS = 24;
+		static constexpr uint32_t REPORT_INTERVAL_FRAMES = 300;
+
+		// depth is normalized to [0, 1], ids are truncated to their bit counts
+		static uint64_t MakeKey(DrawPass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+		CvlDrawList() = default;
+
+		CvlDrawList(const CvlDrawList&) = delete;
+		CvlDrawList& operator=(const CvlDrawList&) = delete;
+
+		void Clear();
+		// Thread safe, for lists filled from CvlThreadPool::ParallelFor batches
+		void Append(const std::vector<uint64_t>& keys, const std::vector<DrawCommand>& commands);
+		void Sort(CvlThreadPool& thread_pool);
+		void Record(VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout, const std::vector<glm::vec4>& materials);
+
+		size_t GetCount() const { return _keys.size(); }
+		// In recording order once sorted
+		const DrawCommand& GetSortedCommand(size_t index) const { return _commands[_order[index]]; }
+		const DrawListStats& GetStats() const { return _stats; }
+
+		// Sorts keys ascending and applies the same permutation to values, scratch buffers are grown as needed
+		static void RadixSort
+		(
+			std::vector<uint64_t>& keys,
+			std::vector<uint32_t>& values,
+			std::vector<uint64_t>& key_scratch,
+			std::vector<uint32_t>& value_scratch,
+			CvlThreadPool& thread_pool
+		);
+
+	private:
+		static constexpr size_t MIN_SORT_CHUNK = 16384;
+
+		void CountUnsortedStateChanges();
+		void ReportStats();
+
+		std::mutex _mutex;
+		std::vector<uint64_t> _keys;
+		std::vector<DrawCommand> _commands;
+		// Command indices in key order after Sort
+		std::vector<uint32_t> _order;
+		std::vector<uint64_t> _key_scratch;
+		std::vector<uint32_t> _order_scratch;
+
+		DrawListStats _stats;
+		// Every REPORT_INTERVAL_FRAMES Record logs that frame's stats
+		uint32_t _stats_frames = 0;
+	};
+}
\ No newline at end of file
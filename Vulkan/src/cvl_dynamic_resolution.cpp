@@ -0,0 +1,64 @@
+#include "cvl_dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace cvl
+{
+	CvlDynamicResolution::CvlDynamicResolution(const DynamicResolutionConfig& config)
+		: _config(config), _scale(config.max_scale)
+	{
+	}
+
+	float CvlDynamicResolution::Update(double gpu_ms)
+	{
+		float previous_scale = _scale;
+		if (gpu_ms > _config.target_frame_ms * _config.decrease_threshold)
+		{
+			_frames_under_budget = 0;
+			if (++_frames_over_budget >= _config.decrease_frames)
+			{
+				// GPU time is roughly proportional to the pixel count, i.e. to scale squared
+				float wanted = _scale * static_cast<float>(std::sqrt(_config.target_frame_ms / gpu_ms));
+				_scale = std::max(_config.min_scale, std::min(wanted, _scale - _config.step));
+				_frames_over_budget = 0;
+			}
+		}
+		else if (gpu_ms < _config.target_frame_ms * _config.increase_threshold)
+		{
+			_frames_over_budget = 0;
+			if (++_frames_under_budget >= _config.increase_frames)
+			{
+				_scale = std::min(_config.max_scale, _scale + _config.step);
+				_frames_under_budget = 0;
+			}
+		}
+		else
+		{
+			_frames_over_budget = 0;
+			_frames_under_budget = 0;
+		}
+
+		if (_scale != previous_scale)
+		{
+			std::cout << "[CvlDynamicResolution] Scale " << previous_scale << " -> " << _scale << " (GPU " << gpu_ms
+				<< " ms, budget " << _config.target_frame_ms << " ms)\n";
+		}
+
+		_history.push_back({ gpu_ms, _scale });
+		if (_history.size() > _config.history_size)
+		{
+			_history.pop_front();
+		}
+		return _scale;
+	}
+
+	VkExtent2D CvlDynamicResolution::GetRenderExtent(VkExtent2D max_extent) const
+	{
+		VkExtent2D extent = {};
+		extent.width = std::max(1u, static_cast<uint32_t>(max_extent.width * _scale));
+		extent.height = std::max(1u, static_cast<uint32_t>(max_extent.height * _scale));
+		return extent;
+	}
+}
\ No newline at end of file
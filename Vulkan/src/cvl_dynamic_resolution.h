@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+
+namespace cvl
+{
+	struct DynamicResolutionConfig
+	{
+		double target_frame_ms = 1000.0 / 60.0;
+		float min_scale = 0.5f;
+		float max_scale = 1.0f;
+		float step = 0.05f;
+		// Hysteresis: scale down quickly when over budget, scale up only after a longer stretch well under it
+		double decrease_threshold = 1.0;
+		double increase_threshold = 0.8;
+		uint32_t decrease_frames = 3;
+		uint32_t increase_frames = 30;
+		size_t history_size = 300;
+	};
+
+	struct DynamicResolutionSample
+	{
+		double gpu_ms;
+		float scale;
+	};
+
+	class CvlDynamicResolution
+	{
+	public:
+		CvlDynamicResolution(const DynamicResolutionConfig& config = DynamicResolutionConfig{});
+
+		// Feeds a measured GPU frame time, returns the scale for the next frame
+		float Update(double gpu_ms);
+		// Scaled sub-rectangle of a target allocated at max_extent
+		VkExtent2D GetRenderExtent(VkExtent2D max_extent) const;
+
+		float GetScale() const { return _scale; }
+		const std::deque<DynamicResolutionSample>& GetHistory() const { return _history; }
+		const DynamicResolutionConfig& GetConfig() const { return _config; }
+
+	private:
+		DynamicResolutionConfig _config;
+		float _scale;
+		uint32_t _frames_over_budget = 0;
+		uint32_t _frames_under_budget = 0;
+		std::deque<DynamicResolutionSample> _history;
+	};
+}
\ No newline at end of file
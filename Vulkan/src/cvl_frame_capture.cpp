@@ -0,0 +1,348 @@
+#include "cvl_frame_capture.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace cvl
+{
+	// Everything is written as it is laid out in memory, captures are replayed on the same kind of machine
+	struct CaptureWriter
+	{
+		std::vector<uint8_t>& out;
+
+		void Bytes(const void* data, size_t size)
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			out.insert(out.end(), bytes, bytes + size);
+		}
+
+		template<typename T>
+		void Pod(const T& value)
+		{
+			Bytes(&value, sizeof(T));
+		}
+
+		template<typename T>
+		void Array(const std::vector<T>& values)
+		{
+			Pod(static_cast<uint32_t>(values.size()));
+			Bytes(values.data(), values.size() * sizeof(T));
+		}
+
+		void String(const std::string& value)
+		{
+			Pod(static_cast<uint32_t>(value.size()));
+			Bytes(value.data(), value.size());
+		}
+
+		void Pipeline(const CapturedPipeline& pipeline)
+		{
+			String(pipeline.vertex_shader);
+			String(pipeline.fragment_shader);
+			Pod(pipeline.topology);
+			Pod(pipeline.primitive_restart);
+			Pod(pipeline.polygon_mode);
+			Pod(pipeline.cull_mode);
+			Pod(pipeline.front_face);
+			Pod(pipeline.line_width);
+			Pod(pipeline.depth_test);
+			Pod(pipeline.depth_write);
+			Pod(pipeline.depth_compare);
+			Pod(pipeline.blend);
+			Array(pipeline.dynamic_states);
+			Array(pipeline.bindings);
+			Array(pipeline.attributes);
+			Array(pipeline.vertex_constants);
+			Array(pipeline.vertex_constant_data);
+			Array(pipeline.fragment_constants);
+			Array(pipeline.fragment_constant_data);
+		}
+	};
+
+	struct CaptureReader
+	{
+		const std::vector<char>& in;
+		const std::string& path;
+		size_t offset = 0;
+
+		void Bytes(void* data, size_t size)
+		{
+			if (size > in.size() - offset)
+			{
+				throw std::runtime_error("[CvlFrameCapture] Truncated capture file: " + path);
+			}
+			memcpy(data, in.data() + offset, size);
+			offset += size;
+		}
+
+		template<typename T>
+		T Pod()
+		{
+			T value;
+			Bytes(&value, sizeof(T));
+			return value;
+		}
+
+		// Number of records that follow, each at least min_size bytes, so a corrupt count can't force a huge allocation
+		uint32_t Count(size_t min_size)
+		{
+			uint32_t count = Pod<uint32_t>();
+			if (count > (in.size() - offset) / min_size)
+			{
+				throw std::runtime_error("[CvlFrameCapture] Truncated capture file: " + path);
+			}
+			return count;
+		}
+
+		template<typename T>
+		std::vector<T> Array()
+		{
+			uint32_t count = Pod<uint32_t>();
+			if (count > (in.size() - offset) / sizeof(T))
+			{
+				throw std::runtime_error("[CvlFrameCapture] Truncated capture file: " + path);
+			}
+			std::vector<T> values(count);
+			Bytes(values.data(), count * sizeof(T));
+			return values;
+		}
+
+		std::string String()
+		{
+			std::vector<char> chars = Array<char>();
+			return std::string(chars.begin(), chars.end());
+		}
+
+		// Specialization constants are scalars, each must lie within the data read with it
+		void CheckConstants(const std::vector<VkSpecializationMapEntry>& entries, const std::vector<uint8_t>& data)
+		{
+			for (const VkSpecializationMapEntry& entry : entries)
+			{
+				if (entry.size == 0 || entry.size > sizeof(uint32_t) || entry.offset > data.size() || entry.size > data.size() - entry.offset)
+				{
+					throw std::runtime_error("[CvlFrameCapture] Specialization constant out of range in capture file: " + path);
+				}
+			}
+		}
+	};
+
+	CvlFrameCapture::CvlFrameCapture(const std::string& path, uint32_t frame_count)
+		: _path(path), _frame_count(frame_count)
+	{
+		_data.frames.reserve(frame_count);
+	}
+
+	void CvlFrameCapture::AddModel(const CvlModel* model, const std::vector<CvlModel::Vertex>& vertices)
+	{
+		if (_model_ids.count(model) > 0)
+		{
+			_data.models[_model_ids[model]] = vertices;
+			return;
+		}
+		_model_ids[model] = static_cast<uint32_t>(_data.models.size());
+		_data.models.push_back(vertices);
+	}
+
+	void CvlFrameCapture::AddPipeline(const CvlPipeline* pipeline, const PipelineConfigInfo& config_info, const std::string& v_shader_fp, const std::string& f_shader_fp)
+	{
+		CapturedPipeline captured = {};
+		captured.vertex_shader = v_shader_fp;
+		captured.fragment_shader = f_shader_fp;
+		captured.topology = config_info.input_assembly_info.topology;
+		captured.primitive_restart = config_info.input_assembly_info.primitiveRestartEnable;
+		captured.polygon_mode = config_info.rasterization_info.polygonMode;
+		captured.cull_mode = config_info.rasterization_info.cullMode;
+		captured.front_face = config_info.rasterization_info.frontFace;
+		captured.line_width = config_info.rasterization_info.lineWidth;
+		captured.depth_test = config_info.depth_stencil_info.depthTestEnable;
+		captured.depth_write = config_info.depth_stencil_info.depthWriteEnable;
+		captured.depth_compare = config_info.depth_stencil_info.depthCompareOp;
+		captured.blend = config_info.color_blend_attachment;
+		captured.dynamic_states = config_info.dynamic_state_enables;
+		captured.bindings = config_info.binding_descriptions;
+		captured.attributes = config_info.attribute_descriptions;
+		captured.vertex_constants = config_info.vertex_specialization.GetEntries();
+		captured.vertex_constant_data = config_info.vertex_specialization.GetData();
+		captured.fragment_constants = config_info.fragment_specialization.GetEntries();
+		captured.fragment_constant_data = config_info.fragment_specialization.GetData();
+
+		// Keyed on what is written to the file, so pipelines recreated with the same config share one entry.
+		// Frames captured before a pipeline was registered again keep pointing at its previous config
+		std::vector<uint8_t> bytes;
+		CaptureWriter writer = { bytes };
+		writer.Pipeline(captured);
+		std::string key(bytes.begin(), bytes.end());
+		auto [it, inserted] = _pipeline_keys.emplace(std::move(key), static_cast<uint32_t>(_data.pipelines.size()));
+		if (inserted)
+		{
+			_data.pipelines.push_back(std::move(captured));
+		}
+		_pipeline_ids[pipeline] = it->second;
+	}
+
+	void CvlFrameCapture::SetTargets(VkExtent2D extent, VkFormat color_format, VkFormat depth_format, const glm::vec4& clear_color)
+	{
+		_data.extent = extent;
+		_data.color_format = color_format;
+		_data.depth_format = depth_format;
+		_data.clear_color = clear_color;
+	}
+
+	void CvlFrameCapture::CaptureFrame(uint64_t frame_number, const glm::mat4& view_proj, const CvlDrawList& draw_list)
+	{
+		if (_done)
+		{
+			return;
+		}
+
+		CapturedFrame frame = {};
+		frame.frame_number = frame_number;
+		frame.view_proj = view_proj;
+		frame.draws.reserve(draw_list.GetCount());
+		for (size_t i = 0; i < draw_list.GetCount(); ++i)
+		{
+			const DrawCommand& command = draw_list.GetSortedCommand(i);
+			auto pipeline = _pipeline_ids.find(command.pipeline);
+			auto model = _model_ids.find(command.model);
+			if (pipeline == _pipeline_ids.end() || model == _model_ids.end() || command.material >= _data.materials.size())
+			{
+				++_dropped_draws;
+				continue;
+			}
+			frame.draws.push_back({ pipeline->second, model->second, command.material, command.transform });
+		}
+		_data.frames.push_back(std::move(frame));
+		if (_data.frames.size() < _frame_count)
+		{
+			return;
+		}
+
+		_done = true;
+		Save(_path, _data);
+		if (_dropped_draws > 0)
+		{
+			std::cout << "[CvlFrameCapture] Dropped " << _dropped_draws << " draws of unregistered pipelines, models or materials\n";
+		}
+	}
+
+	void CvlFrameCapture::Save(const std::string& path, const FrameCaptureData& data)
+	{
+		std::vector<uint8_t> bytes;
+		CaptureWriter writer = { bytes };
+		writer.Pod(FILE_MAGIC);
+		writer.Pod(FILE_VERSION);
+		writer.Pod(data.extent);
+		writer.Pod(data.color_format);
+		writer.Pod(data.depth_format);
+		writer.Pod(data.clear_color);
+
+		writer.Pod(static_cast<uint32_t>(data.pipelines.size()));
+		for (const CapturedPipeline& pipeline : data.pipelines)
+		{
+			writer.Pipeline(pipeline);
+		}
+
+		writer.Pod(static_cast<uint32_t>(data.models.size()));
+		for (const std::vector<CvlModel::Vertex>& vertices : data.models)
+		{
+			writer.Array(vertices);
+		}
+		writer.Array(data.materials);
+
+		size_t draw_count = 0;
+		writer.Pod(static_cast<uint32_t>(data.frames.size()));
+		for (const CapturedFrame& frame : data.frames)
+		{
+			writer.Pod(frame.frame_number);
+			writer.Pod(frame.view_proj);
+			writer.Array(frame.draws);
+			draw_count += frame.draws.size();
+		}
+
+		std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+		if (!ofs.is_open())
+		{
+			std::cout << "[CvlFrameCapture] Failed to write " << path << '\n';
+			return;
+		}
+		ofs.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		std::cout << "[CvlFrameCapture] Wrote " << path << ": " << data.frames.size() << " frames, " << draw_count << " draws, "
+			<< data.pipelines.size() << " pipelines, " << data.models.size() << " models, " << bytes.size() / 1024.0 << " KB\n";
+	}
+
+	FrameCaptureData CvlFrameCapture::Load(const std::string& path)
+	{
+		std::ifstream ifs(path, std::ios::ate | std::ios::binary);
+		if (!ifs.is_open())
+		{
+			throw std::runtime_error("[CvlFrameCapture] Failed to open capture file: " + path);
+		}
+		size_t fsize = static_cast<size_t>(ifs.tellg());
+		std::vector<char> bytes(fsize);
+		ifs.seekg(0);
+		ifs.read(bytes.data(), fsize);
+
+		CaptureReader reader = { bytes, path };
+		if (reader.Pod<uint32_t>() != FILE_MAGIC || reader.Pod<uint32_t>() != FILE_VERSION)
+		{
+			throw std::runtime_error("[CvlFrameCapture] Not a capture file of this version: " + path);
+		}
+		FrameCaptureData data;
+		data.extent = reader.Pod<VkExtent2D>();
+		data.color_format = reader.Pod<VkFormat>();
+		data.depth_format = reader.Pod<VkFormat>();
+		data.clear_color = reader.Pod<glm::vec4>();
+
+		// Two string lengths, seven array counts and the blend state, the other fields only make a record longer
+		data.pipelines.resize(reader.Count(9 * sizeof(uint32_t) + sizeof(VkPipelineColorBlendAttachmentState)));
+		for (CapturedPipeline& pipeline : data.pipelines)
+		{
+			pipeline.vertex_shader = reader.String();
+			pipeline.fragment_shader = reader.String();
+			pipeline.topology = reader.Pod<VkPrimitiveTopology>();
+			pipeline.primitive_restart = reader.Pod<VkBool32>();
+			pipeline.polygon_mode = reader.Pod<VkPolygonMode>();
+			pipeline.cull_mode = reader.Pod<VkCullModeFlags>();
+			pipeline.front_face = reader.Pod<VkFrontFace>();
+			pipeline.line_width = reader.Pod<float>();
+			pipeline.depth_test = reader.Pod<VkBool32>();
+			pipeline.depth_write = reader.Pod<VkBool32>();
+			pipeline.depth_compare = reader.Pod<VkCompareOp>();
+			pipeline.blend = reader.Pod<VkPipelineColorBlendAttachmentState>();
+			pipeline.dynamic_states = reader.Array<VkDynamicState>();
+			pipeline.bindings = reader.Array<VkVertexInputBindingDescription>();
+			pipeline.attributes = reader.Array<VkVertexInputAttributeDescription>();
+			pipeline.vertex_constants = reader.Array<VkSpecializationMapEntry>();
+			pipeline.vertex_constant_data = reader.Array<uint8_t>();
+			pipeline.fragment_constants = reader.Array<VkSpecializationMapEntry>();
+			pipeline.fragment_constant_data = reader.Array<uint8_t>();
+			reader.CheckConstants(pipeline.vertex_constants, pipeline.vertex_constant_data);
+			reader.CheckConstants(pipeline.fragment_constants, pipeline.fragment_constant_data);
+		}
+
+		data.models.resize(reader.Count(sizeof(uint32_t)));
+		for (std::vector<CvlModel::Vertex>& vertices : data.models)
+		{
+			vertices = reader.Array<CvlModel::Vertex>();
+		}
+		data.materials = reader.Array<glm::vec4>();
+
+		data.frames.resize(reader.Count(sizeof(uint64_t) + sizeof(glm::mat4) + sizeof(uint32_t)));
+		for (CapturedFrame& frame : data.frames)
+		{
+			frame.frame_number = reader.Pod<uint64_t>();
+			frame.view_proj = reader.Pod<glm::mat4>();
+			frame.draws = reader.Array<CapturedDraw>();
+			for (const CapturedDraw& draw : frame.draws)
+			{
+				if (draw.pipeline >= data.pipelines.size() || draw.model >= data.models.size() || draw.material >= data.materials.size())
+				{
+					throw std::runtime_error("[CvlFrameCapture] Draw out of range in capture file: " + path);
+				}
+			}
+		}
+		return data;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_draw_list.h"
+#include "cvl_model.h"
+#include "cvl_pipeline.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cvl
+{
+	// Fixed function state and shaders of a draw list pipeline, the layout is always the DrawPushConstants one
+	struct CapturedPipeline
+	{
+		std::string vertex_shader;
+		std::string fragment_shader;
+		VkPrimitiveTopology topology;
+		VkBool32 primitive_restart;
+		VkPolygonMode polygon_mode;
+		VkCullModeFlags cull_mode;
+		VkFrontFace front_face;
+		float line_width;
+		VkBool32 depth_test;
+		VkBool32 depth_write;
+		VkCompareOp depth_compare;
+		VkPipelineColorBlendAttachmentState blend;
+		std::vector<VkDynamicState> dynamic_states;
+		std::vector<VkVertexInputBindingDescription> bindings;
+		std::vector<VkVertexInputAttributeDescription> attributes;
+		std::vector<VkSpecializationMapEntry> vertex_constants;
+		std::vector<uint8_t> vertex_constant_data;
+		std::vector<VkSpecializationMapEntry> fragment_constants;
+		std::vector<uint8_t> fragment_constant_data;
+	};
+
+	struct CapturedDraw
+	{
+		uint32_t pipeline;
+		uint32_t model;
+		uint32_t material;
+		glm::mat4 transform;
+	};
+
+	struct CapturedFrame
+	{
+		uint64_t frame_number;
+		glm::mat4 view_proj;
+		// In recording order
+		std::vector<CapturedDraw> draws;
+	};
+
+	// Contents of a capture file, models and pipelines are stored once and shared by every frame
+	struct FrameCaptureData
+	{
+		VkExtent2D extent = {};
+		VkFormat color_format = VK_FORMAT_UNDEFINED;
+		VkFormat depth_format = VK_FORMAT_UNDEFINED;
+		glm::vec4 clear_color = glm::vec4(0.0f);
+		std::vector<CapturedPipeline> pipelines;
+		std::vector<std::vector<CvlModel::Vertex>> models;
+		std::vector<glm::vec4> materials;
+		std::vector<CapturedFrame> frames;
+	};
+
+	/*
+		Records what CvlDrawList draws over a range of frames: models, pipeline configs, material constants and
+		every draw with its transform, and writes it to a binary file once frame_count frames are in. Models and
+		pipelines have to be registered when they are created, draws referring to anything else are dropped.
+		Replayed by CvlFrameReplay, see replay_main.cpp.
+	*/
+	class CvlFrameCapture
+	{
+	public:
+		static constexpr uint32_t FILE_MAGIC = 0x50414356;	// "VCAP"
+		static constexpr uint32_t FILE_VERSION = 1;
+
+		CvlFrameCapture(const std::string& path, uint32_t frame_count);
+
+		CvlFrameCapture(const CvlFrameCapture&) = delete;
+		CvlFrameCapture& operator=(const CvlFrameCapture&) = delete;
+
+		void AddModel(const CvlModel* model, const std::vector<CvlModel::Vertex>& vertices);
+		// Pipelines with the same config and shaders are stored once, registering a pipeline again points it at its new config
+		void AddPipeline(const CvlPipeline* pipeline, const PipelineConfigInfo& config_info, const std::string& v_shader_fp, const std::string& f_shader_fp);
+		void SetMaterials(const std::vector<glm::vec4>& materials) { _data.materials = materials; }
+		void SetTargets(VkExtent2D extent, VkFormat color_format, VkFormat depth_format, const glm::vec4& clear_color);
+
+		// Call after the draw list is sorted, writes the file with the last frame
+		void CaptureFrame(uint64_t frame_number, const glm::mat4& view_proj, const CvlDrawList& draw_list);
+		bool IsDone() const { return _done; }
+
+		static void Save(const std::string& path, const FrameCaptureData& data);
+		static FrameCaptureData Load(const std::string& path);
+
+	private:
+		std::string _path;
+		uint32_t _frame_count;
+		bool _done = false;
+		uint32_t _dropped_draws = 0;
+		FrameCaptureData _data;
+		std::unordered_map<const CvlModel*, uint32_t> _model_ids;
+		std::unordered_map<const CvlPipeline*, uint32_t> _pipeline_ids;
+		// Serialized CapturedPipeline -> index in _data.pipelines
+		std::unordered_map<std::string, uint32_t> _pipeline_keys;
+	};
+}
\ No newline at end of file
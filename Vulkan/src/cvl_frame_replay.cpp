@@ -0,0 +1,358 @@
+#include "cvl_frame_replay.h"
+#include "cvl_thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace cvl
+{
+	CvlFrameReplay::CvlFrameReplay(CvlDevice& device, CvlPipelineCache& pipeline_cache, const FrameCaptureData& capture)
+		: _cvl_device(device), _pipeline_cache(pipeline_cache), _capture(capture)
+	{
+		if (!_cvl_device.IsDynamicRenderingSupported())
+		{
+			throw std::runtime_error("[CvlFrameReplay] Replay needs dynamic rendering!");
+		}
+		if (_capture.extent.width == 0 || _capture.extent.height == 0 || _capture.frames.empty())
+		{
+			throw std::runtime_error("[CvlFrameReplay] Capture has no frames to replay!");
+		}
+		_depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (_capture.depth_format == VK_FORMAT_D32_SFLOAT_S8_UINT || _capture.depth_format == VK_FORMAT_D24_UNORM_S8_UINT)
+		{
+			_depth_aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+
+		for (const std::vector<CvlModel::Vertex>& vertices : _capture.models)
+		{
+			_models.push_back(std::make_unique<CvlModel>(_cvl_device, vertices));
+		}
+		CreatePipelineLayout();
+		CreatePipelines();
+		CreateDrawLists();
+		CreateTargets();
+		// One frame slot, frames never overlap
+		_gpu_timer = std::make_unique<CvlGpuTimer>(_cvl_device, 1, 2);
+	}
+
+	CvlFrameReplay::~CvlFrameReplay()
+	{
+		vkDeviceWaitIdle(_cvl_device.device());
+		_gpu_timer.reset();
+		vkDestroyFence(_cvl_device.device(), _fence, _cvl_device.GetAllocator());
+		vkFreeCommandBuffers(_cvl_device.device(), _cvl_device.GetCommandPool(), 1, &_command_buffer);
+		vkDestroyImageView(_cvl_device.device(), _color_view, _cvl_device.GetAllocator());
+		vkDestroyImage(_cvl_device.device(), _color_image, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(_color_memory);
+		vkDestroyImageView(_cvl_device.device(), _depth_view, _cvl_device.GetAllocator());
+		vkDestroyImage(_cvl_device.device(), _depth_image, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(_depth_memory);
+		_draw_lists.clear();
+		_pipelines.clear();
+		_pipeline_cache.ReleasePipelines(_pipeline_layout);
+		vkDestroyPipelineLayout(_cvl_device.device(), _pipeline_layout, _cvl_device.GetAllocator());
+	}
+
+	ReplayStats CvlFrameReplay::Run(uint32_t passes)
+	{
+		using clock = std::chrono::high_resolution_clock;
+		ReplayStats stats;
+		stats.passes = passes;
+		stats.frame_ms_min = std::numeric_limits<double>::max();
+		double record_ms_sum = 0.0;
+		double frame_ms_sum = 0.0;
+		double gpu_ms_sum = 0.0;
+		uint64_t gpu_frames = 0;
+
+		uint32_t frame_count = static_cast<uint32_t>(_capture.frames.size());
+		for (uint32_t pass = 0; pass <= passes; ++pass)
+		{
+			bool timed = pass > 0;
+			for (uint32_t frame = 0; frame < frame_count; ++frame)
+			{
+				auto start = clock::now();
+				RecordFrame(frame);
+				auto recorded = clock::now();
+				// BeginFrame picked up the previous frame's timestamps, which belong to the warm-up for the first timed frame
+				std::optional<double> gpu_ms = _gpu_timer->GetElapsedMs(0, 1);
+				if (timed && (pass > 1 || frame > 0) && gpu_ms.has_value())
+				{
+					gpu_ms_sum += gpu_ms.value();
+					++gpu_frames;
+				}
+				SubmitAndWait();
+				if (!timed)
+				{
+					continue;
+				}
+
+				double frame_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+				record_ms_sum += std::chrono::duration<double, std::milli>(recorded - start).count();
+				frame_ms_sum += frame_ms;
+				stats.frame_ms_min = std::min(stats.frame_ms_min, frame_ms);
+				stats.frame_ms_max = std::max(stats.frame_ms_max, frame_ms);
+				stats.draws += _capture.frames[frame].draws.size();
+				++stats.frames;
+			}
+		}
+
+		// Collects the last frame's timestamps
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(_command_buffer, &begin_info);
+		_gpu_timer->BeginFrame(_command_buffer, 0);
+		vkEndCommandBuffer(_command_buffer);
+		SubmitAndWait();
+		std::optional<double> gpu_ms = _gpu_timer->GetElapsedMs(0, 1);
+		if (passes > 0 && gpu_ms.has_value())
+		{
+			gpu_ms_sum += gpu_ms.value();
+			++gpu_frames;
+		}
+
+		double frames = static_cast<double>(std::max<uint64_t>(stats.frames, 1));
+		stats.record_ms = record_ms_sum / frames;
+		stats.frame_ms = frame_ms_sum / frames;
+		stats.gpu_ms = gpu_frames > 0 ? gpu_ms_sum / gpu_frames : 0.0;
+		if (stats.frames == 0)
+		{
+			stats.frame_ms_min = 0.0;
+		}
+
+		std::cout << "[CvlFrameReplay] " << stats.passes << " passes of " << frame_count << " frames at " << _capture.extent.width << "x"
+			<< _capture.extent.height << ", " << stats.draws / frames << " draws per frame: " << stats.record_ms << " ms recording, "
+			<< stats.frame_ms << " ms per frame (" << stats.frame_ms_min << " - " << stats.frame_ms_max << "), ";
+		if (_gpu_timer->IsSupported())
+		{
+			std::cout << stats.gpu_ms << " ms GPU\n";
+		}
+		else
+		{
+			std::cout << "no GPU timestamps\n";
+		}
+		return stats;
+	}
+
+	// private
+	void CvlFrameReplay::CreatePipelineLayout()
+	{
+		// Same layout as the scene pipelines the draws were captured from
+		VkPushConstantRange push_constant_range = {};
+		push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_constant_range.offset = 0;
+		push_constant_range.size = sizeof(DrawPushConstants);
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+		if (vkCreatePipelineLayout(_cvl_device.device(), &pipeline_layout_info, _cvl_device.GetAllocator(), &_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to create pipeline layout!");
+		}
+	}
+
+	void CvlFrameReplay::CreatePipelines()
+	{
+		for (const CapturedPipeline& captured : _capture.pipelines)
+		{
+			PipelineConfigInfo config_info = {};
+			CvlPipeline::DefaultPipelineConfigInfo(config_info);
+			config_info.input_assembly_info.topology = captured.topology;
+			config_info.input_assembly_info.primitiveRestartEnable = captured.primitive_restart;
+			config_info.rasterization_info.polygonMode = captured.polygon_mode;
+			config_info.rasterization_info.cullMode = captured.cull_mode;
+			config_info.rasterization_info.frontFace = captured.front_face;
+			config_info.rasterization_info.lineWidth = captured.line_width;
+			config_info.depth_stencil_info.depthTestEnable = captured.depth_test;
+			config_info.depth_stencil_info.depthWriteEnable = captured.depth_write;
+			config_info.depth_stencil_info.depthCompareOp = captured.depth_compare;
+			config_info.color_blend_attachment = captured.blend;
+			config_info.dynamic_state_enables = captured.dynamic_states;
+			config_info.dynamic_state_info.pDynamicStates = config_info.dynamic_state_enables.data();
+			config_info.dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(config_info.dynamic_state_enables.size());
+			config_info.binding_descriptions = captured.bindings;
+			config_info.attribute_descriptions = captured.attributes;
+			config_info.vertex_specialization = SpecializationConstants(captured.vertex_constants, captured.vertex_constant_data);
+			config_info.fragment_specialization = SpecializationConstants(captured.fragment_constants, captured.fragment_constant_data);
+			config_info.pipeline_layout = _pipeline_layout;
+			config_info.color_attachment_formats = { _capture.color_format };
+			config_info.depth_attachment_format = _capture.depth_format;
+			_pipelines.push_back(_pipeline_cache.GetGraphicsPipeline(config_info, captured.vertex_shader, captured.fragment_shader));
+		}
+	}
+
+	void CvlFrameReplay::CreateDrawLists()
+	{
+		// Draws were captured in recording order, so their index is the sort key and sorting is done once here
+		CvlThreadPool thread_pool(1);
+		for (const CapturedFrame& frame : _capture.frames)
+		{
+			std::vector<uint64_t> keys;
+			std::vector<DrawCommand> commands;
+			keys.reserve(frame.draws.size());
+			commands.reserve(frame.draws.size());
+			for (const CapturedDraw& draw : frame.draws)
+			{
+				keys.push_back(keys.size());
+				commands.push_back({ _pipelines[draw.pipeline].get(), _models[draw.model].get(), draw.material, draw.transform });
+			}
+			auto draw_list = std::make_unique<CvlDrawList>();
+			draw_list->Append(keys, commands);
+			draw_list->Sort(thread_pool);
+			_draw_lists.push_back(std::move(draw_list));
+		}
+	}
+
+	void CvlFrameReplay::CreateTargets()
+	{
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.extent = { _capture.extent.width, _capture.extent.height, 1 };
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.format = _capture.color_format;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		_cvl_device.CreateImageWithInfo(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Attachments, _color_image, _color_memory);
+
+		image_info.format = _capture.depth_format;
+		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		_cvl_device.CreateImageWithInfo(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Attachments, _depth_image, _depth_memory);
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = _color_image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = _capture.color_format;
+		view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &_color_view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to create color view!");
+		}
+		view_info.image = _depth_image;
+		view_info.format = _capture.depth_format;
+		view_info.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &_depth_view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to create depth view!");
+		}
+
+		VkCommandBufferAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandPool = _cvl_device.GetCommandPool();
+		alloc_info.commandBufferCount = 1;
+		if (vkAllocateCommandBuffers(_cvl_device.device(), &alloc_info, &_command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to allocate command buffer!");
+		}
+
+		VkFenceCreateInfo fence_info = {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(_cvl_device.device(), &fence_info, _cvl_device.GetAllocator(), &_fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to create fence!");
+		}
+	}
+
+	void CvlFrameReplay::RecordFrame(uint32_t frame)
+	{
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(_command_buffer, &begin_info) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to begin recording command buffer!");
+		}
+		_gpu_timer->BeginFrame(_command_buffer, 0);
+		_gpu_timer->WriteTimestamp(_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+		// The previous frame was waited on, contents are cleared anyway
+		VkImageMemoryBarrier barriers[2] = {};
+		barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].image = _color_image;
+		barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barriers[1] = barriers[0];
+		barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barriers[1].image = _depth_image;
+		barriers[1].subresourceRange = { _depth_aspect, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier
+		(
+			_command_buffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, 2, barriers
+		);
+
+		VkRenderingAttachmentInfo color_attachment = {};
+		color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		color_attachment.imageView = _color_view;
+		color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		color_attachment.clearValue.color = { _capture.clear_color.x, _capture.clear_color.y, _capture.clear_color.z, _capture.clear_color.w };
+
+		VkRenderingAttachmentInfo depth_attachment = {};
+		depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		depth_attachment.imageView = _depth_view;
+		depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth_attachment.clearValue.depthStencil = { 1.0f, 0 };
+
+		VkRect2D render_area = { { 0, 0 }, _capture.extent };
+		VkRenderingInfo rendering_info = {};
+		rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+		rendering_info.renderArea = render_area;
+		rendering_info.layerCount = 1;
+		rendering_info.colorAttachmentCount = 1;
+		rendering_info.pColorAttachments = &color_attachment;
+		rendering_info.pDepthAttachment = &depth_attachment;
+
+		_cvl_device.CmdBeginRendering(_command_buffer, rendering_info);
+		VkViewport viewport = {};
+		viewport.width = static_cast<float>(_capture.extent.width);
+		viewport.height = static_cast<float>(_capture.extent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(_command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(_command_buffer, 0, 1, &render_area);
+		_draw_lists[frame]->Record(_command_buffer, _pipeline_layout, _capture.materials);
+		_cvl_device.CmdEndRendering(_command_buffer);
+
+		_gpu_timer->WriteTimestamp(_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+		if (vkEndCommandBuffer(_command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to record command buffer!");
+		}
+	}
+
+	void CvlFrameReplay::SubmitAndWait()
+	{
+		QueueSubmission submission;
+		submission.command_buffers = { _command_buffer };
+		if (_cvl_device.Submit(QueueType::Graphics, submission, _fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlFrameReplay] Failed to submit frame!");
+		}
+		vkWaitForFences(_cvl_device.device(), 1, &_fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(_cvl_device.device(), 1, &_fence);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_draw_list.h"
+#include "cvl_frame_capture.h"
+#include "cvl_gpu_timer.h"
+#include "cvl_model.h"
+#include "cvl_pipeline.h"
+#include "cvl_pipeline_cache.h"
+
+#include <memory>
+#include <vector>
+
+namespace cvl
+{
+	// Per frame averages over the timed passes
+	struct ReplayStats
+	{
+		uint32_t passes = 0;
+		uint64_t frames = 0;
+		uint64_t draws = 0;
+		double record_ms = 0.0;		// CPU, command buffer recording
+		double frame_ms = 0.0;		// CPU, record to fence signaled
+		double frame_ms_min = 0.0;
+		double frame_ms_max = 0.0;
+		double gpu_ms = 0.0;		// timestamps around the frame, 0 when unsupported
+	};
+
+	/*
+		Rebuilds the models, pipelines and draw lists of a capture and replays its frames into offscreen targets
+		of the captured size and formats, with nothing else in the way: no window, no simulation, no swap chain.
+		Frames are submitted one at a time and waited on, so every frame is timed on its own. Needs dynamic rendering.
+	*/
+	class CvlFrameReplay
+	{
+	public:
+		CvlFrameReplay(CvlDevice& device, CvlPipelineCache& pipeline_cache, const FrameCaptureData& capture);
+		~CvlFrameReplay();
+
+		CvlFrameReplay(const CvlFrameReplay&) = delete;
+		CvlFrameReplay& operator=(const CvlFrameReplay&) = delete;
+
+		// Replays every captured frame passes times after an untimed warm-up pass
+		ReplayStats Run(uint32_t passes);
+
+	private:
+		void CreatePipelineLayout();
+		void CreatePipelines();
+		void CreateDrawLists();
+		void CreateTargets();
+		void RecordFrame(uint32_t frame);
+		void SubmitAndWait();
+
+		CvlDevice& _cvl_device;
+		CvlPipelineCache& _pipeline_cache;
+		const FrameCaptureData& _capture;
+		VkImageAspectFlags _depth_aspect;
+
+		std::vector<std::unique_ptr<CvlModel>> _models;
+		VkPipelineLayout _pipeline_layout = VK_NULL_HANDLE;
+		std::vector<std::shared_ptr<CvlPipeline>> _pipelines;
+		std::vector<std::unique_ptr<CvlDrawList>> _draw_lists;
+
+		VkImage _color_image;
+		VkDeviceMemory _color_memory;
+		VkImageView _color_view;
+		VkImage _depth_image;
+		VkDeviceMemory _depth_memory;
+		VkImageView _depth_view;
+		VkCommandBuffer _command_buffer;
+		VkFence _fence;
+		// Two timestamps, collected when the next frame begins
+		std::unique_ptr<CvlGpuTimer> _gpu_timer;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "cvl_gpu_timer.h"
+
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+namespace cvl
+{
+	CvlGpuTimer::CvlGpuTimer(CvlDevice& device, uint32_t frame_count, uint32_t timestamps_per_frame, QueueType queue)
+		: _device(device), _timestamps_per_frame(timestamps_per_frame)
+	{
+		_period_ms = static_cast<double>(_device.GetTimestampPeriod()) / 1e6;
+		_written.assign(frame_count, 0);
+		_results.resize(timestamps_per_frame);
+		if (!_device.IsTimestampSupported(queue))
+		{
+			std::cout << "[CvlGpuTimer] Timestamps are not supported on the " << (queue == QueueType::Graphics ? "graphics" : "async") << " queue\n";
+			return;
+		}
+		uint32_t valid_bits = _device.GetTimestampValidBits(queue);
+		_valid_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+		VkQueryPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		pool_info.queryCount = frame_count * timestamps_per_frame;
+		if (vkCreateQueryPool(_device.device(), &pool_info, _device.GetAllocator(), &_query_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlGpuTimer] Failed to create timestamp query pool!");
+		}
+	}
+
+	CvlGpuTimer::~CvlGpuTimer()
+	{
+		if (_query_pool != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(_device.device(), _query_pool, _device.GetAllocator());
+		}
+	}
+
+	void CvlGpuTimer::BeginFrame(VkCommandBuffer command_buffer, uint32_t frame)
+	{
+		_current_frame = frame;
+		if (_query_pool == VK_NULL_HANDLE)
+		{
+			return;
+		}
+
+		uint32_t first_query = frame * _timestamps_per_frame;
+		uint32_t written = _written[frame];
+		// A frame without timestamps has no results, not the ones of the frame before
+		_result_count = 0;
+		if (written > 0)
+		{
+			// The frame's fence has been waited on, so the results are normally there already
+			VkResult result = vkGetQueryPoolResults
+			(
+				_device.device(),
+				_query_pool,
+				first_query,
+				written,
+				written * sizeof(uint64_t),
+				_results.data(),
+				sizeof(uint64_t),
+				VK_QUERY_RESULT_64_BIT
+			);
+			if (result == VK_SUCCESS)
+			{
+				for (uint32_t i = 0; i < written; ++i)
+				{
+					_results[i] &= _valid_mask;
+				}
+				_result_count = written;
+			}
+		}
+
+		vkCmdResetQueryPool(command_buffer, _query_pool, first_query, _timestamps_per_frame);
+		_written[frame] = 0;
+	}
+
+	uint32_t CvlGpuTimer::WriteTimestamp(VkCommandBuffer command_buffer, VkPipelineStageFlagBits stage)
+	{
+		uint32_t index = _written[_current_frame];
+		if (_query_pool == VK_NULL_HANDLE)
+		{
+			return index;
+		}
+		assert(index < _timestamps_per_frame && "Too many timestamps in one frame");
+		vkCmdWriteTimestamp(command_buffer, stage, _query_pool, _current_frame * _timestamps_per_frame + index);
+		++_written[_current_frame];
+		return index;
+	}
+
+	std::optional<double> CvlGpuTimer::GetElapsedMs(uint32_t from, uint32_t to) const
+	{
+		if (from >= _result_count || to >= _result_count)
+		{
+			return std::nullopt;
+		}
+		// Masked again so a counter that wrapped between the two still gives the right delta
+		return static_cast<double>((_results[to] - _results[from]) & _valid_mask) * _period_ms;
+	}
+
+	std::optional<double> CvlGpuTimer::GetTimestampMs(uint32_t index) const
+	{
+		if (index >= _result_count)
+		{
+			return std::nullopt;
+		}
+		return static_cast<double>(_results[index]) * _period_ms;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "cvl_device.h"
+
+#include <optional>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Timestamp queries for each frame in flight. Results are read back without waiting when the
+		frame slot comes around again, i.e. after its fence has been waited on.
+	*/
+	class CvlGpuTimer
+	{
+	public:
+		// Command buffers recording the timestamps must be submitted to queue
+		CvlGpuTimer(CvlDevice& device, uint32_t frame_count, uint32_t timestamps_per_frame, QueueType queue = QueueType::Graphics);
+		~CvlGpuTimer();
+
+		CvlGpuTimer(const CvlGpuTimer&) = delete;
+		CvlGpuTimer& operator=(const CvlGpuTimer&) = delete;
+
+		// Collects the previous results of this frame slot and resets its queries, record outside of rendering
+		void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame);
+		// Returns the index of the timestamp within the frame
+		uint32_t WriteTimestamp(VkCommandBuffer command_buffer, VkPipelineStageFlagBits stage);
+
+		// Time between two timestamps of the most recently completed frame
+		std::optional<double> GetElapsedMs(uint32_t from, uint32_t to) const;
+		// Device time of a timestamp of the most recently completed frame. Comparable between timers on different
+		// queues only when CvlDevice::IsCalibratedTimestampSupported()
+		std::optional<double> GetTimestampMs(uint32_t index) const;
+		bool IsSupported() const { return _query_pool != VK_NULL_HANDLE; }
+
+	private:
+		CvlDevice& _device;
+		VkQueryPool _query_pool = VK_NULL_HANDLE;
+		uint32_t _timestamps_per_frame;
+		double _period_ms;
+		// Clears the bits beyond the queue's timestampValidBits, they are undefined
+		uint64_t _valid_mask = ~0ull;
+
+		uint32_t _current_frame = 0;
+		std::vector<uint32_t> _written;
+		std::vector<uint64_t> _results;
+		uint32_t _result_count = 0;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,282 @@
+#include "cvl_hiz_pyramid.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace cvl
+{
+	struct HiZBuildPushConstants
+	{
+		glm::ivec2 src_size;
+		glm::ivec2 dst_size;
+		uint32_t from_depth;
+	};
+
+	// Rounds down like Vulkan mip sizes, hiz_build.comp folds the odd texel into the last one of the row or column
+	static VkExtent2D HalfExtent(VkExtent2D extent)
+	{
+		return { std::max(extent.width >> 1, 1u), std::max(extent.height >> 1, 1u) };
+	}
+
+	/* CvlHiZPyramid class */
+	CvlHiZPyramid::CvlHiZPyramid(CvlDevice& device, CvlPipelineCache& pipeline_cache, VkExtent2D extent, VkImageView depth_view, uint32_t frame_count)
+		: _cvl_device(device), _pipeline_cache(pipeline_cache), _extent(HalfExtent(extent)), _gpu_timer(device, frame_count, 2)
+	{
+		_mip_levels = 1;
+		while ((std::max(_extent.width, _extent.height) >> _mip_levels) > 0)
+		{
+			++_mip_levels;
+		}
+		CreateImage();
+		CreateDescriptors(depth_view);
+		CreatePipeline();
+	}
+
+	CvlHiZPyramid::~CvlHiZPyramid()
+	{
+		_pipeline.reset();
+		_pipeline_cache.ReleasePipelines(_pipeline_layout);
+		vkDestroyPipelineLayout(_cvl_device.device(), _pipeline_layout, _cvl_device.GetAllocator());
+		vkDestroyDescriptorPool(_cvl_device.device(), _descriptor_pool, _cvl_device.GetAllocator());
+		vkDestroyDescriptorSetLayout(_cvl_device.device(), _descriptor_set_layout, _cvl_device.GetAllocator());
+		vkDestroySampler(_cvl_device.device(), _sampler, _cvl_device.GetAllocator());
+		for (VkImageView mip_view : _mip_views)
+		{
+			vkDestroyImageView(_cvl_device.device(), mip_view, _cvl_device.GetAllocator());
+		}
+		vkDestroyImageView(_cvl_device.device(), _view, _cvl_device.GetAllocator());
+		vkDestroyImage(_cvl_device.device(), _image, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(_image_memory);
+	}
+
+	bool CvlHiZPyramid::IsSupported(CvlDevice& device)
+	{
+		return device.IsStorageImageExtendedFormatsSupported() &&
+			device.IsFormatFeatureSupported(FORMAT, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	}
+
+	void CvlHiZPyramid::Build(VkCommandBuffer command_buffer, uint32_t frame, VkExtent2D source_extent, const glm::mat4& view_proj)
+	{
+		_gpu_timer.BeginFrame(command_buffer, frame);
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		_pipeline->Bind(command_buffer);
+
+		// Levels beyond the rendered area are never read, every level still gets at least one texel
+		VkExtent2D src_extent = source_extent;
+		for (uint32_t level = 0; level < _mip_levels; ++level)
+		{
+			VkExtent2D dst_extent = HalfExtent(src_extent);
+			HiZBuildPushConstants push = {};
+			push.src_size = glm::ivec2(src_extent.width, src_extent.height);
+			push.dst_size = glm::ivec2(dst_extent.width, dst_extent.height);
+			push.from_depth = level == 0 ? 1 : 0;
+
+			if (level > 0)
+			{
+				// The previous level's writes must land before this level reduces them
+				VkMemoryBarrier barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+				barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+				barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				vkCmdPipelineBarrier
+				(
+					command_buffer,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0,
+					1, &barrier,
+					0, nullptr,
+					0, nullptr
+				);
+			}
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline_layout, 0, 1, &_descriptor_sets[level], 0, nullptr);
+			vkCmdPushConstants(command_buffer, _pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+			_pipeline->Dispatch
+			(
+				command_buffer,
+				CvlPipeline::GroupCount(dst_extent.width, WORKGROUP_SIZE),
+				CvlPipeline::GroupCount(dst_extent.height, WORKGROUP_SIZE)
+			);
+			src_extent = dst_extent;
+		}
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		_built = true;
+		_build_extent = source_extent;
+		_build_view_proj = view_proj;
+	}
+
+	// private
+	void CvlHiZPyramid::CreateImage()
+	{
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = FORMAT;
+		image_info.extent = { _extent.width, _extent.height, 1 };
+		image_info.mipLevels = _mip_levels;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		_cvl_device.CreateImageWithInfo(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Attachments, _image, _image_memory);
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = _image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = FORMAT;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.baseMipLevel = 0;
+		view_info.subresourceRange.levelCount = _mip_levels;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = 1;
+		if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &_view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlHiZPyramid] Failed to create image view!");
+		}
+
+		_mip_views.resize(_mip_levels);
+		for (uint32_t level = 0; level < _mip_levels; ++level)
+		{
+			view_info.subresourceRange.baseMipLevel = level;
+			view_info.subresourceRange.levelCount = 1;
+			if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &_mip_views[level]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlHiZPyramid] Failed to create mip view!");
+			}
+		}
+
+		// Texels are fetched, never filtered
+		VkSamplerCreateInfo sampler_info = {};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = VK_FILTER_NEAREST;
+		sampler_info.minFilter = VK_FILTER_NEAREST;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(_cvl_device.device(), &sampler_info, _cvl_device.GetAllocator(), &_sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlHiZPyramid] Failed to create sampler!");
+		}
+
+		// Far plane everywhere occludes nothing, in case a test runs before the first build
+		VkCommandBuffer command_buffer = _cvl_device.BeginSingleTimeCommands();
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = _image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, _mip_levels, 0, 1 };
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+		VkClearColorValue far_plane = { { 1.0f, 1.0f, 0.0f, 0.0f } };
+		vkCmdClearColorImage(command_buffer, _image, VK_IMAGE_LAYOUT_GENERAL, &far_plane, 1, &barrier.subresourceRange);
+		_cvl_device.EndSingleTimeCommands(command_buffer);
+	}
+
+	void CvlHiZPyramid::CreateDescriptors(VkImageView depth_view)
+	{
+		// 0: source (depth or the previous level) fetched through a sampler, 1: destination level
+		VkDescriptorSetLayoutBinding bindings[2] = {};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layout_info = {};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = 2;
+		layout_info.pBindings = bindings;
+		if (vkCreateDescriptorSetLayout(_cvl_device.device(), &layout_info, _cvl_device.GetAllocator(), &_descriptor_set_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlHiZPyramid] Failed to create descriptor set layout!");
+		}
+
+		VkDescriptorPoolSize pool_sizes[2] = {};
+		pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_sizes[0].descriptorCount = _mip_levels;
+		pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		pool_sizes[1].descriptorCount = _mip_levels;
+
+		VkDescriptorPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = _mip_levels;
+		pool_info.poolSizeCount = 2;
+		pool_info.pPoolSizes = pool_sizes;
+		if (vkCreateDescriptorPool(_cvl_device.device(), &pool_info, _cvl_device.GetAllocator(), &_descriptor_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlHiZPyramid] Failed to create descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> set_layouts(_mip_levels, _descriptor_set_layout);
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = _descriptor_pool;
+		alloc_info.descriptorSetCount = _mip_levels;
+		alloc_info.pSetLayouts = set_layouts.data();
+		_descriptor_sets.resize(_mip_levels);
+		if (vkAllocateDescriptorSets(_cvl_device.device(), &alloc_info, _descriptor_sets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlHiZPyramid] Failed to allocate descriptor sets!");
+		}
+
+		for (uint32_t level = 0; level < _mip_levels; ++level)
+		{
+			VkDescriptorImageInfo image_infos[2] = {};
+			image_infos[0].sampler = _sampler;
+			image_infos[0].imageView = level == 0 ? depth_view : _mip_views[level - 1];
+			image_infos[0].imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+			image_infos[1].imageView = _mip_views[level];
+			image_infos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkWriteDescriptorSet writes[2] = {};
+			for (uint32_t i = 0; i < 2; ++i)
+			{
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = _descriptor_sets[level];
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = bindings[i].descriptorType;
+				writes[i].pImageInfo = &image_infos[i];
+			}
+			vkUpdateDescriptorSets(_cvl_device.device(), 2, writes, 0, nullptr);
+		}
+	}
+
+	void CvlHiZPyramid::CreatePipeline()
+	{
+		VkPushConstantRange push_constant_range = {};
+		push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push_constant_range.offset = 0;
+		push_constant_range.size = sizeof(HiZBuildPushConstants);
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.setLayoutCount = 1;
+		pipeline_layout_info.pSetLayouts = &_descriptor_set_layout;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+		if (vkCreatePipelineLayout(_cvl_device.device(), &pipeline_layout_info, _cvl_device.GetAllocator(), &_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlHiZPyramid] Failed to create pipeline layout!");
+		}
+
+		SpecializationConstants specialization;
+		specialization.Set(0, WORKGROUP_SIZE);
+		specialization.Set(1, WORKGROUP_SIZE);
+		_pipeline = _pipeline_cache.GetComputePipeline(_pipeline_layout, "src\\shaders\\hiz_build.comp", specialization);
+	}
+	/* ~CvlHiZPyramid class */
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_pipeline.h"
+#include "cvl_pipeline_cache.h"
+#include "cvl_gpu_timer.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Hierarchical depth pyramid reduced from the depth buffer by a compute pass, one dispatch per mip.
+		Every texel holds the nearest (r) and farthest (g) depth of the block of depth texels below it,
+		level 0 is half the size of the depth buffer and the chain goes down to 1x1.
+		Only the rendered area of the depth buffer is reduced, GetBuildExtent() and GetBuildViewProj() tell which
+		area and camera the pyramid currently describes, so occlusion tests can project bounds into it.
+		The image stays in GENERAL, Build() records the barriers between its own levels only.
+	*/
+	class CvlHiZPyramid
+	{
+	public:
+		static constexpr VkFormat FORMAT = VK_FORMAT_R32G32_SFLOAT;
+		// Passed to shaders/hiz_build.comp as specialization constants 0 and 1
+		static constexpr uint32_t WORKGROUP_SIZE = 8;
+
+		// depth_view must cover the depth aspect only and stay valid for the lifetime of the pyramid
+		CvlHiZPyramid(CvlDevice& device, CvlPipelineCache& pipeline_cache, VkExtent2D extent, VkImageView depth_view, uint32_t frame_count);
+		~CvlHiZPyramid();
+
+		CvlHiZPyramid(const CvlHiZPyramid&) = delete;
+		CvlHiZPyramid& operator=(const CvlHiZPyramid&) = delete;
+
+		// rg32f storage images need shaderStorageImageExtendedFormats
+		static bool IsSupported(CvlDevice& device);
+
+		// Depth must be in SHADER_READ_ONLY_OPTIMAL, source_extent is the rendered area in its top left corner
+		void Build(VkCommandBuffer command_buffer, uint32_t frame, VkExtent2D source_extent, const glm::mat4& view_proj);
+
+		VkImage GetImage() { return _image; }
+		VkImageView GetImageView() { return _view; }
+		VkSampler GetSampler() { return _sampler; }
+		VkExtent2D GetExtent() { return _extent; }
+		uint32_t GetMipLevels() { return _mip_levels; }
+		bool IsBuilt() { return _built; }
+		VkExtent2D GetBuildExtent() { return _build_extent; }
+		const glm::mat4& GetBuildViewProj() { return _build_view_proj; }
+		// Of the build recorded into the same frame slot last time
+		std::optional<double> GetBuildMs() const { return _gpu_timer.GetElapsedMs(0, 1); }
+
+	private:
+		void CreateImage();
+		void CreateDescriptors(VkImageView depth_view);
+		void CreatePipeline();
+
+		CvlDevice& _cvl_device;
+		CvlPipelineCache& _pipeline_cache;
+		VkExtent2D _extent;
+		uint32_t _mip_levels;
+
+		VkImage _image;
+		VkDeviceMemory _image_memory;
+		VkImageView _view;
+		std::vector<VkImageView> _mip_views;
+		VkSampler _sampler;
+
+		// One set per level: the level above it (or depth) as source and the level itself as destination
+		VkDescriptorSetLayout _descriptor_set_layout;
+		VkDescriptorPool _descriptor_pool;
+		std::vector<VkDescriptorSet> _descriptor_sets;
+		VkPipelineLayout _pipeline_layout;
+		std::shared_ptr<CvlPipeline> _pipeline;
+
+		bool _built = false;
+		VkExtent2D _build_extent = {};
+		glm::mat4 _build_view_proj = glm::mat4(1.0f);
+		CvlGpuTimer _gpu_timer;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include "cvl_host_allocator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+namespace cvl
+{
+	CvlHostAllocator::CvlHostAllocator(bool use_pools)
+		: _use_pools(use_pools)
+	{
+		_callbacks.pUserData = this;
+		_callbacks.pfnAllocation = Allocate;
+		_callbacks.pfnReallocation = Reallocate;
+		_callbacks.pfnFree = Free;
+		_callbacks.pfnInternalAllocation = InternalAllocation;
+		_callbacks.pfnInternalFree = InternalFree;
+	}
+
+	CvlHostAllocator::~CvlHostAllocator()
+	{
+		for (auto& scope_pools : _pools)
+		{
+			for (SizeClassPool& pool : scope_pools)
+			{
+				for (void* page : pool.pages)
+				{
+					::operator delete(page, std::align_val_t(MAX_CLASS_SIZE));
+				}
+			}
+		}
+	}
+
+	HostAllocationStats CvlHostAllocator::GetStats(VkSystemAllocationScope scope) const
+	{
+		const ScopeCounters& counters = _counters[scope];
+		HostAllocationStats stats;
+		stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+		stats.pooled = counters.pooled.load(std::memory_order_relaxed);
+		stats.reallocations = counters.reallocations.load(std::memory_order_relaxed);
+		stats.frees = counters.frees.load(std::memory_order_relaxed);
+		stats.bytes = counters.bytes.load(std::memory_order_relaxed);
+		stats.peak = counters.peak.load(std::memory_order_relaxed);
+		stats.total_bytes = counters.total_bytes.load(std::memory_order_relaxed);
+		stats.internal_allocations = counters.internal_allocations.load(std::memory_order_relaxed);
+		stats.internal_bytes = counters.internal_bytes.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	void CvlHostAllocator::Report() const
+	{
+		constexpr double kb = 1024.0;
+		std::cout << "[CvlHostAllocator] Host allocations" << (_use_pools ? "" : " (pools disabled)") << ":\n";
+		for (uint32_t scope = 0; scope < SCOPE_COUNT; ++scope)
+		{
+			HostAllocationStats stats = GetStats(static_cast<VkSystemAllocationScope>(scope));
+			if (stats.allocations == 0 && stats.internal_allocations == 0)
+			{
+				continue;
+			}
+			std::cout << '\t' << GetScopeName(static_cast<VkSystemAllocationScope>(scope)) << ": " << stats.allocations << " allocations ("
+				<< stats.pooled << " pooled), " << stats.reallocations << " reallocations, " << stats.frees << " frees, " << stats.bytes / kb
+				<< " KB live, peak " << stats.peak / kb << " KB, " << stats.total_bytes / kb << " KB total";
+			if (stats.internal_allocations > 0)
+			{
+				std::cout << ", internal " << stats.internal_allocations << " allocations " << stats.internal_bytes / kb << " KB live";
+			}
+			std::cout << '\n';
+		}
+
+		size_t pages = 0;
+		for (const auto& scope_pools : _pools)
+		{
+			for (const SizeClassPool& pool : scope_pools)
+			{
+				std::lock_guard<std::mutex> lock(pool.mutex);
+				pages += pool.pages.size();
+			}
+		}
+		std::cout << "\tPools: " << pages << " pages, " << pages * PAGE_SIZE / kb << " KB reserved\n";
+		for (uint32_t type = 0; type < INTERNAL_TYPE_COUNT; ++type)
+		{
+			const InternalCounters& counters = _internal_counters[type];
+			if (counters.allocations.load(std::memory_order_relaxed) > 0)
+			{
+				std::cout << "\tInternal " << GetInternalTypeName(static_cast<VkInternalAllocationType>(type)) << ": "
+					<< counters.allocations.load(std::memory_order_relaxed) << " allocations, "
+					<< counters.bytes.load(std::memory_order_relaxed) / kb << " KB live\n";
+			}
+		}
+	}
+
+	const char* CvlHostAllocator::GetScopeName(VkSystemAllocationScope scope)
+	{
+		switch (scope)
+		{
+		case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "Command";
+		case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "Object";
+		case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "Cache";
+		case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "Device";
+		case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "Instance";
+		default: return "Unknown";
+		}
+	}
+
+	const char* CvlHostAllocator::GetInternalTypeName(VkInternalAllocationType type)
+	{
+		switch (type)
+		{
+		case VK_INTERNAL_ALLOCATION_TYPE_EXECUTABLE: return "executable";
+		default: return "unknown";
+		}
+	}
+
+	// private
+	VKAPI_ATTR void* VKAPI_CALL CvlHostAllocator::Allocate(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		return static_cast<CvlHostAllocator*>(user_data)->AllocateMemory(size, alignment, scope);
+	}
+
+	VKAPI_ATTR void* VKAPI_CALL CvlHostAllocator::Reallocate(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		if (original == nullptr)
+		{
+			return Allocate(user_data, size, alignment, scope);
+		}
+		CvlHostAllocator* allocator = static_cast<CvlHostAllocator*>(user_data);
+		if (size == 0)
+		{
+			allocator->FreeMemory(original);
+			return nullptr;
+		}
+
+		Header* header = GetHeader(original);
+		allocator->_counters[header->scope].reallocations.fetch_add(1, std::memory_order_relaxed);
+		// Pooled blocks are usually big enough to grow in place. The data stays where the original alignment put it,
+		// so that is what has to fit and it must satisfy the new alignment too
+		if (header->size_class != NO_SIZE_CLASS && alignment <= header->alignment
+			&& GetHeaderOffset(header->alignment) + size <= (MIN_CLASS_SIZE << header->size_class))
+		{
+			ScopeCounters& counters = allocator->_counters[header->scope];
+			if (size > header->size)
+			{
+				allocator->AddBytes(header->scope, size - header->size);
+			}
+			else
+			{
+				counters.bytes.fetch_sub(header->size - size, std::memory_order_relaxed);
+			}
+			header->size = size;
+			return original;
+		}
+
+		void* memory = allocator->AllocateMemory(size, alignment, scope);
+		if (memory == nullptr)
+		{
+			// The original stays valid on failure
+			return nullptr;
+		}
+		memcpy(memory, original, std::min<size_t>(size, header->size));
+		allocator->FreeMemory(original);
+		return memory;
+	}
+
+	VKAPI_ATTR void VKAPI_CALL CvlHostAllocator::Free(void* user_data, void* memory)
+	{
+		if (memory != nullptr)
+		{
+			static_cast<CvlHostAllocator*>(user_data)->FreeMemory(memory);
+		}
+	}
+
+	VKAPI_ATTR void VKAPI_CALL CvlHostAllocator::InternalAllocation(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+	{
+		CvlHostAllocator* allocator = static_cast<CvlHostAllocator*>(user_data);
+		ScopeCounters& counters = allocator->_counters[scope];
+		counters.internal_allocations.fetch_add(1, std::memory_order_relaxed);
+		counters.internal_bytes.fetch_add(size, std::memory_order_relaxed);
+		if (type < INTERNAL_TYPE_COUNT)
+		{
+			allocator->_internal_counters[type].allocations.fetch_add(1, std::memory_order_relaxed);
+			allocator->_internal_counters[type].bytes.fetch_add(size, std::memory_order_relaxed);
+		}
+	}
+
+	VKAPI_ATTR void VKAPI_CALL CvlHostAllocator::InternalFree(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+	{
+		CvlHostAllocator* allocator = static_cast<CvlHostAllocator*>(user_data);
+		ScopeCounters& counters = allocator->_counters[scope];
+		counters.internal_allocations.fetch_sub(1, std::memory_order_relaxed);
+		counters.internal_bytes.fetch_sub(size, std::memory_order_relaxed);
+		if (type < INTERNAL_TYPE_COUNT)
+		{
+			allocator->_internal_counters[type].allocations.fetch_sub(1, std::memory_order_relaxed);
+			allocator->_internal_counters[type].bytes.fetch_sub(size, std::memory_order_relaxed);
+		}
+	}
+
+	void* CvlHostAllocator::AllocateMemory(size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		size_t offset = GetHeaderOffset(alignment);
+		uint32_t size_class = GetSizeClass(offset + size);
+		SizeClassPool* pool = GetPool(scope, size_class);
+
+		uint8_t* base = nullptr;
+		if (pool != nullptr)
+		{
+			std::lock_guard<std::mutex> lock(pool->mutex);
+			if (pool->free_list == nullptr)
+			{
+				// Blocks are aligned to their size since pages are aligned to the largest one
+				uint8_t* page = static_cast<uint8_t*>(::operator new(PAGE_SIZE, std::align_val_t(MAX_CLASS_SIZE), std::nothrow));
+				if (page == nullptr)
+				{
+					return nullptr;
+				}
+				pool->pages.push_back(page);
+				size_t block_size = MIN_CLASS_SIZE << size_class;
+				for (size_t block = PAGE_SIZE; block >= block_size; block -= block_size)
+				{
+					FreeBlock* free_block = reinterpret_cast<FreeBlock*>(page + block - block_size);
+					free_block->next = pool->free_list;
+					pool->free_list = free_block;
+				}
+			}
+			base = reinterpret_cast<uint8_t*>(pool->free_list);
+			pool->free_list = pool->free_list->next;
+			_counters[scope].pooled.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			size_class = NO_SIZE_CLASS;
+			base = static_cast<uint8_t*>(::operator new(offset + size, std::align_val_t(offset), std::nothrow));
+			if (base == nullptr)
+			{
+				return nullptr;
+			}
+		}
+
+		uint8_t* memory = base + offset;
+		Header* header = GetHeader(memory);
+		header->base = base;
+		header->size = size;
+		header->alignment = static_cast<uint32_t>(offset);
+		header->size_class = size_class;
+		header->scope = static_cast<uint32_t>(scope);
+		_counters[scope].allocations.fetch_add(1, std::memory_order_relaxed);
+		AddBytes(header->scope, size);
+		return memory;
+	}
+
+	void CvlHostAllocator::FreeMemory(void* memory)
+	{
+		Header* header = GetHeader(memory);
+		ScopeCounters& counters = _counters[header->scope];
+		counters.frees.fetch_add(1, std::memory_order_relaxed);
+		counters.bytes.fetch_sub(header->size, std::memory_order_relaxed);
+
+		SizeClassPool* pool = header->size_class != NO_SIZE_CLASS ? GetPool(header->scope, header->size_class) : nullptr;
+		if (pool == nullptr)
+		{
+			::operator delete(header->base, std::align_val_t(header->alignment));
+			return;
+		}
+		FreeBlock* block = static_cast<FreeBlock*>(header->base);
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		block->next = pool->free_list;
+		pool->free_list = block;
+	}
+
+	CvlHostAllocator::SizeClassPool* CvlHostAllocator::GetPool(uint32_t scope, uint32_t size_class)
+	{
+		if (!_use_pools || size_class == NO_SIZE_CLASS)
+		{
+			return nullptr;
+		}
+		switch (scope)
+		{
+		case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return &_pools[0][size_class];
+		case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return &_pools[1][size_class];
+		default: return nullptr;
+		}
+	}
+
+	void CvlHostAllocator::AddBytes(uint32_t scope, uint64_t size)
+	{
+		ScopeCounters& counters = _counters[scope];
+		counters.total_bytes.fetch_add(size, std::memory_order_relaxed);
+		uint64_t bytes = counters.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+		uint64_t peak = counters.peak.load(std::memory_order_relaxed);
+		while (bytes > peak && !counters.peak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	uint32_t CvlHostAllocator::GetSizeClass(size_t size)
+	{
+		uint32_t size_class = 0;
+		while (size_class < SIZE_CLASS_COUNT && (MIN_CLASS_SIZE << size_class) < size)
+		{
+			++size_class;
+		}
+		return size_class;
+	}
+}
\ No newline at end of file
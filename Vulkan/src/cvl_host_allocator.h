@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace cvl
+{
+	struct HostAllocationStats
+	{
+		uint64_t allocations = 0;		// including reallocations that moved
+		uint64_t pooled = 0;			// allocations served by a size class pool
+		uint64_t reallocations = 0;
+		uint64_t frees = 0;
+		uint64_t bytes = 0;				// live
+		uint64_t peak = 0;
+		uint64_t total_bytes = 0;		// allocated over the lifetime
+		// Allocations the driver makes itself and only reports
+		uint64_t internal_allocations = 0;
+		uint64_t internal_bytes = 0;
+	};
+
+	/*
+		VkAllocationCallbacks that route driver host allocations by scope. Command and object scope allocations,
+		which are small and come and go with every command or object, are served from per-scope size class pools
+		(64 B to 4 KB, carved from 64 KB pages that are kept until the allocator is destroyed). Cache, device and
+		instance scope allocations are few and long lived and go to the system heap. Calls and bytes are counted per scope.
+		Every allocation is preceded by a header, so frees and reallocations find their pool without a lookup.
+	*/
+	class CvlHostAllocator
+	{
+	public:
+		static constexpr uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+		static constexpr uint32_t INTERNAL_TYPE_COUNT = VK_INTERNAL_ALLOCATION_TYPE_EXECUTABLE + 1;
+		static constexpr uint32_t SIZE_CLASS_COUNT = 7;
+		static constexpr size_t MIN_CLASS_SIZE = 64;
+		static constexpr size_t MAX_CLASS_SIZE = MIN_CLASS_SIZE << (SIZE_CLASS_COUNT - 1);
+		static constexpr size_t PAGE_SIZE = 64 * 1024;
+
+		// Without pools every scope goes to the system heap, to compare against
+		explicit CvlHostAllocator(bool use_pools = true);
+		~CvlHostAllocator();
+
+		CvlHostAllocator(const CvlHostAllocator&) = delete;
+		CvlHostAllocator& operator=(const CvlHostAllocator&) = delete;
+
+		// Objects must be destroyed with the same callbacks they were created with
+		const VkAllocationCallbacks* GetCallbacks() const { return &_callbacks; }
+		HostAllocationStats GetStats(VkSystemAllocationScope scope) const;
+		void Report() const;
+		static const char* GetScopeName(VkSystemAllocationScope scope);
+		static const char* GetInternalTypeName(VkInternalAllocationType type);
+
+	private:
+		static constexpr size_t HEADER_SIZE = 32;
+		static constexpr uint32_t NO_SIZE_CLASS = SIZE_CLASS_COUNT;
+
+		struct Header
+		{
+			void* base;
+			uint64_t size;
+			uint32_t alignment;
+			uint32_t size_class;
+			uint32_t scope;
+		};
+		static_assert(sizeof(Header) <= HEADER_SIZE, "Allocation header doesn't fit");
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		struct SizeClassPool
+		{
+			mutable std::mutex mutex;
+			FreeBlock* free_list = nullptr;
+			std::vector<void*> pages;
+		};
+
+		struct ScopeCounters
+		{
+			std::atomic<uint64_t> allocations{ 0 };
+			std::atomic<uint64_t> pooled{ 0 };
+			std::atomic<uint64_t> reallocations{ 0 };
+			std::atomic<uint64_t> frees{ 0 };
+			std::atomic<uint64_t> bytes{ 0 };
+			std::atomic<uint64_t> peak{ 0 };
+			std::atomic<uint64_t> total_bytes{ 0 };
+			std::atomic<uint64_t> internal_allocations{ 0 };
+			std::atomic<uint64_t> internal_bytes{ 0 };
+		};
+
+		struct InternalCounters
+		{
+			std::atomic<uint64_t> allocations{ 0 };
+			std::atomic<uint64_t> bytes{ 0 };
+		};
+
+		static VKAPI_ATTR void* VKAPI_CALL Allocate(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope);
+		static VKAPI_ATTR void* VKAPI_CALL Reallocate(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+		static VKAPI_ATTR void VKAPI_CALL Free(void* user_data, void* memory);
+		static VKAPI_ATTR void VKAPI_CALL InternalAllocation(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+		static VKAPI_ATTR void VKAPI_CALL InternalFree(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+		void* AllocateMemory(size_t size, size_t alignment, VkSystemAllocationScope scope);
+		void FreeMemory(void* memory);
+		// Null for the scopes that aren't pooled
+		SizeClassPool* GetPool(uint32_t scope, uint32_t size_class);
+		void AddBytes(uint32_t scope, uint64_t size);
+		static Header* GetHeader(void* memory) { return reinterpret_cast<Header*>(static_cast<uint8_t*>(memory) - HEADER_SIZE); }
+		// The header is placed right before the returned pointer, which keeps the requested alignment
+		static size_t GetHeaderOffset(size_t alignment) { return alignment > HEADER_SIZE ? alignment : HEADER_SIZE; }
+		static uint32_t GetSizeClass(size_t size);
+
+		bool _use_pools;
+		VkAllocationCallbacks _callbacks = {};
+		// Command and object scopes
+		std::array<std::array<SizeClassPool, SIZE_CLASS_COUNT>, 2> _pools;
+		std::array<ScopeCounters, SCOPE_COUNT> _counters;
+		// Driver allocations by what they are for, e.g. executable memory for compiled shaders
+		std::array<InternalCounters, INTERNAL_TYPE_COUNT> _internal_counters;
+	};
+}
\ No newline at end of file
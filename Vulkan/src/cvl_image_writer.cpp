@@ -0,0 +1,422 @@
+#include "cvl_image_writer.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace cvl
+{
+	static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	static constexpr uint32_t DEFLATE_WINDOW = 32768;
+	static constexpr uint32_t DEFLATE_MIN_MATCH = 3;
+	static constexpr uint32_t DEFLATE_MAX_MATCH = 258;
+	static constexpr uint32_t HASH_BITS = 15;
+
+	// Deflate packs bits from the least significant end of each byte
+	struct BitWriter
+	{
+		std::vector<uint8_t>& out;
+		uint64_t bits = 0;
+		uint32_t count = 0;
+
+		void Write(uint32_t value, uint32_t bit_count)
+		{
+			bits |= static_cast<uint64_t>(value) << count;
+			count += bit_count;
+			while (count >= 8)
+			{
+				out.push_back(static_cast<uint8_t>(bits));
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		// Huffman codes are defined most significant bit first
+		void WriteCode(uint32_t code, uint32_t bit_count)
+		{
+			uint32_t reversed = 0;
+			for (uint32_t i = 0; i < bit_count; ++i)
+			{
+				reversed |= ((code >> i) & 1u) << (bit_count - 1 - i);
+			}
+			Write(reversed, bit_count);
+		}
+
+		void Flush()
+		{
+			if (count > 0)
+			{
+				out.push_back(static_cast<uint8_t>(bits));
+			}
+			bits = 0;
+			count = 0;
+		}
+	};
+
+	static void WriteLiteralLength(BitWriter& writer, uint32_t symbol)
+	{
+		if (symbol < 144)
+		{
+			writer.WriteCode(0x30 + symbol, 8);
+		}
+		else if (symbol < 256)
+		{
+			writer.WriteCode(0x190 + symbol - 144, 9);
+		}
+		else if (symbol < 280)
+		{
+			writer.WriteCode(symbol - 256, 7);
+		}
+		else
+		{
+			writer.WriteCode(0xC0 + symbol - 280, 8);
+		}
+	}
+
+	static void WriteMatch(BitWriter& writer, uint32_t length, uint32_t distance)
+	{
+		uint32_t length_code = 28;
+		while (LENGTH_BASE[length_code] > length)
+		{
+			--length_code;
+		}
+		WriteLiteralLength(writer, 257 + length_code);
+		writer.Write(length - LENGTH_BASE[length_code], LENGTH_EXTRA[length_code]);
+
+		uint32_t distance_code = 29;
+		while (DISTANCE_BASE[distance_code] > distance)
+		{
+			--distance_code;
+		}
+		writer.WriteCode(distance_code, 5);
+		writer.Write(distance - DISTANCE_BASE[distance_code], DISTANCE_EXTRA[distance_code]);
+	}
+
+	static uint32_t Hash3(const uint8_t* data)
+	{
+		uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+		return (value * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	static uint32_t Adler32(const uint8_t* data, size_t size)
+	{
+		uint32_t a = 1;
+		uint32_t b = 0;
+		while (size > 0)
+		{
+			// Largest run that can't overflow b before the modulo
+			size_t run = std::min<size_t>(size, 5552);
+			for (size_t i = 0; i < run; ++i)
+			{
+				a += data[i];
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+			data += run;
+			size -= run;
+		}
+		return (b << 16) | a;
+	}
+
+	// zlib stream holding a single fixed Huffman deflate block
+	static void Deflate(const std::vector<uint8_t>& data, std::vector<uint8_t>& out)
+	{
+		out.push_back(0x78);
+		out.push_back(0x01);
+
+		BitWriter writer{ out };
+		writer.Write(1, 1);		// final block
+		writer.Write(1, 2);		// fixed Huffman codes
+
+		std::vector<int32_t> head(size_t(1) << HASH_BITS, -1);
+		uint32_t size = static_cast<uint32_t>(data.size());
+		uint32_t pos = 0;
+		while (pos < size)
+		{
+			uint32_t best_length = 0;
+			uint32_t best_distance = 0;
+			if (pos + DEFLATE_MIN_MATCH <= size)
+			{
+				uint32_t hash = Hash3(&data[pos]);
+				int32_t candidate = head[hash];
+				head[hash] = static_cast<int32_t>(pos);
+				if (candidate >= 0 && pos - candidate <= DEFLATE_WINDOW)
+				{
+					uint32_t max_length = std::min(DEFLATE_MAX_MATCH, size - pos);
+					uint32_t length = 0;
+					while (length < max_length && data[candidate + length] == data[pos + length])
+					{
+						++length;
+					}
+					if (length >= DEFLATE_MIN_MATCH)
+					{
+						best_length = length;
+						best_distance = pos - candidate;
+					}
+				}
+			}
+
+			if (best_length == 0)
+			{
+				WriteLiteralLength(writer, data[pos]);
+				++pos;
+				continue;
+			}
+			WriteMatch(writer, best_length, best_distance);
+			// Positions inside the match stay findable for later ones
+			uint32_t end = pos + best_length;
+			for (++pos; pos < end; ++pos)
+			{
+				if (pos + DEFLATE_MIN_MATCH <= size)
+				{
+					head[Hash3(&data[pos])] = static_cast<int32_t>(pos);
+				}
+			}
+		}
+		WriteLiteralLength(writer, 256);
+		writer.Flush();
+
+		uint32_t adler = Adler32(data.data(), data.size());
+		out.push_back(static_cast<uint8_t>(adler >> 24));
+		out.push_back(static_cast<uint8_t>(adler >> 16));
+		out.push_back(static_cast<uint8_t>(adler >> 8));
+		out.push_back(static_cast<uint8_t>(adler));
+	}
+
+	static const std::array<uint32_t, 256>& Crc32Table()
+	{
+		static const std::array<uint32_t, 256> table = []
+		{
+			std::array<uint32_t, 256> result = {};
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t crc = i;
+				for (uint32_t bit = 0; bit < 8; ++bit)
+				{
+					crc = (crc & 1u) ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+				}
+				result[i] = crc;
+			}
+			return result;
+		}();
+		return table;
+	}
+
+	static void AppendBigEndian(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 24));
+		out.push_back(static_cast<uint8_t>(value >> 16));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	static void AppendPngChunk(std::vector<uint8_t>& out, const char type[4], const std::vector<uint8_t>& data)
+	{
+		AppendBigEndian(out, static_cast<uint32_t>(data.size()));
+		size_t crc_begin = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data.begin(), data.end());
+
+		const std::array<uint32_t, 256>& table = Crc32Table();
+		uint32_t crc = 0xFFFFFFFFu;
+		for (size_t i = crc_begin; i < out.size(); ++i)
+		{
+			crc = table[(crc ^ out[i]) & 0xFF] ^ (crc >> 8);
+		}
+		AppendBigEndian(out, crc ^ 0xFFFFFFFFu);
+	}
+
+	static uint8_t Paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = std::abs(p - a);
+		int pb = std::abs(p - b);
+		int pc = std::abs(p - c);
+		if (pa <= pb && pa <= pc)
+		{
+			return static_cast<uint8_t>(a);
+		}
+		return static_cast<uint8_t>(pb <= pc ? b : c);
+	}
+
+	// Tries None, Sub, Up and Paeth and keeps the one with the smallest residuals, the heuristic libpng uses
+	static void FilterRow(const uint8_t* row, const uint8_t* previous, size_t row_size, uint8_t* out, std::vector<uint8_t>& scratch)
+	{
+		static constexpr size_t BPP = 4;
+		static constexpr uint8_t FILTERS[] = { 0, 1, 2, 4 };
+		uint64_t best_cost = UINT64_MAX;
+		for (uint8_t filter : FILTERS)
+		{
+			uint64_t cost = 0;
+			for (size_t i = 0; i < row_size; ++i)
+			{
+				int left = i >= BPP ? row[i - BPP] : 0;
+				int up = previous != nullptr ? previous[i] : 0;
+				int up_left = i >= BPP && previous != nullptr ? previous[i - BPP] : 0;
+				uint8_t predicted = 0;
+				switch (filter)
+				{
+				case 1: predicted = static_cast<uint8_t>(left); break;
+				case 2: predicted = static_cast<uint8_t>(up); break;
+				case 4: predicted = Paeth(left, up, up_left); break;
+				}
+				uint8_t residual = static_cast<uint8_t>(row[i] - predicted);
+				scratch[i] = residual;
+				cost += static_cast<uint64_t>(std::abs(static_cast<int8_t>(residual)));
+			}
+			if (cost < best_cost)
+			{
+				best_cost = cost;
+				out[0] = filter;
+				std::copy(scratch.begin(), scratch.begin() + row_size, out + 1);
+			}
+		}
+	}
+
+	static bool WriteFile(const std::string& path, const std::vector<uint8_t>& bytes)
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+		return file.good();
+	}
+
+	bool WritePng(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba)
+	{
+		size_t row_size = static_cast<size_t>(width) * 4;
+		std::vector<uint8_t> filtered((row_size + 1) * height);
+		std::vector<uint8_t> scratch(row_size);
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			const uint8_t* row = rgba + y * row_size;
+			const uint8_t* previous = y > 0 ? row - row_size : nullptr;
+			FilterRow(row, previous, row_size, &filtered[y * (row_size + 1)], scratch);
+		}
+
+		std::vector<uint8_t> header;
+		AppendBigEndian(header, width);
+		AppendBigEndian(header, height);
+		header.push_back(8);	// bit depth
+		header.push_back(6);	// RGBA
+		header.push_back(0);	// deflate
+		header.push_back(0);	// adaptive filtering
+		header.push_back(0);	// not interlaced
+
+		std::vector<uint8_t> compressed;
+		compressed.reserve(filtered.size() / 2);
+		Deflate(filtered, compressed);
+
+		static const uint8_t SIGNATURE[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		std::vector<uint8_t> png(SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+		png.reserve(compressed.size() + 64);
+		AppendPngChunk(png, "IHDR", header);
+		AppendPngChunk(png, "IDAT", compressed);
+		AppendPngChunk(png, "IEND", {});
+		return WriteFile(path, png);
+	}
+
+	// OpenEXR is little endian throughout
+	static void AppendLittleEndian(std::vector<uint8_t>& out, uint64_t value, uint32_t byte_count)
+	{
+		for (uint32_t i = 0; i < byte_count; ++i)
+		{
+			out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+		}
+	}
+
+	static void AppendFloat(std::vector<uint8_t>& out, float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		AppendLittleEndian(out, bits, 4);
+	}
+
+	static void AppendExrAttribute(std::vector<uint8_t>& out, const char* name, const char* type, const std::vector<uint8_t>& value)
+	{
+		out.insert(out.end(), name, name + std::strlen(name) + 1);
+		out.insert(out.end(), type, type + std::strlen(type) + 1);
+		AppendLittleEndian(out, value.size(), 4);
+		out.insert(out.end(), value.begin(), value.end());
+	}
+
+	bool WriteExr(const std::string& path, uint32_t width, uint32_t height, const float* rgba)
+	{
+		// Channels are stored in alphabetical order, each as a run of width halves per scanline
+		static const char CHANNEL_NAMES[4] = { 'A', 'B', 'G', 'R' };
+		static const uint32_t CHANNEL_SOURCE[4] = { 3, 2, 1, 0 };
+
+		std::vector<uint8_t> exr = { 0x76, 0x2F, 0x31, 0x01, 2, 0, 0, 0 };
+
+		std::vector<uint8_t> channels;
+		for (char name : CHANNEL_NAMES)
+		{
+			channels.push_back(static_cast<uint8_t>(name));
+			channels.push_back(0);
+			AppendLittleEndian(channels, 1, 4);		// HALF
+			AppendLittleEndian(channels, 0, 4);		// pLinear and reserved
+			AppendLittleEndian(channels, 1, 4);		// x sampling
+			AppendLittleEndian(channels, 1, 4);		// y sampling
+		}
+		channels.push_back(0);
+		AppendExrAttribute(exr, "channels", "chlist", channels);
+		AppendExrAttribute(exr, "compression", "compression", { 0 });
+
+		std::vector<uint8_t> window;
+		AppendLittleEndian(window, 0, 4);
+		AppendLittleEndian(window, 0, 4);
+		AppendLittleEndian(window, width - 1, 4);
+		AppendLittleEndian(window, height - 1, 4);
+		AppendExrAttribute(exr, "dataWindow", "box2i", window);
+		AppendExrAttribute(exr, "displayWindow", "box2i", window);
+		AppendExrAttribute(exr, "lineOrder", "lineOrder", { 0 });
+
+		std::vector<uint8_t> value;
+		AppendFloat(value, 1.0f);
+		AppendExrAttribute(exr, "pixelAspectRatio", "float", value);
+		value.clear();
+		AppendFloat(value, 0.0f);
+		AppendFloat(value, 0.0f);
+		AppendExrAttribute(exr, "screenWindowCenter", "v2f", value);
+		value.clear();
+		AppendFloat(value, 1.0f);
+		AppendExrAttribute(exr, "screenWindowWidth", "float", value);
+		exr.push_back(0);
+
+		// Offset table, one entry per scanline block
+		size_t line_size = static_cast<size_t>(width) * 4 * sizeof(uint16_t);
+		uint64_t offset = exr.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+		exr.reserve(static_cast<size_t>(offset) + height * (8 + line_size));
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			AppendLittleEndian(exr, offset + y * (8 + line_size), 8);
+		}
+
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			AppendLittleEndian(exr, y, 4);
+			AppendLittleEndian(exr, line_size, 4);
+			const float* row = rgba + static_cast<size_t>(y) * width * 4;
+			for (uint32_t channel = 0; channel < 4; ++channel)
+			{
+				for (uint32_t x = 0; x < width; ++x)
+				{
+					AppendLittleEndian(exr, glm::packHalf1x16(row[x * 4 + CHANNEL_SOURCE[channel]]), 2);
+				}
+			}
+		}
+		return WriteFile(path, exr);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace cvl
+{
+	/*
+		8-bit RGBA PNG. Every row gets the filter with the smallest sum of absolute residuals and the
+		filtered rows are deflated with fixed Huffman codes over a single-probe hash match finder, which
+		trades some compression ratio for encoding speed. rgba is tightly packed, rows top to bottom.
+		Returns false when the file can't be written.
+	*/
+	bool WritePng(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba);
+
+	/*
+		Uncompressed scanline OpenEXR with half float A, B, G and R channels. rgba is tightly packed
+		linear floats, rows top to bottom. Returns false when the file can't be written.
+	*/
+	bool WriteExr(const std::string& path, uint32_t width, uint32_t height, const float* rgba);
+}
\ No newline at end of file
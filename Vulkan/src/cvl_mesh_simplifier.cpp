@@ -0,0 +1,320 @@
+#include "cvl_mesh_simplifier.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <unordered_map>
+
+namespace cvl
+{
+	// Symmetric 4x4 matrix of summed squared plane distances, weighted by triangle area
+	struct Quadric
+	{
+		double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+		double b2 = 0.0, bc = 0.0, bd = 0.0;
+		double c2 = 0.0, cd = 0.0;
+		double d2 = 0.0;
+		double weight = 0.0;
+
+		void AddPlane(double a, double b, double c, double d, double w)
+		{
+			a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+			b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+			c2 += w * c * c; cd += w * c * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+			b2 += other.b2; bc += other.bc; bd += other.bd;
+			c2 += other.c2; cd += other.cd;
+			d2 += other.d2;
+			weight += other.weight;
+			return *this;
+		}
+
+		double Evaluate(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double error = a2 * x * x + b2 * y * y + c2 * z * z + 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+				+ 2.0 * (ad * x + bd * y + cd * z) + d2;
+			return std::max(error, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+		double geometric_error;
+	};
+
+	class QemSimplifier
+	{
+	public:
+		QemSimplifier
+		(
+			const std::vector<glm::vec3>& positions,
+			const std::vector<glm::vec3>& normals,
+			const std::vector<uint32_t>& indices,
+			const SimplifyOptions& options
+		) : _positions(positions), _normals(normals), _indices(indices), _options(options),
+			_quadrics(positions.size()), _locked(positions.size(), false)
+		{
+			for (size_t t = 0; t < _indices.size(); t += 3)
+			{
+				const glm::vec3& a = _positions[_indices[t]];
+				glm::vec3 n = glm::cross(_positions[_indices[t + 1]] - a, _positions[_indices[t + 2]] - a);
+				double length = glm::length(n);
+				if (length == 0.0)
+				{
+					continue;
+				}
+				double nx = n.x / length, ny = n.y / length, nz = n.z / length;
+				double d = -(nx * a.x + ny * a.y + nz * a.z);
+				for (size_t k = 0; k < 3; ++k)
+				{
+					_quadrics[_indices[t + k]].AddPlane(nx, ny, nz, d, 0.5 * length);
+				}
+			}
+
+			if (_options.lock_border)
+			{
+				// Open edges belong to a single triangle
+				std::unordered_map<uint64_t, uint32_t> edge_use;
+				for (size_t t = 0; t < _indices.size(); t += 3)
+				{
+					for (size_t k = 0; k < 3; ++k)
+					{
+						++edge_use[EdgeKey(_indices[t + k], _indices[t + (k + 1) % 3])];
+					}
+				}
+				for (const auto& [key, count] : edge_use)
+				{
+					if (count == 1)
+					{
+						_locked[static_cast<uint32_t>(key >> 32)] = true;
+						_locked[static_cast<uint32_t>(key)] = true;
+					}
+				}
+			}
+		}
+
+		// Collapses edges until the triangle count is at most target_triangles, false when stuck above it
+		bool Simplify(size_t target_triangles)
+		{
+			while (_indices.size() / 3 > target_triangles)
+			{
+				if (!RunPass(_indices.size() / 3 - target_triangles))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		const std::vector<uint32_t>& GetIndices() const { return _indices; }
+		float GetError() const { return static_cast<float>(_error); }
+
+	private:
+		static uint64_t EdgeKey(uint32_t a, uint32_t b)
+		{
+			return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+		}
+
+		bool EvaluateCollapse(uint32_t from, uint32_t to, Collapse& collapse) const
+		{
+			if (_locked[from])
+			{
+				return false;
+			}
+			Quadric quadric = _quadrics[from];
+			quadric += _quadrics[to];
+			double geometric = quadric.weight > 0.0 ? quadric.Evaluate(_positions[to]) / quadric.weight : 0.0;
+			double attribute = 0.0;
+			if (!_normals.empty())
+			{
+				glm::vec3 dn = _normals[from] - _normals[to];
+				attribute = static_cast<double>(_options.normal_weight) * _options.normal_weight * glm::dot(dn, dn);
+			}
+			collapse = { from, to, geometric + attribute, geometric };
+			return true;
+		}
+
+		bool FlipsTriangle(uint32_t from, uint32_t to, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& adjacency) const
+		{
+			for (uint32_t a = offsets[from]; a < offsets[from + 1]; ++a)
+			{
+				const uint32_t* triangle = &_indices[adjacency[a] * 3];
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+				{
+					continue;
+				}
+				glm::vec3 p[3];
+				glm::vec3 q[3];
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					p[k] = _positions[triangle[k]];
+					q[k] = _positions[triangle[k] == from ? to : triangle[k]];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				if (glm::dot(before, after) <= 0.0f)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// One round of independent collapses in order of cost, every vertex is touched at most once
+		bool RunPass(size_t triangles_to_remove)
+		{
+			const uint32_t vertex_count = static_cast<uint32_t>(_positions.size());
+			const uint32_t triangle_count = static_cast<uint32_t>(_indices.size() / 3);
+
+			std::vector<uint32_t> offsets(vertex_count + 1, 0);
+			for (uint32_t index : _indices)
+			{
+				++offsets[index + 1];
+			}
+			for (uint32_t v = 0; v < vertex_count; ++v)
+			{
+				offsets[v + 1] += offsets[v];
+			}
+			std::vector<uint32_t> adjacency(_indices.size());
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (uint32_t t = 0; t < triangle_count; ++t)
+			{
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					adjacency[fill[_indices[t * 3 + k]]++] = t;
+				}
+			}
+
+			std::vector<uint64_t> edges;
+			edges.reserve(_indices.size());
+			for (uint32_t t = 0; t < triangle_count; ++t)
+			{
+				for (uint32_t k = 0; k < 3; ++k)
+				{
+					edges.push_back(EdgeKey(_indices[t * 3 + k], _indices[t * 3 + (k + 1) % 3]));
+				}
+			}
+			std::sort(edges.begin(), edges.end());
+			edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+			// The cheaper direction of every edge
+			std::vector<Collapse> collapses;
+			collapses.reserve(edges.size());
+			for (uint64_t edge : edges)
+			{
+				uint32_t a = static_cast<uint32_t>(edge >> 32);
+				uint32_t b = static_cast<uint32_t>(edge);
+				Collapse ab;
+				Collapse ba;
+				bool can_ab = EvaluateCollapse(a, b, ab);
+				bool can_ba = EvaluateCollapse(b, a, ba);
+				if (can_ab || can_ba)
+				{
+					collapses.push_back(!can_ba || (can_ab && ab.cost <= ba.cost) ? ab : ba);
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+			std::vector<bool> touched(vertex_count, false);
+			std::vector<uint32_t> remap(vertex_count);
+			for (uint32_t v = 0; v < vertex_count; ++v)
+			{
+				remap[v] = v;
+			}
+			size_t removed = 0;
+			for (const Collapse& collapse : collapses)
+			{
+				if (removed >= triangles_to_remove)
+				{
+					break;
+				}
+				if (touched[collapse.from] || touched[collapse.to] || FlipsTriangle(collapse.from, collapse.to, offsets, adjacency))
+				{
+					continue;
+				}
+
+				remap[collapse.from] = collapse.to;
+				_quadrics[collapse.to] += _quadrics[collapse.from];
+				_error = std::max(_error, std::sqrt(collapse.geometric_error));
+				// Neighbouring collapses would change the triangles checked above, they wait for the next pass
+				for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; ++a)
+				{
+					const uint32_t* triangle = &_indices[adjacency[a] * 3];
+					removed += (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) ? 1 : 0;
+					touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+				}
+			}
+			if (removed == 0)
+			{
+				return false;
+			}
+
+			size_t write = 0;
+			for (size_t t = 0; t < _indices.size(); t += 3)
+			{
+				uint32_t a = remap[_indices[t]];
+				uint32_t b = remap[_indices[t + 1]];
+				uint32_t c = remap[_indices[t + 2]];
+				if (a != b && b != c && c != a)
+				{
+					_indices[write++] = a;
+					_indices[write++] = b;
+					_indices[write++] = c;
+				}
+			}
+			_indices.resize(write);
+			return true;
+		}
+
+		const std::vector<glm::vec3>& _positions;
+		const std::vector<glm::vec3>& _normals;
+		std::vector<uint32_t> _indices;
+		SimplifyOptions _options;
+		std::vector<Quadric> _quadrics;
+		std::vector<bool> _locked;
+		double _error = 0.0;
+	};
+
+	std::vector<MeshLod> BuildLodChain
+	(
+		const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec3>& normals,
+		const std::vector<uint32_t>& indices,
+		uint32_t max_levels,
+		float ratio,
+		const SimplifyOptions& options
+	)
+	{
+		assert(indices.size() % 3 == 0 && "Simplification needs a triangle list");
+		assert(normals.empty() || normals.size() == positions.size());
+
+		std::vector<MeshLod> levels;
+		levels.push_back({ indices, 0.0f });
+		QemSimplifier simplifier(positions, normals, indices, options);
+		while (levels.size() < max_levels)
+		{
+			size_t target = static_cast<size_t>(levels.back().indices.size() / 3 * ratio);
+			bool reached = simplifier.Simplify(target);
+			if (simplifier.GetIndices().size() == levels.back().indices.size())
+			{
+				break;
+			}
+			levels.push_back({ simplifier.GetIndices(), simplifier.GetError() });
+			if (!reached)
+			{
+				break;
+			}
+		}
+		return levels;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace cvl
+{
+	struct SimplifyOptions
+	{
+		// Mesh units of error charged per unit of normal deviation, 0 collapses on geometry alone
+		float normal_weight = 0.01f;
+		// Vertices on open edges never move, so meshes with holes keep their outline
+		bool lock_border = true;
+	};
+
+	struct MeshLod
+	{
+		std::vector<uint32_t> indices;
+		float error;	// approximate distance to the original surface in mesh units
+	};
+
+	/*
+		Quadric error metric simplification by edge collapse onto one of the edge's vertices. Levels keep
+		indexing the input vertices, so a whole chain shares one vertex buffer. Level 0 is the input and
+		every further level targets ratio times the previous triangle count, the chain stops early when
+		no more edges can be collapsed.
+	*/
+	std::vector<MeshLod> BuildLodChain
+	(
+		const std::vector<glm::vec3>& positions,
+		const std::vector<glm::vec3>& normals,
+		const std::vector<uint32_t>& indices,
+		uint32_t max_levels,
+		float ratio = 0.5f,
+		const SimplifyOptions& options = {}
+	);
+}
\ No newline at end of file
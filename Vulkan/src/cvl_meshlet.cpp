@@ -0,0 +1,267 @@
+#include "cvl_meshlet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+namespace cvl
+{
+	MeshletData BuildMeshlets
+	(
+		const std::vector<glm::vec3>& positions,
+		const std::vector<uint32_t>& indices,
+		uint32_t max_vertices,
+		uint32_t max_triangles
+	)
+	{
+		assert(indices.size() % 3 == 0 && "Meshlets need a triangle list");
+		assert(max_vertices >= 3 && max_vertices <= 255 && "Local indices are 8 bit and 0xFF marks vertices outside the meshlet");
+		const uint32_t vertex_count = static_cast<uint32_t>(positions.size());
+		const uint32_t triangle_count = static_cast<uint32_t>(indices.size() / 3);
+
+		// Vertex -> triangles adjacency in compressed rows
+		std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+		for (uint32_t index : indices)
+		{
+			++adjacency_offsets[index + 1];
+		}
+		for (uint32_t v = 0; v < vertex_count; ++v)
+		{
+			adjacency_offsets[v + 1] += adjacency_offsets[v];
+		}
+		std::vector<uint32_t> adjacency(indices.size());
+		std::vector<uint32_t> fill = adjacency_offsets;
+		for (uint32_t t = 0; t < triangle_count; ++t)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				adjacency[fill[indices[t * 3 + k]]++] = t;
+			}
+		}
+
+		std::vector<glm::vec3> centroids(triangle_count);
+		for (uint32_t t = 0; t < triangle_count; ++t)
+		{
+			centroids[t] = (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.0f;
+		}
+		// Triangles not emitted yet per vertex, preferring vertices that are nearly done avoids leaving small islands
+		std::vector<uint32_t> live_triangles(vertex_count);
+		for (uint32_t v = 0; v < vertex_count; ++v)
+		{
+			live_triangles[v] = adjacency_offsets[v + 1] - adjacency_offsets[v];
+		}
+
+		static constexpr uint8_t NOT_IN_MESHLET = 0xFF;
+		std::vector<uint8_t> local_index(vertex_count, NOT_IN_MESHLET);
+		std::vector<bool> emitted(triangle_count, false);
+		MeshletData data;
+		Meshlet meshlet = {};
+		glm::vec3 centroid_sum(0.0f);
+		uint32_t scan = 0;
+
+		auto new_vertices = [&](uint32_t t)
+		{
+			uint32_t count = 0;
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				count += local_index[indices[t * 3 + k]] == NOT_IN_MESHLET ? 1 : 0;
+			}
+			return count;
+		};
+		auto live_sum = [&](uint32_t t)
+		{
+			return live_triangles[indices[t * 3]] + live_triangles[indices[t * 3 + 1]] + live_triangles[indices[t * 3 + 2]];
+		};
+		auto add_triangle = [&](uint32_t t)
+		{
+			for (uint32_t k = 0; k < 3; ++k)
+			{
+				uint32_t v = indices[t * 3 + k];
+				if (local_index[v] == NOT_IN_MESHLET)
+				{
+					local_index[v] = static_cast<uint8_t>(meshlet.vertex_count++);
+					data.vertices.push_back(v);
+					centroid_sum += positions[v];
+				}
+				data.triangles.push_back(local_index[v]);
+				--live_triangles[v];
+			}
+			++meshlet.triangle_count;
+			emitted[t] = true;
+		};
+		auto next_seed = [&]()
+		{
+			// Continue next to the finished meshlet from its most enclosed triangle, fall back to index order
+			uint32_t best = std::numeric_limits<uint32_t>::max();
+			uint32_t best_live = std::numeric_limits<uint32_t>::max();
+			const Meshlet& last = data.meshlets.back();
+			for (uint32_t i = 0; i < last.vertex_count; ++i)
+			{
+				uint32_t v = data.vertices[last.vertex_offset + i];
+				for (uint32_t a = adjacency_offsets[v]; a < adjacency_offsets[v + 1]; ++a)
+				{
+					uint32_t t = adjacency[a];
+					if (!emitted[t] && live_sum(t) < best_live)
+					{
+						best = t;
+						best_live = live_sum(t);
+					}
+				}
+			}
+			if (best != std::numeric_limits<uint32_t>::max())
+			{
+				return best;
+			}
+			while (emitted[scan])
+			{
+				++scan;
+			}
+			return scan;
+		};
+		auto finish_meshlet = [&]()
+		{
+			for (uint32_t i = 0; i < meshlet.vertex_count; ++i)
+			{
+				local_index[data.vertices[meshlet.vertex_offset + i]] = NOT_IN_MESHLET;
+			}
+			data.meshlets.push_back(meshlet);
+			meshlet = {};
+			centroid_sum = glm::vec3(0.0f);
+			meshlet.vertex_offset = static_cast<uint32_t>(data.vertices.size());
+			meshlet.triangle_offset = static_cast<uint32_t>(data.triangles.size());
+		};
+
+		for (uint32_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count)
+		{
+			// Among the unused triangles touching the meshlet, take the one adding the fewest vertices, then the one
+			// whose vertices have the fewest triangles left, then the one closest to the centroid to keep meshlets round
+			uint32_t best = std::numeric_limits<uint32_t>::max();
+			uint32_t best_new = 4;
+			uint32_t best_live = std::numeric_limits<uint32_t>::max();
+			float best_distance = std::numeric_limits<float>::max();
+			glm::vec3 centroid = centroid_sum / static_cast<float>(std::max(meshlet.vertex_count, 1u));
+			for (uint32_t i = 0; i < meshlet.vertex_count; ++i)
+			{
+				uint32_t v = data.vertices[meshlet.vertex_offset + i];
+				for (uint32_t a = adjacency_offsets[v]; a < adjacency_offsets[v + 1]; ++a)
+				{
+					uint32_t t = adjacency[a];
+					if (emitted[t])
+					{
+						continue;
+					}
+					uint32_t added = new_vertices(t);
+					uint32_t live = live_sum(t);
+					if (added > best_new || (added == best_new && live > best_live))
+					{
+						continue;
+					}
+					glm::vec3 d = centroids[t] - centroid;
+					float distance = glm::dot(d, d);
+					if (added < best_new || live < best_live || distance < best_distance)
+					{
+						best = t;
+						best_new = added;
+						best_live = live;
+						best_distance = distance;
+					}
+				}
+			}
+
+			bool fits = best_new < 4 && meshlet.vertex_count + best_new <= max_vertices && meshlet.triangle_count < max_triangles;
+			if (!fits)
+			{
+				if (meshlet.triangle_count > 0)
+				{
+					finish_meshlet();
+				}
+				best = data.meshlets.empty() ? 0 : next_seed();
+			}
+			add_triangle(best);
+		}
+		if (meshlet.triangle_count > 0)
+		{
+			finish_meshlet();
+		}
+
+		data.bounds.reserve(data.meshlets.size());
+		for (const Meshlet& m : data.meshlets)
+		{
+			data.bounds.push_back(ComputeMeshletBounds(data, m, positions));
+		}
+		return data;
+	}
+
+	MeshletBounds ComputeMeshletBounds(const MeshletData& data, const Meshlet& meshlet, const std::vector<glm::vec3>& positions)
+	{
+		MeshletBounds bounds = {};
+
+		glm::vec3 min(std::numeric_limits<float>::max());
+		glm::vec3 max(-std::numeric_limits<float>::max());
+		for (uint32_t i = 0; i < meshlet.vertex_count; ++i)
+		{
+			const glm::vec3& p = positions[data.vertices[meshlet.vertex_offset + i]];
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		bounds.center = (min + max) * 0.5f;
+		for (uint32_t i = 0; i < meshlet.vertex_count; ++i)
+		{
+			bounds.radius = std::max(bounds.radius, glm::distance(bounds.center, positions[data.vertices[meshlet.vertex_offset + i]]));
+		}
+
+		std::vector<glm::vec3> normals;
+		normals.reserve(meshlet.triangle_count);
+		glm::vec3 axis(0.0f);
+		for (uint32_t t = 0; t < meshlet.triangle_count; ++t)
+		{
+			const uint8_t* local = &data.triangles[meshlet.triangle_offset + t * 3];
+			const glm::vec3& a = positions[data.vertices[meshlet.vertex_offset + local[0]]];
+			const glm::vec3& b = positions[data.vertices[meshlet.vertex_offset + local[1]]];
+			const glm::vec3& c = positions[data.vertices[meshlet.vertex_offset + local[2]]];
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float length = glm::length(n);
+			if (length > 0.0f)
+			{
+				normals.push_back(n / length);
+				axis += n / length;
+			}
+		}
+
+		// Degenerate or too wide cones are never culled
+		bounds.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+		bounds.cone_cutoff = 1.0f;
+		float axis_length = glm::length(axis);
+		if (axis_length <= 0.0f)
+		{
+			return bounds;
+		}
+		axis /= axis_length;
+		float min_dot = 1.0f;
+		for (const glm::vec3& n : normals)
+		{
+			min_dot = std::min(min_dot, glm::dot(n, axis));
+		}
+		if (min_dot > 0.1f)
+		{
+			bounds.cone_axis = axis;
+			bounds.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+		}
+		return bounds;
+	}
+
+	std::vector<uint32_t> GetMeshletIndices(const MeshletData& data)
+	{
+		std::vector<uint32_t> indices;
+		indices.reserve(data.triangles.size());
+		for (const Meshlet& meshlet : data.meshlets)
+		{
+			for (uint32_t i = 0; i < meshlet.triangle_count * 3; ++i)
+			{
+				indices.push_back(data.vertices[meshlet.vertex_offset + data.triangles[meshlet.triangle_offset + i]]);
+			}
+		}
+		return indices;
+	}
+}
\ No newline at end of file
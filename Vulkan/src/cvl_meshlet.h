@@ -0,0 +1,55 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace cvl
+{
+	// Limits that fit the usual mesh shader output sizes, 124 triangles keep the local indices within 372 bytes
+	static constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+	static constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+	struct Meshlet
+	{
+		uint32_t vertex_offset;		// into MeshletData::vertices
+		uint32_t triangle_offset;	// into MeshletData::triangles, 3 local indices per triangle
+		uint32_t vertex_count;
+		uint32_t triangle_count;
+	};
+
+	/*
+		Bounding sphere and normal cone. All triangles face away from an eye for which
+		dot(center - eye, cone_axis) >= cone_cutoff * length(center - eye) + radius
+	*/
+	struct MeshletBounds
+	{
+		glm::vec3 center;
+		float radius;
+		glm::vec3 cone_axis;
+		float cone_cutoff;	// sine of the cone half angle, 1 when the normals spread too far to ever cull
+	};
+
+	struct MeshletData
+	{
+		std::vector<Meshlet> meshlets;
+		std::vector<uint32_t> vertices;	// mesh vertex index of every meshlet vertex
+		std::vector<uint8_t> triangles;
+		std::vector<MeshletBounds> bounds;
+	};
+
+	// Greedy clustering: grows each meshlet with the adjacent triangle adding the fewest new vertices
+	MeshletData BuildMeshlets
+	(
+		const std::vector<glm::vec3>& positions,
+		const std::vector<uint32_t>& indices,
+		uint32_t max_vertices = MESHLET_MAX_VERTICES,
+		uint32_t max_triangles = MESHLET_MAX_TRIANGLES
+	);
+	MeshletBounds ComputeMeshletBounds(const MeshletData& data, const Meshlet& meshlet, const std::vector<glm::vec3>& positions);
+	// Mesh indices in meshlet order, meshlet i covers [triangle_offset, triangle_offset + 3 * triangle_count)
+	std::vector<uint32_t> GetMeshletIndices(const MeshletData& data);
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <cstring>
+#include <iostream>
 
 namespace cvl
 {
@@ -14,9 +15,10 @@ namespace cvl
 
 	CvlModel::~CvlModel()
 	{
-		// maxMemoryAllocationCount
-		vkDestroyBuffer(_cvl_device.device(), _vertex_buffer, nullptr);
-		vkFreeMemory(_cvl_device.device(), _vertex_buffer_memory, nullptr);
+		// maxMemoryAllocationCount. Frames in flight may still draw the model, e.g. when it's swapped at runtime
+		CvlDeletionQueue& deletion_queue = _cvl_device.GetDeletionQueue();
+		deletion_queue.DestroyBuffer(_vertex_buffer);
+		deletion_queue.FreeMemory(_vertex_buffer_memory);
 	}
 
 	void CvlModel::Bind(VkCommandBuffer command_buffer)
@@ -31,19 +33,37 @@ namespace cvl
 		vkCmdDraw(command_buffer, _vertex_count, 1, 0, 0);
 	}
 
+	glm::vec4 CvlModel::GetPositionDequantization() const
+	{
+		return glm::vec4(_bounds.half_extent.x, _bounds.half_extent.y, _bounds.center.x, _bounds.center.y);
+	}
+
 	// private
 	void CvlModel::CreateVertexBuffers(const std::vector<Vertex>& vertices)
 	{
 		_vertex_count = static_cast<uint32_t>(vertices.size());
 		assert(_vertex_count >= 3 && "Vertex count must be at least 3");
 
-		VkDeviceSize buffer_size = sizeof(vertices[0]) * _vertex_count;
+		_bounds = ComputeQuantizationBounds(vertices.begin(), vertices.end(), [](const Vertex& v) { return glm::vec3(v.pos, 0.0f); });
+		std::vector<PackedVertex> packed(_vertex_count);
+		for (uint32_t i = 0; i < _vertex_count; ++i)
+		{
+			Snorm16x4 pos = EncodePosition(glm::vec3(vertices[i].pos, 0.0f), _bounds);
+			packed[i].pos = { pos.x, pos.y };
+			packed[i].color = EncodeColor(glm::vec4(vertices[i].color, 1.0f));
+		}
+
+		VkDeviceSize buffer_size = sizeof(packed[0]) * _vertex_count;
+		VkDeviceSize float_size = sizeof(vertices[0]) * _vertex_count;
+		std::cout << "[CvlModel] " << _vertex_count << " vertices, " << buffer_size << " bytes quantized vs " << float_size
+			<< " bytes as floats (" << 100.0 * (1.0 - static_cast<double>(buffer_size) / float_size) << "% saved)\n";
 		_cvl_device.CreateBuffer
 		(
 			buffer_size,
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
 			// Host = CPU, Device = GPU
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Geometry,
 			_vertex_buffer,
 			_vertex_buffer_memory
 		);
@@ -51,35 +71,9 @@ namespace cvl
 		void* data;
 		vkMapMemory(_cvl_device.device(), _vertex_buffer_memory, 0, buffer_size, 0, &data);
 		// Cpy into host map memory region, then the host memory will be automatically flushed to update the device memory
-		memcpy(data, vertices.data(), static_cast<size_t>(buffer_size));
+		memcpy(data, packed.data(), static_cast<size_t>(buffer_size));
 		// no need to call vkFlushMappedMemoryRanges beacuse VK_MEMORY_PROPERTY_HOST_COHERENT_BIT is set
 		vkUnmapMemory(_cvl_device.device(), _vertex_buffer_memory);
 	}
-
-	/* CvlModel::Vertex class */
-	std::vector<VkVertexInputBindingDescription> CvlModel::Vertex::GetBindingDescriptions()
-	{
-		std::vector<VkVertexInputBindingDescription> binding_descriptions(1);
-		binding_descriptions[0].binding = 0;
-		binding_descriptions[0].stride = sizeof(Vertex);
-		binding_descriptions[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-		return binding_descriptions;
-	}
-
-	std::vector<VkVertexInputAttributeDescription> CvlModel::Vertex::GetAttributeDescriptions()
-	{
-		std::vector<VkVertexInputAttributeDescription> attribute_descriptions(2);
-		attribute_descriptions[0].location = 0;
-		attribute_descriptions[0].binding = 0;
-		attribute_descriptions[0].format = VK_FORMAT_R32G32_SFLOAT;
-		attribute_descriptions[0].offset = offsetof(Vertex, pos);
-
-		attribute_descriptions[1].location = 1;
-		attribute_descriptions[1].binding = 0;
-		attribute_descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attribute_descriptions[1].offset = offsetof(Vertex, color);
-		return attribute_descriptions;
-	}
-	/* ~CvlModel::Vertex class */
 	/* ~CvlModel class */
 }
\ No newline at end of file
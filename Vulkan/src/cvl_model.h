@@ -1,11 +1,13 @@
 #pragma once
 
 #include "cvl_device.h"
+#include "cvl_vertex_layout.h"
 
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 
+#include <cstddef>
 #include <vector>
 
 namespace cvl
@@ -13,13 +15,17 @@ namespace cvl
 	class CvlModel
 	{
 	public:
+		// Authoring format, vertices are quantized to PackedVertex for the GPU
 		struct Vertex
 		{
 			glm::vec2 pos;
 			glm::vec3 color;
+		};
 
-			static std::vector<VkVertexInputBindingDescription> GetBindingDescriptions();
-			static std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions();
+		struct PackedVertex
+		{
+			Snorm16x2 pos;		// relative to the model bounds, see GetPositionDequantization
+			Unorm8x4 color;
 		};
 
 		CvlModel(CvlDevice& device, const std::vector<Vertex>& vertices);
@@ -30,6 +36,8 @@ namespace cvl
 
 		void Bind(VkCommandBuffer command_buffer);
 		void Draw(VkCommandBuffer command_buffer);
+		// xy = scale, zw = offset, applied by the vertex shader to the normalized position
+		glm::vec4 GetPositionDequantization() const;
 
 	private:
 		void CreateVertexBuffers(const std::vector<Vertex>& vertices);
@@ -38,5 +46,16 @@ namespace cvl
 		VkBuffer _vertex_buffer;
 		VkDeviceMemory _vertex_buffer_memory;
 		uint32_t _vertex_count;
+		QuantizationBounds _bounds;
+	};
+
+	template<> struct VertexLayout<CvlModel::PackedVertex>
+	{
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings = { VertexBinding<CvlModel::PackedVertex>() };
+		static constexpr std::array<VkVertexInputAttributeDescription, 2> attributes =
+		{
+			VertexAttribute<Snorm16x2>(0, offsetof(CvlModel::PackedVertex, pos)),
+			VertexAttribute<Unorm8x4>(1, offsetof(CvlModel::PackedVertex, color))
+		};
 	};
 }
\ No newline at end of file
@@ -0,0 +1,472 @@
+#include "cvl_offline_renderer.h"
+#include "cvl_image_writer.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace cvl
+{
+	static bool IsBgra(VkFormat format)
+	{
+		return format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+	}
+
+	// Displays treat 8-bit values as sRGB either way, so UNORM targets are decoded the same as SRGB ones
+	static const std::array<float, 256>& SrgbToLinearTable()
+	{
+		static const std::array<float, 256> table = []
+		{
+			std::array<float, 256> result = {};
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				float value = static_cast<float>(i) / 255.0f;
+				result[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+			}
+			return result;
+		}();
+		return table;
+	}
+
+	/* CvlOfflineRenderer class */
+	CvlOfflineRenderer::CvlOfflineRenderer(CvlDevice& device, CvlThreadPool& thread_pool, const OfflineRenderConfig& config)
+		: _cvl_device(device), _thread_pool(thread_pool), _config(config)
+	{
+		if (!IsColorFormatSupported(_config.color_format))
+		{
+			throw std::runtime_error("[CvlOfflineRenderer] Unsupported color format for readback!");
+		}
+		_config.frames_in_flight = std::max(_config.frames_in_flight, 1u);
+		_config.readback_buffers = std::max(_config.readback_buffers, _config.frames_in_flight);
+		_depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (_config.depth_format == VK_FORMAT_D32_SFLOAT_S8_UINT || _config.depth_format == VK_FORMAT_D24_UNORM_S8_UINT)
+		{
+			_depth_aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+		_frame_size = static_cast<VkDeviceSize>(_config.extent.width) * _config.extent.height * 4;
+
+		std::error_code error;
+		std::filesystem::create_directories(_config.output_directory, error);
+		if (error)
+		{
+			throw std::runtime_error("[CvlOfflineRenderer] Failed to create output directory " + _config.output_directory + "!");
+		}
+		CreateTargets();
+		CreateReadbackBuffers();
+	}
+
+	CvlOfflineRenderer::~CvlOfflineRenderer()
+	{
+		// Encoders read the mapped readback memory
+		WaitForEncoders();
+		for (FrameTarget& target : _targets)
+		{
+			if (target.pending)
+			{
+				vkWaitForFences(_cvl_device.device(), 1, &target.fence, VK_TRUE, UINT64_MAX);
+			}
+			vkDestroyFence(_cvl_device.device(), target.fence, _cvl_device.GetAllocator());
+			vkFreeCommandBuffers(_cvl_device.device(), _cvl_device.GetCommandPool(), 1, &target.command_buffer);
+			vkDestroyImageView(_cvl_device.device(), target.color_view, _cvl_device.GetAllocator());
+			vkDestroyImage(_cvl_device.device(), target.color_image, _cvl_device.GetAllocator());
+			_cvl_device.FreeMemory(target.color_memory);
+			vkDestroyImageView(_cvl_device.device(), target.depth_view, _cvl_device.GetAllocator());
+			vkDestroyImage(_cvl_device.device(), target.depth_image, _cvl_device.GetAllocator());
+			_cvl_device.FreeMemory(target.depth_memory);
+		}
+		for (ReadbackBuffer& readback : _readbacks)
+		{
+			vkUnmapMemory(_cvl_device.device(), readback.memory);
+			vkDestroyBuffer(_cvl_device.device(), readback.buffer, _cvl_device.GetAllocator());
+			_cvl_device.FreeMemory(readback.memory);
+		}
+	}
+
+	bool CvlOfflineRenderer::IsColorFormatSupported(VkFormat format)
+	{
+		return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB || IsBgra(format);
+	}
+
+	OfflineRenderStats CvlOfflineRenderer::Render(uint64_t frame_count, const RecordFunction& record)
+	{
+		using clock = std::chrono::high_resolution_clock;
+		auto start = clock::now();
+		double gpu_wait_ms = 0.0;
+		double readback_wait_ms = 0.0;
+		{
+			std::lock_guard<std::mutex> lock(_encode_mutex);
+			_encode_ms_sum = 0.0;
+			_bytes_written = 0;
+			_failed_writes = 0;
+		}
+
+		uint32_t frames_in_flight = _config.frames_in_flight;
+		for (uint64_t index = 0; index < frame_count; ++index)
+		{
+			// The slot's previous frame is the oldest one in flight
+			FrameTarget& target = _targets[index % frames_in_flight];
+			if (target.pending)
+			{
+				auto wait_start = clock::now();
+				RetireFrame(target);
+				gpu_wait_ms += std::chrono::duration<double, std::milli>(clock::now() - wait_start).count();
+			}
+
+			uint32_t readback = static_cast<uint32_t>(index % _config.readback_buffers);
+			auto wait_start = clock::now();
+			WaitForReadback(readback);
+			readback_wait_ms += std::chrono::duration<double, std::milli>(clock::now() - wait_start).count();
+
+			target.index = index;
+			target.readback = readback;
+			RecordFrame(target, index, record);
+		}
+
+		// Oldest first, so encoders pick the last frames up in order
+		uint64_t first_pending = frame_count > frames_in_flight ? frame_count - frames_in_flight : 0;
+		for (uint64_t index = first_pending; index < frame_count; ++index)
+		{
+			auto wait_start = clock::now();
+			RetireFrame(_targets[index % frames_in_flight]);
+			gpu_wait_ms += std::chrono::duration<double, std::milli>(clock::now() - wait_start).count();
+		}
+		WaitForEncoders();
+
+		OfflineRenderStats stats;
+		stats.frames = frame_count;
+		stats.seconds = std::chrono::duration<double>(clock::now() - start).count();
+		stats.fps = stats.seconds > 0.0 ? static_cast<double>(frame_count) / stats.seconds : 0.0;
+		double frames = static_cast<double>(std::max<uint64_t>(frame_count, 1));
+		stats.gpu_wait_ms = gpu_wait_ms / frames;
+		stats.readback_wait_ms = readback_wait_ms / frames;
+		{
+			std::lock_guard<std::mutex> lock(_encode_mutex);
+			stats.encode_ms = _encode_ms_sum / frames;
+			stats.bytes_written = _bytes_written;
+			stats.failed_writes = _failed_writes;
+		}
+
+		std::cout << "[CvlOfflineRenderer] " << stats.frames << " frames of " << _config.extent.width << "x" << _config.extent.height
+			<< " in " << stats.seconds << " s: " << stats.fps << " fps end to end, per frame " << stats.gpu_wait_ms << " ms waiting on the GPU, "
+			<< stats.readback_wait_ms << " ms waiting for a readback buffer, " << stats.encode_ms << " ms encoding on "
+			<< _thread_pool.GetWorkerCount() << " workers, " << stats.bytes_written / (1024.0 * 1024.0) << " MB written";
+		if (stats.failed_writes > 0)
+		{
+			std::cout << ", " << stats.failed_writes << " writes failed";
+		}
+		std::cout << "\n";
+		return stats;
+	}
+
+	// private
+	void CvlOfflineRenderer::CreateTargets()
+	{
+		_targets.resize(_config.frames_in_flight);
+
+		std::vector<VkCommandBuffer> command_buffers(_targets.size());
+		VkCommandBufferAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandPool = _cvl_device.GetCommandPool();
+		alloc_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
+		if (vkAllocateCommandBuffers(_cvl_device.device(), &alloc_info, command_buffers.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlOfflineRenderer] Failed to allocate command buffers!");
+		}
+
+		for (size_t i = 0; i < _targets.size(); ++i)
+		{
+			FrameTarget& target = _targets[i];
+			target.command_buffer = command_buffers[i];
+
+			VkImageCreateInfo image_info = {};
+			image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image_info.imageType = VK_IMAGE_TYPE_2D;
+			image_info.extent = { _config.extent.width, _config.extent.height, 1 };
+			image_info.mipLevels = 1;
+			image_info.arrayLayers = 1;
+			image_info.format = _config.color_format;
+			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+			image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			_cvl_device.CreateImageWithInfo(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Attachments, target.color_image, target.color_memory);
+
+			image_info.format = _config.depth_format;
+			image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+			_cvl_device.CreateImageWithInfo(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Attachments, target.depth_image, target.depth_memory);
+
+			VkImageViewCreateInfo view_info = {};
+			view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			view_info.image = target.color_image;
+			view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			view_info.format = _config.color_format;
+			view_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+			if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &target.color_view) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlOfflineRenderer] Failed to create color view!");
+			}
+			view_info.image = target.depth_image;
+			view_info.format = _config.depth_format;
+			view_info.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+			if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &target.depth_view) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlOfflineRenderer] Failed to create depth view!");
+			}
+
+			VkFenceCreateInfo fence_info = {};
+			fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(_cvl_device.device(), &fence_info, _cvl_device.GetAllocator(), &target.fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlOfflineRenderer] Failed to create fence!");
+			}
+		}
+	}
+
+	void CvlOfflineRenderer::CreateReadbackBuffers()
+	{
+		_readbacks.resize(_config.readback_buffers);
+		for (ReadbackBuffer& readback : _readbacks)
+		{
+			VkBufferCreateInfo buffer_info = {};
+			buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			buffer_info.size = _frame_size;
+			buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+			buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			if (vkCreateBuffer(_cvl_device.device(), &buffer_info, _cvl_device.GetAllocator(), &readback.buffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlOfflineRenderer] Failed to create readback buffer!");
+			}
+
+			// Encoders read every byte, uncached memory would make that the slowest part of the frame
+			VkMemoryRequirements requirements;
+			vkGetBufferMemoryRequirements(_cvl_device.device(), readback.buffer, &requirements);
+			std::optional<uint32_t> memory_type = _cvl_device.TryFindMemoryType
+			(
+				requirements.memoryTypeBits,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT
+			);
+			VkMemoryAllocateInfo memory_info = {};
+			memory_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memory_info.allocationSize = requirements.size;
+			memory_info.memoryTypeIndex = memory_type.has_value() ? memory_type.value() :
+				_cvl_device.FindMemoryType(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			if (_cvl_device.AllocateMemory(memory_info, MemoryCategory::Staging, readback.memory) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlOfflineRenderer] Failed to allocate readback memory!");
+			}
+			vkBindBufferMemory(_cvl_device.device(), readback.buffer, readback.memory, 0);
+
+			void* mapped;
+			if (vkMapMemory(_cvl_device.device(), readback.memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlOfflineRenderer] Failed to map readback buffer!");
+			}
+			readback.mapped = static_cast<const uint8_t*>(mapped);
+		}
+	}
+
+	void CvlOfflineRenderer::RecordFrame(FrameTarget& target, uint64_t index, const RecordFunction& record)
+	{
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(target.command_buffer, &begin_info) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlOfflineRenderer] Failed to begin recording command buffer!");
+		}
+
+		// Contents are discarded, the barriers only order against the previous frame's copy and depth test
+		VkImageMemoryBarrier barriers[2] = {};
+		barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[0].image = target.color_image;
+		barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barriers[1] = barriers[0];
+		barriers[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barriers[1].image = target.depth_image;
+		barriers[1].subresourceRange = { _depth_aspect, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier
+		(
+			target.command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, 2, barriers
+		);
+
+		OfflineFrame frame = {};
+		frame.command_buffer = target.command_buffer;
+		frame.slot = static_cast<uint32_t>(index % _config.frames_in_flight);
+		frame.index = index;
+		frame.color_image = target.color_image;
+		frame.color_view = target.color_view;
+		frame.depth_image = target.depth_image;
+		frame.depth_view = target.depth_view;
+		frame.extent = _config.extent;
+		QueueSubmission submission;
+		record(frame, submission);
+
+		VkImageMemoryBarrier to_transfer = barriers[0];
+		to_transfer.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		to_transfer.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		to_transfer.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		to_transfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		vkCmdPipelineBarrier
+		(
+			target.command_buffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &to_transfer
+		);
+
+		ReadbackBuffer& readback = _readbacks[target.readback];
+		VkBufferImageCopy region = {};
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageExtent = { _config.extent.width, _config.extent.height, 1 };
+		vkCmdCopyImageToBuffer(target.command_buffer, target.color_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer, 1, &region);
+
+		VkBufferMemoryBarrier to_host = {};
+		to_host.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		to_host.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		to_host.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		to_host.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		to_host.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		to_host.buffer = readback.buffer;
+		to_host.offset = 0;
+		to_host.size = VK_WHOLE_SIZE;
+		vkCmdPipelineBarrier(target.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &to_host, 0, nullptr);
+
+		if (vkEndCommandBuffer(target.command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlOfflineRenderer] Failed to record command buffer!");
+		}
+
+		submission.command_buffers = { target.command_buffer };
+		if (_cvl_device.Submit(QueueType::Graphics, submission, target.fence) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlOfflineRenderer] Failed to submit frame!");
+		}
+		target.pending = true;
+	}
+
+	void CvlOfflineRenderer::RetireFrame(FrameTarget& target)
+	{
+		vkWaitForFences(_cvl_device.device(), 1, &target.fence, VK_TRUE, UINT64_MAX);
+		vkResetFences(_cvl_device.device(), 1, &target.fence);
+		target.pending = false;
+
+		// A no-op on coherent memory, cached memory may hold stale lines from the last frame read through it
+		ReadbackBuffer& readback = _readbacks[target.readback];
+		VkMappedMemoryRange range = {};
+		range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+		range.memory = readback.memory;
+		range.offset = 0;
+		range.size = VK_WHOLE_SIZE;
+		vkInvalidateMappedMemoryRanges(_cvl_device.device(), 1, &range);
+
+		{
+			std::lock_guard<std::mutex> lock(_encode_mutex);
+			readback.encoding = true;
+			++_encoding_count;
+		}
+		uint32_t readback_index = target.readback;
+		uint64_t index = target.index;
+		_thread_pool.Enqueue([this, readback_index, index]() { EncodeFrame(readback_index, index); });
+	}
+
+	void CvlOfflineRenderer::EncodeFrame(uint32_t readback, uint64_t index)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		uint32_t width = _config.extent.width;
+		uint32_t height = _config.extent.height;
+		size_t pixel_count = static_cast<size_t>(width) * height;
+		const uint8_t* source = _readbacks[readback].mapped;
+		bool bgra = IsBgra(_config.color_format);
+
+		// Converted into a private copy first, so the readback buffer goes back to the renderer before compression starts
+		std::vector<uint8_t> rgba8;
+		std::vector<float> rgba32f;
+		if (_config.image_format == OfflineImageFormat::Png)
+		{
+			rgba8.assign(source, source + pixel_count * 4);
+			if (bgra)
+			{
+				for (size_t i = 0; i < pixel_count; ++i)
+				{
+					std::swap(rgba8[i * 4], rgba8[i * 4 + 2]);
+				}
+			}
+		}
+		else
+		{
+			const std::array<float, 256>& to_linear = SrgbToLinearTable();
+			rgba32f.resize(pixel_count * 4);
+			for (size_t i = 0; i < pixel_count; ++i)
+			{
+				const uint8_t* pixel = source + i * 4;
+				float* out = &rgba32f[i * 4];
+				out[0] = to_linear[pixel[bgra ? 2 : 0]];
+				out[1] = to_linear[pixel[1]];
+				out[2] = to_linear[pixel[bgra ? 0 : 2]];
+				out[3] = static_cast<float>(pixel[3]) / 255.0f;
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(_encode_mutex);
+			_readbacks[readback].encoding = false;
+		}
+		_encode_done.notify_all();
+
+		std::string path = GetFramePath(index);
+		bool written = _config.image_format == OfflineImageFormat::Png ?
+			WritePng(path, width, height, rgba8.data()) :
+			WriteExr(path, width, height, rgba32f.data());
+		std::error_code error;
+		uintmax_t file_size = written ? std::filesystem::file_size(path, error) : 0;
+		double encode_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		{
+			std::lock_guard<std::mutex> lock(_encode_mutex);
+			_encode_ms_sum += encode_ms;
+			_bytes_written += error ? 0 : file_size;
+			_failed_writes += written ? 0 : 1;
+			--_encoding_count;
+		}
+		_encode_done.notify_all();
+	}
+
+	void CvlOfflineRenderer::WaitForReadback(uint32_t readback)
+	{
+		std::unique_lock<std::mutex> lock(_encode_mutex);
+		_encode_done.wait(lock, [&]() { return !_readbacks[readback].encoding; });
+	}
+
+	void CvlOfflineRenderer::WaitForEncoders()
+	{
+		std::unique_lock<std::mutex> lock(_encode_mutex);
+		_encode_done.wait(lock, [&]() { return _encoding_count == 0; });
+	}
+
+	std::string CvlOfflineRenderer::GetFramePath(uint64_t index) const
+	{
+		std::ostringstream name;
+		name << _config.file_prefix << std::setw(6) << std::setfill('0') << index
+			<< (_config.image_format == OfflineImageFormat::Png ? ".png" : ".exr");
+		return (std::filesystem::path(_config.output_directory) / name.str()).string();
+	}
+	/* ~CvlOfflineRenderer class */
+}
\ No newline at end of file
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_thread_pool.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cvl
+{
+	enum class OfflineImageFormat
+	{
+		Png,	// 8-bit, the color target's values as they are
+		Exr		// half float, decoded from sRGB to linear
+	};
+
+	struct OfflineRenderConfig
+	{
+		VkExtent2D extent = {};
+		// 8-bit RGBA or BGRA, UNORM or SRGB
+		VkFormat color_format = VK_FORMAT_UNDEFINED;
+		VkFormat depth_format = VK_FORMAT_UNDEFINED;
+		uint32_t frames_in_flight = 2;
+		// At least frames_in_flight, the rest are frames read back and waiting for or being encoded
+		uint32_t readback_buffers = 8;
+		OfflineImageFormat image_format = OfflineImageFormat::Png;
+		std::string output_directory = "offline";
+		std::string file_prefix = "frame_";
+	};
+
+	// What the record callback renders into, slot is the frame in flight and index the frame's place in the sequence
+	struct OfflineFrame
+	{
+		VkCommandBuffer command_buffer;
+		uint32_t slot;
+		uint64_t index;
+		VkImage color_image;
+		VkImageView color_view;
+		VkImage depth_image;
+		VkImageView depth_view;
+		VkExtent2D extent;
+	};
+
+	struct OfflineRenderStats
+	{
+		uint64_t frames = 0;
+		double seconds = 0.0;
+		double fps = 0.0;
+		double gpu_wait_ms = 0.0;		// per frame, the CPU blocked on frame fences
+		double readback_wait_ms = 0.0;	// per frame, the CPU blocked until an encoder released a readback buffer
+		double encode_ms = 0.0;			// per frame, conversion, compression and file write on a worker
+		uint64_t bytes_written = 0;
+		uint32_t failed_writes = 0;
+	};
+
+	/*
+		Renders a sequence of frames into offscreen targets and writes each to disk, for throughput rather than latency.
+		frames_in_flight frames are recorded ahead on the graphics queue, every finished frame is copied into one of a
+		ring of host-visible readback buffers, and encoding and file writes run on the thread pool. The GPU, the
+		readback copies and the encoders overlap, rendering only waits when every readback buffer is still being encoded.
+	*/
+	class CvlOfflineRenderer
+	{
+	public:
+		// The command buffer is begun and both targets are in their attachment layouts with undefined contents.
+		// The color target must be left in COLOR_ATTACHMENT_OPTIMAL, semaphores the frame needs go into submission
+		using RecordFunction = std::function<void(const OfflineFrame& frame, QueueSubmission& submission)>;
+
+		CvlOfflineRenderer(CvlDevice& device, CvlThreadPool& thread_pool, const OfflineRenderConfig& config);
+		~CvlOfflineRenderer();
+
+		CvlOfflineRenderer(const CvlOfflineRenderer&) = delete;
+		CvlOfflineRenderer& operator=(const CvlOfflineRenderer&) = delete;
+
+		static bool IsColorFormatSupported(VkFormat format);
+
+		// Returns once every frame is on disk
+		OfflineRenderStats Render(uint64_t frame_count, const RecordFunction& record);
+
+	private:
+		struct FrameTarget
+		{
+			VkImage color_image;
+			VkDeviceMemory color_memory;
+			VkImageView color_view;
+			VkImage depth_image;
+			VkDeviceMemory depth_memory;
+			VkImageView depth_view;
+			VkCommandBuffer command_buffer;
+			VkFence fence;
+			bool pending = false;
+			uint64_t index = 0;
+			uint32_t readback = 0;
+		};
+
+		struct ReadbackBuffer
+		{
+			VkBuffer buffer;
+			VkDeviceMemory memory;
+			const uint8_t* mapped;
+			bool encoding = false;
+		};
+
+		void CreateTargets();
+		void CreateReadbackBuffers();
+		void RecordFrame(FrameTarget& target, uint64_t index, const RecordFunction& record);
+		// Waits for the frame and hands its readback buffer to an encoder
+		void RetireFrame(FrameTarget& target);
+		void EncodeFrame(uint32_t readback, uint64_t index);
+		void WaitForReadback(uint32_t readback);
+		void WaitForEncoders();
+		std::string GetFramePath(uint64_t index) const;
+
+		CvlDevice& _cvl_device;
+		CvlThreadPool& _thread_pool;
+		OfflineRenderConfig _config;
+		VkImageAspectFlags _depth_aspect;
+		VkDeviceSize _frame_size;
+
+		std::vector<FrameTarget> _targets;
+		std::vector<ReadbackBuffer> _readbacks;
+
+		// Guards the readback buffers' encoding flags and the encoder statistics
+		std::mutex _encode_mutex;
+		std::condition_variable _encode_done;
+		uint32_t _encoding_count = 0;
+		double _encode_ms_sum = 0.0;
+		uint64_t _bytes_written = 0;
+		uint32_t _failed_writes = 0;
+	};
+}
\ No newline at end of file
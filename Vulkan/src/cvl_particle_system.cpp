@@ -0,0 +1,433 @@
+#include "cvl_particle_system.h"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace cvl
+{
+	struct ParticlePushConstants
+	{
+		float dt;
+		float time;
+		uint32_t count;
+		uint32_t seed;
+	};
+
+	/* CvlParticleSystem class */
+	CvlParticleSystem::CvlParticleSystem(CvlDevice& device, CvlPipelineCache& pipeline_cache, uint32_t particle_count, uint32_t frame_count, bool async_compute)
+		: _cvl_device(device), _pipeline_cache(pipeline_cache), _particle_count(particle_count),
+		_async_compute(async_compute && device.HasDedicatedQueue(QueueType::Compute)),
+		_gpu_timer(device, frame_count, 2, _async_compute ? QueueType::Compute : QueueType::Graphics)
+	{
+		if (async_compute && !_async_compute)
+		{
+			std::cout << "[CvlParticleSystem] No compute-only queue family, simulating on the graphics queue\n";
+		}
+		CreateParticleBuffer();
+		CreateDescriptors();
+		CreateComputePipeline();
+		if (_async_compute)
+		{
+			CreateAsyncResources(frame_count);
+		}
+	}
+
+	CvlParticleSystem::~CvlParticleSystem()
+	{
+		_compute_pipeline.reset();
+		_render_pipeline.reset();
+		_pipeline_cache.ReleasePipelines(_compute_pipeline_layout);
+		_pipeline_cache.ReleasePipelines(_render_pipeline_layout);
+		vkDestroyPipelineLayout(_cvl_device.device(), _compute_pipeline_layout, _cvl_device.GetAllocator());
+		vkDestroyPipelineLayout(_cvl_device.device(), _render_pipeline_layout, _cvl_device.GetAllocator());
+		vkDestroyDescriptorPool(_cvl_device.device(), _descriptor_pool, _cvl_device.GetAllocator());
+		vkDestroyDescriptorSetLayout(_cvl_device.device(), _descriptor_set_layout, _cvl_device.GetAllocator());
+		for (size_t i = 0; i < _particle_buffers.size(); ++i)
+		{
+			if (_particle_buffers[i] != VK_NULL_HANDLE)
+			{
+				vkDestroyBuffer(_cvl_device.device(), _particle_buffers[i], _cvl_device.GetAllocator());
+				_cvl_device.FreeMemory(_particle_buffer_memories[i]);
+			}
+		}
+		if (_async_compute)
+		{
+			for (size_t i = 0; i < _simulation_finished.size(); ++i)
+			{
+				vkDestroySemaphore(_cvl_device.device(), _simulation_finished[i], _cvl_device.GetAllocator());
+				vkDestroySemaphore(_cvl_device.device(), _draw_finished[i], _cvl_device.GetAllocator());
+			}
+			for (VkFence fence : _compute_fences)
+			{
+				vkDestroyFence(_cvl_device.device(), fence, _cvl_device.GetAllocator());
+			}
+			vkDestroyCommandPool(_cvl_device.device(), _compute_command_pool, _cvl_device.GetAllocator());
+		}
+	}
+
+	void CvlParticleSystem::CreateRenderPipeline(PipelineConfigInfo& config_info)
+	{
+		config_info.input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+		config_info.binding_descriptions = GetBindingDescriptions<Particle>();
+		config_info.attribute_descriptions = GetAttributeDescriptions<Particle>();
+		config_info.depth_stencil_info.depthTestEnable = VK_FALSE;
+		config_info.depth_stencil_info.depthWriteEnable = VK_FALSE;
+		config_info.pipeline_layout = _render_pipeline_layout;
+		_render_pipeline = _pipeline_cache.GetGraphicsPipeline(config_info, "src\\shaders\\particles.vert", "src\\shaders\\particles.frag");
+	}
+
+	void CvlParticleSystem::Simulate(VkCommandBuffer command_buffer, uint32_t frame, float dt)
+	{
+		RecordSimulation(command_buffer, frame, dt, _descriptor_sets[0]);
+	}
+
+	void CvlParticleSystem::Draw(VkCommandBuffer command_buffer)
+	{
+		if (_render_pipeline == nullptr || (_async_compute && _steps < 2))
+		{
+			return;
+		}
+		_render_pipeline->Bind(command_buffer);
+		VkBuffer buffers[] = { GetBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, buffers, offsets);
+		vkCmdDraw(command_buffer, _particle_count, 1, 0, 0);
+	}
+
+	void CvlParticleSystem::SubmitAsyncSimulation(uint32_t frame, float dt)
+	{
+		// The fence also guards the timer's queries of this frame slot
+		vkWaitForFences(_cvl_device.device(), 1, &_compute_fences[frame], VK_TRUE, UINT64_MAX);
+		vkResetFences(_cvl_device.device(), 1, &_compute_fences[frame]);
+
+		VkCommandBuffer command_buffer = _compute_command_buffers[frame];
+		vkResetCommandBuffer(command_buffer, 0);
+		VkCommandBufferBeginInfo begin_info = {};
+		begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to begin recording compute command buffer!");
+		}
+		RecordStepBarrier(command_buffer);
+		RecordSimulation(command_buffer, frame, dt, _descriptor_sets[_steps % 2]);
+		if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to record compute command buffer!");
+		}
+
+		// The previous draw read the buffer written now. The previous step's writes are ordered by the step barrier,
+		// that draw only waited on the step before it
+		QueueSubmission submission;
+		submission.command_buffers = { command_buffer };
+		if (_steps > 0)
+		{
+			submission.wait_semaphores.push_back(_draw_finished[(_steps - 1) % 2]);
+			submission.wait_stages.push_back(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+		submission.signal_semaphores.push_back(_simulation_finished[_steps % 2]);
+		if (_cvl_device.Submit(QueueType::Compute, submission, _compute_fences[frame]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to submit compute command buffer!");
+		}
+		++_steps;
+	}
+
+	void CvlParticleSystem::AddGraphicsDependencies(QueueSubmission& submission)
+	{
+		if (!_async_compute || _steps == 0)
+		{
+			return;
+		}
+		// Every frame signals, so the next step always has something to wait on
+		uint64_t step = _steps - 1;
+		if (step > 0)
+		{
+			submission.wait_semaphores.push_back(_simulation_finished[(step - 1) % 2]);
+			submission.wait_stages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+		}
+		submission.signal_semaphores.push_back(_draw_finished[step % 2]);
+	}
+
+	void CvlParticleSystem::RecordPreSimulationBarrier(VkCommandBuffer command_buffer)
+	{
+		// The previous frame's vertex fetch must be done before the buffer is overwritten, execution dependency only
+		vkCmdPipelineBarrier
+		(
+			command_buffer,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			0, nullptr,
+			0, nullptr
+		);
+	}
+
+	void CvlParticleSystem::RecordPostSimulationBarrier(VkCommandBuffer command_buffer)
+	{
+		VkBufferMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.buffer = _particle_buffers[0];
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier
+		(
+			command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+			0,
+			0, nullptr,
+			1, &barrier,
+			0, nullptr
+		);
+	}
+
+	// private
+	void CvlParticleSystem::CreateParticleBuffer()
+	{
+		// Seeded by the first dispatch, so no staging upload is needed. Shared between the
+		// graphics and compute families with async compute, which avoids queue ownership transfers
+		std::vector<uint32_t> queue_families;
+		if (_async_compute)
+		{
+			queue_families = { _cvl_device.GetQueueFamily(QueueType::Graphics), _cvl_device.GetQueueFamily(QueueType::Compute) };
+		}
+		for (size_t i = 0; i < (_async_compute ? _particle_buffers.size() : 1); ++i)
+		{
+			_cvl_device.CreateBuffer
+			(
+				GetBufferSize(),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				MemoryCategory::Geometry,
+				_particle_buffers[i],
+				_particle_buffer_memories[i],
+				queue_families
+			);
+		}
+	}
+
+	void CvlParticleSystem::CreateDescriptors()
+	{
+		// Binding 0 is read, binding 1 written
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+		for (uint32_t i = 0; i < bindings.size(); ++i)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo layout_info = {};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+		layout_info.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(_cvl_device.device(), &layout_info, _cvl_device.GetAllocator(), &_descriptor_set_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to create descriptor set layout!");
+		}
+
+		uint32_t set_count = _async_compute ? static_cast<uint32_t>(_descriptor_sets.size()) : 1;
+		VkDescriptorPoolSize pool_size = {};
+		pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		pool_size.descriptorCount = set_count * static_cast<uint32_t>(bindings.size());
+
+		VkDescriptorPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = set_count;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+		if (vkCreateDescriptorPool(_cvl_device.device(), &pool_info, _cvl_device.GetAllocator(), &_descriptor_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to create descriptor pool!");
+		}
+
+		std::vector<VkDescriptorSetLayout> set_layouts(set_count, _descriptor_set_layout);
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = _descriptor_pool;
+		alloc_info.descriptorSetCount = set_count;
+		alloc_info.pSetLayouts = set_layouts.data();
+		if (vkAllocateDescriptorSets(_cvl_device.device(), &alloc_info, _descriptor_sets.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to allocate descriptor set!");
+		}
+
+		for (uint32_t set = 0; set < set_count; ++set)
+		{
+			std::array<VkDescriptorBufferInfo, 2> buffer_infos = {};
+			buffer_infos[0].buffer = _particle_buffers[_async_compute ? (set + 1) % 2 : 0];
+			buffer_infos[0].range = VK_WHOLE_SIZE;
+			buffer_infos[1].buffer = _particle_buffers[set];
+			buffer_infos[1].range = VK_WHOLE_SIZE;
+
+			std::array<VkWriteDescriptorSet, 2> writes = {};
+			for (uint32_t i = 0; i < writes.size(); ++i)
+			{
+				writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[i].dstSet = _descriptor_sets[set];
+				writes[i].dstBinding = i;
+				writes[i].descriptorCount = 1;
+				writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[i].pBufferInfo = &buffer_infos[i];
+			}
+			vkUpdateDescriptorSets(_cvl_device.device(), static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+		}
+	}
+
+	void CvlParticleSystem::CreateComputePipeline()
+	{
+		VkPushConstantRange push_range = {};
+		push_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push_range.offset = 0;
+		push_range.size = sizeof(ParticlePushConstants);
+
+		VkPipelineLayoutCreateInfo compute_layout_info = {};
+		compute_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		compute_layout_info.setLayoutCount = 1;
+		compute_layout_info.pSetLayouts = &_descriptor_set_layout;
+		compute_layout_info.pushConstantRangeCount = 1;
+		compute_layout_info.pPushConstantRanges = &push_range;
+		if (vkCreatePipelineLayout(_cvl_device.device(), &compute_layout_info, _cvl_device.GetAllocator(), &_compute_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to create compute pipeline layout!");
+		}
+
+		// Drawing reads the buffer through vertex input only
+		VkPipelineLayoutCreateInfo render_layout_info = {};
+		render_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		if (vkCreatePipelineLayout(_cvl_device.device(), &render_layout_info, _cvl_device.GetAllocator(), &_render_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to create render pipeline layout!");
+		}
+
+		SpecializationConstants specialization;
+		specialization.Set(0, WORKGROUP_SIZE);
+		_compute_pipeline = _pipeline_cache.GetComputePipeline(_compute_pipeline_layout, "src\\shaders\\particles.comp", specialization);
+	}
+
+	void CvlParticleSystem::CreateAsyncResources(uint32_t frame_count)
+	{
+		VkCommandPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		pool_info.queueFamilyIndex = _cvl_device.GetQueueFamily(QueueType::Compute);
+		pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+		if (vkCreateCommandPool(_cvl_device.device(), &pool_info, _cvl_device.GetAllocator(), &_compute_command_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to create compute command pool!");
+		}
+
+		_compute_command_buffers.resize(frame_count);
+		VkCommandBufferAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		alloc_info.commandPool = _compute_command_pool;
+		alloc_info.commandBufferCount = frame_count;
+		if (vkAllocateCommandBuffers(_cvl_device.device(), &alloc_info, _compute_command_buffers.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlParticleSystem] Failed to allocate compute command buffers!");
+		}
+
+		// Signaled, so the first wait in each frame slot returns immediately
+		VkFenceCreateInfo fence_info = {};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+		_compute_fences.resize(frame_count);
+		for (VkFence& fence : _compute_fences)
+		{
+			if (vkCreateFence(_cvl_device.device(), &fence_info, _cvl_device.GetAllocator(), &fence) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlParticleSystem] Failed to create compute fence!");
+			}
+		}
+
+		VkSemaphoreCreateInfo semaphore_info = {};
+		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		for (size_t i = 0; i < _simulation_finished.size(); ++i)
+		{
+			if (vkCreateSemaphore(_cvl_device.device(), &semaphore_info, _cvl_device.GetAllocator(), &_simulation_finished[i]) != VK_SUCCESS ||
+				vkCreateSemaphore(_cvl_device.device(), &semaphore_info, _cvl_device.GetAllocator(), &_draw_finished[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlParticleSystem] Failed to create async compute semaphores!");
+			}
+		}
+	}
+
+	void CvlParticleSystem::RecordStepBarrier(VkCommandBuffer command_buffer)
+	{
+		// Steps follow each other on the compute queue without a semaphore, this step reads what the previous one wrote
+		std::array<VkBufferMemoryBarrier, 2> barriers = {};
+		for (size_t i = 0; i < barriers.size(); ++i)
+		{
+			barriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barriers[i].buffer = _particle_buffers[i];
+			barriers[i].offset = 0;
+			barriers[i].size = VK_WHOLE_SIZE;
+		}
+
+		vkCmdPipelineBarrier
+		(
+			command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(barriers.size()), barriers.data(),
+			0, nullptr
+		);
+	}
+
+	void CvlParticleSystem::RecordSimulation(VkCommandBuffer command_buffer, uint32_t frame, float dt, VkDescriptorSet descriptor_set)
+	{
+		_gpu_timer.BeginFrame(command_buffer, frame);
+		ReportTimings();
+
+		ParticlePushConstants push = {};
+		push.dt = dt;
+		push.time = _time;
+		push.count = _particle_count;
+		push.seed = _seeded ? 0 : 0x9E3779B9u;
+		_seeded = true;
+		_time += dt;
+
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+		_compute_pipeline->Bind(command_buffer);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, _compute_pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+		vkCmdPushConstants(command_buffer, _compute_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+		_compute_pipeline->Dispatch(command_buffer, CvlPipeline::GroupCount(_particle_count, WORKGROUP_SIZE));
+		_gpu_timer.WriteTimestamp(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
+
+	void CvlParticleSystem::ReportTimings()
+	{
+		std::optional<double> dispatch_ms = _gpu_timer.GetElapsedMs(0, 1);
+		if (!dispatch_ms.has_value())
+		{
+			return;
+		}
+		_dispatch_ms_sum += dispatch_ms.value();
+		if (++_dispatch_samples < REPORT_INTERVAL_FRAMES)
+		{
+			return;
+		}
+
+		double average_ms = _dispatch_ms_sum / _dispatch_samples;
+		double particles_per_second = average_ms > 0.0 ? _particle_count / (average_ms / 1000.0) : 0.0;
+		std::cout << "[CvlParticleSystem] " << _particle_count << (_async_compute ? " particles on the compute queue" : " particles") << ", dispatch " << average_ms << " ms, "
+			<< particles_per_second / 1e6 << " M particles/s\n";
+		_dispatch_ms_sum = 0.0;
+		_dispatch_samples = 0;
+	}
+	/* ~CvlParticleSystem class */
+}
\ No newline at end of file
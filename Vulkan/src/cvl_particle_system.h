@@ -0,0 +1,130 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_pipeline.h"
+#include "cvl_pipeline_cache.h"
+#include "cvl_gpu_timer.h"
+#include "cvl_vertex_layout.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Particles live in device local storage buffers: a compute pass seeds and simulates them
+		and the result is bound as vertex buffer for drawing points, nothing goes through the CPU.
+		Simulate() and Draw() don't record barriers, the render graph derives them from the declared usage.
+
+		With async compute the simulation is submitted to the compute-only queue instead and runs one step ahead
+		of drawing: step n writes one of two buffers while the graphics queue draws step n - 1 from the other.
+		Semaphores order step n after the draw of step n - 2 (which read its buffer) and each draw after the step it shows.
+	*/
+	class CvlParticleSystem
+	{
+	public:
+		// std430 layout, matches shaders/particles.comp
+		struct Particle
+		{
+			glm::vec2 pos;
+			glm::vec2 vel;
+			glm::vec4 color;
+		};
+
+		// Passed to shaders/particles.comp as specialization constant 0 (local_size_x_id)
+		static constexpr uint32_t WORKGROUP_SIZE = 256;
+		static constexpr uint32_t REPORT_INTERVAL_FRAMES = 300;
+
+		// async_compute is ignored when the device has no compute-only queue family
+		CvlParticleSystem(CvlDevice& device, CvlPipelineCache& pipeline_cache, uint32_t particle_count, uint32_t frame_count, bool async_compute = false);
+		~CvlParticleSystem();
+
+		CvlParticleSystem(const CvlParticleSystem&) = delete;
+		CvlParticleSystem& operator=(const CvlParticleSystem&) = delete;
+
+		// config_info must have its attachments set, topology, vertex input, depth and layout are overridden
+		void CreateRenderPipeline(PipelineConfigInfo& config_info);
+
+		// Must be recorded outside of rendering, only without async compute
+		void Simulate(VkCommandBuffer command_buffer, uint32_t frame, float dt);
+		// Nothing is drawn until the first async step has completed
+		void Draw(VkCommandBuffer command_buffer);
+
+		/* Async compute */
+		// Records and submits the next step, once per frame before the graphics submission
+		void SubmitAsyncSimulation(uint32_t frame, float dt);
+		// Adds the semaphores ordering this frame's graphics submission against the simulation steps
+		void AddGraphicsDependencies(QueueSubmission& submission);
+		bool IsAsyncCompute() { return _async_compute; }
+		// Timestamps 0 and 1 bracket the dispatch
+		const CvlGpuTimer& GetGpuTimer() { return _gpu_timer; }
+
+		// For command buffers that aren't recorded through the render graph
+		void RecordPreSimulationBarrier(VkCommandBuffer command_buffer);
+		void RecordPostSimulationBarrier(VkCommandBuffer command_buffer);
+
+		// The buffer drawn this frame
+		VkBuffer GetBuffer() { return _particle_buffers[_async_compute ? _steps % 2 : 0]; }
+		VkDeviceSize GetBufferSize() { return sizeof(Particle) * _particle_count; }
+		uint32_t GetParticleCount() { return _particle_count; }
+
+	private:
+		void CreateParticleBuffer();
+		void CreateDescriptors();
+		void CreateComputePipeline();
+		void CreateAsyncResources(uint32_t frame_count);
+		void RecordStepBarrier(VkCommandBuffer command_buffer);
+		void RecordSimulation(VkCommandBuffer command_buffer, uint32_t frame, float dt, VkDescriptorSet descriptor_set);
+		void ReportTimings();
+
+		CvlDevice& _cvl_device;
+		CvlPipelineCache& _pipeline_cache;
+		uint32_t _particle_count;
+		bool _async_compute;
+
+		// Only the first is used without async compute
+		std::array<VkBuffer, 2> _particle_buffers = {};
+		std::array<VkDeviceMemory, 2> _particle_buffer_memories = {};
+
+		VkDescriptorSetLayout _descriptor_set_layout;
+		VkDescriptorPool _descriptor_pool;
+		// Set i reads the other buffer and writes buffer i, without async compute set 0 reads and writes buffer 0
+		std::array<VkDescriptorSet, 2> _descriptor_sets = {};
+		VkPipelineLayout _compute_pipeline_layout;
+		VkPipelineLayout _render_pipeline_layout;
+		std::shared_ptr<CvlPipeline> _compute_pipeline;
+		std::shared_ptr<CvlPipeline> _render_pipeline;
+
+		/* Async compute */
+		// Simulation steps submitted so far, the buffers and semaphores alternate with the step
+		uint64_t _steps = 0;
+		VkCommandPool _compute_command_pool = VK_NULL_HANDLE;
+		// Per frame in flight
+		std::vector<VkCommandBuffer> _compute_command_buffers;
+		std::vector<VkFence> _compute_fences;
+		std::array<VkSemaphore, 2> _simulation_finished = {};
+		std::array<VkSemaphore, 2> _draw_finished = {};
+
+		CvlGpuTimer _gpu_timer;
+		bool _seeded = false;
+		float _time = 0.0f;
+		double _dispatch_ms_sum = 0.0;
+		uint32_t _dispatch_samples = 0;
+	};
+
+	template<> struct VertexLayout<CvlParticleSystem::Particle>
+	{
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings = { VertexBinding<CvlParticleSystem::Particle>() };
+		static constexpr std::array<VkVertexInputAttributeDescription, 2> attributes =
+		{
+			VertexAttribute<glm::vec2>(0, offsetof(CvlParticleSystem::Particle, pos)),
+			VertexAttribute<glm::vec4>(1, offsetof(CvlParticleSystem::Particle, color))
+		};
+	};
+}
\ No newline at end of file
@@ -7,19 +7,196 @@
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
+#include <cstring>
+#include <map>
+#include <sstream>
 
 namespace cvl
 {
+	/* SpecializationConstants class */
+	SpecializationConstants::SpecializationConstants(const std::vector<VkSpecializationMapEntry>& entries, const std::vector<uint8_t>& data)
+	{
+		for (const auto& entry : entries)
+		{
+			assert(entry.offset <= data.size() && entry.size <= data.size() - entry.offset && "Specialization constant outside its data");
+			SetRaw(entry.constantID, data.data() + entry.offset, entry.size);
+		}
+	}
+
+	void SpecializationConstants::Set(uint32_t constant_id, bool value)
+	{
+		// SPIR-V booleans are 32 bit
+		VkBool32 b = value ? VK_TRUE : VK_FALSE;
+		SetRaw(constant_id, &b, sizeof(b));
+	}
+
+	void SpecializationConstants::Set(uint32_t constant_id, int32_t value)
+	{
+		SetRaw(constant_id, &value, sizeof(value));
+	}
+
+	void SpecializationConstants::Set(uint32_t constant_id, uint32_t value)
+	{
+		SetRaw(constant_id, &value, sizeof(value));
+	}
+
+	void SpecializationConstants::Set(uint32_t constant_id, float value)
+	{
+		SetRaw(constant_id, &value, sizeof(value));
+	}
+
+	const VkSpecializationInfo* SpecializationConstants::GetInfo() const
+	{
+		if (_entries.empty())
+		{
+			return nullptr;
+		}
+		_info.mapEntryCount = static_cast<uint32_t>(_entries.size());
+		_info.pMapEntries = _entries.data();
+		_info.dataSize = _data.size();
+		_info.pData = _data.data();
+		return &_info;
+	}
+
+	std::string SpecializationConstants::GetKey() const
+	{
+		// Sorted by id so the insertion order doesn't create distinct variants
+		std::map<uint32_t, uint32_t> values;
+		for (const auto& entry : _entries)
+		{
+			uint32_t bits = 0;
+			memcpy(&bits, _data.data() + entry.offset, entry.size);
+			values[entry.constantID] = bits;
+		}
+		std::ostringstream key;
+		key << std::hex;
+		for (const auto& [id, bits] : values)
+		{
+			key << id << '=' << bits << ';';
+		}
+		return key.str();
+	}
+
+	void SpecializationConstants::SetRaw(uint32_t constant_id, const void* data, size_t size)
+	{
+		for (const auto& entry : _entries)
+		{
+			if (entry.constantID == constant_id)
+			{
+				assert(entry.size == size && "Specialization constant set with a different type");
+				memcpy(_data.data() + entry.offset, data, size);
+				return;
+			}
+		}
+		VkSpecializationMapEntry entry = {};
+		entry.constantID = constant_id;
+		entry.offset = static_cast<uint32_t>(_data.size());
+		entry.size = size;
+		_entries.push_back(entry);
+		_data.resize(_data.size() + size);
+		memcpy(_data.data() + entry.offset, data, size);
+	}
+	/* ~SpecializationConstants class */
+
 	std::string CvlPipeline::_glslc_fp = "C:\\VulkanSDK\\1.3.239.0\\Bin\\glslc.exe";
-	std::string CvlPipeline::CompileShader(const std::string& shader_fp)
+	std::string CvlPipeline::CompileShader(const std::string& shader_fp, std::string* error)
 	{
 		// Windows only
 		std::string cmd = _glslc_fp + " " + shader_fp + " -o " + shader_fp + ".spv";
+		std::string log_fp = shader_fp + ".log";
+		if (error != nullptr)
+		{
+			// glslc doesn't write the output on failure, the diagnostics are collected for the caller
+			cmd += " 2> " + log_fp;
+		}
+		// Hashed before compiling, an edit during the compile leaves a stale hash and is compiled next time
+		std::string source_hash = GetSourceHash(shader_fp);
 		std::cout << "[CvlPipeline] " << cmd << '\n';
-		system(cmd.c_str());
+		int result = system(cmd.c_str());
+		if (error != nullptr && result != 0)
+		{
+			std::ifstream ifs(log_fp);
+			std::ostringstream log;
+			log << ifs.rdbuf();
+			*error = log.str().empty() ? "glslc exited with code " + std::to_string(result) : log.str();
+			return "";
+		}
+		if (result == 0 && !source_hash.empty())
+		{
+			std::ofstream(shader_fp + ".spv.hash", std::ios::trunc) << source_hash;
+		}
 		return shader_fp + ".spv";
 	}
 
+	bool CvlPipeline::IsShaderUpToDate(const std::string& shader_fp)
+	{
+		// Modification times can't be trusted, checkouts and copies reorder them. A .spv without a hash, e.g.
+		// from compile_shader.bat, is always rebuilt
+		std::string source_hash = GetSourceHash(shader_fp);
+		if (source_hash.empty() || !std::filesystem::exists(shader_fp + ".spv"))
+		{
+			return false;
+		}
+		std::ifstream ifs(shader_fp + ".spv.hash");
+		std::string spv_hash;
+		return (ifs >> spv_hash) && spv_hash == source_hash;
+	}
+
+	std::string CvlPipeline::GetSourceHash(const std::string& shader_fp)
+	{
+		// FNV-1a, only has to tell edits apart. Empty when the source can't be read
+		std::ifstream ifs(shader_fp, std::ios::binary);
+		if (!ifs.is_open())
+		{
+			return "";
+		}
+		uint64_t hash = 14695981039346656037ull;
+		char c;
+		while (ifs.get(c))
+		{
+			hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+		}
+		std::ostringstream ss;
+		ss << std::hex << hash;
+		return ss.str();
+	}
+
+	std::vector<char> CvlPipeline::LoadShaderCode(const std::string& shader_fp)
+	{
+		std::string fp = std::filesystem::current_path().string() + '\\' + shader_fp;
+		return ReadFile(IsShaderUpToDate(fp) ? fp + ".spv" : CompileShader(fp));
+	}
+
+	bool CvlPipeline::PrecompileShader(const std::string& shader_fp)
+	{
+		std::string fp = std::filesystem::current_path().string() + '\\' + shader_fp;
+		if (IsShaderUpToDate(fp))
+		{
+			return false;
+		}
+		CompileShader(fp);
+		return true;
+	}
+
+	bool CvlPipeline::TryLoadShaderCode(const std::string& shader_fp, std::vector<char>& code, std::string& error)
+	{
+		std::string spv_fp = CompileShader(std::filesystem::current_path().string() + '\\' + shader_fp, &error);
+		if (spv_fp.empty())
+		{
+			return false;
+		}
+		try
+		{
+			code = ReadFile(spv_fp);
+		}
+		catch (const std::runtime_error& e)
+		{
+			error = e.what();
+			return false;
+		}
+		return true;
+	}
+
 	std::vector<char> CvlPipeline::ReadFile(const std::string& fp)
 	{
 		std::ifstream ifs(fp, std::ios::ate | std::ios::binary);
@@ -106,6 +283,39 @@ namespace cvl
 		config_info.dynamic_state_info.pDynamicStates = config_info.dynamic_state_enables.data();
 		config_info.dynamic_state_info.dynamicStateCount = static_cast<uint32_t>(config_info.dynamic_state_enables.size());
 		config_info.dynamic_state_info.flags = 0;
+
+		config_info.binding_descriptions = GetBindingDescriptions<CvlModel::PackedVertex>();
+		config_info.attribute_descriptions = GetAttributeDescriptions<CvlModel::PackedVertex>();
+	}
+
+	void CvlPipeline::CopyPipelineConfigInfo(const PipelineConfigInfo& src, PipelineConfigInfo& dst)
+	{
+		assert(src.color_blend_info.pAttachments == &src.color_blend_attachment && src.color_blend_info.attachmentCount <= 1
+			&& "Only the embedded blend attachment can be copied");
+		assert(src.dynamic_state_info.pDynamicStates == src.dynamic_state_enables.data()
+			&& "Only the embedded dynamic states can be copied");
+
+		dst.viewport_info = src.viewport_info;
+		dst.input_assembly_info = src.input_assembly_info;
+		dst.rasterization_info = src.rasterization_info;
+		dst.multisample_info = src.multisample_info;
+		dst.color_blend_attachment = src.color_blend_attachment;
+		dst.color_blend_info = src.color_blend_info;
+		dst.color_blend_info.pAttachments = &dst.color_blend_attachment;
+		dst.depth_stencil_info = src.depth_stencil_info;
+		dst.dynamic_state_enables = src.dynamic_state_enables;
+		dst.binding_descriptions = src.binding_descriptions;
+		dst.attribute_descriptions = src.attribute_descriptions;
+		dst.dynamic_state_info = src.dynamic_state_info;
+		dst.dynamic_state_info.pDynamicStates = dst.dynamic_state_enables.data();
+		dst.pipeline_layout = src.pipeline_layout;
+		dst.render_pass = src.render_pass;
+		dst.subpass = src.subpass;
+		dst.color_attachment_formats = src.color_attachment_formats;
+		dst.depth_attachment_format = src.depth_attachment_format;
+		dst.stencil_attachment_format = src.stencil_attachment_format;
+		dst.vertex_specialization = src.vertex_specialization;
+		dst.fragment_specialization = src.fragment_specialization;
 	}
 
 	CvlPipeline::CvlPipeline
@@ -114,55 +324,123 @@ namespace cvl
 		const PipelineConfigInfo& config_info,
 		const std::string& v_shader_fp,
 		const std::string& f_shader_fp
-	) : _cvl_device(device)
+	) : _cvl_device(device), _bind_point(VK_PIPELINE_BIND_POINT_GRAPHICS)
+	{
+		auto v_shader_code = LoadShaderCode(v_shader_fp);
+		auto f_shader_code = LoadShaderCode(f_shader_fp);
+
+		std::cout << "Vertex shader code size: " << v_shader_code.size() << '\n';
+		std::cout << "Fragment shader code size: " << f_shader_code.size() << '\n';
+
+		CreateShaderModule(_cvl_device, v_shader_code, &_v_shader_module);
+		CreateShaderModule(_cvl_device, f_shader_code, &_f_shader_module);
+		CreateGraphicsPipeline(_v_shader_module, _f_shader_module, config_info, VK_NULL_HANDLE);
+	}
+
+	CvlPipeline::CvlPipeline
+	(
+		CvlDevice& device,
+		VkPipelineLayout pipeline_layout,
+		const std::string& c_shader_fp,
+		const SpecializationConstants& specialization
+	) : _cvl_device(device), _bind_point(VK_PIPELINE_BIND_POINT_COMPUTE)
+	{
+		auto c_shader_code = LoadShaderCode(c_shader_fp);
+
+		std::cout << "Compute shader code size: " << c_shader_code.size() << '\n';
+
+		CreateShaderModule(_cvl_device, c_shader_code, &_c_shader_module);
+		CreateComputePipeline(_c_shader_module, pipeline_layout, specialization, VK_NULL_HANDLE);
+	}
+
+	CvlPipeline::CvlPipeline
+	(
+		CvlDevice& device,
+		const PipelineConfigInfo& config_info,
+		VkShaderModule v_shader_module,
+		VkShaderModule f_shader_module,
+		VkPipelineCache pipeline_cache
+	) : _cvl_device(device), _bind_point(VK_PIPELINE_BIND_POINT_GRAPHICS)
 	{
-		CreateGraphicsPipeline(v_shader_fp, f_shader_fp, config_info);
+		CreateGraphicsPipeline(v_shader_module, f_shader_module, config_info, pipeline_cache);
+	}
+
+	CvlPipeline::CvlPipeline
+	(
+		CvlDevice& device,
+		VkPipelineLayout pipeline_layout,
+		VkShaderModule c_shader_module,
+		const SpecializationConstants& specialization,
+		VkPipelineCache pipeline_cache
+	) : _cvl_device(device), _bind_point(VK_PIPELINE_BIND_POINT_COMPUTE)
+	{
+		CreateComputePipeline(c_shader_module, pipeline_layout, specialization, pipeline_cache);
 	}
 
 	CvlPipeline::~CvlPipeline()
 	{
-		vkDestroyShaderModule(_cvl_device.device(), _v_shader_module, nullptr);
-		vkDestroyShaderModule(_cvl_device.device(), _f_shader_module, nullptr);
-		vkDestroyPipeline(_cvl_device.device(), _graphics_pipeline, nullptr);
+		// Frames in flight may still be bound to the pipeline, the deletion queue ignores null shader modules
+		CvlDeletionQueue& deletion_queue = _cvl_device.GetDeletionQueue();
+		deletion_queue.DestroyShaderModule(_v_shader_module);
+		deletion_queue.DestroyShaderModule(_f_shader_module);
+		deletion_queue.DestroyShaderModule(_c_shader_module);
+		deletion_queue.DestroyPipeline(_pipeline);
+	}
+
+	void CvlPipeline::Swap(CvlPipeline& other)
+	{
+		assert(_bind_point == other._bind_point && "Swapping pipelines of a different kind");
+		std::swap(_pipeline, other._pipeline);
 	}
 
 	void CvlPipeline::Bind(VkCommandBuffer command_buffer)
 	{
 		// BIND_POINT: _GRAPHICS, _COMPUTE, _RAY_TRACING
-		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline);
+		vkCmdBindPipeline(command_buffer, _bind_point, _pipeline);
 	}
 
-	void CvlPipeline::CreateGraphicsPipeline(const std::string& v_shader_fp, const std::string& f_shader_fp, const PipelineConfigInfo& config_info)
+	void CvlPipeline::Dispatch(VkCommandBuffer command_buffer, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z)
 	{
-		assert(config_info.pipeline_layout != VK_NULL_HANDLE);
-		assert(config_info.render_pass != VK_NULL_HANDLE);
-		auto v_shader_code = ReadFile(CompileShader(std::filesystem::current_path().string() + '\\' + v_shader_fp));
-		auto f_shader_code = ReadFile(CompileShader(std::filesystem::current_path().string() + '\\' + f_shader_fp));
+		assert(_bind_point == VK_PIPELINE_BIND_POINT_COMPUTE && "Dispatch needs a compute pipeline");
+		vkCmdDispatch(command_buffer, group_count_x, group_count_y, group_count_z);
+	}
 
-		std::cout << "Vertex shader code size: " << v_shader_code.size() << '\n';
-		std::cout << "Fragment shader code size: " << f_shader_code.size() << '\n';
+	void CvlPipeline::DispatchIndirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset)
+	{
+		assert(_bind_point == VK_PIPELINE_BIND_POINT_COMPUTE && "Dispatch needs a compute pipeline");
+		vkCmdDispatchIndirect(command_buffer, buffer, offset);
+	}
 
-		CreateShaderModule(v_shader_code, &_v_shader_module);
-		CreateShaderModule(f_shader_code, &_f_shader_module);
+	void CvlPipeline::CreateGraphicsPipeline
+	(
+		VkShaderModule v_shader_module,
+		VkShaderModule f_shader_module,
+		const PipelineConfigInfo& config_info,
+		VkPipelineCache pipeline_cache
+	)
+	{
+		assert(config_info.pipeline_layout != VK_NULL_HANDLE);
+		assert((config_info.render_pass != VK_NULL_HANDLE || !config_info.color_attachment_formats.empty())
+			&& "Pipeline needs either a render pass or attachment formats for dynamic rendering");
 
 		VkPipelineShaderStageCreateInfo shader_stages[2];
 		shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-		shader_stages[0].module = _v_shader_module;
+		shader_stages[0].module = v_shader_module;
 		shader_stages[0].pName = "main";
 		shader_stages[0].flags = 0;
 		shader_stages[0].pNext = nullptr;
-		shader_stages[0].pSpecializationInfo = nullptr;
+		shader_stages[0].pSpecializationInfo = config_info.vertex_specialization.GetInfo();
 		shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		shader_stages[1].module = _f_shader_module;
+		shader_stages[1].module = f_shader_module;
 		shader_stages[1].pName = "main";
 		shader_stages[1].flags = 0;
 		shader_stages[1].pNext = nullptr;
-		shader_stages[1].pSpecializationInfo = nullptr;
+		shader_stages[1].pSpecializationInfo = config_info.fragment_specialization.GetInfo();
 
-		auto attribute_descriptions = CvlModel::Vertex::GetAttributeDescriptions();
-		auto binding_descriptions = CvlModel::Vertex::GetBindingDescriptions();
+		const auto& attribute_descriptions = config_info.attribute_descriptions;
+		const auto& binding_descriptions = config_info.binding_descriptions;
 		VkPipelineVertexInputStateCreateInfo vertex_input_info{};
 		vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
 		vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(attribute_descriptions.size());
@@ -187,16 +465,58 @@ namespace cvl
 		pipeline_info.renderPass = config_info.render_pass;
 		pipeline_info.subpass = config_info.subpass;
 
+		VkPipelineRenderingCreateInfo rendering_info = {};
+		if (config_info.render_pass == VK_NULL_HANDLE)
+		{
+			rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+			rendering_info.colorAttachmentCount = static_cast<uint32_t>(config_info.color_attachment_formats.size());
+			rendering_info.pColorAttachmentFormats = config_info.color_attachment_formats.data();
+			rendering_info.depthAttachmentFormat = config_info.depth_attachment_format;
+			rendering_info.stencilAttachmentFormat = config_info.stencil_attachment_format;
+			pipeline_info.pNext = &rendering_info;
+			pipeline_info.subpass = 0;
+		}
+
 		pipeline_info.basePipelineIndex = -1;
 		pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 
-		if (vkCreateGraphicsPipelines(_cvl_device.device(), VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_graphics_pipeline) != VK_SUCCESS)
+		if (vkCreateGraphicsPipelines(_cvl_device.device(), pipeline_cache, 1, &pipeline_info, _cvl_device.GetAllocator(), &_pipeline) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlPipeline] Failed to create graphics pipeline!");
 		}
 	}
 
-	void CvlPipeline::CreateShaderModule(const std::vector<char>& code, VkShaderModule* shader_module)
+	void CvlPipeline::CreateComputePipeline
+	(
+		VkShaderModule c_shader_module,
+		VkPipelineLayout pipeline_layout,
+		const SpecializationConstants& specialization,
+		VkPipelineCache pipeline_cache
+	)
+	{
+		assert(pipeline_layout != VK_NULL_HANDLE);
+
+		VkPipelineShaderStageCreateInfo shader_stage = {};
+		shader_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shader_stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shader_stage.module = c_shader_module;
+		shader_stage.pName = "main";
+		shader_stage.pSpecializationInfo = specialization.GetInfo();
+
+		VkComputePipelineCreateInfo pipeline_info = {};
+		pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipeline_info.stage = shader_stage;
+		pipeline_info.layout = pipeline_layout;
+		pipeline_info.basePipelineIndex = -1;
+		pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+		if (vkCreateComputePipelines(_cvl_device.device(), pipeline_cache, 1, &pipeline_info, _cvl_device.GetAllocator(), &_pipeline) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlPipeline] Failed to create compute pipeline!");
+		}
+	}
+
+	void CvlPipeline::CreateShaderModule(CvlDevice& device, const std::vector<char>& code, VkShaderModule* shader_module)
 	{
 		VkShaderModuleCreateInfo create_info{};
 		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -204,7 +524,7 @@ namespace cvl
 		// default allocator of vector ensures that the data satisfies the worst case alignment requirement
 		create_info.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
-		if (vkCreateShaderModule(_cvl_device.device(), &create_info, nullptr, shader_module) != VK_SUCCESS)
+		if (vkCreateShaderModule(device.device(), &create_info, device.GetAllocator(), shader_module) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlPipeline] Failed to create shader module!");
 		}
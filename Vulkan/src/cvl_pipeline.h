@@ -7,6 +7,36 @@
 
 namespace cvl
 {
+	// Typed constant_id -> value map for one shader stage
+	class SpecializationConstants
+	{
+	public:
+		SpecializationConstants() = default;
+		// Rebuilds the constants from what GetEntries() and GetData() returned, e.g. to deserialize them
+		SpecializationConstants(const std::vector<VkSpecializationMapEntry>& entries, const std::vector<uint8_t>& data);
+
+		void Set(uint32_t constant_id, bool value);
+		void Set(uint32_t constant_id, int32_t value);
+		void Set(uint32_t constant_id, uint32_t value);
+		void Set(uint32_t constant_id, float value);
+
+		bool Empty() const { return _entries.empty(); }
+		// Null when empty, points into this object so it must outlive pipeline creation
+		const VkSpecializationInfo* GetInfo() const;
+		// Identifies the variant, part of the pipeline cache key
+		std::string GetKey() const;
+		// Entries and values as they are passed to Vulkan, e.g. to serialize them
+		const std::vector<VkSpecializationMapEntry>& GetEntries() const { return _entries; }
+		const std::vector<uint8_t>& GetData() const { return _data; }
+
+	private:
+		void SetRaw(uint32_t constant_id, const void* data, size_t size);
+
+		std::vector<VkSpecializationMapEntry> _entries;
+		std::vector<uint8_t> _data;
+		mutable VkSpecializationInfo _info = {};
+	};
+
 	struct PipelineConfigInfo
 	{
 		PipelineConfigInfo() = default;
@@ -21,10 +51,20 @@ namespace cvl
 		VkPipelineColorBlendStateCreateInfo color_blend_info;
 		VkPipelineDepthStencilStateCreateInfo depth_stencil_info;
 		std::vector<VkDynamicState> dynamic_state_enables;
+		// Defaults to CvlModel::PackedVertex
+		std::vector<VkVertexInputBindingDescription> binding_descriptions;
+		std::vector<VkVertexInputAttributeDescription> attribute_descriptions;
 		VkPipelineDynamicStateCreateInfo dynamic_state_info;
 		VkPipelineLayout pipeline_layout = nullptr;
 		VkRenderPass render_pass = nullptr;
 		uint32_t subpass = 0;
+		// Used instead of render_pass for dynamic rendering (render_pass must be null)
+		std::vector<VkFormat> color_attachment_formats;
+		VkFormat depth_attachment_format = VK_FORMAT_UNDEFINED;
+		VkFormat stencil_attachment_format = VK_FORMAT_UNDEFINED;
+		// The same shader modules serve every specialized variant
+		SpecializationConstants vertex_specialization;
+		SpecializationConstants fragment_specialization;
 	};
 
 	class CvlPipeline
@@ -37,27 +77,86 @@ namespace cvl
 			const std::string& v_shader_fp, 
 			const std::string& f_shader_fp
 		);
+		// Compute pipeline
+		CvlPipeline
+		(
+			CvlDevice& device,
+			VkPipelineLayout pipeline_layout,
+			const std::string& c_shader_fp,
+			const SpecializationConstants& specialization = {}
+		);
+		// From shader modules owned by the caller (see CvlPipelineCache)
+		CvlPipeline
+		(
+			CvlDevice& device,
+			const PipelineConfigInfo& config_info,
+			VkShaderModule v_shader_module,
+			VkShaderModule f_shader_module,
+			VkPipelineCache pipeline_cache
+		);
+		CvlPipeline
+		(
+			CvlDevice& device,
+			VkPipelineLayout pipeline_layout,
+			VkShaderModule c_shader_module,
+			const SpecializationConstants& specialization,
+			VkPipelineCache pipeline_cache
+		);
 		~CvlPipeline();
 
 		CvlPipeline(const CvlPipeline&) = delete;
 		CvlPipeline& operator=(const CvlPipeline&) = delete;
 
 		void Bind(VkCommandBuffer command_buffer);
+		void Dispatch(VkCommandBuffer command_buffer, uint32_t group_count_x, uint32_t group_count_y = 1, uint32_t group_count_z = 1);
+		void DispatchIndirect(VkCommandBuffer command_buffer, VkBuffer buffer, VkDeviceSize offset);
+		VkPipelineBindPoint GetBindPoint() { return _bind_point; }
+		// Exchanges the VkPipeline with other, lets holders of this object pick up a rebuilt pipeline
+		void Swap(CvlPipeline& other);
+
+		static uint32_t GroupCount(uint32_t item_count, uint32_t group_size) { return (item_count + group_size - 1) / group_size; }
 
 		static void DefaultPipelineConfigInfo(PipelineConfigInfo& config_info);
+		// PipelineConfigInfo points into itself, so it can't be copied member-wise
+		static void CopyPipelineConfigInfo(const PipelineConfigInfo& src, PipelineConfigInfo& dst);
 		static void SetGlslcFp(const std::string& fp) { _glslc_fp = fp; }
+		// Returns the SPIR-V of a shader relative to the working directory, compiling it unless its .spv is up to date
+		static std::vector<char> LoadShaderCode(const std::string& shader_fp);
+		// Compiles the shader unless its .spv was built from the current source, returns whether it had to
+		static bool PrecompileShader(const std::string& shader_fp);
+		// Same as LoadShaderCode but reports compile errors instead of loading the previous SPIR-V
+		static bool TryLoadShaderCode(const std::string& shader_fp, std::vector<char>& code, std::string& error);
+		static void CreateShaderModule(CvlDevice& device, const std::vector<char>& code, VkShaderModule* shader_module);
 
 	private:
 		static std::vector<char> ReadFile(const std::string& fp);
-		static std::string CompileShader(const std::string& shader_fp);
+		static std::string CompileShader(const std::string& shader_fp, std::string* error = nullptr);
+		// Compares the source's hash with the one stored next to the .spv when it was compiled
+		static bool IsShaderUpToDate(const std::string& shader_fp);
+		static std::string GetSourceHash(const std::string& shader_fp);
 		static std::string _glslc_fp;
 
-		void CreateGraphicsPipeline(const std::string& v_shader_fp, const std::string& f_shader_fp, const PipelineConfigInfo& config_info);
-		void CreateShaderModule(const std::vector<char>& code, VkShaderModule* shader_module);
+		void CreateGraphicsPipeline
+		(
+			VkShaderModule v_shader_module,
+			VkShaderModule f_shader_module,
+			const PipelineConfigInfo& config_info,
+			VkPipelineCache pipeline_cache
+		);
+		void CreateComputePipeline
+		(
+			VkShaderModule c_shader_module,
+			VkPipelineLayout pipeline_layout,
+			const SpecializationConstants& specialization,
+			VkPipelineCache pipeline_cache
+		);
 		CvlDevice& _cvl_device;
-		VkPipeline _graphics_pipeline;
-		VkShaderModule _v_shader_module;
-		VkShaderModule _f_shader_module;
+		VkPipeline _pipeline;
+		VkPipelineBindPoint _bind_point;
+		// Only set when the pipeline owns its modules
+		VkShaderModule _v_shader_module = VK_NULL_HANDLE;
+		VkShaderModule _f_shader_module = VK_NULL_HANDLE;
+		VkShaderModule _c_shader_module = VK_NULL_HANDLE;
 
 		std::vector<char> _code;
 	};
@@ -0,0 +1,420 @@
+#include "cvl_pipeline_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace cvl
+{
+	CvlPipelineCache::CvlPipelineCache(CvlDevice& device, const std::string& cache_fp)
+		: _cvl_device(device), _cache_fp(cache_fp)
+	{
+		std::vector<char> data = LoadCacheData();
+
+		VkPipelineCacheCreateInfo cache_info = {};
+		cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cache_info.initialDataSize = data.size();
+		cache_info.pInitialData = data.empty() ? nullptr : data.data();
+		if (vkCreatePipelineCache(_cvl_device.device(), &cache_info, _cvl_device.GetAllocator(), &_pipeline_cache) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlPipelineCache] Failed to create pipeline cache!");
+		}
+		std::cout << "[CvlPipelineCache] Loaded " << data.size() << " bytes from " << _cache_fp << '\n';
+	}
+
+	CvlPipelineCache::~CvlPipelineCache()
+	{
+		// Waits for compiles still running
+		_shader_compiles.clear();
+		_shader_watcher.reset();
+		Save();
+		_pipelines.clear();
+		for (auto& [fp, module] : _shader_modules)
+		{
+			vkDestroyShaderModule(_cvl_device.device(), module, _cvl_device.GetAllocator());
+		}
+		vkDestroyPipelineCache(_cvl_device.device(), _pipeline_cache, _cvl_device.GetAllocator());
+	}
+
+	VkShaderModule CvlPipelineCache::GetShaderModule(const std::string& shader_fp)
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto it = _shader_modules.find(shader_fp);
+			if (it != _shader_modules.end())
+			{
+				return it->second;
+			}
+		}
+		VkShaderModule module;
+		CvlPipeline::CreateShaderModule(_cvl_device, CvlPipeline::LoadShaderCode(shader_fp), &module);
+
+		// Another thread may have created the same module meanwhile, the first one in is kept
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto [it, inserted] = _shader_modules.emplace(shader_fp, module);
+		if (!inserted)
+		{
+			vkDestroyShaderModule(_cvl_device.device(), module, _cvl_device.GetAllocator());
+		}
+		return it->second;
+	}
+
+	std::shared_ptr<CvlPipeline> CvlPipelineCache::GetGraphicsPipeline
+	(
+		const PipelineConfigInfo& config_info,
+		const std::string& v_shader_fp,
+		const std::string& f_shader_fp
+	)
+	{
+		std::string key = v_shader_fp + '|' + config_info.vertex_specialization.GetKey() + '|'
+			+ f_shader_fp + '|' + config_info.fragment_specialization.GetKey() + '|' + GetConfigKey(config_info);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto it = _pipelines.find(key);
+			if (it != _pipelines.end())
+			{
+				++_pipelines_reused;
+				return it->second.pipeline;
+			}
+		}
+
+		PipelineEntry entry;
+		entry.shader_fps = { v_shader_fp, f_shader_fp };
+		entry.config_info = std::make_unique<PipelineConfigInfo>();
+		CvlPipeline::CopyPipelineConfigInfo(config_info, *entry.config_info);
+		entry.pipeline = CreatePipeline(entry);
+		return InsertPipeline(key, std::move(entry));
+	}
+
+	std::shared_ptr<CvlPipeline> CvlPipelineCache::GetComputePipeline
+	(
+		VkPipelineLayout pipeline_layout,
+		const std::string& c_shader_fp,
+		const SpecializationConstants& specialization
+	)
+	{
+		std::ostringstream key;
+		key << c_shader_fp << '|' << specialization.GetKey() << '|' << pipeline_layout;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto it = _pipelines.find(key.str());
+			if (it != _pipelines.end())
+			{
+				++_pipelines_reused;
+				return it->second.pipeline;
+			}
+		}
+
+		PipelineEntry entry;
+		entry.shader_fps = { c_shader_fp };
+		entry.compute_pipeline_layout = pipeline_layout;
+		entry.compute_specialization = specialization;
+		entry.pipeline = CreatePipeline(entry);
+		return InsertPipeline(key.str(), std::move(entry));
+	}
+
+	void CvlPipelineCache::ReleaseUnusedPipelines()
+	{
+		for (auto it = _pipelines.begin(); it != _pipelines.end();)
+		{
+			it = it->second.pipeline.use_count() == 1 ? _pipelines.erase(it) : std::next(it);
+		}
+	}
+
+	void CvlPipelineCache::ReleasePipelines(VkPipelineLayout pipeline_layout)
+	{
+		// A later layout may get the same handle, a variant left behind would then be returned for it
+		for (auto it = _pipelines.begin(); it != _pipelines.end();)
+		{
+			const PipelineEntry& entry = it->second;
+			bool uses_layout = entry.config_info != nullptr ? entry.config_info->pipeline_layout == pipeline_layout
+				: entry.compute_pipeline_layout == pipeline_layout;
+			it = uses_layout ? _pipelines.erase(it) : std::next(it);
+		}
+	}
+
+	void CvlPipelineCache::EnableHotReload(const std::string& shader_directory)
+	{
+		_shader_watcher = std::make_unique<CvlShaderWatcher>(shader_directory);
+	}
+
+	void CvlPipelineCache::BeginFrame()
+	{
+		if (_shader_watcher == nullptr)
+		{
+			return;
+		}
+
+		for (const auto& changed_fp : _shader_watcher->PollChanges())
+		{
+			for (const auto& [shader_fp, module] : _shader_modules)
+			{
+				if (CvlShaderWatcher::Normalize(shader_fp) == changed_fp)
+				{
+					_reload_requests.insert(shader_fp);
+				}
+			}
+		}
+
+		// One compile per shader at a time, a change during a compile starts another one afterwards
+		for (auto it = _reload_requests.begin(); it != _reload_requests.end();)
+		{
+			if (_shader_compiles.count(*it) != 0)
+			{
+				++it;
+				continue;
+			}
+			_shader_compiles[*it] = std::async(std::launch::async, [shader_fp = *it]()
+			{
+				ShaderCompileResult result;
+				result.success = CvlPipeline::TryLoadShaderCode(shader_fp, result.code, result.error);
+				return result;
+			});
+			it = _reload_requests.erase(it);
+		}
+
+		for (auto it = _shader_compiles.begin(); it != _shader_compiles.end();)
+		{
+			if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++it;
+				continue;
+			}
+			ShaderCompileResult result = it->second.get();
+			if (result.success)
+			{
+				ReloadShader(it->first, result.code);
+			}
+			else
+			{
+				std::cout << "[CvlPipelineCache] Failed to compile " << it->first << ", keeping the previous pipelines:\n"
+					<< result.error << '\n';
+			}
+			it = _shader_compiles.erase(it);
+		}
+	}
+
+	void CvlPipelineCache::Save()
+	{
+		size_t size = 0;
+		vkGetPipelineCacheData(_cvl_device.device(), _pipeline_cache, &size, nullptr);
+		std::vector<char> data(size);
+		if (size == 0 || vkGetPipelineCacheData(_cvl_device.device(), _pipeline_cache, &size, data.data()) != VK_SUCCESS)
+		{
+			return;
+		}
+
+		std::ofstream ofs(_cache_fp, std::ios::binary);
+		if (!ofs.is_open())
+		{
+			std::cout << "[CvlPipelineCache] Failed to write " << _cache_fp << '\n';
+			return;
+		}
+		ofs.write(data.data(), size);
+		std::cout << "[CvlPipelineCache] Saved " << size << " bytes, " << _pipelines_created << " pipelines created, "
+			<< _pipelines_reused << " reused, " << _shader_modules.size() << " shader modules\n";
+	}
+
+	// private
+	std::shared_ptr<CvlPipeline> CvlPipelineCache::CreatePipeline(const PipelineEntry& entry)
+	{
+		if (entry.config_info != nullptr)
+		{
+			return std::make_shared<CvlPipeline>
+			(
+				_cvl_device,
+				*entry.config_info,
+				GetShaderModule(entry.shader_fps[0]),
+				GetShaderModule(entry.shader_fps[1]),
+				_pipeline_cache
+			);
+		}
+		return std::make_shared<CvlPipeline>
+		(
+			_cvl_device,
+			entry.compute_pipeline_layout,
+			GetShaderModule(entry.shader_fps[0]),
+			entry.compute_specialization,
+			_pipeline_cache
+		);
+	}
+
+	std::shared_ptr<CvlPipeline> CvlPipelineCache::InsertPipeline(const std::string& key, PipelineEntry entry)
+	{
+		// A variant requested by two threads at once is created twice, the second one is dropped
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto [it, inserted] = _pipelines.emplace(key, std::move(entry));
+		if (inserted)
+		{
+			++_pipelines_created;
+		}
+		else
+		{
+			++_pipelines_reused;
+		}
+		return it->second.pipeline;
+	}
+
+	void CvlPipelineCache::ReloadShader(const std::string& shader_fp, const std::vector<char>& code)
+	{
+		auto start_time = std::chrono::high_resolution_clock::now();
+		VkShaderModule old_module = _shader_modules[shader_fp];
+		VkShaderModule new_module = VK_NULL_HANDLE;
+		std::vector<std::pair<PipelineEntry*, std::shared_ptr<CvlPipeline>>> rebuilt;
+		try
+		{
+			CvlPipeline::CreateShaderModule(_cvl_device, code, &new_module);
+			_shader_modules[shader_fp] = new_module;
+			// Everything is rebuilt before swapping, a failure leaves all pipelines on the old module
+			for (auto& [key, entry] : _pipelines)
+			{
+				if (std::find(entry.shader_fps.begin(), entry.shader_fps.end(), shader_fp) != entry.shader_fps.end())
+				{
+					rebuilt.emplace_back(&entry, CreatePipeline(entry));
+				}
+			}
+		}
+		catch (const std::runtime_error& e)
+		{
+			rebuilt.clear();
+			if (_shader_modules[shader_fp] == new_module)
+			{
+				vkDestroyShaderModule(_cvl_device.device(), new_module, _cvl_device.GetAllocator());
+			}
+			_shader_modules[shader_fp] = old_module;
+			std::cout << "[CvlPipelineCache] Failed to reload " << shader_fp << ", keeping the previous pipelines: " << e.what() << '\n';
+			return;
+		}
+
+		// Frames in flight may still use the old objects. The swapped out handles end up in the rebuilt objects,
+		// whose destructors hand them to the deletion queue when they go out of scope
+		for (auto& [entry, pipeline] : rebuilt)
+		{
+			entry->pipeline->Swap(*pipeline);
+		}
+		_cvl_device.GetDeletionQueue().DestroyShaderModule(old_module);
+
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time);
+		std::cout << "[CvlPipelineCache] Reloaded " << shader_fp << ", " << rebuilt.size() << " pipelines swapped in "
+			<< elapsed.count() << " ms\n";
+	}
+
+	std::string CvlPipelineCache::GetConfigKey(const PipelineConfigInfo& config_info)
+	{
+		// The raw bytes of the state that ends up in the pipeline rather than a hash of them, so two different
+		// configs can never share a key. Pointers and padding are left out, array lengths go in before the arrays
+		std::string key;
+		auto add = [&key](const auto& value)
+		{
+			key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		};
+
+		add(config_info.input_assembly_info.topology);
+		add(config_info.input_assembly_info.primitiveRestartEnable);
+		add(config_info.viewport_info.viewportCount);
+		add(config_info.viewport_info.scissorCount);
+
+		const auto& raster = config_info.rasterization_info;
+		add(raster.depthClampEnable);
+		add(raster.rasterizerDiscardEnable);
+		add(raster.polygonMode);
+		add(raster.cullMode);
+		add(raster.frontFace);
+		add(raster.depthBiasEnable);
+		add(raster.depthBiasConstantFactor);
+		add(raster.depthBiasClamp);
+		add(raster.depthBiasSlopeFactor);
+		add(raster.lineWidth);
+
+		const auto& multisample = config_info.multisample_info;
+		add(multisample.rasterizationSamples);
+		add(multisample.sampleShadingEnable);
+		add(multisample.minSampleShading);
+		add(multisample.alphaToCoverageEnable);
+		add(multisample.alphaToOneEnable);
+
+		add(config_info.color_blend_attachment);
+		add(config_info.color_blend_info.logicOpEnable);
+		add(config_info.color_blend_info.logicOp);
+		add(config_info.color_blend_info.blendConstants);
+
+		const auto& depth = config_info.depth_stencil_info;
+		add(depth.depthTestEnable);
+		add(depth.depthWriteEnable);
+		add(depth.depthCompareOp);
+		add(depth.depthBoundsTestEnable);
+		add(depth.stencilTestEnable);
+		add(depth.front);
+		add(depth.back);
+		add(depth.minDepthBounds);
+		add(depth.maxDepthBounds);
+
+		add(config_info.dynamic_state_enables.size());
+		for (VkDynamicState state : config_info.dynamic_state_enables)
+		{
+			add(state);
+		}
+		add(config_info.binding_descriptions.size());
+		for (const auto& binding : config_info.binding_descriptions)
+		{
+			add(binding);
+		}
+		add(config_info.attribute_descriptions.size());
+		for (const auto& attribute : config_info.attribute_descriptions)
+		{
+			add(attribute);
+		}
+
+		add(config_info.pipeline_layout);
+		add(config_info.render_pass);
+		add(config_info.subpass);
+		add(config_info.color_attachment_formats.size());
+		for (VkFormat format : config_info.color_attachment_formats)
+		{
+			add(format);
+		}
+		add(config_info.depth_attachment_format);
+		add(config_info.stencil_attachment_format);
+		return key;
+	}
+
+	std::vector<char> CvlPipelineCache::LoadCacheData()
+	{
+		std::ifstream ifs(_cache_fp, std::ios::ate | std::ios::binary);
+		if (!ifs.is_open())
+		{
+			return {};
+		}
+		size_t fsize = static_cast<size_t>(ifs.tellg());
+		std::vector<char> data(fsize);
+		ifs.seekg(0);
+		ifs.read(data.data(), fsize);
+
+		// Data from another device or driver version is rejected or ignored by some drivers only, check the header.
+		// Same layout as VkPipelineCacheHeaderVersionOne, which the loader headers in use don't declare yet
+		struct
+		{
+			uint32_t headerSize;
+			uint32_t headerVersion;
+			uint32_t vendorID;
+			uint32_t deviceID;
+			uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		} header = {};
+		const auto& properties = _cvl_device.GetPhysicalDeviceProperties();
+		if (fsize < sizeof(header))
+		{
+			return {};
+		}
+		memcpy(&header, data.data(), sizeof(header));
+		if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header.vendorID != properties.vendorID
+			|| header.deviceID != properties.deviceID || memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			std::cout << "[CvlPipelineCache] Ignoring " << _cache_fp << " from a different device or driver\n";
+			return {};
+		}
+		return data;
+	}
+}
\ No newline at end of file
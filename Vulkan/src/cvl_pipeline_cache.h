@@ -0,0 +1,99 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_pipeline.h"
+#include "cvl_shader_watcher.h"
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace cvl
+{
+	/*
+		Owns the VkPipelineCache (persisted to disk) and one shader module per shader file, shared by
+		all variants. Pipelines are looked up by shaders, fixed function state and specialization
+		constants, so requesting an existing variant returns the same object.
+		With hot reload enabled, changed shaders are recompiled in the background and the pipelines using
+		them are rebuilt and swapped in place at the next BeginFrame(), the old objects go through the device's
+		deletion queue. A shader that fails to compile keeps its old pipelines.
+		The Get functions may be called from several threads at once, e.g. to build pipelines in parallel at startup.
+		Everything else must not run concurrently with them.
+	*/
+	class CvlPipelineCache
+	{
+	public:
+		CvlPipelineCache(CvlDevice& device, const std::string& cache_fp = "pipeline_cache.bin");
+		~CvlPipelineCache();
+
+		CvlPipelineCache(const CvlPipelineCache&) = delete;
+		CvlPipelineCache& operator=(const CvlPipelineCache&) = delete;
+
+		VkShaderModule GetShaderModule(const std::string& shader_fp);
+		std::shared_ptr<CvlPipeline> GetGraphicsPipeline
+		(
+			const PipelineConfigInfo& config_info,
+			const std::string& v_shader_fp,
+			const std::string& f_shader_fp
+		);
+		std::shared_ptr<CvlPipeline> GetComputePipeline
+		(
+			VkPipelineLayout pipeline_layout,
+			const std::string& c_shader_fp,
+			const SpecializationConstants& specialization = {}
+		);
+
+		// Releases pipelines nobody else holds, frames in flight may still use them
+		void ReleaseUnusedPipelines();
+		// Forgets every variant created with the layout, call before destroying it. Holders keep their pipelines alive
+		void ReleasePipelines(VkPipelineLayout pipeline_layout);
+
+		void EnableHotReload(const std::string& shader_directory);
+		// Call once per frame before recording, swaps reloaded pipelines
+		void BeginFrame();
+		void Save();
+
+		VkPipelineCache GetPipelineCache() { return _pipeline_cache; }
+
+	private:
+		struct PipelineEntry
+		{
+			std::shared_ptr<CvlPipeline> pipeline;
+			std::vector<std::string> shader_fps;
+			// Kept to rebuild the pipeline when one of its shaders is reloaded
+			std::unique_ptr<PipelineConfigInfo> config_info;
+			VkPipelineLayout compute_pipeline_layout = VK_NULL_HANDLE;
+			SpecializationConstants compute_specialization;
+		};
+
+		struct ShaderCompileResult
+		{
+			bool success = false;
+			std::vector<char> code;
+			std::string error;
+		};
+
+		static std::string GetConfigKey(const PipelineConfigInfo& config_info);
+		std::vector<char> LoadCacheData();
+		std::shared_ptr<CvlPipeline> CreatePipeline(const PipelineEntry& entry);
+		std::shared_ptr<CvlPipeline> InsertPipeline(const std::string& key, PipelineEntry entry);
+		void ReloadShader(const std::string& shader_fp, const std::vector<char>& code);
+
+		CvlDevice& _cvl_device;
+		std::string _cache_fp;
+		VkPipelineCache _pipeline_cache = VK_NULL_HANDLE;
+		// Guards the maps and counters in the Get functions, held only for lookups and inserts, not while creating
+		std::mutex _mutex;
+		std::unordered_map<std::string, VkShaderModule> _shader_modules;
+		std::unordered_map<std::string, PipelineEntry> _pipelines;
+		uint32_t _pipelines_created = 0;
+		uint32_t _pipelines_reused = 0;
+
+		std::unique_ptr<CvlShaderWatcher> _shader_watcher;
+		std::set<std::string> _reload_requests;
+		std::unordered_map<std::string, std::future<ShaderCompileResult>> _shader_compiles;
+	};
+}
\ No newline at end of file
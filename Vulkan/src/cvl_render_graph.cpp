@@ -0,0 +1,997 @@
+#include "cvl_render_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+namespace cvl
+{
+	static constexpr VkAccessFlags2 WRITE_ACCESS_MASK =
+		VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+	static bool IsAttachmentUsage(RenderGraphUsage usage)
+	{
+		return usage == RenderGraphUsage::ColorAttachment || usage == RenderGraphUsage::DepthAttachment || usage == RenderGraphUsage::DepthRead;
+	}
+
+	/* PassBuilder class */
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::Read(RenderGraphResource resource, RenderGraphUsage usage)
+	{
+		assert(resource < _graph._resources.size() && "Unknown render graph resource");
+		auto& accesses = _graph._passes[_pass_index].accesses;
+		assert(std::none_of(accesses.begin(), accesses.end(), [resource](const Access& a) { return a.resource == resource; })
+			&& "A pass can use a resource only once");
+		accesses.push_back({ resource, usage, true, false, std::nullopt });
+		return *this;
+	}
+
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::Write(RenderGraphResource resource, RenderGraphUsage usage)
+	{
+		assert(resource < _graph._resources.size() && "Unknown render graph resource");
+		assert(GetUsageInfo(usage).write && "Usage is read-only");
+		auto& accesses = _graph._passes[_pass_index].accesses;
+		assert(std::none_of(accesses.begin(), accesses.end(), [resource](const Access& a) { return a.resource == resource; })
+			&& "A pass can use a resource only once");
+		// Partial writes keep the previous contents, so they also depend on earlier writers
+		accesses.push_back({ resource, usage, true, true, std::nullopt });
+		return *this;
+	}
+
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::ClearColor(RenderGraphResource resource, VkClearColorValue color)
+	{
+		for (auto& access : _graph._passes[_pass_index].accesses)
+		{
+			if (access.resource == resource && access.usage == RenderGraphUsage::ColorAttachment)
+			{
+				access.clear_value = VkClearValue{};
+				access.clear_value->color = color;
+				access.read = false;
+				return *this;
+			}
+		}
+		throw std::runtime_error("[CvlRenderGraph] Clear of a resource that isn't written as color attachment!");
+	}
+
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::ClearDepth(RenderGraphResource resource, VkClearDepthStencilValue depth_stencil)
+	{
+		for (auto& access : _graph._passes[_pass_index].accesses)
+		{
+			if (access.resource == resource && access.usage == RenderGraphUsage::DepthAttachment)
+			{
+				access.clear_value = VkClearValue{};
+				access.clear_value->depthStencil = depth_stencil;
+				access.read = false;
+				return *this;
+			}
+		}
+		throw std::runtime_error("[CvlRenderGraph] Clear of a resource that isn't written as depth attachment!");
+	}
+
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::SetRenderArea(VkRect2D render_area)
+	{
+		_graph._passes[_pass_index].render_area = render_area;
+		return *this;
+	}
+
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::SetDynamicRenderArea(std::function<VkRect2D()> render_area)
+	{
+		_graph._passes[_pass_index].dynamic_render_area = std::move(render_area);
+		return *this;
+	}
+
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::SetSideEffects()
+	{
+		_graph._passes[_pass_index].side_effects = true;
+		return *this;
+	}
+
+	CvlRenderGraph::PassBuilder& CvlRenderGraph::PassBuilder::SetExecute(std::function<void(const PassContext&)> execute)
+	{
+		_graph._passes[_pass_index].execute = std::move(execute);
+		return *this;
+	}
+	/* ~PassBuilder class */
+
+	/* CvlRenderGraph class */
+	CvlRenderGraph::CvlRenderGraph(CvlDevice& device) : _device(device)
+	{
+	}
+
+	CvlRenderGraph::~CvlRenderGraph()
+	{
+		DestroyTransientResources();
+	}
+
+	RenderGraphResource CvlRenderGraph::CreateImage(const std::string& name, const RenderGraphImageInfo& info)
+	{
+		Resource resource = {};
+		resource.name = name;
+		resource.is_image = true;
+		resource.image_info = info;
+		_resources.push_back(resource);
+		return static_cast<RenderGraphResource>(_resources.size() - 1);
+	}
+
+	RenderGraphResource CvlRenderGraph::CreateBuffer(const std::string& name, const RenderGraphBufferInfo& info)
+	{
+		Resource resource = {};
+		resource.name = name;
+		resource.is_image = false;
+		resource.buffer_info = info;
+		_resources.push_back(resource);
+		return static_cast<RenderGraphResource>(_resources.size() - 1);
+	}
+
+	RenderGraphResource CvlRenderGraph::ImportImage
+	(
+		const std::string& name,
+		const RenderGraphImageInfo& info,
+		const RenderGraphImportState& initial_state,
+		std::optional<RenderGraphUsage> final_usage
+	)
+	{
+		RenderGraphResource handle = CreateImage(name, info);
+		Resource& resource = _resources[handle];
+		resource.imported = true;
+		resource.import_state = initial_state;
+		resource.final_usage = final_usage;
+		resource.output = final_usage.has_value();
+		return handle;
+	}
+
+	RenderGraphResource CvlRenderGraph::ImportBuffer
+	(
+		const std::string& name,
+		const RenderGraphBufferInfo& info,
+		const RenderGraphImportState& initial_state
+	)
+	{
+		RenderGraphResource handle = CreateBuffer(name, info);
+		Resource& resource = _resources[handle];
+		resource.imported = true;
+		resource.import_state = initial_state;
+		return handle;
+	}
+
+	void CvlRenderGraph::SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view)
+	{
+		assert(_resources[resource].imported && _resources[resource].is_image && "Resource is not an imported image");
+		_resources[resource].image = image;
+		_resources[resource].view = view;
+	}
+
+	void CvlRenderGraph::SetImportedBuffer(RenderGraphResource resource, VkBuffer buffer)
+	{
+		assert(_resources[resource].imported && !_resources[resource].is_image && "Resource is not an imported buffer");
+		_resources[resource].buffer = buffer;
+	}
+
+	void CvlRenderGraph::MarkOutput(RenderGraphResource resource)
+	{
+		_resources[resource].output = true;
+	}
+
+	CvlRenderGraph::PassBuilder CvlRenderGraph::AddPass(const std::string& name)
+	{
+		assert(!_compiled && "Cannot add passes to a compiled render graph");
+		Pass pass = {};
+		pass.name = name;
+		_passes.push_back(pass);
+		return PassBuilder(*this, static_cast<uint32_t>(_passes.size() - 1));
+	}
+
+	void CvlRenderGraph::Compile()
+	{
+		DestroyTransientResources();
+		_compiled_passes.clear();
+		_final_barriers = {};
+		_stats = {};
+		_stats.declared_passes = static_cast<uint32_t>(_passes.size());
+
+		std::vector<bool> alive = CullPasses();
+		std::vector<uint32_t> schedule = SchedulePasses(alive);
+		_stats.culled_passes = _stats.declared_passes - static_cast<uint32_t>(schedule.size());
+
+		for (uint32_t pass : schedule)
+		{
+			CompiledPass compiled = {};
+			compiled.pass = pass;
+			_compiled_passes.push_back(compiled);
+		}
+
+		AllocateTransientResources();
+		BuildBarriers();
+		for (auto& compiled : _compiled_passes)
+		{
+			BuildAttachments(compiled);
+		}
+
+		_compiled = true;
+		ReportStats();
+	}
+
+	void CvlRenderGraph::Execute(VkCommandBuffer command_buffer)
+	{
+		assert(_compiled && "Render graph must be compiled before execution");
+
+		std::vector<VkRenderingAttachmentInfo> color_infos;
+		for (auto& compiled : _compiled_passes)
+		{
+			RecordBarriers(command_buffer, compiled.barriers);
+
+			const Pass& pass = _passes[compiled.pass];
+			VkRect2D render_area = pass.dynamic_render_area ? pass.dynamic_render_area() : compiled.render_area;
+
+			bool raster = !compiled.color_attachments.empty() || compiled.depth_attachment.has_value();
+			if (raster)
+			{
+				auto to_rendering_info = [this](const Attachment& attachment, VkImageLayout layout)
+				{
+					VkRenderingAttachmentInfo info = {};
+					info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+					info.imageView = _resources[attachment.resource].view;
+					info.imageLayout = layout;
+					info.loadOp = attachment.load_op;
+					info.storeOp = attachment.store_op;
+					info.clearValue = attachment.clear_value;
+					return info;
+				};
+
+				color_infos.clear();
+				for (const auto& attachment : compiled.color_attachments)
+				{
+					color_infos.push_back(to_rendering_info(attachment, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL));
+				}
+				VkRenderingAttachmentInfo depth_info = {};
+				if (compiled.depth_attachment.has_value())
+				{
+					VkImageLayout depth_layout = GetUsageInfo(RenderGraphUsage::DepthAttachment).layout;
+					for (const auto& access : _passes[compiled.pass].accesses)
+					{
+						if (access.resource == compiled.depth_attachment->resource)
+						{
+							depth_layout = GetUsageInfo(access.usage).layout;
+						}
+					}
+					depth_info = to_rendering_info(*compiled.depth_attachment, depth_layout);
+				}
+
+				VkRenderingInfo rendering_info = {};
+				rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+				rendering_info.renderArea = render_area;
+				rendering_info.layerCount = 1;
+				rendering_info.colorAttachmentCount = static_cast<uint32_t>(color_infos.size());
+				rendering_info.pColorAttachments = color_infos.data();
+				rendering_info.pDepthAttachment = compiled.depth_attachment.has_value() ? &depth_info : nullptr;
+				_device.CmdBeginRendering(command_buffer, rendering_info);
+			}
+
+			if (pass.execute)
+			{
+				pass.execute(PassContext(*this, command_buffer, render_area));
+			}
+
+			if (raster)
+			{
+				_device.CmdEndRendering(command_buffer);
+			}
+		}
+
+		RecordBarriers(command_buffer, _final_barriers);
+	}
+
+	void CvlRenderGraph::Reset()
+	{
+		DestroyTransientResources();
+		_resources.clear();
+		_passes.clear();
+		_compiled_passes.clear();
+		_final_barriers = {};
+		_stats = {};
+		_compiled = false;
+	}
+
+	// private
+	CvlRenderGraph::UsageInfo CvlRenderGraph::GetUsageInfo(RenderGraphUsage usage)
+	{
+		switch (usage)
+		{
+		case RenderGraphUsage::ColorAttachment:
+			return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+		case RenderGraphUsage::DepthAttachment:
+			return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+		case RenderGraphUsage::DepthRead:
+			return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false };
+		case RenderGraphUsage::FragmentSampled:
+			return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+		case RenderGraphUsage::ComputeSampled:
+			return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+		case RenderGraphUsage::ComputeStorageRead:
+			return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, false };
+		case RenderGraphUsage::ComputeStorageWrite:
+			return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, true };
+		case RenderGraphUsage::TransferSrc:
+			return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+		case RenderGraphUsage::TransferDst:
+			return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+		case RenderGraphUsage::VertexBuffer:
+			return { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, false };
+		case RenderGraphUsage::IndexBuffer:
+			return { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, false };
+		case RenderGraphUsage::IndirectBuffer:
+			return { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, false };
+		case RenderGraphUsage::UniformBuffer:
+			return { VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+				VK_ACCESS_2_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+		case RenderGraphUsage::Present:
+			return { VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, VK_ACCESS_2_NONE,
+				VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false };
+		}
+		throw std::runtime_error("[CvlRenderGraph] Unknown resource usage!");
+	}
+
+	VkImageUsageFlags CvlRenderGraph::GetImageUsageFlags(RenderGraphUsage usage)
+	{
+		switch (usage)
+		{
+		case RenderGraphUsage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		case RenderGraphUsage::DepthAttachment:
+		case RenderGraphUsage::DepthRead: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		case RenderGraphUsage::FragmentSampled:
+		case RenderGraphUsage::ComputeSampled: return VK_IMAGE_USAGE_SAMPLED_BIT;
+		case RenderGraphUsage::ComputeStorageRead:
+		case RenderGraphUsage::ComputeStorageWrite: return VK_IMAGE_USAGE_STORAGE_BIT;
+		case RenderGraphUsage::TransferSrc: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		case RenderGraphUsage::TransferDst: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		default: return 0;
+		}
+	}
+
+	VkBufferUsageFlags CvlRenderGraph::GetBufferUsageFlags(RenderGraphUsage usage)
+	{
+		switch (usage)
+		{
+		case RenderGraphUsage::ComputeStorageRead:
+		case RenderGraphUsage::ComputeStorageWrite: return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		case RenderGraphUsage::TransferSrc: return VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+		case RenderGraphUsage::TransferDst: return VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		case RenderGraphUsage::VertexBuffer: return VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		case RenderGraphUsage::IndexBuffer: return VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+		case RenderGraphUsage::IndirectBuffer: return VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		case RenderGraphUsage::UniformBuffer: return VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		default: return 0;
+		}
+	}
+
+	std::vector<bool> CvlRenderGraph::CullPasses()
+	{
+		// Walk backwards from the outputs, a pass survives if something downstream needs what it writes
+		std::vector<bool> needed(_resources.size());
+		for (size_t i = 0; i < _resources.size(); ++i)
+		{
+			needed[i] = _resources[i].output;
+		}
+
+		std::vector<bool> alive(_passes.size(), false);
+		for (size_t i = _passes.size(); i-- > 0;)
+		{
+			const Pass& pass = _passes[i];
+			bool is_alive = pass.side_effects;
+			for (const auto& access : pass.accesses)
+			{
+				is_alive = is_alive || (access.write && needed[access.resource]);
+			}
+			if (!is_alive)
+			{
+				continue;
+			}
+			alive[i] = true;
+
+			// A full overwrite makes earlier contents irrelevant, reads make them needed
+			for (const auto& access : pass.accesses)
+			{
+				if (access.write && !access.read && !_resources[access.resource].output)
+				{
+					needed[access.resource] = false;
+				}
+			}
+			for (const auto& access : pass.accesses)
+			{
+				if (access.read)
+				{
+					needed[access.resource] = true;
+				}
+			}
+		}
+		return alive;
+	}
+
+	std::vector<uint32_t> CvlRenderGraph::SchedulePasses(const std::vector<bool>& alive)
+	{
+		// Dependency edges follow declaration order: read after write, write after write, write after read
+		std::vector<std::set<uint32_t>> dependencies(_passes.size());
+		std::vector<std::optional<uint32_t>> last_writer(_resources.size());
+		std::vector<std::vector<uint32_t>> readers(_resources.size());
+		for (uint32_t i = 0; i < _passes.size(); ++i)
+		{
+			if (!alive[i])
+			{
+				continue;
+			}
+			for (const auto& access : _passes[i].accesses)
+			{
+				auto& writer = last_writer[access.resource];
+				if (writer.has_value())
+				{
+					dependencies[i].insert(writer.value());
+				}
+				if (access.write)
+				{
+					for (uint32_t reader : readers[access.resource])
+					{
+						if (reader != i)
+						{
+							dependencies[i].insert(reader);
+						}
+					}
+					readers[access.resource].clear();
+					writer = i;
+				}
+				else
+				{
+					readers[access.resource].push_back(i);
+				}
+			}
+		}
+
+		// Kahn's algorithm, preferring passes that don't consume the previous pass's results so the
+		// producer gets more time before its barrier is hit
+		std::vector<uint32_t> schedule;
+		std::vector<bool> scheduled(_passes.size(), false);
+		size_t alive_count = std::count(alive.begin(), alive.end(), true);
+		while (schedule.size() < alive_count)
+		{
+			std::optional<uint32_t> best;
+			for (uint32_t i = 0; i < _passes.size(); ++i)
+			{
+				if (!alive[i] || scheduled[i])
+				{
+					continue;
+				}
+				bool ready = std::all_of(dependencies[i].begin(), dependencies[i].end(), [&scheduled](uint32_t d) { return scheduled[d]; });
+				if (!ready)
+				{
+					continue;
+				}
+				bool depends_on_previous = !schedule.empty() && dependencies[i].count(schedule.back()) > 0;
+				if (!best.has_value())
+				{
+					best = i;
+				}
+				if (!depends_on_previous)
+				{
+					best = i;
+					break;
+				}
+			}
+			assert(best.has_value() && "Render graph has a dependency cycle");
+			scheduled[best.value()] = true;
+			schedule.push_back(best.value());
+		}
+		return schedule;
+	}
+
+	void CvlRenderGraph::AllocateTransientResources()
+	{
+		for (uint32_t order = 0; order < _compiled_passes.size(); ++order)
+		{
+			for (const auto& access : _passes[_compiled_passes[order].pass].accesses)
+			{
+				Resource& resource = _resources[access.resource];
+				resource.first_use = std::min(resource.first_use, order);
+				resource.last_use = std::max(resource.last_use, order);
+				resource.image_usage |= GetImageUsageFlags(access.usage);
+				resource.buffer_usage |= GetBufferUsageFlags(access.usage);
+			}
+		}
+
+		// Create the transient objects to learn their memory requirements
+		std::vector<RenderGraphResource> transients;
+		for (RenderGraphResource i = 0; i < _resources.size(); ++i)
+		{
+			Resource& resource = _resources[i];
+			if (resource.imported || resource.first_use == std::numeric_limits<uint32_t>::max())
+			{
+				continue;
+			}
+			if (resource.is_image)
+			{
+				VkImageCreateInfo image_info = {};
+				image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+				image_info.imageType = VK_IMAGE_TYPE_2D;
+				image_info.extent = { resource.image_info.extent.width, resource.image_info.extent.height, 1 };
+				image_info.mipLevels = 1;
+				image_info.arrayLayers = 1;
+				image_info.format = resource.image_info.format;
+				image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+				image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				image_info.usage = resource.image_usage;
+				image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+				image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				image_info.flags = 0;
+				if (vkCreateImage(_device.device(), &image_info, _device.GetAllocator(), &resource.image) != VK_SUCCESS)
+				{
+					throw std::runtime_error("[CvlRenderGraph] Failed to create transient image " + resource.name + "!");
+				}
+				vkGetImageMemoryRequirements(_device.device(), resource.image, &resource.requirements);
+			}
+			else
+			{
+				VkBufferCreateInfo buffer_info = {};
+				buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+				buffer_info.size = resource.buffer_info.size;
+				buffer_info.usage = resource.buffer_usage;
+				buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+				if (vkCreateBuffer(_device.device(), &buffer_info, _device.GetAllocator(), &resource.buffer) != VK_SUCCESS)
+				{
+					throw std::runtime_error("[CvlRenderGraph] Failed to create transient buffer " + resource.name + "!");
+				}
+				vkGetBufferMemoryRequirements(_device.device(), resource.buffer, &resource.requirements);
+			}
+			_stats.unaliased_transient_memory += resource.requirements.size;
+			transients.push_back(i);
+		}
+
+		// Group by memory type, images and buffers apart so bufferImageGranularity never matters
+		std::map<std::pair<uint32_t, bool>, std::vector<RenderGraphResource>> groups;
+		for (RenderGraphResource i : transients)
+		{
+			uint32_t memory_type = _device.FindMemoryType(_resources[i].requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			groups[{ memory_type, _resources[i].is_image }].push_back(i);
+		}
+
+		for (auto& [key, members] : groups)
+		{
+			// Largest first, each goes to the lowest offset not used by a resource alive at the same time
+			std::sort(members.begin(), members.end(), [this](RenderGraphResource a, RenderGraphResource b)
+			{
+				return _resources[a].requirements.size > _resources[b].requirements.size;
+			});
+
+			TransientHeap heap = {};
+			heap.memory_type = key.first;
+			heap.images = key.second;
+			uint32_t heap_index = static_cast<uint32_t>(_heaps.size());
+
+			std::vector<RenderGraphResource> placed;
+			for (RenderGraphResource i : members)
+			{
+				Resource& resource = _resources[i];
+				std::vector<RenderGraphResource> overlapping;
+				for (RenderGraphResource other : placed)
+				{
+					const Resource& o = _resources[other];
+					if (o.first_use <= resource.last_use && resource.first_use <= o.last_use)
+					{
+						overlapping.push_back(other);
+					}
+				}
+
+				VkDeviceSize alignment = resource.requirements.alignment;
+				auto align = [alignment](VkDeviceSize value) { return (value + alignment - 1) / alignment * alignment; };
+				std::vector<VkDeviceSize> candidates = { 0 };
+				for (RenderGraphResource other : overlapping)
+				{
+					candidates.push_back(align(_resources[other].offset + _resources[other].requirements.size));
+				}
+				std::sort(candidates.begin(), candidates.end());
+
+				for (VkDeviceSize candidate : candidates)
+				{
+					bool fits = std::none_of(overlapping.begin(), overlapping.end(), [&](RenderGraphResource other)
+					{
+						const Resource& o = _resources[other];
+						return candidate < o.offset + o.requirements.size && o.offset < candidate + resource.requirements.size;
+					});
+					if (fits)
+					{
+						resource.offset = candidate;
+						break;
+					}
+				}
+				resource.heap = heap_index;
+				heap.size = std::max(heap.size, resource.offset + resource.requirements.size);
+				placed.push_back(i);
+			}
+
+			VkMemoryAllocateInfo alloc_info = {};
+			alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			alloc_info.allocationSize = heap.size;
+			alloc_info.memoryTypeIndex = heap.memory_type;
+			if (_device.AllocateMemory(alloc_info, MemoryCategory::Attachments, heap.memory) != VK_SUCCESS)
+			{
+				throw std::runtime_error("[CvlRenderGraph] Failed to allocate transient memory!");
+			}
+			_stats.transient_memory += heap.size;
+			_heaps.push_back(heap);
+
+			for (RenderGraphResource i : members)
+			{
+				Resource& resource = _resources[i];
+				if (resource.is_image)
+				{
+					vkBindImageMemory(_device.device(), resource.image, heap.memory, resource.offset);
+
+					VkImageViewCreateInfo view_info = {};
+					view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+					view_info.image = resource.image;
+					view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+					view_info.format = resource.image_info.format;
+					view_info.subresourceRange = { resource.image_info.aspect, 0, 1, 0, 1 };
+					if (vkCreateImageView(_device.device(), &view_info, _device.GetAllocator(), &resource.view) != VK_SUCCESS)
+					{
+						throw std::runtime_error("[CvlRenderGraph] Failed to create transient image view " + resource.name + "!");
+					}
+				}
+				else
+				{
+					vkBindBufferMemory(_device.device(), resource.buffer, heap.memory, resource.offset);
+				}
+			}
+		}
+	}
+
+	void CvlRenderGraph::BuildBarriers()
+	{
+		struct State
+		{
+			bool initialized = false;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags2 write_stages = 0;
+			VkAccessFlags2 write_access = 0;
+			VkPipelineStageFlags2 read_stages = 0;
+			// Stages the last write has already been made visible to
+			VkPipelineStageFlags2 visible_stages = 0;
+		};
+
+		// Aliased memory may still be in use by another resource of the heap, possibly from the previous frame
+		std::vector<VkPipelineStageFlags2> heap_stages(_heaps.size(), 0);
+		std::vector<VkAccessFlags2> heap_write_access(_heaps.size(), 0);
+		for (const auto& compiled : _compiled_passes)
+		{
+			for (const auto& access : _passes[compiled.pass].accesses)
+			{
+				const Resource& resource = _resources[access.resource];
+				if (resource.heap < _heaps.size())
+				{
+					UsageInfo info = GetUsageInfo(access.usage);
+					heap_stages[resource.heap] |= info.stages;
+					heap_write_access[resource.heap] |= info.access & WRITE_ACCESS_MASK;
+				}
+			}
+		}
+
+		std::vector<State> states(_resources.size());
+		for (size_t i = 0; i < _resources.size(); ++i)
+		{
+			if (_resources[i].imported)
+			{
+				states[i].initialized = true;
+				states[i].layout = _resources[i].import_state.layout;
+				states[i].write_stages = _resources[i].import_state.stages;
+				states[i].write_access = _resources[i].import_state.access;
+			}
+		}
+
+		auto add_barrier = [this](BarrierBatch& batch, RenderGraphResource index, VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+			VkImageLayout old_layout, const UsageInfo& dst)
+		{
+			const Resource& resource = _resources[index];
+			if (resource.is_image)
+			{
+				VkImageMemoryBarrier2 barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+				barrier.srcStageMask = src_stages;
+				barrier.srcAccessMask = src_access;
+				barrier.dstStageMask = dst.stages;
+				barrier.dstAccessMask = dst.access;
+				barrier.oldLayout = old_layout;
+				barrier.newLayout = dst.layout;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.subresourceRange = { resource.image_info.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+				batch.image_barriers.push_back(barrier);
+				batch.image_barrier_resources.push_back(index);
+			}
+			else
+			{
+				VkBufferMemoryBarrier2 barrier = {};
+				barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+				barrier.srcStageMask = src_stages;
+				barrier.srcAccessMask = src_access;
+				barrier.dstStageMask = dst.stages;
+				barrier.dstAccessMask = dst.access;
+				barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barrier.offset = 0;
+				barrier.size = VK_WHOLE_SIZE;
+				batch.buffer_barriers.push_back(barrier);
+				batch.buffer_barrier_resources.push_back(index);
+			}
+			++_stats.barriers;
+		};
+
+		for (auto& compiled : _compiled_passes)
+		{
+			for (const auto& access : _passes[compiled.pass].accesses)
+			{
+				++_stats.naive_barriers;
+				const Resource& resource = _resources[access.resource];
+				State& state = states[access.resource];
+				UsageInfo info = GetUsageInfo(access.usage);
+
+				if (!state.initialized)
+				{
+					// First use of a transient: contents are undefined, wait for whatever used the memory before
+					add_barrier(compiled.barriers, access.resource, heap_stages[resource.heap], heap_write_access[resource.heap],
+						VK_IMAGE_LAYOUT_UNDEFINED, info);
+					state.initialized = true;
+					state.visible_stages = info.stages;
+				}
+				else
+				{
+					bool layout_change = resource.is_image && state.layout != info.layout;
+					bool pending_write = state.write_stages != 0;
+					if (layout_change || (info.write && (pending_write || state.read_stages != 0)))
+					{
+						add_barrier(compiled.barriers, access.resource, state.write_stages | state.read_stages, state.write_access,
+							state.layout, info);
+						state.visible_stages = info.stages;
+					}
+					else if (!info.write && pending_write && (info.stages & ~state.visible_stages) != 0)
+					{
+						add_barrier(compiled.barriers, access.resource, state.write_stages, state.write_access, state.layout, info);
+						state.visible_stages |= info.stages;
+					}
+				}
+
+				state.layout = resource.is_image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+				if (info.write)
+				{
+					state.write_stages = info.stages;
+					state.write_access = info.access & WRITE_ACCESS_MASK;
+					state.read_stages = 0;
+					state.visible_stages = 0;
+				}
+				else
+				{
+					state.read_stages |= info.stages;
+				}
+			}
+			if (!compiled.barriers.Empty())
+			{
+				++_stats.barrier_batches;
+			}
+		}
+
+		for (RenderGraphResource i = 0; i < _resources.size(); ++i)
+		{
+			const Resource& resource = _resources[i];
+			if (!resource.final_usage.has_value() || resource.first_use == std::numeric_limits<uint32_t>::max())
+			{
+				continue;
+			}
+			const State& state = states[i];
+			UsageInfo info = GetUsageInfo(resource.final_usage.value());
+			add_barrier(_final_barriers, i, state.write_stages | state.read_stages, state.write_access, state.layout, info);
+		}
+		if (!_final_barriers.Empty())
+		{
+			++_stats.barrier_batches;
+		}
+	}
+
+	void CvlRenderGraph::BuildAttachments(CompiledPass& compiled)
+	{
+		uint32_t order = static_cast<uint32_t>(&compiled - _compiled_passes.data());
+		const Pass& pass = _passes[compiled.pass];
+		std::optional<VkExtent2D> extent;
+
+		for (const auto& access : pass.accesses)
+		{
+			if (!IsAttachmentUsage(access.usage))
+			{
+				continue;
+			}
+			const Resource& resource = _resources[access.resource];
+			if (!extent.has_value())
+			{
+				extent = resource.image_info.extent;
+			}
+
+			Attachment attachment = {};
+			attachment.resource = access.resource;
+			attachment.clear_value = access.clear_value.value_or(VkClearValue{});
+			if (access.clear_value.has_value())
+			{
+				attachment.load_op = VK_ATTACHMENT_LOAD_OP_CLEAR;
+			}
+			else if (!resource.imported && resource.first_use == order)
+			{
+				attachment.load_op = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			}
+			else
+			{
+				attachment.load_op = VK_ATTACHMENT_LOAD_OP_LOAD;
+			}
+			// Only store what someone is going to look at
+			bool stored = resource.output || resource.last_use > order || !access.write;
+			attachment.store_op = stored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+			if (access.usage == RenderGraphUsage::ColorAttachment)
+			{
+				compiled.color_attachments.push_back(attachment);
+			}
+			else
+			{
+				compiled.depth_attachment = attachment;
+			}
+		}
+
+		if (pass.render_area.has_value())
+		{
+			compiled.render_area = pass.render_area.value();
+		}
+		else
+		{
+			compiled.render_area = { { 0, 0 }, extent.value_or(VkExtent2D{ 0, 0 }) };
+		}
+
+		if ((!compiled.color_attachments.empty() || compiled.depth_attachment.has_value()) && !_device.IsDynamicRenderingSupported())
+		{
+			throw std::runtime_error("[CvlRenderGraph] Raster passes need dynamic rendering!");
+		}
+	}
+
+	void CvlRenderGraph::RecordBarriers(VkCommandBuffer command_buffer, BarrierBatch& batch)
+	{
+		if (batch.Empty())
+		{
+			return;
+		}
+		for (size_t i = 0; i < batch.image_barriers.size(); ++i)
+		{
+			batch.image_barriers[i].image = _resources[batch.image_barrier_resources[i]].image;
+		}
+		for (size_t i = 0; i < batch.buffer_barriers.size(); ++i)
+		{
+			batch.buffer_barriers[i].buffer = _resources[batch.buffer_barrier_resources[i]].buffer;
+		}
+
+		if (_device.IsSynchronization2Supported())
+		{
+			VkDependencyInfo dependency_info = {};
+			dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+			dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(batch.image_barriers.size());
+			dependency_info.pImageMemoryBarriers = batch.image_barriers.data();
+			dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(batch.buffer_barriers.size());
+			dependency_info.pBufferMemoryBarriers = batch.buffer_barriers.data();
+			_device.CmdPipelineBarrier2(command_buffer, dependency_info);
+			return;
+		}
+
+		// Legacy barriers share one pair of stage masks, all stage and access bits used here fit in 32 bits
+		VkPipelineStageFlags src_stages = 0;
+		VkPipelineStageFlags dst_stages = 0;
+		std::vector<VkImageMemoryBarrier> image_barriers(batch.image_barriers.size());
+		for (size_t i = 0; i < batch.image_barriers.size(); ++i)
+		{
+			const auto& barrier2 = batch.image_barriers[i];
+			auto& barrier = image_barriers[i];
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = static_cast<VkAccessFlags>(barrier2.srcAccessMask);
+			barrier.dstAccessMask = static_cast<VkAccessFlags>(barrier2.dstAccessMask);
+			barrier.oldLayout = barrier2.oldLayout;
+			barrier.newLayout = barrier2.newLayout;
+			barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+			barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+			barrier.image = barrier2.image;
+			barrier.subresourceRange = barrier2.subresourceRange;
+			src_stages |= static_cast<VkPipelineStageFlags>(barrier2.srcStageMask);
+			dst_stages |= static_cast<VkPipelineStageFlags>(barrier2.dstStageMask);
+		}
+		std::vector<VkBufferMemoryBarrier> buffer_barriers(batch.buffer_barriers.size());
+		for (size_t i = 0; i < batch.buffer_barriers.size(); ++i)
+		{
+			const auto& barrier2 = batch.buffer_barriers[i];
+			auto& barrier = buffer_barriers[i];
+			barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			barrier.srcAccessMask = static_cast<VkAccessFlags>(barrier2.srcAccessMask);
+			barrier.dstAccessMask = static_cast<VkAccessFlags>(barrier2.dstAccessMask);
+			barrier.srcQueueFamilyIndex = barrier2.srcQueueFamilyIndex;
+			barrier.dstQueueFamilyIndex = barrier2.dstQueueFamilyIndex;
+			barrier.buffer = barrier2.buffer;
+			barrier.offset = barrier2.offset;
+			barrier.size = barrier2.size;
+			src_stages |= static_cast<VkPipelineStageFlags>(barrier2.srcStageMask);
+			dst_stages |= static_cast<VkPipelineStageFlags>(barrier2.dstStageMask);
+		}
+		if (src_stages == 0)
+		{
+			src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		}
+		if (dst_stages == 0)
+		{
+			dst_stages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		}
+
+		vkCmdPipelineBarrier
+		(
+			command_buffer,
+			src_stages,
+			dst_stages,
+			0,
+			0, nullptr,
+			static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+			static_cast<uint32_t>(image_barriers.size()), image_barriers.data()
+		);
+	}
+
+	void CvlRenderGraph::DestroyTransientResources()
+	{
+		// Frames recorded from the previous graph may still be in flight
+		CvlDeletionQueue& deletion_queue = _device.GetDeletionQueue();
+		for (auto& resource : _resources)
+		{
+			if (!resource.imported)
+			{
+				deletion_queue.DestroyImageView(resource.view);
+				deletion_queue.DestroyImage(resource.image);
+				deletion_queue.DestroyBuffer(resource.buffer);
+				resource.view = VK_NULL_HANDLE;
+				resource.image = VK_NULL_HANDLE;
+				resource.buffer = VK_NULL_HANDLE;
+			}
+			resource.image_usage = 0;
+			resource.buffer_usage = 0;
+			resource.first_use = std::numeric_limits<uint32_t>::max();
+			resource.last_use = 0;
+			resource.heap = std::numeric_limits<uint32_t>::max();
+		}
+		for (auto& heap : _heaps)
+		{
+			deletion_queue.FreeMemory(heap.memory);
+		}
+		_heaps.clear();
+	}
+
+	void CvlRenderGraph::ReportStats()
+	{
+		constexpr double MB = 1024.0 * 1024.0;
+		std::cout << "[CvlRenderGraph] " << _compiled_passes.size() << '/' << _stats.declared_passes << " passes ("
+			<< _stats.culled_passes << " culled), " << _stats.barriers << " barriers in " << _stats.barrier_batches
+			<< " batches (one per access would be " << _stats.naive_barriers << ", synchronization2: "
+			<< (_device.IsSynchronization2Supported() ? "yes" : "no") << "), transient memory "
+			<< _stats.transient_memory / MB << " MB aliased / " << _stats.unaliased_transient_memory / MB << " MB unaliased\n";
+	}
+	/* ~CvlRenderGraph class */
+}
\ No newline at end of file
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "cvl_device.h"
+
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+#include <optional>
+
+namespace cvl
+{
+	using RenderGraphResource = uint32_t;
+	static constexpr RenderGraphResource INVALID_RENDER_GRAPH_RESOURCE = std::numeric_limits<uint32_t>::max();
+
+	// How a pass uses a resource, determines stages, access masks and image layouts
+	enum class RenderGraphUsage
+	{
+		ColorAttachment,
+		DepthAttachment,
+		DepthRead,
+		FragmentSampled,
+		ComputeSampled,
+		ComputeStorageRead,
+		ComputeStorageWrite,
+		TransferSrc,
+		TransferDst,
+		VertexBuffer,
+		IndexBuffer,
+		IndirectBuffer,
+		UniformBuffer,
+		Present
+	};
+
+	struct RenderGraphImageInfo
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		VkExtent2D extent = {};
+		VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+	};
+
+	struct RenderGraphBufferInfo
+	{
+		VkDeviceSize size = 0;
+	};
+
+	// Last use of an imported resource before the graph runs
+	struct RenderGraphImportState
+	{
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkPipelineStageFlags2 stages = VK_PIPELINE_STAGE_2_NONE;
+		VkAccessFlags2 access = VK_ACCESS_2_NONE;
+	};
+
+	struct RenderGraphStats
+	{
+		uint32_t declared_passes = 0;
+		uint32_t culled_passes = 0;
+		uint32_t barriers = 0;
+		uint32_t barrier_batches = 0;
+		uint32_t naive_barriers = 0;
+		VkDeviceSize transient_memory = 0;
+		VkDeviceSize unaliased_transient_memory = 0;
+	};
+
+	/*
+		Frame graph: passes declare which virtual resources they read and write, Compile() culls passes
+		that don't contribute to an output, schedules the rest, derives batched barriers and places
+		transient resources with non-overlapping lifetimes into shared memory.
+		Transient resources released by Reset(), Compile() and the destructor go through the device's deletion queue,
+		so the graph can be rebuilt while frames recorded from it are still in flight.
+	*/
+	class CvlRenderGraph
+	{
+	public:
+		class PassContext
+		{
+		public:
+			PassContext(CvlRenderGraph& graph, VkCommandBuffer command_buffer, VkRect2D render_area)
+				: _graph(graph), command_buffer(command_buffer), render_area(render_area) {}
+
+			VkImage GetImage(RenderGraphResource resource) const { return _graph._resources[resource].image; }
+			VkImageView GetImageView(RenderGraphResource resource) const { return _graph._resources[resource].view; }
+			VkBuffer GetBuffer(RenderGraphResource resource) const { return _graph._resources[resource].buffer; }
+
+		private:
+			CvlRenderGraph& _graph;
+
+		public:
+			VkCommandBuffer command_buffer;
+			VkRect2D render_area;
+		};
+
+		class PassBuilder
+		{
+		public:
+			PassBuilder(CvlRenderGraph& graph, uint32_t pass_index) : _graph(graph), _pass_index(pass_index) {}
+
+			PassBuilder& Read(RenderGraphResource resource, RenderGraphUsage usage);
+			PassBuilder& Write(RenderGraphResource resource, RenderGraphUsage usage);
+			// Attachments without a clear value are loaded, which makes them a read as well
+			PassBuilder& ClearColor(RenderGraphResource resource, VkClearColorValue color);
+			PassBuilder& ClearDepth(RenderGraphResource resource, VkClearDepthStencilValue depth_stencil);
+			PassBuilder& SetRenderArea(VkRect2D render_area);
+			// Evaluated on every Execute, for render areas that change without recompiling (e.g. dynamic resolution)
+			PassBuilder& SetDynamicRenderArea(std::function<VkRect2D()> render_area);
+			PassBuilder& SetSideEffects();
+			PassBuilder& SetExecute(std::function<void(const PassContext&)> execute);
+
+		private:
+			CvlRenderGraph& _graph;
+			uint32_t _pass_index;
+		};
+
+		CvlRenderGraph(CvlDevice& device);
+		~CvlRenderGraph();
+
+		CvlRenderGraph(const CvlRenderGraph&) = delete;
+		CvlRenderGraph& operator=(const CvlRenderGraph&) = delete;
+
+		RenderGraphResource CreateImage(const std::string& name, const RenderGraphImageInfo& info);
+		RenderGraphResource CreateBuffer(const std::string& name, const RenderGraphBufferInfo& info);
+		RenderGraphResource ImportImage
+		(
+			const std::string& name,
+			const RenderGraphImageInfo& info,
+			const RenderGraphImportState& initial_state,
+			std::optional<RenderGraphUsage> final_usage = std::nullopt
+		);
+		RenderGraphResource ImportBuffer
+		(
+			const std::string& name,
+			const RenderGraphBufferInfo& info,
+			const RenderGraphImportState& initial_state
+		);
+		// Imported handles may change every frame (e.g. the acquired swap chain image)
+		void SetImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+		void SetImportedBuffer(RenderGraphResource resource, VkBuffer buffer);
+		// Keeps the passes writing this resource alive
+		void MarkOutput(RenderGraphResource resource);
+
+		PassBuilder AddPass(const std::string& name);
+
+		void Compile();
+		void Execute(VkCommandBuffer command_buffer);
+		void Reset();
+
+		const RenderGraphStats& GetStats() { return _stats; }
+
+	private:
+		struct UsageInfo
+		{
+			VkPipelineStageFlags2 stages;
+			VkAccessFlags2 access;
+			VkImageLayout layout;
+			bool write;
+		};
+
+		struct Resource
+		{
+			std::string name;
+			bool is_image = true;
+			bool imported = false;
+			bool output = false;
+			RenderGraphImageInfo image_info;
+			RenderGraphBufferInfo buffer_info;
+			RenderGraphImportState import_state;
+			std::optional<RenderGraphUsage> final_usage;
+
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			VkBuffer buffer = VK_NULL_HANDLE;
+
+			// Filled in by Compile
+			VkImageUsageFlags image_usage = 0;
+			VkBufferUsageFlags buffer_usage = 0;
+			uint32_t first_use = std::numeric_limits<uint32_t>::max();
+			uint32_t last_use = 0;
+			uint32_t heap = std::numeric_limits<uint32_t>::max();
+			VkDeviceSize offset = 0;
+			VkMemoryRequirements requirements = {};
+		};
+
+		struct Access
+		{
+			RenderGraphResource resource;
+			RenderGraphUsage usage;
+			bool read;
+			bool write;
+			std::optional<VkClearValue> clear_value;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			std::vector<Access> accesses;
+			std::function<void(const PassContext&)> execute;
+			std::optional<VkRect2D> render_area;
+			std::function<VkRect2D()> dynamic_render_area;
+			bool side_effects = false;
+		};
+
+		// Barriers are stored in synchronization2 form and downgraded when it isn't available
+		struct BarrierBatch
+		{
+			std::vector<VkImageMemoryBarrier2> image_barriers;
+			std::vector<RenderGraphResource> image_barrier_resources;
+			std::vector<VkBufferMemoryBarrier2> buffer_barriers;
+			std::vector<RenderGraphResource> buffer_barrier_resources;
+
+			bool Empty() const { return image_barriers.empty() && buffer_barriers.empty(); }
+		};
+
+		struct Attachment
+		{
+			RenderGraphResource resource;
+			VkAttachmentLoadOp load_op;
+			VkAttachmentStoreOp store_op;
+			VkClearValue clear_value;
+		};
+
+		struct CompiledPass
+		{
+			uint32_t pass;
+			BarrierBatch barriers;
+			std::vector<Attachment> color_attachments;
+			std::optional<Attachment> depth_attachment;
+			VkRect2D render_area;
+		};
+
+		struct TransientHeap
+		{
+			uint32_t memory_type;
+			bool images;
+			VkDeviceSize size;
+			VkDeviceMemory memory;
+		};
+
+		static UsageInfo GetUsageInfo(RenderGraphUsage usage);
+		static VkImageUsageFlags GetImageUsageFlags(RenderGraphUsage usage);
+		static VkBufferUsageFlags GetBufferUsageFlags(RenderGraphUsage usage);
+
+		std::vector<bool> CullPasses();
+		std::vector<uint32_t> SchedulePasses(const std::vector<bool>& alive);
+		void AllocateTransientResources();
+		void BuildBarriers();
+		void BuildAttachments(CompiledPass& compiled);
+		void RecordBarriers(VkCommandBuffer command_buffer, BarrierBatch& batch);
+		void DestroyTransientResources();
+		void ReportStats();
+
+		CvlDevice& _device;
+		std::vector<Resource> _resources;
+		std::vector<Pass> _passes;
+
+		std::vector<CompiledPass> _compiled_passes;
+		BarrierBatch _final_barriers;
+		std::vector<TransientHeap> _heaps;
+		RenderGraphStats _stats;
+		bool _compiled = false;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,365 @@
+#include "cvl_scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CVL_SCENE_SSE
+#endif
+
+namespace cvl
+{
+	void CvlScene::Reserve(size_t count)
+	{
+		_dense_indices.reserve(count);
+		_generations.reserve(count);
+		_entities.reserve(count);
+		_parents.reserve(count);
+		_positions.reserve(count);
+		_rotations.reserve(count);
+		_scales.reserve(count);
+		_local_bounds.reserve(count);
+		_world_matrices.reserve(count);
+		_world_bounds.reserve(count);
+		_mesh_ids.reserve(count);
+		_material_ids.reserve(count);
+	}
+
+	Entity CvlScene::CreateEntity(Entity parent)
+	{
+		if (parent != INVALID_ENTITY && !IsAlive(parent))
+		{
+			throw std::runtime_error("[CvlScene] Failed to create entity, parent is not alive!");
+		}
+
+		Entity entity;
+		if (!_free_slots.empty())
+		{
+			entity.index = _free_slots.back();
+			_free_slots.pop_back();
+		}
+		else
+		{
+			entity.index = static_cast<uint32_t>(_generations.size());
+			_generations.push_back(0);
+			_dense_indices.push_back(INVALID_ID);
+		}
+		entity.generation = _generations[entity.index];
+		_dense_indices[entity.index] = static_cast<uint32_t>(_entities.size());
+
+		_entities.push_back(entity);
+		_parents.push_back(parent);
+		_positions.push_back(glm::vec3(0.0f));
+		_rotations.push_back(glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+		_scales.push_back(glm::vec3(1.0f));
+		_local_bounds.push_back(glm::vec4(0.0f));
+		_world_matrices.push_back(glm::mat4(1.0f));
+		_world_bounds.push_back(glm::vec4(0.0f));
+		_mesh_ids.push_back(INVALID_ID);
+		_material_ids.push_back(INVALID_ID);
+		// Appended after the deepest level
+		_hierarchy_dirty = true;
+		return entity;
+	}
+
+	void CvlScene::DestroyEntity(Entity entity)
+	{
+		uint32_t dense = GetDenseIndex(entity);
+		uint32_t last = static_cast<uint32_t>(_entities.size() - 1);
+		if (dense != last)
+		{
+			_entities[dense] = _entities[last];
+			_parents[dense] = _parents[last];
+			_positions[dense] = _positions[last];
+			_rotations[dense] = _rotations[last];
+			_scales[dense] = _scales[last];
+			_local_bounds[dense] = _local_bounds[last];
+			_world_matrices[dense] = _world_matrices[last];
+			_world_bounds[dense] = _world_bounds[last];
+			_mesh_ids[dense] = _mesh_ids[last];
+			_material_ids[dense] = _material_ids[last];
+			_dense_indices[_entities[dense].index] = dense;
+		}
+		_entities.pop_back();
+		_parents.pop_back();
+		_positions.pop_back();
+		_rotations.pop_back();
+		_scales.pop_back();
+		_local_bounds.pop_back();
+		_world_matrices.pop_back();
+		_world_bounds.pop_back();
+		_mesh_ids.pop_back();
+		_material_ids.pop_back();
+
+		// Children still hold the stale handle, RebuildHierarchy turns them into roots
+		_dense_indices[entity.index] = INVALID_ID;
+		++_generations[entity.index];
+		_free_slots.push_back(entity.index);
+		_hierarchy_dirty = true;
+	}
+
+	bool CvlScene::IsAlive(Entity entity) const
+	{
+		return entity.index < _generations.size() && _generations[entity.index] == entity.generation
+			&& _dense_indices[entity.index] != INVALID_ID;
+	}
+
+	void CvlScene::SetParent(Entity entity, Entity parent)
+	{
+		uint32_t dense = GetDenseIndex(entity);
+		if (parent != INVALID_ENTITY && !IsAlive(parent))
+		{
+			throw std::runtime_error("[CvlScene] Failed to set parent, parent is not alive!");
+		}
+		// A destroyed ancestor is a root until RebuildHierarchy clears the stale handle, the walk ends there
+		for (Entity ancestor = parent; ancestor != INVALID_ENTITY && IsAlive(ancestor); ancestor = _parents[GetDenseIndex(ancestor)])
+		{
+			if (ancestor == entity)
+			{
+				throw std::runtime_error("[CvlScene] Failed to set parent, the hierarchy would contain a cycle!");
+			}
+		}
+		_parents[dense] = parent;
+		_hierarchy_dirty = true;
+	}
+
+	void CvlScene::UpdateTransforms(CvlThreadPool& thread_pool)
+	{
+		auto start_time = std::chrono::high_resolution_clock::now();
+		if (_hierarchy_dirty)
+		{
+			RebuildHierarchy();
+			_stats.rebuild_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+		}
+
+		// Levels run one after another, entities within a level only read their parent from a previous one
+		for (size_t level = 0; level + 1 < _level_offsets.size(); ++level)
+		{
+			uint32_t level_begin = _level_offsets[level];
+			thread_pool.ParallelFor
+			(
+				_level_offsets[level + 1] - level_begin,
+				TRANSFORM_BATCH,
+				[this, level_begin](size_t begin, size_t end)
+				{
+					UpdateLevel(level_begin + static_cast<uint32_t>(begin), level_begin + static_cast<uint32_t>(end));
+				}
+			);
+		}
+
+		_stats.entities = static_cast<uint32_t>(_entities.size());
+		_stats.levels = _level_offsets.empty() ? 0 : static_cast<uint32_t>(_level_offsets.size() - 1);
+		_stats.threads = thread_pool.GetThreadCount();
+		_stats.update_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start_time).count();
+	}
+
+	// private
+	uint32_t CvlScene::GetDenseIndex(Entity entity) const
+	{
+		if (!IsAlive(entity))
+		{
+			throw std::runtime_error("[CvlScene] Entity is not alive!");
+		}
+		return _dense_indices[entity.index];
+	}
+
+	void CvlScene::RebuildHierarchy()
+	{
+		uint32_t count = static_cast<uint32_t>(_entities.size());
+
+		std::vector<uint32_t> parents(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (IsAlive(_parents[i]))
+			{
+				parents[i] = _dense_indices[_parents[i].index];
+			}
+			else
+			{
+				_parents[i] = INVALID_ENTITY;
+				parents[i] = INVALID_ID;
+			}
+		}
+
+		// Depth of every entity, walking up only until an ancestor with a known depth
+		std::vector<uint32_t> depths(count, INVALID_ID);
+		std::vector<uint32_t> chain;
+		uint32_t level_count = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t current = i;
+			while (depths[current] == INVALID_ID && parents[current] != INVALID_ID)
+			{
+				chain.push_back(current);
+				current = parents[current];
+			}
+			if (depths[current] == INVALID_ID)
+			{
+				depths[current] = 0;
+			}
+			uint32_t depth = depths[current];
+			while (!chain.empty())
+			{
+				depths[chain.back()] = ++depth;
+				chain.pop_back();
+			}
+			level_count = std::max(level_count, depths[i] + 1);
+		}
+
+		// Stable counting sort by depth gives the breadth-first order
+		_level_offsets.assign(level_count + 1, 0);
+		for (uint32_t depth : depths)
+		{
+			++_level_offsets[depth + 1];
+		}
+		for (uint32_t level = 0; level < level_count; ++level)
+		{
+			_level_offsets[level + 1] += _level_offsets[level];
+		}
+		std::vector<uint32_t> order(count);
+		std::vector<uint32_t> new_indices(count);
+		std::vector<uint32_t> cursors(_level_offsets.begin(), _level_offsets.end() - 1);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t position = cursors[depths[i]]++;
+			order[position] = i;
+			new_indices[i] = position;
+		}
+
+		{
+			std::vector<Entity> entity_scratch;
+			Permute(_entities, order, entity_scratch);
+			Permute(_parents, order, entity_scratch);
+		}
+		{
+			std::vector<glm::vec3> vec3_scratch;
+			Permute(_positions, order, vec3_scratch);
+			Permute(_scales, order, vec3_scratch);
+		}
+		{
+			std::vector<glm::quat> quat_scratch;
+			Permute(_rotations, order, quat_scratch);
+		}
+		{
+			std::vector<glm::vec4> vec4_scratch;
+			Permute(_local_bounds, order, vec4_scratch);
+			Permute(_world_bounds, order, vec4_scratch);
+		}
+		{
+			std::vector<glm::mat4> mat4_scratch;
+			Permute(_world_matrices, order, mat4_scratch);
+		}
+		{
+			std::vector<uint32_t> id_scratch;
+			Permute(_mesh_ids, order, id_scratch);
+			Permute(_material_ids, order, id_scratch);
+		}
+
+		_parent_indices.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			_dense_indices[_entities[i].index] = i;
+			uint32_t parent = parents[order[i]];
+			_parent_indices[i] = parent == INVALID_ID ? INVALID_ID : new_indices[parent];
+		}
+		_hierarchy_dirty = false;
+	}
+
+	void CvlScene::UpdateLevel(uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const glm::quat& q = _rotations[i];
+			const glm::vec3& s = _scales[i];
+			const glm::vec3& t = _positions[i];
+
+			// Local TRS columns, rotation from the (assumed unit) quaternion
+			float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+			float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+			float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+			float c0[3] = { (1.0f - 2.0f * (yy + zz)) * s.x, 2.0f * (xy + wz) * s.x, 2.0f * (xz - wy) * s.x };
+			float c1[3] = { 2.0f * (xy - wz) * s.y, (1.0f - 2.0f * (xx + zz)) * s.y, 2.0f * (yz + wx) * s.y };
+			float c2[3] = { 2.0f * (xz + wy) * s.z, 2.0f * (yz - wx) * s.z, (1.0f - 2.0f * (xx + yy)) * s.z };
+
+			float* world = &_world_matrices[i][0][0];
+			uint32_t parent = _parent_indices[i];
+#ifdef CVL_SCENE_SSE
+			__m128 w0, w1, w2, w3;
+			if (parent == INVALID_ID)
+			{
+				w0 = _mm_setr_ps(c0[0], c0[1], c0[2], 0.0f);
+				w1 = _mm_setr_ps(c1[0], c1[1], c1[2], 0.0f);
+				w2 = _mm_setr_ps(c2[0], c2[1], c2[2], 0.0f);
+				w3 = _mm_setr_ps(t.x, t.y, t.z, 1.0f);
+			}
+			else
+			{
+				// world = parent * local, one parent column per local matrix element
+				const float* parent_world = &_world_matrices[parent][0][0];
+				__m128 p0 = _mm_loadu_ps(parent_world);
+				__m128 p1 = _mm_loadu_ps(parent_world + 4);
+				__m128 p2 = _mm_loadu_ps(parent_world + 8);
+				__m128 p3 = _mm_loadu_ps(parent_world + 12);
+				auto transform = [&](float x, float y, float z)
+				{
+					return _mm_add_ps
+					(
+						_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(x)), _mm_mul_ps(p1, _mm_set1_ps(y))),
+						_mm_mul_ps(p2, _mm_set1_ps(z))
+					);
+				};
+				w0 = transform(c0[0], c0[1], c0[2]);
+				w1 = transform(c1[0], c1[1], c1[2]);
+				w2 = transform(c2[0], c2[1], c2[2]);
+				w3 = _mm_add_ps(transform(t.x, t.y, t.z), p3);
+			}
+			_mm_storeu_ps(world, w0);
+			_mm_storeu_ps(world + 4, w1);
+			_mm_storeu_ps(world + 8, w2);
+			_mm_storeu_ps(world + 12, w3);
+
+			const glm::vec4& bounds = _local_bounds[i];
+			__m128 center = _mm_add_ps
+			(
+				_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(bounds.x)), _mm_mul_ps(w1, _mm_set1_ps(bounds.y))),
+				_mm_add_ps(_mm_mul_ps(w2, _mm_set1_ps(bounds.z)), w3)
+			);
+			_mm_storeu_ps(&_world_bounds[i][0], center);
+#else
+			glm::mat4 local
+			(
+				glm::vec4(c0[0], c0[1], c0[2], 0.0f),
+				glm::vec4(c1[0], c1[1], c1[2], 0.0f),
+				glm::vec4(c2[0], c2[1], c2[2], 0.0f),
+				glm::vec4(t.x, t.y, t.z, 1.0f)
+			);
+			_world_matrices[i] = parent == INVALID_ID ? local : _world_matrices[parent] * local;
+
+			const glm::vec4& bounds = _local_bounds[i];
+			_world_bounds[i] = _world_matrices[i] * glm::vec4(bounds.x, bounds.y, bounds.z, 1.0f);
+#endif
+			// Radius scaled by the largest axis scale, written over the w of the transformed center
+			float max_scale_squared = 0.0f;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float* column = world + axis * 4;
+				max_scale_squared = std::max(max_scale_squared, column[0] * column[0] + column[1] * column[1] + column[2] * column[2]);
+			}
+			_world_bounds[i].w = bounds.w * std::sqrt(max_scale_squared);
+		}
+	}
+
+	template<typename T>
+	void CvlScene::Permute(std::vector<T>& components, const std::vector<uint32_t>& order, std::vector<T>& scratch)
+	{
+		scratch.resize(components.size());
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			scratch[i] = components[order[i]];
+		}
+		components.swap(scratch);
+	}
+}
\ No newline at end of file
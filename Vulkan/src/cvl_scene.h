@@ -0,0 +1,125 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "cvl_thread_pool.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace cvl
+{
+	// Index into the entity slots plus the slot's generation, so handles to destroyed entities are detected
+	struct Entity
+	{
+		uint32_t index = std::numeric_limits<uint32_t>::max();
+		uint32_t generation = 0;
+
+		bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+		bool operator!=(const Entity& other) const { return !(*this == other); }
+	};
+	static constexpr Entity INVALID_ENTITY = {};
+
+	struct SceneStats
+	{
+		uint32_t entities = 0;
+		uint32_t levels = 0;
+		uint32_t threads = 0;
+		double update_ms = 0.0;
+		double rebuild_ms = 0.0;
+	};
+
+	/*
+		Entity/component store with every component in its own densely packed array (structure of arrays).
+		Dense arrays are kept ordered breadth-first by hierarchy depth, so UpdateTransforms can process one
+		depth level at a time in parallel with every parent already up to date. Dense indices change when
+		entities are created, destroyed or reparented; use Entity handles to keep references across frames.
+	*/
+	class CvlScene
+	{
+	public:
+		static constexpr uint32_t INVALID_ID = std::numeric_limits<uint32_t>::max();
+
+		CvlScene() = default;
+
+		CvlScene(const CvlScene&) = delete;
+		CvlScene& operator=(const CvlScene&) = delete;
+
+		void Reserve(size_t count);
+		Entity CreateEntity(Entity parent = INVALID_ENTITY);
+		// Children of a destroyed entity become roots
+		void DestroyEntity(Entity entity);
+		bool IsAlive(Entity entity) const;
+		void SetParent(Entity entity, Entity parent);
+
+		void SetPosition(Entity entity, const glm::vec3& position) { _positions[GetDenseIndex(entity)] = position; }
+		void SetRotation(Entity entity, const glm::quat& rotation) { _rotations[GetDenseIndex(entity)] = rotation; }
+		void SetScale(Entity entity, const glm::vec3& scale) { _scales[GetDenseIndex(entity)] = scale; }
+		// Bounding sphere in local space, xyz = center, w = radius
+		void SetLocalBounds(Entity entity, const glm::vec4& sphere) { _local_bounds[GetDenseIndex(entity)] = sphere; }
+		void SetMesh(Entity entity, uint32_t mesh_id) { _mesh_ids[GetDenseIndex(entity)] = mesh_id; }
+		void SetMaterial(Entity entity, uint32_t material_id) { _material_ids[GetDenseIndex(entity)] = material_id; }
+
+		const glm::vec3& GetPosition(Entity entity) const { return _positions[GetDenseIndex(entity)]; }
+		const glm::quat& GetRotation(Entity entity) const { return _rotations[GetDenseIndex(entity)]; }
+		const glm::vec3& GetScale(Entity entity) const { return _scales[GetDenseIndex(entity)]; }
+		// As of the last UpdateTransforms
+		const glm::mat4& GetWorldMatrix(Entity entity) const { return _world_matrices[GetDenseIndex(entity)]; }
+		Entity GetParent(Entity entity) const { return _parents[GetDenseIndex(entity)]; }
+
+		// Restores the breadth-first order if needed, then recomputes every world matrix and world bounding sphere
+		void UpdateTransforms(CvlThreadPool& thread_pool);
+
+		// Dense component arrays, all GetCount() long
+		size_t GetCount() const { return _entities.size(); }
+		const Entity* GetEntities() const { return _entities.data(); }
+		glm::vec3* GetPositions() { return _positions.data(); }
+		glm::quat* GetRotations() { return _rotations.data(); }
+		glm::vec3* GetScales() { return _scales.data(); }
+		const glm::mat4* GetWorldMatrices() const { return _world_matrices.data(); }
+		const glm::vec4* GetWorldBounds() const { return _world_bounds.data(); }
+		const uint32_t* GetMeshIds() const { return _mesh_ids.data(); }
+		const uint32_t* GetMaterialIds() const { return _material_ids.data(); }
+		// Dense range of each depth level, level i is [offsets[i], offsets[i + 1])
+		const std::vector<uint32_t>& GetLevelOffsets() const { return _level_offsets; }
+
+		const SceneStats& GetStats() const { return _stats; }
+
+	private:
+		static constexpr size_t TRANSFORM_BATCH = 4096;
+
+		uint32_t GetDenseIndex(Entity entity) const;
+		void RebuildHierarchy();
+		void UpdateLevel(uint32_t begin, uint32_t end);
+		template<typename T>
+		static void Permute(std::vector<T>& components, const std::vector<uint32_t>& order, std::vector<T>& scratch);
+
+		// Sparse: entity slot -> dense index, generation and free slots
+		std::vector<uint32_t> _dense_indices;
+		std::vector<uint32_t> _generations;
+		std::vector<uint32_t> _free_slots;
+
+		// Dense components
+		std::vector<Entity> _entities;
+		std::vector<Entity> _parents;
+		std::vector<glm::vec3> _positions;
+		std::vector<glm::quat> _rotations;
+		std::vector<glm::vec3> _scales;
+		std::vector<glm::vec4> _local_bounds;
+		std::vector<glm::mat4> _world_matrices;
+		std::vector<glm::vec4> _world_bounds;
+		std::vector<uint32_t> _mesh_ids;
+		std::vector<uint32_t> _material_ids;
+
+		// Filled in by RebuildHierarchy
+		std::vector<uint32_t> _parent_indices;
+		std::vector<uint32_t> _level_offsets;
+		bool _hierarchy_dirty = false;
+
+		SceneStats _stats;
+	};
+}
\ No newline at end of file
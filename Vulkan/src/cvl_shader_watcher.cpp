@@ -0,0 +1,177 @@
+#include "cvl_shader_watcher.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <queue>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace cvl
+{
+	CvlShaderWatcher::CvlShaderWatcher(const std::string& directory)
+		: _directory(Normalize(directory))
+	{
+		std::error_code ec;
+		for (const auto& entry : std::filesystem::directory_iterator(_directory, ec))
+		{
+			if (entry.is_regular_file(ec))
+			{
+				_write_times[entry.path()] = entry.last_write_time(ec);
+				ScanIncludes(entry.path());
+			}
+		}
+		if (ec)
+		{
+			std::cout << "[CvlShaderWatcher] Failed to scan " << _directory << ": " << ec.message() << '\n';
+		}
+		_thread = std::thread(&CvlShaderWatcher::Run, this);
+		std::cout << "[CvlShaderWatcher] Watching " << _directory << " (" << _write_times.size() << " files)\n";
+	}
+
+	CvlShaderWatcher::~CvlShaderWatcher()
+	{
+		_running = false;
+		_thread.join();
+	}
+
+	std::vector<std::filesystem::path> CvlShaderWatcher::PollChanges()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::vector<std::filesystem::path> changed(_changed.begin(), _changed.end());
+		_changed.clear();
+		return changed;
+	}
+
+	std::filesystem::path CvlShaderWatcher::Normalize(const std::string& fp)
+	{
+		std::string generic = fp;
+		std::replace(generic.begin(), generic.end(), '\\', '/');
+		std::error_code ec;
+		std::filesystem::path path = std::filesystem::weakly_canonical(std::filesystem::absolute(generic), ec);
+		return ec ? std::filesystem::path(generic) : path;
+	}
+
+	// private
+	void CvlShaderWatcher::Run()
+	{
+#ifdef __linux__
+		int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0 || inotify_add_watch(fd, _directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		{
+			std::cout << "[CvlShaderWatcher] inotify unavailable, polling instead\n";
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			RunPolling();
+			return;
+		}
+
+		alignas(inotify_event) char buffer[4096];
+		while (_running)
+		{
+			// Timeout so the destructor doesn't need to wake the thread
+			pollfd pfd = { fd, POLLIN, 0 };
+			if (poll(&pfd, 1, static_cast<int>(POLL_INTERVAL.count())) <= 0)
+			{
+				continue;
+			}
+			ssize_t length = read(fd, buffer, sizeof(buffer));
+			for (ssize_t offset = 0; offset < length;)
+			{
+				const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+				if (event->len > 0)
+				{
+					OnFileChanged(_directory / event->name);
+				}
+				offset += sizeof(inotify_event) + event->len;
+			}
+		}
+		close(fd);
+#else
+		RunPolling();
+#endif
+	}
+
+	void CvlShaderWatcher::RunPolling()
+	{
+		while (_running)
+		{
+			std::this_thread::sleep_for(POLL_INTERVAL);
+			std::error_code ec;
+			for (const auto& entry : std::filesystem::directory_iterator(_directory, ec))
+			{
+				// Files being written may fail to stat, they are picked up on the next round
+				auto write_time = entry.last_write_time(ec);
+				if (ec || !entry.is_regular_file(ec))
+				{
+					continue;
+				}
+				auto it = _write_times.find(entry.path());
+				if (it == _write_times.end() || it->second != write_time)
+				{
+					_write_times[entry.path()] = write_time;
+					OnFileChanged(entry.path());
+				}
+			}
+		}
+	}
+
+	void CvlShaderWatcher::ScanIncludes(const std::filesystem::path& file)
+	{
+		std::set<std::filesystem::path>& includes = _includes[file];
+		includes.clear();
+
+		std::ifstream ifs(file);
+		std::string line;
+		while (std::getline(ifs, line))
+		{
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 8, "#include") != 0)
+			{
+				continue;
+			}
+			size_t open = line.find_first_of("\"<", start + 8);
+			if (open == std::string::npos)
+			{
+				continue;
+			}
+			size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+			if (close != std::string::npos)
+			{
+				std::string name = line.substr(open + 1, close - open - 1);
+				includes.insert(Normalize((file.parent_path() / name).string()));
+			}
+		}
+	}
+
+	void CvlShaderWatcher::OnFileChanged(const std::filesystem::path& file)
+	{
+		ScanIncludes(file);
+
+		// Walk the include graph backwards to every file depending on the changed one
+		std::set<std::filesystem::path> affected = { file };
+		std::queue<std::filesystem::path> pending;
+		pending.push(file);
+		while (!pending.empty())
+		{
+			std::filesystem::path current = pending.front();
+			pending.pop();
+			for (const auto& [includer, includes] : _includes)
+			{
+				if (includes.count(current) != 0 && affected.insert(includer).second)
+				{
+					pending.push(includer);
+				}
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_changed.insert(affected.begin(), affected.end());
+	}
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Watches a shader directory on a background thread (inotify on Linux, modification times elsewhere)
+		and tracks #include dependencies, so editing an included file also reports every shader including it.
+	*/
+	class CvlShaderWatcher
+	{
+	public:
+		CvlShaderWatcher(const std::string& directory);
+		~CvlShaderWatcher();
+
+		CvlShaderWatcher(const CvlShaderWatcher&) = delete;
+		CvlShaderWatcher& operator=(const CvlShaderWatcher&) = delete;
+
+		// Files changed since the last call and the files including them, normalized
+		std::vector<std::filesystem::path> PollChanges();
+
+		// Shader paths are written with '\\', this makes them comparable on every platform
+		static std::filesystem::path Normalize(const std::string& fp);
+
+	private:
+		static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+
+		void Run();
+		void RunPolling();
+		void ScanIncludes(const std::filesystem::path& file);
+		void OnFileChanged(const std::filesystem::path& file);
+
+		std::filesystem::path _directory;
+		// Only touched by the watcher thread once it runs
+		std::map<std::filesystem::path, std::set<std::filesystem::path>> _includes;
+		std::map<std::filesystem::path, std::filesystem::file_time_type> _write_times;
+
+		std::mutex _mutex;
+		std::set<std::filesystem::path> _changed;
+
+		std::atomic<bool> _running = true;
+		std::thread _thread;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,233 @@
+#include "cvl_sprite_batch.h"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace cvl
+{
+	/* CvlSpriteBatch class */
+	CvlSpriteBatch::CvlSpriteBatch(CvlDevice& device, CvlPipelineCache& pipeline_cache, uint32_t max_sprites, uint32_t frame_count)
+		: _cvl_device(device), _pipeline_cache(pipeline_cache), _max_sprites(max_sprites), _frame_count(frame_count),
+		_keys(max_sprites), _sprites(max_sprites), _key_offsets(MAX_LAYERS << 8)
+	{
+		VkDeviceSize buffer_size = sizeof(Sprite) * static_cast<VkDeviceSize>(_max_sprites) * _frame_count;
+		_cvl_device.CreateBuffer
+		(
+			buffer_size,
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging,
+			_instance_buffer,
+			_instance_buffer_memory
+		);
+		if (vkMapMemory(_cvl_device.device(), _instance_buffer_memory, 0, buffer_size, 0, reinterpret_cast<void**>(&_mapped)) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlSpriteBatch] Failed to map instance buffer!");
+		}
+		CreateDescriptors();
+
+		// Pixel to clip space scale and offset
+		VkPushConstantRange push_constant_range = {};
+		push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_constant_range.offset = 0;
+		push_constant_range.size = sizeof(glm::vec4);
+
+		VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+		pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout_info.setLayoutCount = 1;
+		pipeline_layout_info.pSetLayouts = &_descriptor_set_layout;
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+		if (vkCreatePipelineLayout(_cvl_device.device(), &pipeline_layout_info, _cvl_device.GetAllocator(), &_pipeline_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlSpriteBatch] Failed to create pipeline layout!");
+		}
+	}
+
+	CvlSpriteBatch::~CvlSpriteBatch()
+	{
+		_pipeline.reset();
+		_pipeline_cache.ReleasePipelines(_pipeline_layout);
+		vkDestroyPipelineLayout(_cvl_device.device(), _pipeline_layout, _cvl_device.GetAllocator());
+		vkDestroyDescriptorPool(_cvl_device.device(), _descriptor_pool, _cvl_device.GetAllocator());
+		vkDestroyDescriptorSetLayout(_cvl_device.device(), _descriptor_set_layout, _cvl_device.GetAllocator());
+		vkUnmapMemory(_cvl_device.device(), _instance_buffer_memory);
+		vkDestroyBuffer(_cvl_device.device(), _instance_buffer, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(_instance_buffer_memory);
+	}
+
+	uint32_t CvlSpriteBatch::AddTexture(CvlTextureArray& texture)
+	{
+		if (_texture_sets.size() == MAX_TEXTURES)
+		{
+			throw std::runtime_error("[CvlSpriteBatch] Failed to add texture, MAX_TEXTURES reached!");
+		}
+
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = _descriptor_pool;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &_descriptor_set_layout;
+		VkDescriptorSet descriptor_set;
+		if (vkAllocateDescriptorSets(_cvl_device.device(), &alloc_info, &descriptor_set) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlSpriteBatch] Failed to allocate descriptor set!");
+		}
+
+		VkDescriptorImageInfo image_info = {};
+		image_info.sampler = texture.GetSampler();
+		image_info.imageView = texture.GetImageView();
+		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = descriptor_set;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &image_info;
+		vkUpdateDescriptorSets(_cvl_device.device(), 1, &write, 0, nullptr);
+
+		_texture_sets.push_back(descriptor_set);
+		return static_cast<uint32_t>(_texture_sets.size() - 1);
+	}
+
+	void CvlSpriteBatch::CreateRenderPipeline(const PipelineConfigInfo& config_info)
+	{
+		PipelineConfigInfo sprite_config = {};
+		CvlPipeline::CopyPipelineConfigInfo(config_info, sprite_config);
+		sprite_config.input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		sprite_config.rasterization_info.cullMode = VK_CULL_MODE_NONE;
+		sprite_config.binding_descriptions = GetBindingDescriptions<Sprite>();
+		sprite_config.attribute_descriptions = GetAttributeDescriptions<Sprite>();
+		sprite_config.depth_stencil_info.depthTestEnable = VK_FALSE;
+		sprite_config.depth_stencil_info.depthWriteEnable = VK_FALSE;
+		sprite_config.color_blend_attachment.blendEnable = VK_TRUE;
+		sprite_config.color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+		sprite_config.color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		sprite_config.color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+		sprite_config.color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		sprite_config.color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		sprite_config.color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		sprite_config.pipeline_layout = _pipeline_layout;
+		_pipeline = _pipeline_cache.GetGraphicsPipeline(sprite_config, "src\\shaders\\sprite.vert", "src\\shaders\\sprite.frag");
+	}
+
+	void CvlSpriteBatch::Begin(uint32_t frame)
+	{
+		_frame = frame;
+		_count = 0;
+		_batches.clear();
+		_begin_time = std::chrono::high_resolution_clock::now();
+	}
+
+	void CvlSpriteBatch::End()
+	{
+		// Counting sort over the 16-bit (layer, texture) key: one pass to count, one to scatter
+		std::fill(_key_offsets.begin(), _key_offsets.end(), 0u);
+		for (uint32_t i = 0; i < _count; ++i)
+		{
+			++_key_offsets[_keys[i]];
+		}
+		uint32_t offset = _frame * _max_sprites;
+		for (uint32_t key = 0; key < _key_offsets.size(); ++key)
+		{
+			uint32_t key_count = _key_offsets[key];
+			if (key_count == 0)
+			{
+				continue;
+			}
+			_batches.push_back({ key & 0xFF, offset, key_count });
+			_key_offsets[key] = offset;
+			offset += key_count;
+		}
+		// Writes go to write-combined memory as one sequential stream per batch
+		for (uint32_t i = 0; i < _count; ++i)
+		{
+			_mapped[_key_offsets[_keys[i]]++] = _sprites[i];
+		}
+
+		_stats_cpu_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _begin_time).count();
+		_stats_sprites += _count;
+		_stats_batches += _batches.size();
+		ReportStats();
+	}
+
+	void CvlSpriteBatch::Draw(VkCommandBuffer command_buffer, VkRect2D render_area)
+	{
+		if (_batches.empty() || _pipeline == nullptr)
+		{
+			return;
+		}
+
+		_pipeline->Bind(command_buffer);
+		VkBuffer buffers[] = { _instance_buffer };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, buffers, offsets);
+		glm::vec4 pixel_to_clip(2.0f / static_cast<float>(render_area.extent.width), 2.0f / static_cast<float>(render_area.extent.height), -1.0f, -1.0f);
+		vkCmdPushConstants(command_buffer, _pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pixel_to_clip), &pixel_to_clip);
+
+		uint32_t bound_texture = MAX_TEXTURES;
+		for (const SpriteBatch& batch : _batches)
+		{
+			if (batch.texture != bound_texture)
+			{
+				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline_layout, 0, 1, &_texture_sets[batch.texture], 0, nullptr);
+				bound_texture = batch.texture;
+			}
+			// Six vertices per quad, corners come from gl_VertexIndex
+			vkCmdDraw(command_buffer, 6, batch.instance_count, 0, batch.first_instance);
+		}
+	}
+
+	// private
+	void CvlSpriteBatch::CreateDescriptors()
+	{
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layout_info = {};
+		layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layout_info.bindingCount = 1;
+		layout_info.pBindings = &binding;
+		if (vkCreateDescriptorSetLayout(_cvl_device.device(), &layout_info, _cvl_device.GetAllocator(), &_descriptor_set_layout) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlSpriteBatch] Failed to create descriptor set layout!");
+		}
+
+		VkDescriptorPoolSize pool_size = {};
+		pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_size.descriptorCount = MAX_TEXTURES;
+
+		VkDescriptorPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = MAX_TEXTURES;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+		if (vkCreateDescriptorPool(_cvl_device.device(), &pool_info, _cvl_device.GetAllocator(), &_descriptor_pool) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlSpriteBatch] Failed to create descriptor pool!");
+		}
+	}
+
+	void CvlSpriteBatch::ReportStats()
+	{
+		if (++_stats_frames < REPORT_INTERVAL_FRAMES)
+		{
+			return;
+		}
+		double frames = static_cast<double>(_stats_frames);
+		std::cout << "[CvlSpriteBatch] " << _stats_sprites / frames << " sprites in " << _stats_batches / frames << " batches per frame, "
+			<< _stats_cpu_ms / frames << " ms CPU from Begin to End, " << _dropped << " dropped\n";
+		_stats_cpu_ms = 0.0;
+		_stats_sprites = 0;
+		_stats_batches = 0;
+		_dropped = 0;
+		_stats_frames = 0;
+	}
+	/* ~CvlSpriteBatch class */
+}
\ No newline at end of file
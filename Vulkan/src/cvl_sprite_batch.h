@@ -0,0 +1,137 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_pipeline.h"
+#include "cvl_pipeline_cache.h"
+#include "cvl_texture_array.h"
+#include "cvl_vertex_layout.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		2D sprites in pixel space drawn as instanced quads expanded in shaders/sprite.vert.
+		Submit() only appends to CPU arrays; End() counting-sorts the frame's sprites by (layer, texture)
+		straight into a persistently mapped per-frame instance buffer and forms one batch per key,
+		each drawn with a single instanced vkCmdDraw. Texture changes rebind a descriptor set.
+	*/
+	class CvlSpriteBatch
+	{
+	public:
+		// Per-instance vertex data
+		struct Sprite
+		{
+			glm::vec2 position;	// center, pixels from the top left of the render area
+			glm::vec2 size;		// pixels
+			float rotation;		// radians, clockwise on screen
+			uint32_t texture_layer;
+			Unorm16x4 uv_rect;	// xy = min, zw = max, see EncodeUvRect
+			Unorm8x4 color;
+		};
+
+		static constexpr uint32_t MAX_LAYERS = 256;
+		static constexpr uint32_t MAX_TEXTURES = 16;
+		// Submit packs both into a 16-bit sort key, the texture in the low 8 bits
+		static_assert(MAX_TEXTURES <= 256 && MAX_LAYERS <= 256, "Layer and texture must each fit in 8 bits of the sort key");
+		static constexpr uint32_t REPORT_INTERVAL_FRAMES = 300;
+
+		CvlSpriteBatch(CvlDevice& device, CvlPipelineCache& pipeline_cache, uint32_t max_sprites, uint32_t frame_count);
+		~CvlSpriteBatch();
+
+		CvlSpriteBatch(const CvlSpriteBatch&) = delete;
+		CvlSpriteBatch& operator=(const CvlSpriteBatch&) = delete;
+
+		// Returns the texture index for Submit, the texture must outlive the batch
+		uint32_t AddTexture(CvlTextureArray& texture);
+		// config_info must have its attachments set, everything else is overridden
+		void CreateRenderPipeline(const PipelineConfigInfo& config_info);
+
+		// The frame's previous instances must no longer be in use by the GPU
+		void Begin(uint32_t frame);
+		// Lower layers are drawn first, sprites beyond max_sprites are dropped
+		void Submit(uint32_t layer, uint32_t texture, const Sprite& sprite)
+		{
+			if (_count == _max_sprites)
+			{
+				++_dropped;
+				return;
+			}
+			assert(texture < _texture_sets.size() && "Texture index not returned by AddTexture");
+			_keys[_count] = static_cast<uint16_t>(((layer & (MAX_LAYERS - 1)) << 8) | texture);
+			_sprites[_count++] = sprite;
+		}
+		void End();
+		// Must be recorded inside rendering
+		void Draw(VkCommandBuffer command_buffer, VkRect2D render_area);
+
+		uint32_t GetCount() const { return _count; }
+
+	private:
+		struct SpriteBatch
+		{
+			uint32_t texture;
+			uint32_t first_instance;
+			uint32_t instance_count;
+		};
+
+		void CreateDescriptors();
+		void ReportStats();
+
+		CvlDevice& _cvl_device;
+		CvlPipelineCache& _pipeline_cache;
+		uint32_t _max_sprites;
+		uint32_t _frame_count;
+
+		VkBuffer _instance_buffer;
+		VkDeviceMemory _instance_buffer_memory;
+		Sprite* _mapped = nullptr;
+
+		VkDescriptorSetLayout _descriptor_set_layout;
+		VkDescriptorPool _descriptor_pool;
+		std::vector<VkDescriptorSet> _texture_sets;
+		VkPipelineLayout _pipeline_layout;
+		std::shared_ptr<CvlPipeline> _pipeline;
+
+		uint32_t _frame = 0;
+		uint32_t _count = 0;
+		std::vector<uint16_t> _keys;
+		std::vector<Sprite> _sprites;
+		// Per key count, then write cursor into the frame's instances
+		std::vector<uint32_t> _key_offsets;
+		std::vector<SpriteBatch> _batches;
+
+		std::chrono::high_resolution_clock::time_point _begin_time;
+		double _stats_cpu_ms = 0.0;
+		uint64_t _stats_sprites = 0;
+		uint64_t _stats_batches = 0;
+		uint64_t _dropped = 0;
+		uint32_t _stats_frames = 0;
+	};
+
+	template<> struct VertexLayout<CvlSpriteBatch::Sprite>
+	{
+		static constexpr std::array<VkVertexInputBindingDescription, 1> bindings =
+		{
+			VertexBinding<CvlSpriteBatch::Sprite>(0, VK_VERTEX_INPUT_RATE_INSTANCE)
+		};
+		static constexpr std::array<VkVertexInputAttributeDescription, 6> attributes =
+		{
+			VertexAttribute<glm::vec2>(0, offsetof(CvlSpriteBatch::Sprite, position)),
+			VertexAttribute<glm::vec2>(1, offsetof(CvlSpriteBatch::Sprite, size)),
+			VertexAttribute<float>(2, offsetof(CvlSpriteBatch::Sprite, rotation)),
+			VertexAttribute<uint32_t>(3, offsetof(CvlSpriteBatch::Sprite, texture_layer)),
+			VertexAttribute<Unorm16x4>(4, offsetof(CvlSpriteBatch::Sprite, uv_rect)),
+			VertexAttribute<Unorm8x4>(5, offsetof(CvlSpriteBatch::Sprite, color))
+		};
+	};
+}
\ No newline at end of file
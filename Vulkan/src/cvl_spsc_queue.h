@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Bounded queue between exactly one producer and one consumer thread. TryPush() and TryPop() are lock-free,
+		each index is only written by its own side. Push() and Pop() spin for a moment and then sleep until the
+		other side makes progress, the mutex is only taken while one side sleeps or has to wake the other.
+	*/
+	template<typename T>
+	class CvlSpscQueue
+	{
+	public:
+		// One slot stays empty to tell a full ring from an empty one
+		CvlSpscQueue(size_t capacity) : _slots(capacity + 1) {}
+
+		CvlSpscQueue(const CvlSpscQueue&) = delete;
+		CvlSpscQueue& operator=(const CvlSpscQueue&) = delete;
+
+		// Producer only, value is left untouched when the queue is full
+		bool TryPush(T&& value)
+		{
+			if (!PushOnce(std::move(value)))
+			{
+				return false;
+			}
+			WakeSleeper();
+			return true;
+		}
+
+		// Consumer only
+		bool TryPop(T& value)
+		{
+			if (!PopOnce(value))
+			{
+				return false;
+			}
+			WakeSleeper();
+			return true;
+		}
+
+		void Push(T value)
+		{
+			Wait([this, &value]() { return PushOnce(std::move(value)); });
+		}
+
+		T Pop()
+		{
+			T value;
+			Wait([this, &value]() { return PopOnce(value); });
+			return value;
+		}
+
+		size_t GetCapacity() const { return _slots.size() - 1; }
+
+	private:
+		static constexpr uint32_t SPIN_COUNT = 64;
+
+		bool PushOnce(T&& value)
+		{
+			size_t tail = _tail.load(std::memory_order_relaxed);
+			size_t next = tail + 1 == _slots.size() ? 0 : tail + 1;
+			if (next == _head.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+			_slots[tail] = std::move(value);
+			_tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		bool PopOnce(T& value)
+		{
+			size_t head = _head.load(std::memory_order_relaxed);
+			if (head == _tail.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+			value = std::move(_slots[head]);
+			_head.store(head + 1 == _slots.size() ? 0 : head + 1, std::memory_order_release);
+			return true;
+		}
+
+		template<typename F>
+		void Wait(const F& try_once)
+		{
+			for (uint32_t i = 0; i < SPIN_COUNT; ++i)
+			{
+				if (try_once())
+				{
+					WakeSleeper();
+					return;
+				}
+				std::this_thread::yield();
+			}
+
+			{
+				// Announced before trying again, so progress after the last failed try sees the sleeper and wakes it
+				std::unique_lock<std::mutex> lock(_mutex);
+				_sleepers.fetch_add(1);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				_wake.wait(lock, try_once);
+				_sleepers.fetch_sub(1);
+			}
+			WakeSleeper();
+		}
+
+		void WakeSleeper()
+		{
+			// Pairs with the fence in Wait(): either the sleeper sees this side's progress or this side sees it sleeping
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (_sleepers.load(std::memory_order_relaxed) != 0)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_wake.notify_all();
+			}
+		}
+
+		std::vector<T> _slots;
+		// On separate cache lines, the consumer writes _head and the producer _tail
+		alignas(64) std::atomic<size_t> _head = 0;
+		alignas(64) std::atomic<size_t> _tail = 0;
+		alignas(64) std::atomic<uint32_t> _sleepers = 0;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,296 @@
+#include "cvl_startup_graph.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace cvl
+{
+	CvlStartupGraph::CvlStartupGraph(CvlThreadPool& thread_pool)
+		: _thread_pool(thread_pool), _start_time(std::chrono::high_resolution_clock::now()), _main_thread_id(std::this_thread::get_id())
+	{
+	}
+
+	void CvlStartupGraph::AddStep(const std::string& name, const std::vector<std::string>& dependencies, StartupThread thread, std::function<void()> func)
+	{
+		Step step;
+		step.name = name;
+		step.dependency_names = dependencies;
+		step.thread = thread;
+		step.func = std::move(func);
+		_steps.push_back(std::move(step));
+	}
+
+	void CvlStartupGraph::Run()
+	{
+		ResolveDependencies();
+		_main_thread_id = std::this_thread::get_id();
+		std::vector<size_t> worker_steps;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (size_t i = 0; i < _steps.size(); ++i)
+			{
+				if (_steps[i].pending_dependencies == 0)
+				{
+					Schedule(i, worker_steps);
+				}
+			}
+		}
+		Enqueue(worker_steps);
+
+		while (true)
+		{
+			size_t step;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				// After an error the queued main steps are dropped, only the running worker steps are waited for
+				_wake.wait(lock, [this]()
+				{
+					return _error ? _running_worker_steps == 0 : !_main_ready.empty() || _finished_steps == _steps.size();
+				});
+				if (_error)
+				{
+					std::rethrow_exception(_error);
+				}
+				if (_main_ready.empty())
+				{
+					break;
+				}
+				step = _main_ready.front();
+				_main_ready.pop_front();
+			}
+			Execute(step);
+		}
+		_graph_ms = GetElapsedMs();
+		std::cout << "[CvlStartupGraph] " << _steps.size() << " steps finished in " << *_graph_ms << " ms\n";
+	}
+
+	void CvlStartupGraph::SetFirstFrame()
+	{
+		_first_frame_ms = GetElapsedMs();
+	}
+
+	void CvlStartupGraph::WriteReport(const std::string& path, double target_ms) const
+	{
+		// Threads are numbered in the order they first ran a step, the main thread is always 0
+		std::unordered_map<std::thread::id, uint32_t> thread_numbers = { { _main_thread_id, 0 } };
+		std::vector<size_t> order(_steps.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return _steps[a].start_ms < _steps[b].start_ms; });
+		double busy_ms = 0.0;
+		for (size_t i : order)
+		{
+			thread_numbers.emplace(_steps[i].thread_id, static_cast<uint32_t>(thread_numbers.size()));
+			busy_ms += _steps[i].end_ms - _steps[i].start_ms;
+		}
+
+		std::ostringstream report;
+		report << std::fixed << std::setprecision(2);
+		if (_first_frame_ms.has_value())
+		{
+			report << "Time to first frame: " << *_first_frame_ms << " ms (target " << target_ms << " ms, "
+				<< (*_first_frame_ms <= target_ms ? "met" : "missed") << ")\n";
+		}
+		else
+		{
+			report << "Time to first frame: no frame presented\n";
+		}
+		double graph_ms = _graph_ms.value_or(0.0);
+		report << "Startup steps finished: " << graph_ms << " ms\n";
+		report << "Step time: " << busy_ms << " ms on " << thread_numbers.size() << " threads, "
+			<< (graph_ms > 0.0 ? busy_ms / graph_ms : 0.0) << "x overlap\n\n";
+
+		report << std::left << std::setw(24) << "Step" << std::setw(10) << "Thread" << std::right
+			<< std::setw(12) << "Start ms" << std::setw(12) << "End ms" << std::setw(12) << "Duration ms" << '\n';
+		for (size_t i : order)
+		{
+			const Step& step = _steps[i];
+			uint32_t thread_number = thread_numbers[step.thread_id];
+			std::string thread = thread_number == 0 ? "main" : "worker " + std::to_string(thread_number);
+			report << std::left << std::setw(24) << step.name << std::setw(10) << thread << std::right
+				<< std::setw(12) << step.start_ms << std::setw(12) << step.end_ms << std::setw(12) << step.end_ms - step.start_ms << '\n';
+		}
+
+		report << "\nCritical path:";
+		for (size_t i : GetCriticalPath())
+		{
+			report << ' ' << _steps[i].name << " (" << _steps[i].end_ms - _steps[i].start_ms << " ms) ->";
+		}
+		if (_first_frame_ms.has_value())
+		{
+			report << " first frame (" << *_first_frame_ms - graph_ms << " ms)\n";
+		}
+		else
+		{
+			report << " done\n";
+		}
+
+		std::ofstream ofs(path, std::ios::trunc);
+		if (!ofs.is_open())
+		{
+			std::cout << "[CvlStartupGraph] Failed to write " << path << '\n';
+			return;
+		}
+		ofs << report.str();
+		std::cout << "[CvlStartupGraph] " << (_first_frame_ms.has_value() ? *_first_frame_ms : graph_ms)
+			<< " ms to " << (_first_frame_ms.has_value() ? "first frame" : "the end of startup") << ", report written to " << path << '\n';
+	}
+
+	double CvlStartupGraph::GetElapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - _start_time).count();
+	}
+
+	// private
+	void CvlStartupGraph::ResolveDependencies()
+	{
+		std::unordered_map<std::string, size_t> indices;
+		for (size_t i = 0; i < _steps.size(); ++i)
+		{
+			if (!indices.emplace(_steps[i].name, i).second)
+			{
+				throw std::runtime_error("[CvlStartupGraph] Duplicate step: " + _steps[i].name);
+			}
+		}
+		for (size_t i = 0; i < _steps.size(); ++i)
+		{
+			for (const std::string& name : _steps[i].dependency_names)
+			{
+				auto it = indices.find(name);
+				if (it == indices.end())
+				{
+					throw std::runtime_error("[CvlStartupGraph] Step " + _steps[i].name + " depends on unknown step " + name);
+				}
+				_steps[i].dependencies.push_back(it->second);
+				_steps[it->second].dependents.push_back(i);
+			}
+			_steps[i].pending_dependencies = _steps[i].dependencies.size();
+		}
+
+		// A cycle would leave Run() waiting forever, so the graph is sorted once up front
+		std::vector<size_t> pending(_steps.size());
+		std::vector<size_t> ready;
+		for (size_t i = 0; i < _steps.size(); ++i)
+		{
+			pending[i] = _steps[i].pending_dependencies;
+			if (pending[i] == 0)
+			{
+				ready.push_back(i);
+			}
+		}
+		size_t sorted = 0;
+		while (!ready.empty())
+		{
+			size_t step = ready.back();
+			ready.pop_back();
+			++sorted;
+			for (size_t dependent : _steps[step].dependents)
+			{
+				if (--pending[dependent] == 0)
+				{
+					ready.push_back(dependent);
+				}
+			}
+		}
+		if (sorted != _steps.size())
+		{
+			throw std::runtime_error("[CvlStartupGraph] Step dependencies form a cycle!");
+		}
+	}
+
+	void CvlStartupGraph::Schedule(size_t step, std::vector<size_t>& worker_steps)
+	{
+		if (_steps[step].thread == StartupThread::Main)
+		{
+			_main_ready.push_back(step);
+			return;
+		}
+		// Counted before it is enqueued, so Run() can't give up on an error while the step is about to start
+		++_running_worker_steps;
+		worker_steps.push_back(step);
+	}
+
+	void CvlStartupGraph::Enqueue(const std::vector<size_t>& worker_steps)
+	{
+		// Runs inline when the pool has no workers, so the lock must not be held here
+		for (size_t step : worker_steps)
+		{
+			_thread_pool.Enqueue([this, step]()
+			{
+				Execute(step);
+			});
+		}
+	}
+
+	void CvlStartupGraph::Execute(size_t step)
+	{
+		Step& current = _steps[step];
+		current.thread_id = std::this_thread::get_id();
+		current.start_ms = GetElapsedMs();
+		std::exception_ptr error;
+		try
+		{
+			current.func();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		current.end_ms = GetElapsedMs();
+
+		std::vector<size_t> worker_steps;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			++_finished_steps;
+			if (current.thread == StartupThread::Worker)
+			{
+				--_running_worker_steps;
+			}
+			if (error && !_error)
+			{
+				_error = error;
+			}
+			for (size_t dependent : current.dependents)
+			{
+				if (--_steps[dependent].pending_dependencies == 0 && !_error)
+				{
+					Schedule(dependent, worker_steps);
+				}
+			}
+			// Notified under the lock, once Run() returns or throws the graph may be destroyed
+			_wake.notify_one();
+		}
+		Enqueue(worker_steps);
+	}
+
+	std::vector<size_t> CvlStartupGraph::GetCriticalPath() const
+	{
+		// Walks back from the last step to finish through the dependency that finished last
+		std::vector<size_t> path;
+		if (_steps.empty())
+		{
+			return path;
+		}
+		auto later = [this](size_t a, size_t b) { return _steps[a].end_ms < _steps[b].end_ms; };
+		std::vector<size_t> all(_steps.size());
+		std::iota(all.begin(), all.end(), 0);
+		size_t step = *std::max_element(all.begin(), all.end(), later);
+		while (true)
+		{
+			path.push_back(step);
+			const std::vector<size_t>& dependencies = _steps[step].dependencies;
+			if (dependencies.empty())
+			{
+				break;
+			}
+			step = *std::max_element(dependencies.begin(), dependencies.end(), later);
+		}
+		std::reverse(path.begin(), path.end());
+		return path;
+	}
+}
\ No newline at end of file
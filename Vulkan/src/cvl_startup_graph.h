@@ -0,0 +1,89 @@
+#pragma once
+
+#include "cvl_thread_pool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cvl
+{
+	enum class StartupThread
+	{
+		// Steps touching GLFW or the device's command pool, which only the thread calling Run() may use
+		Main,
+		Worker
+	};
+
+	/*
+		Application startup as a graph of named steps. Run() starts every step as soon as the steps it depends
+		on have finished, worker steps on the thread pool and main steps on the calling thread, so independent
+		steps overlap instead of running one after another. Every step is timed from the graph's creation and
+		WriteReport() lists them with the critical path and the time to the first frame.
+	*/
+	class CvlStartupGraph
+	{
+	public:
+		CvlStartupGraph(CvlThreadPool& thread_pool);
+
+		CvlStartupGraph(const CvlStartupGraph&) = delete;
+		CvlStartupGraph& operator=(const CvlStartupGraph&) = delete;
+
+		// Dependencies are looked up by name when Run() is called, so steps can be added in any order
+		void AddStep(const std::string& name, const std::vector<std::string>& dependencies, StartupThread thread, std::function<void()> func);
+		// Returns once every step has finished. If one throws, no further steps are started and the exception is
+		// rethrown once the running ones are done
+		void Run();
+
+		// Call once the first frame has been presented
+		void SetFirstFrame();
+		void WriteReport(const std::string& path, double target_ms) const;
+
+		double GetElapsedMs() const;
+
+	private:
+		struct Step
+		{
+			std::string name;
+			std::vector<std::string> dependency_names;
+			StartupThread thread;
+			std::function<void()> func;
+
+			std::vector<size_t> dependencies;
+			std::vector<size_t> dependents;
+			size_t pending_dependencies = 0;
+			double start_ms = 0.0;
+			double end_ms = 0.0;
+			std::thread::id thread_id;
+		};
+
+		void ResolveDependencies();
+		// Expects _mutex to be held. Main steps are queued for Run(), worker steps are added to worker_steps for Enqueue()
+		void Schedule(size_t step, std::vector<size_t>& worker_steps);
+		void Enqueue(const std::vector<size_t>& worker_steps);
+		void Execute(size_t step);
+		std::vector<size_t> GetCriticalPath() const;
+
+		CvlThreadPool& _thread_pool;
+		std::chrono::high_resolution_clock::time_point _start_time;
+		std::thread::id _main_thread_id;
+		std::vector<Step> _steps;
+		std::optional<double> _graph_ms;
+		std::optional<double> _first_frame_ms;
+
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::deque<size_t> _main_ready;
+		size_t _finished_steps = 0;
+		size_t _running_worker_steps = 0;
+		std::exception_ptr _error;
+	};
+}
\ No newline at end of file
@@ -12,65 +12,66 @@
 namespace cvl
 {
 	/* CvlSwapchain class */
-	CvlSwapchain::CvlSwapchain(CvlDevice& device_ref, VkExtent2D extent)
-		: _device(device_ref), _window_extent(extent)
+	CvlSwapchain::CvlSwapchain(CvlDevice& device_ref, VkExtent2D extent, bool dynamic_rendering)
+		: _dynamic_rendering(dynamic_rendering), _device(device_ref), _window_extent(extent)
 	{
 		Init();
 	}
 	
 	CvlSwapchain::CvlSwapchain(CvlDevice& device_ref, VkExtent2D extent, std::shared_ptr<CvlSwapchain> previous)
-		: _device(device_ref), _window_extent(extent), _old_swap_chain(previous)
+		: _dynamic_rendering(previous->_dynamic_rendering), _device(device_ref), _window_extent(extent), _old_swap_chain(previous)
 	{
 		Init();
 
-		// Clean up old swap chain since it's no longer needed
+		// The old swap chain is retired through oldSwapchain, its frames in flight are covered by the deletion queue
 		_old_swap_chain = nullptr;
 	}
 
 	void CvlSwapchain::Init()
 	{
+		_depth_format = FindDepthFormat();
 		CreateSwapChain();
 		CreateImageViews();
-		CreateRenderPass();
 		CreateDepthResources();
-		CreateFramebuffers();
+		// With dynamic rendering a resize only has to rebuild images and views
+		if (!_dynamic_rendering)
+		{
+			CreateRenderPass();
+			CreateFramebuffers();
+		}
 		CreateSyncObjects();
 	}
 
 	CvlSwapchain::~CvlSwapchain()
 	{
+		// A replaced swap chain is destroyed right after its successor is created, while its last frames are still in flight
+		CvlDeletionQueue& deletion_queue = _device.GetDeletionQueue();
 		for (auto image_view : _swap_chain_image_views)
 		{
-			vkDestroyImageView(_device.device(), image_view, nullptr);
+			deletion_queue.DestroyImageView(image_view);
 		}
 		_swap_chain_image_views.clear();
 
-		if (_swap_chain != nullptr)
-		{
-			vkDestroySwapchainKHR(_device.device(), _swap_chain, nullptr);
-			_swap_chain = nullptr;
-		}
+		deletion_queue.DestroySwapchain(_swap_chain);
+		_swap_chain = VK_NULL_HANDLE;
 
-		for (int i = 0; i < _depth_images.size(); ++i)
-		{
-			vkDestroyImageView(_device.device(), _depth_image_views[i], nullptr);
-			vkDestroyImage(_device.device(), _depth_images[i], nullptr);
-			vkFreeMemory(_device.device(), _depth_image_memorys[i], nullptr);
-		}
+		// Depth resources are released together with the last swap chain that uses them
+		_depth_resources = nullptr;
 
 		for (auto framebuffer : _swap_chain_framebuffers)
 		{
-			vkDestroyFramebuffer(_device.device(), framebuffer, nullptr);
+			deletion_queue.DestroyFramebuffer(framebuffer);
 		}
 
-		vkDestroyRenderPass(_device.device(), _render_pass, nullptr);
+		// Null when it was handed over to a newer swap chain
+		deletion_queue.DestroyRenderPass(_render_pass);
 
-		// Cleanup synchronization objects
-		for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+		// Cleanup synchronization objects, unless they were handed over to a newer swap chain
+		for (size_t i = 0; i < _in_flight_fences.size(); ++i)
 		{
-			vkDestroySemaphore(_device.device(), _render_finished_semaphores[i], nullptr);
-			vkDestroySemaphore(_device.device(), _image_available_semaphores[i], nullptr);
-			vkDestroyFence(_device.device(), _in_flight_fences[i], nullptr);
+			deletion_queue.DestroySemaphore(_render_finished_semaphores[i]);
+			deletion_queue.DestroySemaphore(_image_available_semaphores[i]);
+			deletion_queue.DestroyFence(_in_flight_fences[i]);
 		}
 	}
 
@@ -84,6 +85,7 @@ namespace cvl
 			VK_TRUE,
 			std::numeric_limits<uint64_t>::max()
 		);
+
 		VkResult result = vkAcquireNextImageKHR
 		(
 			_device.device(),
@@ -96,7 +98,7 @@ namespace cvl
 		return result;
 	}
 
-	VkResult CvlSwapchain::SubmitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* image_index)
+	VkResult CvlSwapchain::SubmitCommandBuffers(QueueSubmission submission, uint32_t* image_index)
 	{
 		if (_images_in_flight[*image_index] != VK_NULL_HANDLE)
 		{
@@ -104,24 +106,14 @@ namespace cvl
 		}
 		_images_in_flight[*image_index] = _in_flight_fences[_current_frame];
 
-		VkSubmitInfo submit_info = {};
-		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-		VkSemaphore wait_semaphores[] = { _image_available_semaphores[_current_frame] };
-		VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		submit_info.waitSemaphoreCount = 1;
-		submit_info.pWaitSemaphores = wait_semaphores;
-		submit_info.pWaitDstStageMask = wait_stages;
-
-		submit_info.commandBufferCount = 1;
-		submit_info.pCommandBuffers = buffers;
-
+		// Image acquisition and presentation are added to the caller's dependencies
+		submission.wait_semaphores.push_back(_image_available_semaphores[_current_frame]);
+		submission.wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+		submission.signal_semaphores.push_back(_render_finished_semaphores[_current_frame]);
 		VkSemaphore signal_semaphores[] = { _render_finished_semaphores[_current_frame] };
-		submit_info.signalSemaphoreCount = 1;
-		submit_info.pSignalSemaphores = signal_semaphores;
 
 		vkResetFences(_device.device(), 1, &_in_flight_fences[_current_frame]);
-		if (vkQueueSubmit(_device.GraphicsQueue(), 1, &submit_info, _in_flight_fences[_current_frame]) != VK_SUCCESS)
+		if (_device.Submit(QueueType::Graphics, submission, _in_flight_fences[_current_frame]) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlSwapchain] Failed to submit draw command buffer!");
 		}
@@ -145,6 +137,18 @@ namespace cvl
 		return result;
 	}
 
+	void CvlSwapchain::WaitForFramesInFlight()
+	{
+		vkWaitForFences
+		(
+			_device.device(),
+			static_cast<uint32_t>(_in_flight_fences.size()),
+			_in_flight_fences.data(),
+			VK_TRUE,
+			std::numeric_limits<uint64_t>::max()
+		);
+	}
+
 	void CvlSwapchain::CreateSwapChain()
 	{
 		SwapChainSupportDetails swap_chain_support = _device.GetSwapChainSupport();
@@ -169,7 +173,10 @@ namespace cvl
 		create_info.imageColorSpace = surface_format.colorSpace;
 		create_info.imageExtent = extent;
 		create_info.imageArrayLayers = 1;
-		create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		// Transfer destination allows blitting a lower resolution image into the swap chain
+		_image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		_image_usage |= swap_chain_support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		create_info.imageUsage = _image_usage;
 
 		QueueFamilyIndices indices = _device.FindPhysicalQueueFamilies();
 		uint32_t queue_family_indices[] = { indices.graphics_family.value(), indices.present_family.value() };
@@ -195,7 +202,7 @@ namespace cvl
 
 		create_info.oldSwapchain = _old_swap_chain == nullptr ? VK_NULL_HANDLE : _old_swap_chain->_swap_chain;
 
-		if (vkCreateSwapchainKHR(_device.device(), &create_info, nullptr, &_swap_chain) != VK_SUCCESS)
+		if (vkCreateSwapchainKHR(_device.device(), &create_info, _device.GetAllocator(), &_swap_chain) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlSwapchain] Failed to create swap chain!");
 		}
@@ -233,7 +240,7 @@ namespace cvl
 			create_info.subresourceRange.levelCount = 1;
 			create_info.subresourceRange.baseArrayLayer = 0;
 			create_info.subresourceRange.layerCount = 1;
-			if (vkCreateImageView(_device.device(), &create_info, nullptr, &_swap_chain_image_views[i]) != VK_SUCCESS)
+			if (vkCreateImageView(_device.device(), &create_info, _device.GetAllocator(), &_swap_chain_image_views[i]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("[CvlSwapchain] Failed to create image views!");
 			}
@@ -242,8 +249,16 @@ namespace cvl
 
 	void CvlSwapchain::CreateRenderPass()
 	{
+		// A render pass with the same attachment formats can be adopted from the previous swap chain
+		if (_old_swap_chain != nullptr && _old_swap_chain->_render_pass != VK_NULL_HANDLE && CompareSwapFormats(*_old_swap_chain))
+		{
+			_render_pass = _old_swap_chain->_render_pass;
+			_old_swap_chain->_render_pass = VK_NULL_HANDLE;
+			return;
+		}
+
 		VkAttachmentDescription depth_attachment = {};
-		depth_attachment.format = FindDepthFormat();
+		depth_attachment.format = _depth_format;
 		depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
 		depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
 		depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -276,16 +291,17 @@ namespace cvl
 		subpass.pColorAttachments = &color_attachment_ref;
 		subpass.pDepthStencilAttachment = &depth_attachment_ref;
 
+		// The depth attachment is shared by all frames, so wait for the previous frame's depth writes
 		VkSubpassDependency dependency = {};
 		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.srcAccessMask = 0;
+		dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 		dependency.srcStageMask =
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		dependency.dstSubpass = 0;
 		dependency.dstStageMask = 
-			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		dependency.dstAccessMask =
-			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
 		VkAttachmentDescription attachments[] = { color_attachment, depth_attachment };
 		VkRenderPassCreateInfo render_pass_info = {};
@@ -297,7 +313,7 @@ namespace cvl
 		render_pass_info.dependencyCount = 1;
 		render_pass_info.pDependencies = &dependency;
 
-		if (vkCreateRenderPass(_device.device(), &render_pass_info, nullptr, &_render_pass) != VK_SUCCESS)
+		if (vkCreateRenderPass(_device.device(), &render_pass_info, _device.GetAllocator(), &_render_pass) != VK_SUCCESS)
 		{
 			throw std::runtime_error("[CvlSwapchain] Failed to create render pass!");
 		}
@@ -305,55 +321,135 @@ namespace cvl
 
 	void CvlSwapchain::CreateDepthResources()
 	{
-		VkFormat depth_format = FindDepthFormat();
+		VkFormat depth_format = _depth_format;
 		VkExtent2D swap_chain_extent = GetSwapChainExtent();
 
-		_depth_images.resize(ImageCount());
-		_depth_image_memorys.resize(ImageCount());
-		_depth_image_views.resize(ImageCount());
+		// Only the render graph reads depth after rendering, the render pass path keeps it transient
+		bool sampled = _dynamic_rendering &&
+			_device.IsFormatFeatureSupported(depth_format, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 
-		for (int i = 0; i < _depth_images.size(); ++i)
+		if (_old_swap_chain != nullptr)
 		{
-			VkImageCreateInfo image_info = {};
-			image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-			image_info.imageType = VK_IMAGE_TYPE_2D;
-			image_info.extent.width = swap_chain_extent.width;
-			image_info.extent.height = swap_chain_extent.height;
-			image_info.extent.depth = 1;
-			image_info.mipLevels = 1;
-			image_info.arrayLayers = 1;
-			image_info.format = depth_format;
-			image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-			image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-			image_info.samples = VK_SAMPLE_COUNT_1_BIT;
-			image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-			image_info.flags = 0;
-
-			_device.CreateImageWithInfo
-			(
-				image_info,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				_depth_images[i],
-				_depth_image_memorys[i]
-			);
-
-			VkImageViewCreateInfo view_info = {};
-			view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			view_info.image = _depth_images[i];
-			view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-			view_info.format = depth_format;
-			view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-			view_info.subresourceRange.baseMipLevel = 0;
-			view_info.subresourceRange.levelCount = 1;
-			view_info.subresourceRange.baseArrayLayer = 0;
-			view_info.subresourceRange.layerCount = 1;
-
-			if (vkCreateImageView(_device.device(), &view_info, nullptr, &_depth_image_views[i]) != VK_SUCCESS)
+			auto& previous = _old_swap_chain->_depth_resources;
+			if (previous->format == depth_format && previous->sampled == sampled &&
+				previous->extent.width >= swap_chain_extent.width && previous->extent.height >= swap_chain_extent.height)
 			{
-				throw std::runtime_error("[CvlSwapchain] Failed to create texture image view!");
+				_depth_resources = previous;
+				return;
 			}
 		}
+
+		// Round up so that the next few resizes can keep using this image
+		uint32_t max_dimension = _device.GetPhysicalDeviceProperties().limits.maxImageDimension2D;
+		auto round_up = [max_dimension](uint32_t value)
+		{
+			uint32_t rounded = (value + DEPTH_EXTENT_GRANULARITY - 1) / DEPTH_EXTENT_GRANULARITY * DEPTH_EXTENT_GRANULARITY;
+			return std::min(rounded, max_dimension);
+		};
+
+		_depth_resources = std::make_shared<DepthResources>(_device);
+		_depth_resources->format = depth_format;
+		_depth_resources->extent = { round_up(swap_chain_extent.width), round_up(swap_chain_extent.height) };
+		_depth_resources->sampled = sampled;
+
+		// Without sampling, depth is cleared on load and discarded on store, so it never has to leave tile memory
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.extent.width = _depth_resources->extent.width;
+		image_info.extent.height = _depth_resources->extent.height;
+		image_info.extent.depth = 1;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.format = depth_format;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+			(sampled ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT);
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.flags = 0;
+
+		VkMemoryPropertyFlags memory_flags = _device.CreateImageWithInfo
+		(
+			image_info,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			MemoryCategory::Attachments,
+			_depth_resources->image,
+			_depth_resources->memory,
+			sampled ? 0 : VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+		);
+		_depth_resources->lazily_allocated = (memory_flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = _depth_resources->image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		view_info.format = depth_format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+		view_info.subresourceRange.baseMipLevel = 0;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(_device.device(), &view_info, _device.GetAllocator(), &_depth_resources->view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlSwapchain] Failed to create texture image view!");
+		}
+
+		ReportDepthMemory();
+	}
+
+	void CvlSwapchain::ReportDepthMemory()
+	{
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(_device.device(), _depth_resources->image, &requirements);
+		VkDeviceSize committed = requirements.size;
+		if (_depth_resources->lazily_allocated)
+		{
+			vkGetDeviceMemoryCommitment(_device.device(), _depth_resources->memory, &committed);
+		}
+
+		// Compare against one depth image per swap chain image at 4K with triple buffering
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.extent = { 3840, 2160, 1 };
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.format = _depth_resources->format;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		VkImage probe_image;
+		if (vkCreateImage(_device.device(), &image_info, _device.GetAllocator(), &probe_image) != VK_SUCCESS)
+		{
+			return;
+		}
+		VkMemoryRequirements uhd_requirements;
+		vkGetImageMemoryRequirements(_device.device(), probe_image, &uhd_requirements);
+		vkDestroyImage(_device.device(), probe_image, _device.GetAllocator());
+
+		constexpr double MB = 1024.0 * 1024.0;
+		constexpr VkDeviceSize TRIPLE_BUFFERING = 3;
+		VkDeviceSize uhd_before = uhd_requirements.size * TRIPLE_BUFFERING;
+		VkDeviceSize uhd_after = _depth_resources->lazily_allocated ? 0 : uhd_requirements.size;
+		std::cout << "[CvlSwapchain] Depth: 1 image " << _depth_resources->extent.width << 'x' << _depth_resources->extent.height
+			<< ", lazily allocated: " << (_depth_resources->lazily_allocated ? "yes" : "no")
+			<< ", committed " << committed / MB << " MB instead of " << requirements.size * ImageCount() / MB << " MB"
+			<< "; at 3840x2160 with triple buffering " << uhd_before / MB << " MB -> " << uhd_after / MB << " MB"
+			<< " (saves " << (uhd_before - uhd_after) / MB << " MB)\n";
+	}
+
+	CvlSwapchain::DepthResources::~DepthResources()
+	{
+		CvlDeletionQueue& deletion_queue = device.GetDeletionQueue();
+		deletion_queue.DestroyImageView(view);
+		deletion_queue.DestroyImage(image);
+		deletion_queue.FreeMemory(memory);
 	}
 
 	void CvlSwapchain::CreateFramebuffers()
@@ -361,7 +457,7 @@ namespace cvl
 		_swap_chain_framebuffers.resize(ImageCount());
 		for (size_t i = 0; i < ImageCount(); ++i)
 		{
-			VkImageView attachments[] = { _swap_chain_image_views[i], _depth_image_views[i] };
+			VkImageView attachments[] = { _swap_chain_image_views[i], _depth_resources->view };
 
 			VkExtent2D swap_chain_extent = GetSwapChainExtent();
 			VkFramebufferCreateInfo framebuffer_info = {};
@@ -373,7 +469,7 @@ namespace cvl
 			framebuffer_info.height = swap_chain_extent.height;
 			framebuffer_info.layers = 1;
 
-			if (vkCreateFramebuffer(_device.device(), &framebuffer_info, nullptr, &_swap_chain_framebuffers[i]) != VK_SUCCESS)
+			if (vkCreateFramebuffer(_device.device(), &framebuffer_info, _device.GetAllocator(), &_swap_chain_framebuffers[i]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("[CvlSwapchain] Failed to create framebuffer!");
 			}
@@ -382,10 +478,24 @@ namespace cvl
 
 	void CvlSwapchain::CreateSyncObjects()
 	{
+		_images_in_flight.assign(ImageCount(), VK_NULL_HANDLE);
+
+		// Per-frame sync objects outlive the swap chain, take them over from the previous one
+		if (_old_swap_chain != nullptr)
+		{
+			_image_available_semaphores = std::move(_old_swap_chain->_image_available_semaphores);
+			_render_finished_semaphores = std::move(_old_swap_chain->_render_finished_semaphores);
+			_in_flight_fences = std::move(_old_swap_chain->_in_flight_fences);
+			_old_swap_chain->_image_available_semaphores.clear();
+			_old_swap_chain->_render_finished_semaphores.clear();
+			_old_swap_chain->_in_flight_fences.clear();
+			_current_frame = _old_swap_chain->_current_frame;
+			return;
+		}
+
 		_image_available_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		_render_finished_semaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		_in_flight_fences.resize(MAX_FRAMES_IN_FLIGHT);
-		_images_in_flight.resize(ImageCount(), VK_NULL_HANDLE);
 
 		VkSemaphoreCreateInfo semaphore_info = {};
 		semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -396,11 +506,11 @@ namespace cvl
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
 		{
-			if (vkCreateSemaphore(_device.device(), &semaphore_info, nullptr, &_image_available_semaphores[i])
+			if (vkCreateSemaphore(_device.device(), &semaphore_info, _device.GetAllocator(), &_image_available_semaphores[i])
 				!= VK_SUCCESS ||
-				vkCreateSemaphore(_device.device(), &semaphore_info, nullptr, &_render_finished_semaphores[i])
+				vkCreateSemaphore(_device.device(), &semaphore_info, _device.GetAllocator(), &_render_finished_semaphores[i])
 				!= VK_SUCCESS ||
-				vkCreateFence(_device.device(), &fence_info, nullptr, &_in_flight_fences[i])
+				vkCreateFence(_device.device(), &fence_info, _device.GetAllocator(), &_in_flight_fences[i])
 				!= VK_SUCCESS)
 			{
 				throw std::runtime_error("[CvlSwapchain] Failed to create synchronization objects for a frame!");
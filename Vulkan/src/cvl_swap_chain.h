@@ -13,7 +13,7 @@ namespace cvl
 	class CvlSwapchain
 	{
 	public:
-		CvlSwapchain(CvlDevice& device_ref, VkExtent2D extent);
+		CvlSwapchain(CvlDevice& device_ref, VkExtent2D extent, bool dynamic_rendering = false);
 		CvlSwapchain(CvlDevice& device_ref, VkExtent2D extent, std::shared_ptr<CvlSwapchain> previous);
 		~CvlSwapchain();
 
@@ -23,8 +23,17 @@ namespace cvl
 		VkFramebuffer GetFramebuffer(int index) { return _swap_chain_framebuffers[index]; }
 		VkRenderPass GetRenderPass() { return _render_pass; }
 		VkImageView GetImageView(int index) { return _swap_chain_image_views[index]; }
+		VkImage GetImage(int index) { return _swap_chain_images[index]; }
+		// A single depth attachment is shared by all frames, frames are ordered on the graphics queue
+		VkImage GetDepthImage() { return _depth_resources->image; }
+		VkImageView GetDepthImageView() { return _depth_resources->view; }
+		// With dynamic rendering the depth image can be sampled by compute passes after rendering, see CvlHiZPyramid
+		bool IsDepthSampled() { return _depth_resources->sampled; }
+		bool UsesDynamicRendering() { return _dynamic_rendering; }
 		size_t ImageCount() { return _swap_chain_images.size(); }
 		VkFormat GetSwapChainImageFormat() { return _swap_chain_image_format; }
+		VkImageUsageFlags GetImageUsage() { return _image_usage; }
+		VkFormat GetDepthFormat() { return _depth_format; }
 		VkExtent2D GetSwapChainExtent() { return _swap_chain_extent; }
 		uint32_t width() { return _swap_chain_extent.width; }
 		uint32_t height() { return _swap_chain_extent.height; }
@@ -34,17 +43,46 @@ namespace cvl
 			return static_cast<float>(_swap_chain_extent.width) / static_cast<float>(_swap_chain_extent.height);
 		}
 		VkFormat FindDepthFormat();
+		bool CompareSwapFormats(const CvlSwapchain& other) const
+		{
+			return _swap_chain_image_format == other._swap_chain_image_format && _depth_format == other._depth_format;
+		}
 
 		VkResult AquireNextImage(uint32_t* image_index);
-		VkResult SubmitCommandBuffers(const VkCommandBuffer* buffers, uint32_t* image_index);
+		// Waits for the acquired image and signals presentation on top of the submission's own semaphores
+		VkResult SubmitCommandBuffers(QueueSubmission submission, uint32_t* image_index);
+		size_t GetCurrentFrame() { return _current_frame; }
+		void WaitForFramesInFlight();
 
 		static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+		// Depth images are allocated in steps so dragging a window edge doesn't reallocate every frame
+		static constexpr uint32_t DEPTH_EXTENT_GRANULARITY = 256;
 
 	private:
+		// Shared between a swapchain and its successor while they are large enough to be reused
+		struct DepthResources
+		{
+			DepthResources(CvlDevice& device_ref) : device(device_ref) {}
+			~DepthResources();
+
+			DepthResources(const DepthResources&) = delete;
+			DepthResources& operator=(const DepthResources&) = delete;
+
+			CvlDevice& device;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			VkExtent2D extent = {};
+			VkImage image = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+			bool lazily_allocated = false;
+			bool sampled = false;
+		};
+
 		void Init();
 		void CreateSwapChain();
 		void CreateImageViews();
 		void CreateDepthResources();
+		void ReportDepthMemory();
 		void CreateRenderPass();
 		void CreateFramebuffers();
 		void CreateSyncObjects();
@@ -54,14 +92,16 @@ namespace cvl
 		VkExtent2D ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
 		VkFormat _swap_chain_image_format;
+		VkImageUsageFlags _image_usage = 0;
+		VkFormat _depth_format;
 		VkExtent2D _swap_chain_extent;
 		
+		// Render pass and framebuffers are only created when dynamic rendering is off
+		bool _dynamic_rendering = false;
 		std::vector<VkFramebuffer> _swap_chain_framebuffers;
-		VkRenderPass _render_pass;
+		VkRenderPass _render_pass = VK_NULL_HANDLE;
 
-		std::vector<VkImage> _depth_images;
-		std::vector<VkDeviceMemory> _depth_image_memorys;
-		std::vector<VkImageView> _depth_image_views;
+		std::shared_ptr<DepthResources> _depth_resources;
 		std::vector<VkImage> _swap_chain_images;
 		std::vector<VkImageView> _swap_chain_image_views;
 
@@ -69,6 +109,7 @@ namespace cvl
 		VkExtent2D _window_extent;
 
 		VkSwapchainKHR _swap_chain;
+		// Only set while the swap chain is created, its objects are reused or retired through oldSwapchain
 		std::shared_ptr<CvlSwapchain> _old_swap_chain;
 
 		std::vector<VkSemaphore> _image_available_semaphores;
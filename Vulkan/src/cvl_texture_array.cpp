@@ -0,0 +1,152 @@
+#include "cvl_texture_array.h"
+
+#include <cstring>
+#include <stdexcept>
+
+namespace cvl
+{
+	/* CvlTextureArray class */
+	CvlTextureArray::CvlTextureArray(CvlDevice& device, uint32_t width, uint32_t height, uint32_t layer_count, VkFormat format)
+		: _cvl_device(device), _width(width), _height(height), _layer_count(layer_count), _format(format)
+	{
+		VkImageCreateInfo image_info = {};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = _format;
+		image_info.extent = { _width, _height, 1 };
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = _layer_count;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		_cvl_device.CreateImageWithInfo(image_info, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Textures, _image, _image_memory);
+
+		VkImageViewCreateInfo view_info = {};
+		view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		view_info.image = _image;
+		view_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		view_info.format = _format;
+		view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		view_info.subresourceRange.baseMipLevel = 0;
+		view_info.subresourceRange.levelCount = 1;
+		view_info.subresourceRange.baseArrayLayer = 0;
+		view_info.subresourceRange.layerCount = _layer_count;
+
+		if (vkCreateImageView(_cvl_device.device(), &view_info, _cvl_device.GetAllocator(), &_image_view) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlTextureArray] Failed to create image view!");
+		}
+
+		VkSamplerCreateInfo sampler_info = {};
+		sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		sampler_info.magFilter = VK_FILTER_LINEAR;
+		sampler_info.minFilter = VK_FILTER_LINEAR;
+		sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		sampler_info.maxLod = 0.0f;
+
+		if (vkCreateSampler(_cvl_device.device(), &sampler_info, _cvl_device.GetAllocator(), &_sampler) != VK_SUCCESS)
+		{
+			throw std::runtime_error("[CvlTextureArray] Failed to create sampler!");
+		}
+	}
+
+	CvlTextureArray::~CvlTextureArray()
+	{
+		vkDestroySampler(_cvl_device.device(), _sampler, _cvl_device.GetAllocator());
+		vkDestroyImageView(_cvl_device.device(), _image_view, _cvl_device.GetAllocator());
+		vkDestroyImage(_cvl_device.device(), _image, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(_image_memory);
+	}
+
+	void CvlTextureArray::Upload(const void* pixels, VkDeviceSize size)
+	{
+		VkBufferImageCopy region = {};
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, _layer_count };
+		region.imageExtent = { _width, _height, 1 };
+		// Previous contents are replaced entirely, so they don't need to be preserved
+		UploadStaged(pixels, size, { region }, VK_IMAGE_LAYOUT_UNDEFINED);
+	}
+
+	void CvlTextureArray::UploadRegions(const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions)
+	{
+		UploadStaged(data, size, regions, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+
+	void CvlTextureArray::Clear(const VkClearColorValue& color)
+	{
+		TransitionLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		VkCommandBuffer command_buffer = _cvl_device.BeginSingleTimeCommands();
+		VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, _layer_count };
+		vkCmdClearColorImage(command_buffer, _image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &color, 1, &range);
+		_cvl_device.EndSingleTimeCommands(command_buffer);
+		TransitionLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	}
+
+	// private
+	void CvlTextureArray::UploadStaged(const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions, VkImageLayout old_layout)
+	{
+		VkBuffer staging_buffer;
+		VkDeviceMemory staging_buffer_memory;
+		_cvl_device.CreateBuffer
+		(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			MemoryCategory::Staging,
+			staging_buffer,
+			staging_buffer_memory
+		);
+		void* mapped;
+		vkMapMemory(_cvl_device.device(), staging_buffer_memory, 0, size, 0, &mapped);
+		memcpy(mapped, data, static_cast<size_t>(size));
+		vkUnmapMemory(_cvl_device.device(), staging_buffer_memory);
+
+		TransitionLayout(old_layout, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		_cvl_device.CopyBufferToImage(staging_buffer, _image, regions);
+		TransitionLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+		vkDestroyBuffer(_cvl_device.device(), staging_buffer, _cvl_device.GetAllocator());
+		_cvl_device.FreeMemory(staging_buffer_memory);
+	}
+
+	void CvlTextureArray::TransitionLayout(VkImageLayout old_layout, VkImageLayout new_layout)
+	{
+		VkCommandBuffer command_buffer = _cvl_device.BeginSingleTimeCommands();
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = old_layout;
+		barrier.newLayout = new_layout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = _image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, _layer_count };
+
+		VkPipelineStageFlags src_stage;
+		VkPipelineStageFlags dst_stage;
+		if (new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+		{
+			// Waits for earlier sampling when the contents are replaced or updated
+			barrier.srcAccessMask = 0;
+			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			src_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		}
+		else
+		{
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		}
+		vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		_cvl_device.EndSingleTimeCommands(command_buffer);
+	}
+	/* ~CvlTextureArray class */
+}
\ No newline at end of file
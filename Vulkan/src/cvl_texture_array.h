@@ -0,0 +1,53 @@
+#pragma once
+
+#include "cvl_device.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Sampled 2D array image with a view and a linear clamp-to-edge sampler.
+		Layers are uploaded through a staging buffer and left in SHADER_READ_ONLY_OPTIMAL.
+	*/
+	class CvlTextureArray
+	{
+	public:
+		CvlTextureArray(CvlDevice& device, uint32_t width, uint32_t height, uint32_t layer_count, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+		~CvlTextureArray();
+
+		CvlTextureArray(const CvlTextureArray&) = delete;
+		CvlTextureArray& operator=(const CvlTextureArray&) = delete;
+
+		// Every layer at once, tightly packed layer after layer, waits for the copy to complete
+		void Upload(const void* pixels, VkDeviceSize size);
+		// Regions' buffer offsets index into data, texels outside the regions are preserved.
+		// The image must have been filled by Upload or Clear before
+		void UploadRegions(const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions);
+		void Clear(const VkClearColorValue& color);
+
+		VkImage GetImage() { return _image; }
+		VkImageView GetImageView() { return _image_view; }
+		VkSampler GetSampler() { return _sampler; }
+		uint32_t GetWidth() const { return _width; }
+		uint32_t GetHeight() const { return _height; }
+		uint32_t GetLayerCount() const { return _layer_count; }
+		VkFormat GetFormat() const { return _format; }
+
+	private:
+		void UploadStaged(const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions, VkImageLayout old_layout);
+		void TransitionLayout(VkImageLayout old_layout, VkImageLayout new_layout);
+
+		CvlDevice& _cvl_device;
+		uint32_t _width;
+		uint32_t _height;
+		uint32_t _layer_count;
+		VkFormat _format;
+
+		VkImage _image;
+		VkDeviceMemory _image_memory;
+		VkImageView _image_view;
+		VkSampler _sampler;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,348 @@
+#include "cvl_texture_atlas.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+
+namespace cvl
+{
+	template<typename Rect>
+	static bool Intersects(const Rect& a, const Rect& b)
+	{
+		return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+	}
+
+	template<typename Rect>
+	static bool Contains(const Rect& outer, const Rect& inner)
+	{
+		return inner.x >= outer.x && inner.y >= outer.y
+			&& inner.x + inner.width <= outer.x + outer.width && inner.y + inner.height <= outer.y + outer.height;
+	}
+
+	/* CvlTextureAtlas class */
+	CvlTextureAtlas::CvlTextureAtlas(CvlDevice& device, uint32_t page_size, uint32_t page_count, uint32_t gutter)
+		: _cvl_device(device), _page_size(page_size), _gutter(gutter), _pages(page_count)
+	{
+		_texture = std::make_unique<CvlTextureArray>(_cvl_device, _page_size, _page_size, page_count);
+		// Sub-region uploads preserve the rest of the page, so it has to start out defined
+		_texture->Clear({ { 0.0f, 0.0f, 0.0f, 0.0f } });
+		for (Page& page : _pages)
+		{
+			ResetPage(page);
+		}
+	}
+
+	AtlasHandle CvlTextureAtlas::Insert(uint32_t width, uint32_t height, const uint8_t* pixels)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		auto record_latency = [this, start]()
+		{
+			double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+			_insert_us_sum += us;
+			_insert_us_max = std::max(_insert_us_max, us);
+		};
+		++_inserts;
+
+		uint32_t page_index;
+		Rect rect;
+		if (width == 0 || height == 0 || !FindPosition(width + 2 * _gutter, height + 2 * _gutter, page_index, rect))
+		{
+			++_failed_inserts;
+			record_latency();
+			return INVALID_ATLAS_HANDLE;
+		}
+		Page& page = _pages[page_index];
+		PlaceRect(page, rect);
+		++page.images;
+		page.image_texels += static_cast<uint64_t>(width) * height;
+
+		AtlasHandle handle;
+		if (!_free_handles.empty())
+		{
+			handle = _free_handles.back();
+			_free_handles.pop_back();
+		}
+		else
+		{
+			handle = static_cast<AtlasHandle>(_entries.size());
+			_entries.emplace_back();
+		}
+		float scale = 1.0f / static_cast<float>(_page_size);
+		Entry& entry = _entries[handle];
+		entry.rect = rect;
+		entry.page = page_index;
+		entry.texels = static_cast<uint64_t>(width) * height;
+		entry.region.uv_rect = glm::vec4
+		(
+			static_cast<float>(rect.x + _gutter) * scale,
+			static_cast<float>(rect.y + _gutter) * scale,
+			static_cast<float>(rect.x + _gutter + width) * scale,
+			static_cast<float>(rect.y + _gutter + height) * scale
+		);
+		entry.region.layer = page_index;
+		entry.alive = true;
+
+		StageTexels(rect, page_index, width, height, pixels);
+		record_latency();
+		return handle;
+	}
+
+	void CvlTextureAtlas::Evict(AtlasHandle handle)
+	{
+		if (handle >= _entries.size() || !_entries[handle].alive)
+		{
+			throw std::runtime_error("[CvlTextureAtlas] Failed to evict, invalid handle!");
+		}
+		Entry& entry = _entries[handle];
+		Page& page = _pages[entry.page];
+		entry.alive = false;
+		// A copy still staged for the region would overlap whatever gets inserted there before the next Flush,
+		// and overlapping regions in one copy command are undefined. Its texels stay in the staging data unused
+		auto pending = std::find_if(_pending_copies.begin(), _pending_copies.end(), [&entry](const VkBufferImageCopy& copy)
+		{
+			return copy.imageSubresource.baseArrayLayer == entry.page
+				&& copy.imageOffset.x == static_cast<int32_t>(entry.rect.x) && copy.imageOffset.y == static_cast<int32_t>(entry.rect.y);
+		});
+		if (pending != _pending_copies.end())
+		{
+			_pending_copies.erase(pending);
+		}
+		--page.images;
+		page.image_texels -= entry.texels;
+		if (page.images == 0)
+		{
+			ResetPage(page);
+		}
+		else
+		{
+			FreeRect(page, entry.rect);
+		}
+		_free_handles.push_back(handle);
+		++_evictions;
+	}
+
+	void CvlTextureAtlas::Flush()
+	{
+		// Everything staged may have been evicted already, its texels still have to go
+		if (!_pending_copies.empty())
+		{
+			_texture->UploadRegions(_pending_texels.data(), _pending_texels.size(), _pending_copies);
+		}
+		_pending_texels.clear();
+		_pending_copies.clear();
+	}
+
+	AtlasStats CvlTextureAtlas::GetStats() const
+	{
+		AtlasStats stats = {};
+		uint64_t image_texels = 0;
+		for (const Page& page : _pages)
+		{
+			stats.regions += page.images;
+			if (page.images > 0)
+			{
+				++stats.pages_used;
+				image_texels += page.image_texels;
+			}
+		}
+		if (stats.pages_used > 0)
+		{
+			stats.packing_efficiency = static_cast<float>(static_cast<double>(image_texels) / (static_cast<double>(_page_size) * _page_size * stats.pages_used));
+		}
+		stats.inserts = _inserts;
+		stats.failed_inserts = _failed_inserts;
+		stats.evictions = _evictions;
+		stats.insert_us_avg = _inserts > 0 ? _insert_us_sum / _inserts : 0.0;
+		stats.insert_us_max = _insert_us_max;
+		return stats;
+	}
+
+	void CvlTextureAtlas::ReportStats() const
+	{
+		AtlasStats stats = GetStats();
+		std::cout << "[CvlTextureAtlas] " << stats.regions << " images on " << stats.pages_used << "/" << _pages.size() << " pages of "
+			<< _page_size << "x" << _page_size << ", " << stats.packing_efficiency * 100.0f << "% packing efficiency, "
+			<< stats.inserts << " inserts (" << stats.failed_inserts << " failed, " << stats.insert_us_avg << " us avg, "
+			<< stats.insert_us_max << " us max), " << stats.evictions << " evictions\n";
+	}
+
+	// private
+	bool CvlTextureAtlas::FindPosition(uint32_t width, uint32_t height, uint32_t& page_index, Rect& rect) const
+	{
+		// First page with room keeps the number of pages in use low, best short side fit within it
+		for (uint32_t p = 0; p < _pages.size(); ++p)
+		{
+			uint32_t best_short = UINT32_MAX;
+			uint32_t best_long = UINT32_MAX;
+			for (const Rect& free_rect : _pages[p].free_rects)
+			{
+				if (free_rect.width < width || free_rect.height < height)
+				{
+					continue;
+				}
+				uint32_t leftover_x = free_rect.width - width;
+				uint32_t leftover_y = free_rect.height - height;
+				uint32_t short_side = std::min(leftover_x, leftover_y);
+				uint32_t long_side = std::max(leftover_x, leftover_y);
+				if (short_side < best_short || (short_side == best_short && long_side < best_long))
+				{
+					best_short = short_side;
+					best_long = long_side;
+					rect = { free_rect.x, free_rect.y, width, height };
+				}
+			}
+			if (best_short != UINT32_MAX)
+			{
+				page_index = p;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void CvlTextureAtlas::PlaceRect(Page& page, const Rect& used)
+	{
+		// Every free rectangle overlapping the new image is replaced by up to four maximal pieces around it
+		std::vector<Rect>& free_rects = page.free_rects;
+		_split_scratch.clear();
+		for (size_t i = 0; i < free_rects.size();)
+		{
+			Rect free_rect = free_rects[i];
+			if (!Intersects(free_rect, used))
+			{
+				++i;
+				continue;
+			}
+			uint32_t free_right = free_rect.x + free_rect.width;
+			uint32_t free_bottom = free_rect.y + free_rect.height;
+			uint32_t used_right = used.x + used.width;
+			uint32_t used_bottom = used.y + used.height;
+			if (used.x > free_rect.x)
+			{
+				_split_scratch.push_back({ free_rect.x, free_rect.y, used.x - free_rect.x, free_rect.height });
+			}
+			if (used_right < free_right)
+			{
+				_split_scratch.push_back({ used_right, free_rect.y, free_right - used_right, free_rect.height });
+			}
+			if (used.y > free_rect.y)
+			{
+				_split_scratch.push_back({ free_rect.x, free_rect.y, free_rect.width, used.y - free_rect.y });
+			}
+			if (used_bottom < free_bottom)
+			{
+				_split_scratch.push_back({ free_rect.x, used_bottom, free_rect.width, free_bottom - used_bottom });
+			}
+			free_rects[i] = free_rects.back();
+			free_rects.pop_back();
+		}
+
+		// Untouched rectangles contain no other, so only the pieces can be redundant
+		size_t untouched = free_rects.size();
+		for (const Rect& split : _split_scratch)
+		{
+			bool redundant = false;
+			for (size_t i = 0; i < free_rects.size() && !redundant; ++i)
+			{
+				redundant = Contains(free_rects[i], split);
+			}
+			if (redundant)
+			{
+				continue;
+			}
+			for (size_t i = untouched; i < free_rects.size();)
+			{
+				if (Contains(split, free_rects[i]))
+				{
+					free_rects[i] = free_rects.back();
+					free_rects.pop_back();
+					continue;
+				}
+				++i;
+			}
+			free_rects.push_back(split);
+		}
+	}
+
+	void CvlTextureAtlas::FreeRect(Page& page, Rect freed)
+	{
+		// The freed area overlaps no free rectangle, grow it over neighbours sharing a full edge until none is left
+		std::vector<Rect>& free_rects = page.free_rects;
+		bool merged = true;
+		while (merged)
+		{
+			merged = false;
+			for (size_t i = 0; i < free_rects.size(); ++i)
+			{
+				const Rect& other = free_rects[i];
+				bool vertical = other.x == freed.x && other.width == freed.width
+					&& (other.y + other.height == freed.y || freed.y + freed.height == other.y);
+				bool horizontal = other.y == freed.y && other.height == freed.height
+					&& (other.x + other.width == freed.x || freed.x + freed.width == other.x);
+				if (!vertical && !horizontal)
+				{
+					continue;
+				}
+				Rect combined =
+				{
+					std::min(freed.x, other.x),
+					std::min(freed.y, other.y),
+					vertical ? freed.width : freed.width + other.width,
+					vertical ? freed.height + other.height : freed.height
+				};
+				freed = combined;
+				free_rects[i] = free_rects.back();
+				free_rects.pop_back();
+				merged = true;
+				break;
+			}
+		}
+		// A neighbour may have been part of a larger overlapping free rectangle that now lies inside the merged one
+		for (size_t i = 0; i < free_rects.size();)
+		{
+			if (Contains(freed, free_rects[i]))
+			{
+				free_rects[i] = free_rects.back();
+				free_rects.pop_back();
+				continue;
+			}
+			++i;
+		}
+		free_rects.push_back(freed);
+	}
+
+	void CvlTextureAtlas::ResetPage(Page& page)
+	{
+		page.free_rects.assign(1, { 0, 0, _page_size, _page_size });
+		page.images = 0;
+		page.image_texels = 0;
+	}
+
+	void CvlTextureAtlas::StageTexels(const Rect& rect, uint32_t page_index, uint32_t width, uint32_t height, const uint8_t* pixels)
+	{
+		// Gutter texels repeat the nearest edge texel, like clamp-to-edge addressing
+		size_t offset = _pending_texels.size();
+		_pending_texels.resize(offset + static_cast<size_t>(rect.width) * rect.height * 4);
+		uint8_t* dst = &_pending_texels[offset];
+		for (uint32_t y = 0; y < rect.height; ++y)
+		{
+			uint32_t src_y = static_cast<uint32_t>(std::clamp(static_cast<int64_t>(y) - _gutter, int64_t(0), static_cast<int64_t>(height) - 1));
+			const uint8_t* src_row = pixels + static_cast<size_t>(src_y) * width * 4;
+			for (uint32_t x = 0; x < rect.width; ++x)
+			{
+				uint32_t src_x = static_cast<uint32_t>(std::clamp(static_cast<int64_t>(x) - _gutter, int64_t(0), static_cast<int64_t>(width) - 1));
+				std::copy_n(src_row + src_x * 4, 4, dst);
+				dst += 4;
+			}
+		}
+
+		VkBufferImageCopy copy = {};
+		copy.bufferOffset = offset;
+		copy.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, page_index, 1 };
+		copy.imageOffset = { static_cast<int32_t>(rect.x), static_cast<int32_t>(rect.y), 0 };
+		copy.imageExtent = { rect.width, rect.height, 1 };
+		_pending_copies.push_back(copy);
+	}
+	/* ~CvlTextureAtlas class */
+}
\ No newline at end of file
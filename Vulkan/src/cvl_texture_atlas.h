@@ -0,0 +1,114 @@
+#pragma once
+
+#include "cvl_device.h"
+#include "cvl_texture_array.h"
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cvl
+{
+	using AtlasHandle = uint32_t;
+	constexpr AtlasHandle INVALID_ATLAS_HANDLE = UINT32_MAX;
+
+	// Where an inserted image ended up
+	struct AtlasRegion
+	{
+		glm::vec4 uv_rect;	// xy = min, zw = max
+		uint32_t layer;
+	};
+
+	struct AtlasStats
+	{
+		uint32_t regions = 0;
+		uint32_t pages_used = 0;
+		// Texels of the live images over the area of the pages holding them, gutters and free space count as waste
+		float packing_efficiency = 0.0f;
+		uint32_t inserts = 0;
+		uint32_t failed_inserts = 0;
+		uint32_t evictions = 0;
+		double insert_us_avg = 0.0;
+		double insert_us_max = 0.0;
+	};
+
+	/*
+		Packs RGBA8 images into the layers (pages) of one CvlTextureArray, so everything in the atlas is sampled
+		through a single descriptor. Placement is MaxRects with best short side fit on the first page that has room.
+		Every image is surrounded by a gutter of replicated edge texels so filtering never reaches a neighbour.
+		Insert() only packs and stages texels on the CPU, Flush() uploads all staged images as sub-region copies of one submission.
+		Evicted space becomes a free rectangle again, merged with free neighbours sharing a full edge, and an empty page is reset.
+	*/
+	class CvlTextureAtlas
+	{
+	public:
+		CvlTextureAtlas(CvlDevice& device, uint32_t page_size, uint32_t page_count, uint32_t gutter = 2);
+
+		CvlTextureAtlas(const CvlTextureAtlas&) = delete;
+		CvlTextureAtlas& operator=(const CvlTextureAtlas&) = delete;
+
+		// pixels are width * height tightly packed RGBA8, INVALID_ATLAS_HANDLE when no page has room
+		AtlasHandle Insert(uint32_t width, uint32_t height, const uint8_t* pixels);
+		// The handle may be returned by a later Insert, the GPU must no longer sample the region. Drops the upload if it wasn't flushed yet
+		void Evict(AtlasHandle handle);
+		// Uploads everything inserted since the last Flush, waits for the copy to complete
+		void Flush();
+
+		const AtlasRegion& GetRegion(AtlasHandle handle) const { return _entries[handle].region; }
+		CvlTextureArray& GetTexture() { return *_texture; }
+		AtlasStats GetStats() const;
+		void ReportStats() const;
+
+	private:
+		struct Rect
+		{
+			uint32_t x, y, width, height;
+		};
+
+		struct Page
+		{
+			// May overlap each other, never overlap an image, none is contained in another
+			std::vector<Rect> free_rects;
+			uint32_t images = 0;
+			uint64_t image_texels = 0;
+		};
+
+		struct Entry
+		{
+			Rect rect;	// including the gutter
+			uint32_t page;
+			uint64_t texels;
+			AtlasRegion region;
+			bool alive;
+		};
+
+		bool FindPosition(uint32_t width, uint32_t height, uint32_t& page_index, Rect& rect) const;
+		void PlaceRect(Page& page, const Rect& used);
+		void FreeRect(Page& page, Rect freed);
+		void ResetPage(Page& page);
+		void StageTexels(const Rect& rect, uint32_t page_index, uint32_t width, uint32_t height, const uint8_t* pixels);
+
+		CvlDevice& _cvl_device;
+		uint32_t _page_size;
+		uint32_t _gutter;
+		std::unique_ptr<CvlTextureArray> _texture;
+
+		std::vector<Page> _pages;
+		std::vector<Entry> _entries;
+		std::vector<AtlasHandle> _free_handles;
+		std::vector<Rect> _split_scratch;
+
+		std::vector<uint8_t> _pending_texels;
+		std::vector<VkBufferImageCopy> _pending_copies;
+
+		uint32_t _inserts = 0;
+		uint32_t _failed_inserts = 0;
+		uint32_t _evictions = 0;
+		double _insert_us_sum = 0.0;
+		double _insert_us_max = 0.0;
+	};
+}
\ No newline at end of file
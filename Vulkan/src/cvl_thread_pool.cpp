@@ -0,0 +1,133 @@
+#include "cvl_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace cvl
+{
+	CvlThreadPool::CvlThreadPool(uint32_t worker_count)
+	{
+		if (worker_count == 0)
+		{
+			worker_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+		_workers.reserve(worker_count);
+		for (uint32_t i = 0; i < worker_count; ++i)
+		{
+			_workers.emplace_back(&CvlThreadPool::WorkerLoop, this);
+		}
+	}
+
+	CvlThreadPool::~CvlThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+		for (std::thread& worker : _workers)
+		{
+			worker.join();
+		}
+	}
+
+	void CvlThreadPool::ParallelFor(size_t count, size_t min_batch, const std::function<void(size_t, size_t)>& func)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		min_batch = std::max<size_t>(min_batch, 1);
+		// A few batches per thread so uneven batches even out
+		size_t batch_size = std::max(min_batch, (count + GetThreadCount() * 4 - 1) / (GetThreadCount() * 4));
+		size_t batch_count = (count + batch_size - 1) / batch_size;
+		if (batch_count == 1 || _workers.empty())
+		{
+			func(0, count);
+			return;
+		}
+
+		// Shared with the worker tasks, which may only get to run after every batch has already been taken
+		struct Loop
+		{
+			std::atomic<size_t> next_batch = 0;
+			std::atomic<size_t> done_batches = 0;
+			std::mutex mutex;
+			std::condition_variable done;
+		};
+		auto loop = std::make_shared<Loop>();
+		auto run_batches = [loop, &func, count, batch_size, batch_count]()
+		{
+			size_t batch;
+			while ((batch = loop->next_batch.fetch_add(1)) < batch_count)
+			{
+				size_t begin = batch * batch_size;
+				func(begin, std::min(begin + batch_size, count));
+				if (loop->done_batches.fetch_add(1) + 1 == batch_count)
+				{
+					std::lock_guard<std::mutex> lock(loop->mutex);
+					loop->done.notify_one();
+				}
+			}
+		};
+
+		size_t helpers = std::min<size_t>(_workers.size(), batch_count - 1);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			for (size_t i = 0; i < helpers; ++i)
+			{
+				_tasks.push_back(run_batches);
+			}
+		}
+		if (helpers == _workers.size())
+		{
+			_wake.notify_all();
+		}
+		else
+		{
+			for (size_t i = 0; i < helpers; ++i)
+			{
+				_wake.notify_one();
+			}
+		}
+
+		run_batches();
+		std::unique_lock<std::mutex> lock(loop->mutex);
+		loop->done.wait(lock, [&loop, batch_count]() { return loop->done_batches.load() == batch_count; });
+	}
+
+	void CvlThreadPool::Enqueue(std::function<void()> task)
+	{
+		if (_workers.empty())
+		{
+			task();
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_tasks.push_back(std::move(task));
+		}
+		_wake.notify_one();
+	}
+
+	// private
+	void CvlThreadPool::WorkerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wake.wait(lock, [this]() { return _stopping || !_tasks.empty(); });
+				if (_stopping && _tasks.empty())
+				{
+					return;
+				}
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+			task();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cvl
+{
+	/*
+		Fixed set of worker threads for data-parallel loops. The calling thread takes part in
+		every ParallelFor, so a pool with zero workers just runs the loop inline.
+		Enqueue() hands a single background task to the workers and returns right away.
+	*/
+	class CvlThreadPool
+	{
+	public:
+		// 0 uses one worker per hardware thread except the caller's
+		CvlThreadPool(uint32_t worker_count = 0);
+		~CvlThreadPool();
+
+		CvlThreadPool(const CvlThreadPool&) = delete;
+		CvlThreadPool& operator=(const CvlThreadPool&) = delete;
+
+		// Splits [0, count) into batches of at least min_batch and calls func(begin, end) for each, returns once all are done
+		void ParallelFor(size_t count, size_t min_batch, const std::function<void(size_t, size_t)>& func);
+		// Runs task on a worker, inline when there are none. The task has to signal its own completion
+		void Enqueue(std::function<void()> task);
+
+		uint32_t GetWorkerCount() const { return static_cast<uint32_t>(_workers.size()); }
+		// Workers plus the calling thread
+		uint32_t GetThreadCount() const { return GetWorkerCount() + 1; }
+
+	private:
+		void WorkerLoop();
+
+		std::vector<std::thread> _workers;
+		std::mutex _mutex;
+		std::condition_variable _wake;
+		std::deque<std::function<void()>> _tasks;
+		bool _stopping = false;
+	};
+}
\ No newline at end of file
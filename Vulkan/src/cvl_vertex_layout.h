@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace cvl
+{
+	/* Quantized attribute types */
+	struct Snorm16x2
+	{
+		int16_t x, y;
+	};
+
+	struct Snorm16x4
+	{
+		int16_t x, y, z, w;
+	};
+
+	struct Unorm8x4
+	{
+		uint8_t r, g, b, a;
+	};
+
+	struct Unorm16x4
+	{
+		uint16_t x, y, z, w;
+	};
+	/* ~Quantized attribute types */
+
+	// Vertex input format of a C++ attribute type
+	template<typename T> struct VertexFormat;
+	template<> struct VertexFormat<float> { static constexpr VkFormat value = VK_FORMAT_R32_SFLOAT; };
+	template<> struct VertexFormat<glm::vec2> { static constexpr VkFormat value = VK_FORMAT_R32G32_SFLOAT; };
+	template<> struct VertexFormat<glm::vec3> { static constexpr VkFormat value = VK_FORMAT_R32G32B32_SFLOAT; };
+	template<> struct VertexFormat<glm::vec4> { static constexpr VkFormat value = VK_FORMAT_R32G32B32A32_SFLOAT; };
+	template<> struct VertexFormat<uint32_t> { static constexpr VkFormat value = VK_FORMAT_R32_UINT; };
+	template<> struct VertexFormat<Snorm16x2> { static constexpr VkFormat value = VK_FORMAT_R16G16_SNORM; };
+	template<> struct VertexFormat<Snorm16x4> { static constexpr VkFormat value = VK_FORMAT_R16G16B16A16_SNORM; };
+	template<> struct VertexFormat<Unorm8x4> { static constexpr VkFormat value = VK_FORMAT_R8G8B8A8_UNORM; };
+	template<> struct VertexFormat<Unorm16x4> { static constexpr VkFormat value = VK_FORMAT_R16G16B16A16_UNORM; };
+
+	template<typename Field>
+	constexpr VkVertexInputAttributeDescription VertexAttribute(uint32_t location, uint32_t offset, uint32_t binding = 0)
+	{
+		return { location, binding, VertexFormat<Field>::value, offset };
+	}
+
+	template<typename Vertex>
+	constexpr VkVertexInputBindingDescription VertexBinding(uint32_t binding = 0, VkVertexInputRate input_rate = VK_VERTEX_INPUT_RATE_VERTEX)
+	{
+		return { binding, static_cast<uint32_t>(sizeof(Vertex)), input_rate };
+	}
+
+	/*
+		Specialized next to each vertex type with constexpr arrays, e.g.
+			template<> struct VertexLayout<MyVertex>
+			{
+				static constexpr std::array<VkVertexInputBindingDescription, 1> bindings = { VertexBinding<MyVertex>() };
+				static constexpr std::array<VkVertexInputAttributeDescription, 1> attributes =
+				{
+					VertexAttribute<glm::vec3>(0, offsetof(MyVertex, pos))
+				};
+			};
+	*/
+	template<typename Vertex> struct VertexLayout;
+
+	template<typename Vertex>
+	std::vector<VkVertexInputBindingDescription> GetBindingDescriptions()
+	{
+		const auto& bindings = VertexLayout<Vertex>::bindings;
+		return { bindings.begin(), bindings.end() };
+	}
+
+	template<typename Vertex>
+	std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions()
+	{
+		const auto& attributes = VertexLayout<Vertex>::attributes;
+		return { attributes.begin(), attributes.end() };
+	}
+
+	/* Encoders */
+	inline int16_t EncodeSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	inline float DecodeSnorm16(int16_t value)
+	{
+		return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+	}
+
+	inline uint8_t EncodeUnorm8(float value)
+	{
+		return static_cast<uint8_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+	}
+
+	inline Unorm8x4 EncodeColor(const glm::vec4& color)
+	{
+		return { EncodeUnorm8(color.x), EncodeUnorm8(color.y), EncodeUnorm8(color.z), EncodeUnorm8(color.w) };
+	}
+
+	inline uint16_t EncodeUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::round(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+	}
+
+	// Texture coordinate rectangle, xy = min, zw = max
+	inline Unorm16x4 EncodeUvRect(const glm::vec4& uv_rect)
+	{
+		return { EncodeUnorm16(uv_rect.x), EncodeUnorm16(uv_rect.y), EncodeUnorm16(uv_rect.z), EncodeUnorm16(uv_rect.w) };
+	}
+
+	// Positions are stored relative to the mesh bounds, the shader applies center + value * half_extent
+	struct QuantizationBounds
+	{
+		glm::vec3 center = glm::vec3(0.0f);
+		glm::vec3 half_extent = glm::vec3(1.0f);
+	};
+
+	template<typename Iterator, typename GetPosition>
+	QuantizationBounds ComputeQuantizationBounds(Iterator begin, Iterator end, GetPosition get_position)
+	{
+		if (begin == end)
+		{
+			return {};
+		}
+		glm::vec3 min_position = get_position(*begin);
+		glm::vec3 max_position = min_position;
+		for (auto it = begin; it != end; ++it)
+		{
+			min_position = glm::min(min_position, get_position(*it));
+			max_position = glm::max(max_position, get_position(*it));
+		}
+		QuantizationBounds bounds = {};
+		bounds.center = (min_position + max_position) * 0.5f;
+		// Flat axes would divide by zero
+		bounds.half_extent = glm::max((max_position - min_position) * 0.5f, glm::vec3(1e-6f));
+		return bounds;
+	}
+
+	inline Snorm16x4 EncodePosition(const glm::vec3& position, const QuantizationBounds& bounds)
+	{
+		glm::vec3 normalized = (position - bounds.center) / bounds.half_extent;
+		return { EncodeSnorm16(normalized.x), EncodeSnorm16(normalized.y), EncodeSnorm16(normalized.z), 0 };
+	}
+
+	// Octahedral mapping of a unit vector to two components
+	inline Snorm16x2 EncodeOctahedral(const glm::vec3& normal)
+	{
+		glm::vec3 n = normal / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+		float x = n.x;
+		float y = n.y;
+		if (n.z < 0.0f)
+		{
+			x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return { EncodeSnorm16(x), EncodeSnorm16(y) };
+	}
+
+	inline glm::vec3 DecodeOctahedral(const Snorm16x2& encoded)
+	{
+		float x = DecodeSnorm16(encoded.x);
+		float y = DecodeSnorm16(encoded.y);
+		glm::vec3 n(x, y, 1.0f - std::abs(x) - std::abs(y));
+		float t = std::max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return glm::normalize(n);
+	}
+	/* ~Encoders */
+}
\ No newline at end of file
@@ -18,6 +18,7 @@ namespace cvl
 		
 		void Init();
 		void PollEvents() { glfwPollEvents(); }
+		void WaitEvents() { glfwWaitEvents(); }
 		bool ShouldClose() { return glfwWindowShouldClose(_window); }
 		VkExtent2D GetExtent() { return { static_cast<uint32_t>(_width), static_cast<uint32_t>(_height) }; }
 		bool WasWindowResized() { return _framebuffer_resized; }
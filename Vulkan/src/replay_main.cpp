@@ -0,0 +1,37 @@
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "cvl_device.h"
+#include "cvl_frame_capture.h"
+#include "cvl_frame_replay.h"
+#include "cvl_pipeline_cache.h"
+
+// Replays a capture written by CvlFrameCapture: Replay.exe <capture file> [passes]
+// Shader paths in the capture are relative, so run it from the same working directory as the application
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: " << argv[0] << " <capture file> [passes]\n";
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		uint32_t passes = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 100;
+		cvl::FrameCaptureData capture = cvl::CvlFrameCapture::Load(argv[1]);
+		cvl::CvlDevice device;
+		cvl::CvlPipelineCache pipeline_cache(device);
+		cvl::CvlFrameReplay replay(device, pipeline_cache, capture);
+		replay.Run(passes);
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << ex.what() << '\n';
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
\ No newline at end of file
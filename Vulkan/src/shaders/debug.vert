@@ -0,0 +1,18 @@
+#version 450 core
+
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec4 color;
+
+layout (location = 0) out vec4 v_frag_color;
+
+// View projection for world batches, pixel to clip space for screen batches
+layout (push_constant) uniform Push
+{
+	mat4 transform;
+} push;
+
+void main()
+{
+	gl_Position = push.transform * vec4(pos, 1.0);
+	v_frag_color = color;
+}
\ No newline at end of file
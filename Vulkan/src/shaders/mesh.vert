@@ -0,0 +1,18 @@
+#version 450 core
+
+layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 normal;
+
+layout (location = 0) out vec3 v_frag_color;
+
+layout (push_constant) uniform Push
+{
+	mat4 view_proj;
+} push;
+
+void main()
+{
+	gl_Position = push.view_proj * vec4(pos, 1.0);
+	float light = 0.2 + 0.8 * max(dot(normalize(normal), normalize(vec3(0.4, 1.0, 0.3))), 0.0);
+	v_frag_color = vec3(0.85, 0.7, 0.5) * light;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#version 450 core
+
+layout (location = 0) in vec4 v_frag_color;
+
+layout (location = 0) out vec4 o_color;
+
+void main()
+{
+	o_color = v_frag_color;
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 450 core
+
+layout (location = 0) in vec2 pos;
+layout (location = 1) in vec4 color;
+
+layout (location = 0) out vec4 v_frag_color;
+
+void main()
+{
+	gl_Position = vec4(pos, 0.0, 1.0);
+	gl_PointSize = 1.0;
+	v_frag_color = color;
+}
\ No newline at end of file
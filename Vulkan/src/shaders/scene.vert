@@ -0,0 +1,23 @@
+#version 450 core
+
+layout (location = 0) in vec2 pos;
+layout (location = 1) in vec3 color;
+
+layout (location = 0) out vec3 v_frag_color;
+
+layout (constant_id = 0) const bool USE_VERTEX_COLOR = true;
+
+// Matches DrawPushConstants, CvlDrawList only pushes the ranges that changed
+layout (push_constant) uniform Push
+{
+	mat4 transform;
+	vec4 position_dequantization;	// xy = scale, zw = offset
+	vec4 material;					// rgb = tint
+} push;
+
+void main()
+{
+	vec2 position = pos * push.position_dequantization.xy + push.position_dequantization.zw;
+	gl_Position = push.transform * vec4(position, 0.0, 1.0);
+	v_frag_color = USE_VERTEX_COLOR ? color * push.material.rgb : push.material.rgb;
+}
\ No newline at end of file
@@ -5,8 +5,14 @@ layout (location = 1) in vec3 color;
 
 layout (location = 0) out vec3 v_frag_color;
 
+// Positions arrive normalized to the model bounds (snorm16)
+layout (push_constant) uniform Push
+{
+	vec4 position_dequantization;	// xy = scale, zw = offset
+} push;
+
 void main()
 {
-	gl_Position = vec4(pos, 0.0, 1.0);
+	gl_Position = vec4(pos * push.position_dequantization.xy + push.position_dequantization.zw, 0.0, 1.0);
 	v_frag_color = color;
 }
\ No newline at end of file
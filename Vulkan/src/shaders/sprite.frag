@@ -0,0 +1,13 @@
+#version 450 core
+
+layout (location = 0) in vec3 v_uv;
+layout (location = 1) in vec4 v_frag_color;
+
+layout (location = 0) out vec4 o_color;
+
+layout (set = 0, binding = 0) uniform sampler2DArray u_texture;
+
+void main()
+{
+	o_color = texture(u_texture, v_uv) * v_frag_color;
+}
\ No newline at end of file
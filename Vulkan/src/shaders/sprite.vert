@@ -0,0 +1,37 @@
+#version 450 core
+
+// Per instance, see CvlSpriteBatch::Sprite
+layout (location = 0) in vec2 position;
+layout (location = 1) in vec2 size;
+layout (location = 2) in float rotation;
+layout (location = 3) in uint texture_layer;
+layout (location = 4) in vec4 uv_rect;
+layout (location = 5) in vec4 color;
+
+layout (location = 0) out vec3 v_uv;
+layout (location = 1) out vec4 v_frag_color;
+
+// xy = 2 / render area size, zw = -1
+layout (push_constant) uniform Push
+{
+	vec4 pixel_to_clip;
+} push;
+
+// Two triangles of the unit quad, indexed by gl_VertexIndex
+const vec2 CORNERS[6] = vec2[]
+(
+	vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0),
+	vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0)
+);
+
+void main()
+{
+	vec2 corner = CORNERS[gl_VertexIndex];
+	vec2 offset = (corner - 0.5) * size;
+	float c = cos(rotation);
+	float s = sin(rotation);
+	vec2 pixel = position + vec2(c * offset.x - s * offset.y, s * offset.x + c * offset.y);
+	gl_Position = vec4(pixel * push.pixel_to_clip.xy + push.pixel_to_clip.zw, 0.0, 1.0);
+	v_uv = vec3(mix(uv_rect.xy, uv_rect.zw, corner), float(texture_layer));
+	v_frag_color = color;
+}
\ No newline at end of file